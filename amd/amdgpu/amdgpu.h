@@ -88,6 +88,7 @@ extern int amdgpu_vm_fault_stop;
 extern int amdgpu_vm_debug;
 extern int amdgpu_sched_jobs;
 extern int amdgpu_sched_hw_submission;
+extern int amdgpu_sched_policy;
 extern int amdgpu_powerplay;
 extern int amdgpu_powercontainment;
 extern unsigned amdgpu_pcie_gen_cap;
@@ -98,6 +99,7 @@ extern char *amdgpu_disable_cu;
 extern int amdgpu_sclk_deep_sleep_en;
 extern char *amdgpu_virtual_display;
 extern unsigned amdgpu_pp_feature_mask;
+extern int amdgpu_ih_threaded;
 
 #define AMDGPU_WAIT_IDLE_TIMEOUT_IN_MS	        3000
 #define AMDGPU_MAX_USEC_TIMEOUT			100000	/* 100 ms */
@@ -285,6 +287,8 @@ struct amdgpu_ih_funcs {
 	void (*decode_iv)(struct amdgpu_device *adev,
 			  struct amdgpu_iv_entry *entry);
 	void (*set_rptr)(struct amdgpu_device *adev);
+	/* mask/unmask the IH interrupt, the ring keeps running */
+	void (*set_intr)(struct amdgpu_device *adev, bool enable);
 };
 
 /* provided by hw blocks that expose a ring buffer for commands */
@@ -415,6 +419,9 @@ struct amdgpu_bo_list_entry {
 	uint32_t			priority;
 	struct page			**user_pages;
 	int				user_invalidated;
+	/* domain and move generation of the BO when last validated by CS */
+	uint32_t			validated_domain;
+	u64				validated_gen;
 };
 
 struct amdgpu_bo_va_mapping {
@@ -461,6 +468,8 @@ struct amdgpu_bo {
 	void				*metadata;
 	u32				metadata_size;
 	unsigned			prime_shared_count;
+	/* bumped every time TTM moves the BO */
+	u64				move_gen;
 	/* list of all virtual address to which this bo
 	 * is associated to
 	 */
@@ -998,11 +1007,45 @@ void amdgpu_ctx_mgr_fini(struct amdgpu_ctx_mgr *mgr);
  * file private structure
  */
 
+/*
+ * buffer migration throttling
+ */
+
+/* Buffer migrations may take up to 1/16th of the wall time */
+#define AMDGPU_MM_DUTY_SHIFT		4
+/* Maximum migration time a client can accumulate, in wall time */
+#define AMDGPU_MM_WINDOW_US		200000
+/* Clients which didn't submit for that long don't get a share */
+#define AMDGPU_MM_IDLE_US		1000000
+/* Smaller migrations are too noisy to measure the bandwidth */
+#define AMDGPU_MM_MIN_SAMPLE_BYTES	(1 << 20)
+/* Bandwidth assumed until the first measurement, in bytes per us */
+#define AMDGPU_MM_INITIAL_BYTES_PER_US	1024
+
+/* Migration budget of a process, shared by all of its files so that opening
+ * more of them doesn't buy more migration time.
+ */
+struct amdgpu_mm_client {
+	/* on adev->mm_stats.known_clients while a file of the process is
+	 * open, protected by adev->mm_stats.lock like the rest of the
+	 * structure */
+	struct list_head	link;
+	unsigned		refcount;
+	/* on adev->mm_stats.clients while the client submits */
+	struct list_head	node;
+	pid_t			pid;
+	s64			last_update_us;
+	s64			accum_us; /* accumulated migration time */
+	u64			bytes_moved;
+	u64			bytes_deferred;
+};
+
 struct amdgpu_fpriv {
 	struct amdgpu_vm	vm;
 	struct mutex		bo_list_lock;
 	struct idr		bo_list_handles;
 	struct amdgpu_ctx_mgr	ctx_mgr;
+	struct amdgpu_mm_client	*mm_client;
 };
 
 /*
@@ -1025,6 +1068,10 @@ void amdgpu_bo_list_get_list(struct amdgpu_bo_list *list,
 			     struct list_head *validated);
 void amdgpu_bo_list_put(struct amdgpu_bo_list *list);
 void amdgpu_bo_list_free(struct amdgpu_bo_list *list);
+int amdgpu_bo_list_change(struct amdgpu_device *adev, struct drm_file *filp,
+			  struct amdgpu_bo_list *list, u32 operation,
+			  struct drm_amdgpu_bo_list_entry *info,
+			  unsigned num_entries);
 
 /*
  * GFX stuff
@@ -1230,10 +1277,17 @@ struct amdgpu_cs_parser {
 	struct fence			*fence;
 	uint64_t			bytes_moved_threshold;
 	uint64_t			bytes_moved;
+	uint64_t			bytes_deferred;
+	s64				move_start_us;
+	struct fence			*move_fence;
 	struct amdgpu_bo_list_entry	*evictable;
 
 	/* user fence */
 	struct amdgpu_bo_list_entry	uf_entry;
+
+	/* sync objects signaled when the job is submitted */
+	unsigned			num_post_dep_syncobjs;
+	struct drm_syncobj		**post_dep_syncobjs;
 };
 
 #define AMDGPU_PREAMBLE_IB_PRESENT          (1 << 0) /* bit set means command submit involves a preamble IB */
@@ -1752,6 +1806,7 @@ void amdgpu_test_ring_sync(struct amdgpu_device *adev,
 			   struct amdgpu_ring *cpA,
 			   struct amdgpu_ring *cpB);
 void amdgpu_test_syncing(struct amdgpu_device *adev);
+void amdgpu_test_bo_list(struct amdgpu_device *adev);
 
 /*
  * MMU Notifier
@@ -1864,6 +1919,13 @@ int amdgpu_gem_op_ioctl(struct drm_device *dev, void *data,
 			struct drm_file *filp);
 int amdgpu_cs_ioctl(struct drm_device *dev, void *data, struct drm_file *filp);
 int amdgpu_cs_wait_ioctl(struct drm_device *dev, void *data, struct drm_file *filp);
+int amdgpu_cs_wait_fences_ioctl(struct drm_device *dev, void *data,
+				struct drm_file *filp);
+void amdgpu_cs_mm_stats_init(struct amdgpu_device *adev);
+struct amdgpu_mm_client *amdgpu_cs_mm_client_get(struct amdgpu_device *adev);
+void amdgpu_cs_mm_client_put(struct amdgpu_device *adev,
+			     struct amdgpu_mm_client *client);
+int amdgpu_cs_debugfs_init(struct amdgpu_device *adev);
 
 int amdgpu_gem_metadata_ioctl(struct drm_device *dev, void *data,
 				struct drm_file *filp);
@@ -2053,9 +2115,21 @@ struct amdgpu_device {
 	/* data for buffer migration throttling */
 	struct {
 		spinlock_t		lock;
-		s64			last_update_us;
-		s64			accum_us; /* accumulated microseconds */
-		u32			log2_max_MBps;
+		bool			enabled;
+		/* measured move bandwidth and its upper bound */
+		atomic64_t		bytes_per_us;
+		u64			max_bytes_per_us;
+		atomic64_t		num_samples;
+		/* processes with open files, by pid */
+		struct list_head	known_clients;
+		/* clients which recently submitted */
+		struct list_head	clients;
+		unsigned		num_clients;
+		/* statistics */
+		u64			bytes_moved;
+		u64			bytes_deferred;
+		u64			debt_us;
+		u64			throttled_cs;
 	} mm_stats;
 
 	/* display */
@@ -2288,6 +2362,7 @@ amdgpu_get_sdma_instance(struct amdgpu_ring *ring)
 #define amdgpu_ih_get_wptr(adev) (adev)->irq.ih_funcs->get_wptr((adev))
 #define amdgpu_ih_decode_iv(adev, iv) (adev)->irq.ih_funcs->decode_iv((adev), (iv))
 #define amdgpu_ih_set_rptr(adev) (adev)->irq.ih_funcs->set_rptr((adev))
+#define amdgpu_ih_set_intr(adev, e) (adev)->irq.ih_funcs->set_intr((adev), (e))
 #define amdgpu_display_set_vga_render_state(adev, r) (adev)->mode_info.funcs->set_vga_render_state((adev), (r))
 #define amdgpu_display_vblank_get_counter(adev, crtc) (adev)->mode_info.funcs->vblank_get_counter((adev), (crtc))
 #define amdgpu_display_vblank_wait(adev, crtc) (adev)->mode_info.funcs->vblank_wait((adev), (crtc))
@@ -2418,6 +2493,8 @@ bool amdgpu_card_posted(struct amdgpu_device *adev);
 void amdgpu_update_display_priority(struct amdgpu_device *adev);
 
 int amdgpu_cs_parser_init(struct amdgpu_cs_parser *p, void *data);
+int amdgpu_cs_list_validate(struct amdgpu_cs_parser *p,
+			    struct list_head *validated);
 int amdgpu_cs_get_ring(struct amdgpu_device *adev, u32 ip_type,
 		       u32 ip_instance, u32 ring,
 		       struct amdgpu_ring **out_ring);
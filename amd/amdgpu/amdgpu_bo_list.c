@@ -80,6 +80,50 @@ static void amdgpu_bo_list_destroy(struct amdgpu_fpriv *fpriv, int id)
 	mutex_unlock(&fpriv->bo_list_lock);
 }
 
+static int amdgpu_bo_list_lookup(struct drm_file *filp, u32 handle,
+				 struct amdgpu_bo **result)
+{
+	struct drm_gem_object *gobj;
+	struct amdgpu_bo *bo;
+	struct mm_struct *usermm;
+
+	gobj = drm_gem_object_lookup(filp, handle);
+	if (!gobj)
+		return -ENOENT;
+
+	bo = amdgpu_bo_ref(gem_to_amdgpu_bo(gobj));
+	drm_gem_object_unreference_unlocked(gobj);
+
+	usermm = amdgpu_ttm_tt_get_usermm(bo->tbo.ttm);
+	if (usermm && usermm != current->mm) {
+		amdgpu_bo_unref(&bo);
+		return -EPERM;
+	}
+
+	*result = bo;
+	return 0;
+}
+
+static void amdgpu_bo_list_entry_init(struct amdgpu_bo_list *list,
+				      struct amdgpu_bo_list_entry *entry,
+				      struct amdgpu_bo *bo,
+				      uint32_t priority)
+{
+	entry->robj = bo;
+	entry->priority = min(priority, AMDGPU_BO_LIST_MAX_PRIORITY);
+	entry->tv.bo = &entry->robj->tbo;
+	entry->tv.shared = !entry->robj->prime_shared_count;
+
+	if (entry->robj->prefered_domains == AMDGPU_GEM_DOMAIN_GDS)
+		list->gds_obj = entry->robj;
+	if (entry->robj->prefered_domains == AMDGPU_GEM_DOMAIN_GWS)
+		list->gws_obj = entry->robj;
+	if (entry->robj->prefered_domains == AMDGPU_GEM_DOMAIN_OA)
+		list->oa_obj = entry->robj;
+
+	trace_amdgpu_bo_list_set(list, entry->robj);
+}
+
 static int amdgpu_bo_list_set(struct amdgpu_device *adev,
 				     struct drm_file *filp,
 				     struct amdgpu_bo_list *list,
@@ -87,9 +131,9 @@ static int amdgpu_bo_list_set(struct amdgpu_device *adev,
 				     unsigned num_entries)
 {
 	struct amdgpu_bo_list_entry *array;
-	struct amdgpu_bo *gds_obj = adev->gds.gds_gfx_bo;
-	struct amdgpu_bo *gws_obj = adev->gds.gws_gfx_bo;
-	struct amdgpu_bo *oa_obj = adev->gds.oa_gfx_bo;
+	struct amdgpu_bo *gds_obj = list->gds_obj;
+	struct amdgpu_bo *gws_obj = list->gws_obj;
+	struct amdgpu_bo *oa_obj = list->oa_obj;
 
 	unsigned last_entry = 0, first_userptr = num_entries;
 	unsigned i;
@@ -101,48 +145,26 @@ static int amdgpu_bo_list_set(struct amdgpu_device *adev,
 		return -ENOMEM;
 	memset(array, 0, num_entries * sizeof(struct amdgpu_bo_list_entry));
 
+	list->gds_obj = adev->gds.gds_gfx_bo;
+	list->gws_obj = adev->gds.gws_gfx_bo;
+	list->oa_obj = adev->gds.oa_gfx_bo;
+
 	for (i = 0; i < num_entries; ++i) {
 		struct amdgpu_bo_list_entry *entry;
-		struct drm_gem_object *gobj;
 		struct amdgpu_bo *bo;
-		struct mm_struct *usermm;
 
-		gobj = drm_gem_object_lookup(filp, info[i].bo_handle);
-		if (!gobj) {
-			r = -ENOENT;
+		r = amdgpu_bo_list_lookup(filp, info[i].bo_handle, &bo);
+		if (r)
 			goto error_free;
-		}
 
-		bo = amdgpu_bo_ref(gem_to_amdgpu_bo(gobj));
-		drm_gem_object_unreference_unlocked(gobj);
-
-		usermm = amdgpu_ttm_tt_get_usermm(bo->tbo.ttm);
-		if (usermm) {
-			if (usermm != current->mm) {
-				amdgpu_bo_unref(&bo);
-				r = -EPERM;
-				goto error_free;
-			}
+		if (amdgpu_ttm_tt_get_usermm(bo->tbo.ttm))
 			entry = &array[--first_userptr];
-		} else {
+		else
 			entry = &array[last_entry++];
-		}
-
-		entry->robj = bo;
-		entry->priority = min(info[i].bo_priority,
-				      AMDGPU_BO_LIST_MAX_PRIORITY);
-		entry->tv.bo = &entry->robj->tbo;
-		entry->tv.shared = !entry->robj->prime_shared_count;
-
-		if (entry->robj->prefered_domains == AMDGPU_GEM_DOMAIN_GDS)
-			gds_obj = entry->robj;
-		if (entry->robj->prefered_domains == AMDGPU_GEM_DOMAIN_GWS)
-			gws_obj = entry->robj;
-		if (entry->robj->prefered_domains == AMDGPU_GEM_DOMAIN_OA)
-			oa_obj = entry->robj;
 
+		amdgpu_bo_list_entry_init(list, entry, bo,
+					  info[i].bo_priority);
 		total_size += amdgpu_bo_size(entry->robj);
-		trace_amdgpu_bo_list_set(list, entry->robj);
 	}
 
 	for (i = 0; i < list->num_entries; ++i)
@@ -150,9 +172,6 @@ static int amdgpu_bo_list_set(struct amdgpu_device *adev,
 
 	drm_free_large(list->array);
 
-	list->gds_obj = gds_obj;
-	list->gws_obj = gws_obj;
-	list->oa_obj = oa_obj;
 	list->first_userptr = first_userptr;
 	list->array = array;
 	list->num_entries = num_entries;
@@ -161,12 +180,225 @@ static int amdgpu_bo_list_set(struct amdgpu_device *adev,
 	return 0;
 
 error_free:
-	while (i--)
+	for (i = 0; i < last_entry; ++i)
+		amdgpu_bo_unref(&array[i].robj);
+	for (i = first_userptr; i < num_entries; ++i)
 		amdgpu_bo_unref(&array[i].robj);
 	drm_free_large(array);
+	list->gds_obj = gds_obj;
+	list->gws_obj = gws_obj;
+	list->oa_obj = oa_obj;
 	return r;
 }
 
+static struct amdgpu_bo_list_entry *
+amdgpu_bo_list_find(struct amdgpu_bo_list_entry *array, unsigned start,
+		    unsigned end, struct amdgpu_bo *bo)
+{
+	unsigned i;
+
+	for (i = start; i < end; ++i)
+		if (array[i].robj == bo)
+			return &array[i];
+
+	return NULL;
+}
+
+/*
+ * Add handles to an existing list without touching the entries already on
+ * it, so they keep their validation state. Handles which are already on the
+ * list only get their priority updated. Nothing changes on error.
+ */
+static int amdgpu_bo_list_add(struct amdgpu_device *adev,
+			      struct drm_file *filp,
+			      struct amdgpu_bo_list *list,
+			      struct drm_amdgpu_bo_list_entry *info,
+			      unsigned num_entries)
+{
+	unsigned num_userptr = list->num_entries - list->first_userptr;
+	unsigned size = list->num_entries + num_entries;
+	unsigned last_entry, first_userptr, first_added_userptr;
+	struct amdgpu_bo *gds_obj = list->gds_obj;
+	struct amdgpu_bo *gws_obj = list->gws_obj;
+	struct amdgpu_bo *oa_obj = list->oa_obj;
+	struct amdgpu_bo_list_entry *array;
+	unsigned i;
+	int r;
+
+	if (size < list->num_entries)
+		return -EINVAL;
+
+	array = drm_malloc_ab(size, sizeof(struct amdgpu_bo_list_entry));
+	if (!array)
+		return -ENOMEM;
+	memset(array, 0, size * sizeof(struct amdgpu_bo_list_entry));
+
+	/* Keep the userptr BOs at the end, new ones are placed in front of
+	 * them and the hole left by duplicates is closed afterwards.
+	 */
+	last_entry = list->first_userptr;
+	first_userptr = size - num_userptr;
+	first_added_userptr = first_userptr;
+	memcpy(array, list->array, last_entry * sizeof(*array));
+	memcpy(&array[first_userptr], &list->array[list->first_userptr],
+	       num_userptr * sizeof(*array));
+
+	for (i = 0; i < num_entries; ++i) {
+		struct amdgpu_bo_list_entry *entry;
+		struct amdgpu_bo *bo;
+
+		r = amdgpu_bo_list_lookup(filp, info[i].bo_handle, &bo);
+		if (r)
+			goto error_free;
+
+		entry = amdgpu_bo_list_find(array, 0, last_entry, bo);
+		if (!entry)
+			entry = amdgpu_bo_list_find(array, first_userptr,
+						    size, bo);
+		if (entry) {
+			entry->priority = min(info[i].bo_priority,
+					      AMDGPU_BO_LIST_MAX_PRIORITY);
+			amdgpu_bo_unref(&bo);
+			continue;
+		}
+
+		if (amdgpu_ttm_tt_get_usermm(bo->tbo.ttm))
+			entry = &array[--first_userptr];
+		else
+			entry = &array[last_entry++];
+
+		amdgpu_bo_list_entry_init(list, entry, bo,
+					  info[i].bo_priority);
+	}
+
+	if (last_entry != first_userptr)
+		memmove(&array[last_entry], &array[first_userptr],
+			(size - first_userptr) * sizeof(*array));
+
+	drm_free_large(list->array);
+
+	list->first_userptr = last_entry;
+	list->num_entries = last_entry + size - first_userptr;
+	list->array = array;
+	return 0;
+
+error_free:
+	for (i = list->first_userptr; i < last_entry; ++i)
+		amdgpu_bo_unref(&array[i].robj);
+	for (i = first_userptr; i < first_added_userptr; ++i)
+		amdgpu_bo_unref(&array[i].robj);
+	drm_free_large(array);
+	list->gds_obj = gds_obj;
+	list->gws_obj = gws_obj;
+	list->oa_obj = oa_obj;
+	return r;
+}
+
+/*
+ * Drop handles from an existing list, compacting it in place. Handles which
+ * are not on the list are ignored. All handles are resolved before the list
+ * is touched, so nothing changes on error.
+ */
+static int amdgpu_bo_list_remove(struct amdgpu_device *adev,
+				 struct drm_file *filp,
+				 struct amdgpu_bo_list *list,
+				 struct drm_amdgpu_bo_list_entry *info,
+				 unsigned num_entries)
+{
+	struct amdgpu_bo_list_entry *entry;
+	struct drm_gem_object **gobjs;
+	unsigned i, j, first_userptr;
+	int r = 0;
+
+	if (!num_entries)
+		return 0;
+
+	gobjs = drm_malloc_ab(num_entries, sizeof(*gobjs));
+	if (!gobjs)
+		return -ENOMEM;
+
+	for (i = 0; i < num_entries; ++i) {
+		gobjs[i] = drm_gem_object_lookup(filp, info[i].bo_handle);
+		if (!gobjs[i]) {
+			num_entries = i;
+			r = -ENOENT;
+			goto out;
+		}
+	}
+
+	for (i = 0; i < num_entries; ++i) {
+		struct amdgpu_bo *bo = gem_to_amdgpu_bo(gobjs[i]);
+
+		entry = amdgpu_bo_list_find(list->array, 0,
+					    list->num_entries, bo);
+		if (!entry)
+			continue;
+
+		if (list->gds_obj == bo)
+			list->gds_obj = adev->gds.gds_gfx_bo;
+		if (list->gws_obj == bo)
+			list->gws_obj = adev->gds.gws_gfx_bo;
+		if (list->oa_obj == bo)
+			list->oa_obj = adev->gds.oa_gfx_bo;
+		amdgpu_bo_unref(&entry->robj);
+	}
+
+	first_userptr = list->first_userptr;
+	for (i = 0, j = 0; i < list->num_entries; ++i) {
+		entry = &list->array[i];
+		if (!entry->robj) {
+			if (i < list->first_userptr)
+				--first_userptr;
+			continue;
+		}
+		if (i != j)
+			list->array[j] = *entry;
+		++j;
+	}
+
+	list->first_userptr = first_userptr;
+	list->num_entries = j;
+
+out:
+	for (i = 0; i < num_entries; ++i)
+		drm_gem_object_unreference_unlocked(gobjs[i]);
+	drm_free_large(gobjs);
+	return r;
+}
+
+/**
+ * amdgpu_bo_list_change - apply an update operation to a locked list
+ *
+ * @adev: amdgpu device pointer
+ * @filp: drm file the handles belong to
+ * @list: BO list, locked by amdgpu_bo_list_get()
+ * @operation: AMDGPU_BO_LIST_OP_UPDATE, _ADD or _REMOVE
+ * @info: handles and priorities
+ * @num_entries: number of entries in @info
+ *
+ * Returns 0 on success, negative error code on failure in which case the
+ * list is left unchanged.
+ */
+int amdgpu_bo_list_change(struct amdgpu_device *adev, struct drm_file *filp,
+			  struct amdgpu_bo_list *list, u32 operation,
+			  struct drm_amdgpu_bo_list_entry *info,
+			  unsigned num_entries)
+{
+	switch (operation) {
+	case AMDGPU_BO_LIST_OP_UPDATE:
+		return amdgpu_bo_list_set(adev, filp, list, info,
+					  num_entries);
+	case AMDGPU_BO_LIST_OP_ADD:
+		return amdgpu_bo_list_add(adev, filp, list, info,
+					  num_entries);
+	case AMDGPU_BO_LIST_OP_REMOVE:
+		return amdgpu_bo_list_remove(adev, filp, list, info,
+					     num_entries);
+	default:
+		return -EINVAL;
+	}
+}
+
 struct amdgpu_bo_list *
 amdgpu_bo_list_get(struct amdgpu_fpriv *fpriv, int id)
 {
@@ -291,13 +523,15 @@ int amdgpu_bo_list_ioctl(struct drm_device *dev, void *data,
 		break;
 
 	case AMDGPU_BO_LIST_OP_UPDATE:
+	case AMDGPU_BO_LIST_OP_ADD:
+	case AMDGPU_BO_LIST_OP_REMOVE:
 		r = -ENOENT;
 		list = amdgpu_bo_list_get(fpriv, handle);
 		if (!list)
 			goto error_free;
 
-		r = amdgpu_bo_list_set(adev, filp, list, info,
-					      args->in.bo_number);
+		r = amdgpu_bo_list_change(adev, filp, list, args->in.operation,
+					  info, args->in.bo_number);
 		amdgpu_bo_list_put(list);
 		if (r)
 			goto error_free;
@@ -25,8 +25,10 @@
  *    Jerome Glisse <glisse@freedesktop.org>
  */
 #include <linux/pagemap.h>
+#include <linux/fence-array.h>
 #include <drm/drmP.h>
 #include <drm/amdgpu_drm.h>
+#include <drm/drm_syncobj.h>
 #include "amdgpu.h"
 #include "amdgpu_trace.h"
 
@@ -210,6 +212,8 @@ int amdgpu_cs_parser_init(struct amdgpu_cs_parser *p, void *data)
 			break;
 
 		case AMDGPU_CHUNK_ID_DEPENDENCIES:
+		case AMDGPU_CHUNK_ID_SYNCOBJ_IN:
+		case AMDGPU_CHUNK_ID_SYNCOBJ_OUT:
 			break;
 
 		default:
@@ -241,55 +245,140 @@ free_chunk:
 	return ret;
 }
 
-/* Convert microseconds to bytes. */
+/* Convert migration time to bytes at the measured bandwidth. */
 static u64 us_to_bytes(struct amdgpu_device *adev, s64 us)
 {
-	if (us <= 0 || !adev->mm_stats.log2_max_MBps)
+	if (us <= 0)
 		return 0;
 
-	/* Since accum_us is incremented by a million per second, just
-	 * multiply it by the number of MB/s to get the number of bytes.
-	 */
-	return us << adev->mm_stats.log2_max_MBps;
+	return us * atomic64_read(&adev->mm_stats.bytes_per_us);
 }
 
 static s64 bytes_to_us(struct amdgpu_device *adev, u64 bytes)
 {
-	if (!adev->mm_stats.log2_max_MBps)
+	u64 bytes_per_us = atomic64_read(&adev->mm_stats.bytes_per_us);
+
+	if (!bytes_per_us)
 		return 0;
 
-	return bytes >> adev->mm_stats.log2_max_MBps;
+	return div64_u64(bytes, bytes_per_us);
+}
+
+void amdgpu_cs_mm_stats_init(struct amdgpu_device *adev)
+{
+	u64 bytes_per_us = AMDGPU_MM_INITIAL_BYTES_PER_US;
+
+	INIT_LIST_HEAD(&adev->mm_stats.known_clients);
+	INIT_LIST_HEAD(&adev->mm_stats.clients);
+
+	/* amdgpu_moverate caps the average migration rate in MB/s, which
+	 * is one byte per us. Migrations only take a fraction of the time,
+	 * so the bandwidth may be higher than that.
+	 */
+	adev->mm_stats.enabled = amdgpu_moverate < 0 || amdgpu_moverate > 1;
+	if (amdgpu_moverate > 1)
+		adev->mm_stats.max_bytes_per_us =
+			(u64)amdgpu_moverate << AMDGPU_MM_DUTY_SHIFT;
+	else
+		adev->mm_stats.max_bytes_per_us = ~0ULL;
+
+	bytes_per_us = min(bytes_per_us, adev->mm_stats.max_bytes_per_us);
+	atomic64_set(&adev->mm_stats.bytes_per_us, bytes_per_us);
+}
+
+/**
+ * amdgpu_cs_mm_client_get - look up the migration budget of the caller
+ *
+ * @adev: amdgpu device pointer
+ *
+ * Returns a reference to the budget of the calling process, creating it on
+ * first use, or NULL if out of memory.  All files a process opens share it.
+ */
+struct amdgpu_mm_client *amdgpu_cs_mm_client_get(struct amdgpu_device *adev)
+{
+	struct amdgpu_mm_client *client, *new;
+#ifdef __FreeBSD__
+	pid_t pid = curproc->p_pid;
+#else
+	pid_t pid = task_tgid_nr(current);
+#endif
+
+	new = kzalloc(sizeof(*new), GFP_KERNEL);
+	if (!new)
+		return NULL;
+
+	spin_lock(&adev->mm_stats.lock);
+	list_for_each_entry(client, &adev->mm_stats.known_clients, link) {
+		if (client->pid == pid) {
+			client->refcount++;
+			spin_unlock(&adev->mm_stats.lock);
+			kfree(new);
+			return client;
+		}
+	}
+
+	INIT_LIST_HEAD(&new->node);
+	new->pid = pid;
+	new->refcount = 1;
+	list_add_tail(&new->link, &adev->mm_stats.known_clients);
+	spin_unlock(&adev->mm_stats.lock);
+
+	return new;
+}
+
+/**
+ * amdgpu_cs_mm_client_put - drop a reference to a migration budget
+ *
+ * @adev: amdgpu device pointer
+ * @client: budget from amdgpu_cs_mm_client_get()
+ */
+void amdgpu_cs_mm_client_put(struct amdgpu_device *adev,
+			     struct amdgpu_mm_client *client)
+{
+	spin_lock(&adev->mm_stats.lock);
+	if (--client->refcount) {
+		spin_unlock(&adev->mm_stats.lock);
+		return;
+	}
+	if (!list_empty(&client->node)) {
+		list_del(&client->node);
+		adev->mm_stats.num_clients--;
+	}
+	list_del(&client->link);
+	spin_unlock(&adev->mm_stats.lock);
+
+	kfree(client);
 }
 
 /* Returns how many bytes TTM can move right now. If no bytes can be moved,
  * it returns 0. If it returns non-zero, it's OK to move at least one buffer,
- * which means it can go over the threshold once. If that happens, the driver
+ * which means it can go over the threshold once. If that happens, the client
  * will be in debt and no other buffer migrations can be done until that debt
  * is repaid.
  *
  * This approach allows moving a buffer of any size (it's important to allow
  * that).
  *
- * The currency is simply time in microseconds and it increases as the clock
- * ticks. The accumulated microseconds (us) are converted to bytes and
- * returned.
+ * The currency is time spent migrating buffers, in microseconds. Migrations
+ * may take 1 / 2^AMDGPU_MM_DUTY_SHIFT of the wall time, which is shared
+ * evenly between the processes which recently submitted, so that one process
+ * cannot starve the promotions of the others. The accumulated time is
+ * converted to bytes with the measured migration bandwidth.
  */
-static u64 amdgpu_cs_get_threshold_for_moves(struct amdgpu_device *adev)
+static u64 amdgpu_cs_get_threshold_for_moves(struct amdgpu_device *adev,
+					     struct amdgpu_mm_client *client)
 {
+	struct amdgpu_mm_client *c, *tmp;
 	s64 time_us, increment_us;
 	u64 max_bytes;
 	u64 free_vram, total_vram, used_vram;
 
-	/* Allow a maximum of 200 accumulated ms. This is basically per-IB
-	 * throttling.
-	 *
-	 * It means that in order to get full max MBps, at least 5 IBs per
-	 * second must be submitted and not more than 200ms apart from each
-	 * other.
+	/* Allow a maximum of 200 accumulated ms of wall time worth of
+	 * migrations. This is basically per-IB throttling.
 	 */
-	const s64 us_upper_bound = 200000;
+	const s64 us_upper_bound = AMDGPU_MM_WINDOW_US >> AMDGPU_MM_DUTY_SHIFT;
 
-	if (!adev->mm_stats.log2_max_MBps)
+	if (!adev->mm_stats.enabled)
 		return 0;
 
 	total_vram = adev->mc.real_vram_size - adev->vram_pin_size;
@@ -298,15 +387,36 @@ static u64 amdgpu_cs_get_threshold_for_moves(struct amdgpu_device *adev)
 
 	spin_lock(&adev->mm_stats.lock);
 
-	/* Increase the amount of accumulated us. */
 	time_us = ktime_to_us(ktime_get());
-	increment_us = time_us - adev->mm_stats.last_update_us;
-	adev->mm_stats.last_update_us = time_us;
-	adev->mm_stats.accum_us = min(adev->mm_stats.accum_us + increment_us,
-                                      us_upper_bound);
+
+	/* Idle clients don't get a share of the migration time. */
+	list_for_each_entry_safe(c, tmp, &adev->mm_stats.clients, node) {
+		if (c != client &&
+		    time_us - c->last_update_us > AMDGPU_MM_IDLE_US) {
+			list_del_init(&c->node);
+			adev->mm_stats.num_clients--;
+		}
+	}
+	if (list_empty(&client->node)) {
+		list_add_tail(&client->node, &adev->mm_stats.clients);
+		adev->mm_stats.num_clients++;
+		if (!client->last_update_us)
+			client->last_update_us = time_us;
+	}
+
+	/* Increase the amount of accumulated us. */
+	increment_us = time_us - client->last_update_us;
+	client->last_update_us = time_us;
+	if (client->accum_us < 0)
+		adev->mm_stats.debt_us += increment_us;
+
+	increment_us = div_s64(increment_us >> AMDGPU_MM_DUTY_SHIFT,
+			       adev->mm_stats.num_clients);
+	client->accum_us = min(client->accum_us + increment_us,
+			       us_upper_bound);
 
 	/* This prevents the short period of low performance when the VRAM
-	 * usage is low and the driver is in debt or doesn't have enough
+	 * usage is low and the client is in debt or doesn't have enough
 	 * accumulated us to fill VRAM quickly.
 	 *
 	 * The situation can occur in these cases:
@@ -328,34 +438,115 @@ static u64 amdgpu_cs_get_threshold_for_moves(struct amdgpu_device *adev)
 		else
 			min_us = 0; /* Reset accum_us on APUs. */
 
-		adev->mm_stats.accum_us = max(min_us, adev->mm_stats.accum_us);
+		client->accum_us = max(min_us, client->accum_us);
 	}
 
-	/* This returns 0 if the driver is in debt to disallow (optional)
+	/* This returns 0 if the client is in debt to disallow (optional)
 	 * buffer moves.
 	 */
-	max_bytes = us_to_bytes(adev, adev->mm_stats.accum_us);
+	max_bytes = us_to_bytes(adev, client->accum_us);
+	if (!max_bytes)
+		adev->mm_stats.throttled_cs++;
 
 	spin_unlock(&adev->mm_stats.lock);
 	return max_bytes;
 }
 
+/* Feed a measured migration into the bandwidth estimate. */
+static void amdgpu_cs_update_bandwidth(struct amdgpu_device *adev,
+				       u64 num_bytes, s64 elapsed_us)
+{
+	u64 sample, bytes_per_us;
+
+	sample = div64_u64(num_bytes, max_t(s64, elapsed_us, 1));
+	sample = clamp_t(u64, sample, 1, adev->mm_stats.max_bytes_per_us);
+
+	/* Exponentially weighted, a new sample counts for 1/8th. Racing
+	 * updates may lose a sample, which doesn't matter.
+	 */
+	bytes_per_us = atomic64_read(&adev->mm_stats.bytes_per_us);
+	bytes_per_us = div64_u64(bytes_per_us * 7 + sample, 8);
+	atomic64_set(&adev->mm_stats.bytes_per_us, max_t(u64, bytes_per_us, 1));
+	atomic64_inc(&adev->mm_stats.num_samples);
+}
+
+struct amdgpu_cs_move_sample {
+	struct fence_cb		base;
+	struct amdgpu_device	*adev;
+	u64			num_bytes;
+	s64			start_us;
+};
+
+static void amdgpu_cs_move_sample_cb(struct fence *fence, struct fence_cb *cb)
+{
+	struct amdgpu_cs_move_sample *sample =
+		container_of(cb, struct amdgpu_cs_move_sample, base);
+
+	amdgpu_cs_update_bandwidth(sample->adev, sample->num_bytes,
+				   ktime_to_us(ktime_get()) - sample->start_us);
+	kfree(sample);
+}
+
 /* Report how many bytes have really been moved for the last command
  * submission. This can result in a debt that can stop buffer migrations
- * temporarily.
+ * temporarily. The time the moves really took is measured once the last
+ * of them finished and corrects the bandwidth used for later submissions.
  */
-static void amdgpu_cs_report_moved_bytes(struct amdgpu_device *adev,
-					 u64 num_bytes)
+static void amdgpu_cs_report_moved_bytes(struct amdgpu_cs_parser *p)
 {
+	struct amdgpu_device *adev = p->adev;
+	struct amdgpu_fpriv *fpriv = p->filp->driver_priv;
+	struct amdgpu_mm_client *client = fpriv->mm_client;
+	struct amdgpu_cs_move_sample *sample;
+
 	spin_lock(&adev->mm_stats.lock);
-	adev->mm_stats.accum_us -= bytes_to_us(adev, num_bytes);
+	client->accum_us -= bytes_to_us(adev, p->bytes_moved);
+	client->bytes_moved += p->bytes_moved;
+	client->bytes_deferred += p->bytes_deferred;
+	adev->mm_stats.bytes_moved += p->bytes_moved;
+	adev->mm_stats.bytes_deferred += p->bytes_deferred;
 	spin_unlock(&adev->mm_stats.lock);
+
+	if (p->bytes_moved < AMDGPU_MM_MIN_SAMPLE_BYTES)
+		return;
+
+	/* Moves done by the CPU are finished already */
+	if (!p->move_fence) {
+		amdgpu_cs_update_bandwidth(adev, p->bytes_moved,
+					   ktime_to_us(ktime_get()) -
+					   p->move_start_us);
+		return;
+	}
+
+	sample = kmalloc(sizeof(*sample), GFP_KERNEL);
+	if (!sample)
+		return;
+
+	sample->adev = adev;
+	sample->num_bytes = p->bytes_moved;
+	sample->start_us = p->move_start_us;
+	if (fence_add_callback(p->move_fence, &sample->base,
+			       amdgpu_cs_move_sample_cb))
+		amdgpu_cs_move_sample_cb(p->move_fence, &sample->base);
+}
+
+static void amdgpu_cs_account_deferred(struct amdgpu_cs_parser *p,
+				       struct amdgpu_bo *bo, uint32_t domain)
+{
+	uint32_t current_domain;
+
+	if (domain == bo->prefered_domains)
+		return;
+
+	current_domain = amdgpu_mem_type_to_domain(bo->tbo.mem.mem_type);
+	if (!(current_domain & bo->prefered_domains))
+		p->bytes_deferred += amdgpu_bo_size(bo);
 }
 
 static int amdgpu_cs_bo_validate(struct amdgpu_cs_parser *p,
 				 struct amdgpu_bo *bo)
 {
-	u64 initial_bytes_moved;
+	u64 initial_bytes_moved, bytes_moved;
 	uint32_t domain;
 	int r;
 
@@ -374,17 +565,51 @@ retry:
 	amdgpu_ttm_placement_from_domain(bo, domain);
 	initial_bytes_moved = atomic64_read(&bo->adev->num_bytes_moved);
 	r = ttm_bo_validate(&bo->tbo, &bo->placement, true, false);
-	p->bytes_moved += atomic64_read(&bo->adev->num_bytes_moved) -
+	bytes_moved = atomic64_read(&bo->adev->num_bytes_moved) -
 		initial_bytes_moved;
+	p->bytes_moved += bytes_moved;
+
+	/* Remember the last move so that its duration can be measured */
+	if (bytes_moved && bo->tbo.moving) {
+		fence_put(p->move_fence);
+		p->move_fence = fence_get(bo->tbo.moving);
+	}
 
 	if (unlikely(r == -ENOMEM) && domain != bo->allowed_domains) {
 		domain = bo->allowed_domains;
 		goto retry;
 	}
 
+	if (!r)
+		amdgpu_cs_account_deferred(p, bo, domain);
+
 	return r;
 }
 
+static bool amdgpu_cs_bo_still_valid(struct amdgpu_cs_parser *p,
+				     struct amdgpu_bo_list_entry *lobj)
+{
+	struct amdgpu_bo *bo = lobj->robj;
+	uint32_t domain;
+
+	if (!lobj->validated_domain || lobj->validated_gen != bo->move_gen)
+		return false;
+
+	if (bo->shadow)
+		return false;
+
+	if (p->bytes_moved < p->bytes_moved_threshold)
+		domain = bo->prefered_domains;
+	else
+		domain = bo->allowed_domains;
+
+	if (!(lobj->validated_domain & domain))
+		return false;
+
+	amdgpu_cs_account_deferred(p, bo, domain);
+	return true;
+}
+
 /* Last resort, try to evict something from the current working set */
 static bool amdgpu_cs_try_evict(struct amdgpu_cs_parser *p,
 				struct amdgpu_bo_list_entry *lobj)
@@ -437,7 +662,7 @@ static bool amdgpu_cs_try_evict(struct amdgpu_cs_parser *p,
 	return false;
 }
 
-static int amdgpu_cs_list_validate(struct amdgpu_cs_parser *p,
+int amdgpu_cs_list_validate(struct amdgpu_cs_parser *p,
 			    struct list_head *validated)
 {
 	struct amdgpu_bo_list_entry *lobj;
@@ -464,6 +689,12 @@ static int amdgpu_cs_list_validate(struct amdgpu_cs_parser *p,
 		if (p->evictable == lobj)
 			p->evictable = NULL;
 
+		/* Nothing to do if TTM didn't touch the BO since we last
+		 * validated it and it still sits in an acceptable domain.
+		 */
+		if (!binding_userptr && amdgpu_cs_bo_still_valid(p, lobj))
+			continue;
+
 		do {
 			r = amdgpu_cs_bo_validate(p, bo);
 		} while (r == -ENOMEM && amdgpu_cs_try_evict(p, lobj));
@@ -480,6 +711,10 @@ static int amdgpu_cs_list_validate(struct amdgpu_cs_parser *p,
 			drm_free_large(lobj->user_pages);
 			lobj->user_pages = NULL;
 		}
+
+		lobj->validated_domain =
+			amdgpu_mem_type_to_domain(bo->tbo.mem.mem_type);
+		lobj->validated_gen = bo->move_gen;
 	}
 	return 0;
 }
@@ -596,8 +831,11 @@ static int amdgpu_cs_parser_bos(struct amdgpu_cs_parser *p,
 
 	amdgpu_vm_get_pt_bos(p->adev, &fpriv->vm, &duplicates);
 
-	p->bytes_moved_threshold = amdgpu_cs_get_threshold_for_moves(p->adev);
+	p->bytes_moved_threshold =
+		amdgpu_cs_get_threshold_for_moves(p->adev, fpriv->mm_client);
 	p->bytes_moved = 0;
+	p->bytes_deferred = 0;
+	p->move_start_us = ktime_to_us(ktime_get());
 	p->evictable = list_last_entry(&p->validated,
 				       struct amdgpu_bo_list_entry,
 				       tv.head);
@@ -614,7 +852,7 @@ static int amdgpu_cs_parser_bos(struct amdgpu_cs_parser *p,
 		goto error_validate;
 	}
 
-	amdgpu_cs_report_moved_bytes(p->adev, p->bytes_moved);
+	amdgpu_cs_report_moved_bytes(p);
 
 	fpriv->vm.last_eviction_counter =
 		atomic64_read(&p->adev->num_evictions);
@@ -721,6 +959,7 @@ static void amdgpu_cs_parser_fini(struct amdgpu_cs_parser *parser, int error, bo
 					   &parser->validated);
 	}
 	fence_put(parser->fence);
+	fence_put(parser->move_fence);
 
 	if (parser->ctx)
 		amdgpu_ctx_put(parser->ctx);
@@ -733,6 +972,10 @@ static void amdgpu_cs_parser_fini(struct amdgpu_cs_parser *parser, int error, bo
 	if (parser->job)
 		amdgpu_job_free(parser->job);
 	amdgpu_bo_unref(&parser->uf_entry.robj);
+
+	for (i = 0; i < parser->num_post_dep_syncobjs; i++)
+		drm_syncobj_put(parser->post_dep_syncobjs[i]);
+	kfree(parser->post_dep_syncobjs);
 }
 
 static int amdgpu_bo_vm_update_pte(struct amdgpu_cs_parser *p,
@@ -934,62 +1177,149 @@ static int amdgpu_cs_ib_fill(struct amdgpu_device *adev,
 	return 0;
 }
 
-static int amdgpu_cs_dependencies(struct amdgpu_device *adev,
-				  struct amdgpu_cs_parser *p)
+static int amdgpu_cs_process_fence_dep(struct amdgpu_cs_parser *p,
+				       struct amdgpu_cs_chunk *chunk)
 {
 	struct amdgpu_fpriv *fpriv = p->filp->driver_priv;
-	int i, j, r;
+	struct drm_amdgpu_cs_chunk_dep *deps;
+	unsigned num_deps;
+	int i, r;
 
-	for (i = 0; i < p->nchunks; ++i) {
-		struct drm_amdgpu_cs_chunk_dep *deps;
-		struct amdgpu_cs_chunk *chunk;
-		unsigned num_deps;
+	deps = (struct drm_amdgpu_cs_chunk_dep *)chunk->kdata;
+	num_deps = chunk->length_dw * 4 /
+		sizeof(struct drm_amdgpu_cs_chunk_dep);
 
-		chunk = &p->chunks[i];
+	for (i = 0; i < num_deps; ++i) {
+		struct amdgpu_ring *ring;
+		struct amdgpu_ctx *ctx;
+		struct fence *fence;
 
-		if (chunk->chunk_id != AMDGPU_CHUNK_ID_DEPENDENCIES)
-			continue;
+		r = amdgpu_cs_get_ring(p->adev, deps[i].ip_type,
+				       deps[i].ip_instance,
+				       deps[i].ring, &ring);
+		if (r)
+			return r;
 
-		deps = (struct drm_amdgpu_cs_chunk_dep *)chunk->kdata;
-		num_deps = chunk->length_dw * 4 /
-			sizeof(struct drm_amdgpu_cs_chunk_dep);
+		ctx = amdgpu_ctx_get(fpriv, deps[i].ctx_id);
+		if (ctx == NULL)
+			return -EINVAL;
 
-		for (j = 0; j < num_deps; ++j) {
-			struct amdgpu_ring *ring;
-			struct amdgpu_ctx *ctx;
-			struct fence *fence;
+		fence = amdgpu_ctx_get_fence(ctx, ring,
+					     deps[i].handle);
+		if (IS_ERR(fence)) {
+			r = PTR_ERR(fence);
+			amdgpu_ctx_put(ctx);
+			return r;
 
-			r = amdgpu_cs_get_ring(adev, deps[j].ip_type,
-					       deps[j].ip_instance,
-					       deps[j].ring, &ring);
+		} else if (fence) {
+			r = amdgpu_sync_fence(p->adev, &p->job->sync,
+					      fence);
+			fence_put(fence);
+			amdgpu_ctx_put(ctx);
 			if (r)
 				return r;
+		}
+	}
+	return 0;
+}
 
-			ctx = amdgpu_ctx_get(fpriv, deps[j].ctx_id);
-			if (ctx == NULL)
-				return -EINVAL;
+static int amdgpu_cs_process_syncobj_in_dep(struct amdgpu_cs_parser *p,
+					    struct amdgpu_cs_chunk *chunk)
+{
+	struct drm_amdgpu_cs_chunk_sem *deps;
+	unsigned num_deps;
+	int i, r;
 
-			fence = amdgpu_ctx_get_fence(ctx, ring,
-						     deps[j].handle);
-			if (IS_ERR(fence)) {
-				r = PTR_ERR(fence);
-				amdgpu_ctx_put(ctx);
-				return r;
+	deps = (struct drm_amdgpu_cs_chunk_sem *)chunk->kdata;
+	num_deps = chunk->length_dw * 4 /
+		sizeof(struct drm_amdgpu_cs_chunk_sem);
 
-			} else if (fence) {
-				r = amdgpu_sync_fence(adev, &p->job->sync,
-						      fence);
-				fence_put(fence);
-				amdgpu_ctx_put(ctx);
-				if (r)
-					return r;
-			}
+	for (i = 0; i < num_deps; ++i) {
+		struct fence *fence;
+
+		r = drm_syncobj_find_fence(p->filp, deps[i].handle, &fence);
+		if (r)
+			return r;
+
+		r = amdgpu_sync_fence(p->adev, &p->job->sync, fence);
+		fence_put(fence);
+		if (r)
+			return r;
+	}
+	return 0;
+}
+
+static int amdgpu_cs_process_syncobj_out_dep(struct amdgpu_cs_parser *p,
+					     struct amdgpu_cs_chunk *chunk)
+{
+	struct drm_amdgpu_cs_chunk_sem *deps;
+	struct drm_syncobj **syncobjs;
+	unsigned num_deps;
+	int i;
+
+	deps = (struct drm_amdgpu_cs_chunk_sem *)chunk->kdata;
+	num_deps = chunk->length_dw * 4 /
+		sizeof(struct drm_amdgpu_cs_chunk_sem);
+	if (num_deps == 0)
+		return 0;
+
+	syncobjs = krealloc(p->post_dep_syncobjs,
+			    sizeof(struct drm_syncobj *) *
+			    (p->num_post_dep_syncobjs + num_deps),
+			    GFP_KERNEL);
+	if (!syncobjs)
+		return -ENOMEM;
+	p->post_dep_syncobjs = syncobjs;
+
+	for (i = 0; i < num_deps; ++i) {
+		syncobjs[p->num_post_dep_syncobjs] =
+			drm_syncobj_find(p->filp, deps[i].handle);
+		if (!syncobjs[p->num_post_dep_syncobjs])
+			return -EINVAL;
+		p->num_post_dep_syncobjs++;
+	}
+	return 0;
+}
+
+static int amdgpu_cs_dependencies(struct amdgpu_device *adev,
+				  struct amdgpu_cs_parser *p)
+{
+	int i, r;
+
+	for (i = 0; i < p->nchunks; ++i) {
+		struct amdgpu_cs_chunk *chunk;
+
+		chunk = &p->chunks[i];
+
+		switch (chunk->chunk_id) {
+		case AMDGPU_CHUNK_ID_DEPENDENCIES:
+			r = amdgpu_cs_process_fence_dep(p, chunk);
+			break;
+		case AMDGPU_CHUNK_ID_SYNCOBJ_IN:
+			r = amdgpu_cs_process_syncobj_in_dep(p, chunk);
+			break;
+		case AMDGPU_CHUNK_ID_SYNCOBJ_OUT:
+			r = amdgpu_cs_process_syncobj_out_dep(p, chunk);
+			break;
+		default:
+			r = 0;
+			break;
 		}
+		if (r)
+			return r;
 	}
 
 	return 0;
 }
 
+static void amdgpu_cs_post_dependencies(struct amdgpu_cs_parser *p)
+{
+	int i;
+
+	for (i = 0; i < p->num_post_dep_syncobjs; ++i)
+		drm_syncobj_replace_fence(p->post_dep_syncobjs[i], p->fence);
+}
+
 static int amdgpu_cs_submit(struct amdgpu_cs_parser *p,
 			    union drm_amdgpu_cs *cs)
 {
@@ -1014,6 +1344,8 @@ static int amdgpu_cs_submit(struct amdgpu_cs_parser *p,
 	job->uf_sequence = cs->out.handle;
 	amdgpu_job_free_resources(job);
 
+	amdgpu_cs_post_dependencies(p);
+
 	trace_amdgpu_cs_ioctl(job);
 	amd_sched_entity_push_job(&job->base);
 
@@ -1123,6 +1455,224 @@ int amdgpu_cs_wait_ioctl(struct drm_device *dev, void *data,
 	return 0;
 }
 
+/**
+ * amdgpu_cs_get_fence - look up the fence of a command submission
+ *
+ * @adev: amdgpu device
+ * @filp: file private
+ * @user: submission handle from userspace
+ *
+ * Returns a reference to the fence, NULL if the submission already
+ * retired or an ERR_PTR on invalid handles.
+ */
+static struct fence *amdgpu_cs_get_fence(struct amdgpu_device *adev,
+					 struct drm_file *filp,
+					 struct drm_amdgpu_fence *user)
+{
+	struct amdgpu_ring *ring;
+	struct amdgpu_ctx *ctx;
+	struct fence *fence;
+	int r;
+
+	r = amdgpu_cs_get_ring(adev, user->ip_type, user->ip_instance,
+			       user->ring, &ring);
+	if (r)
+		return ERR_PTR(r);
+
+	ctx = amdgpu_ctx_get(filp->driver_priv, user->ctx_id);
+	if (ctx == NULL)
+		return ERR_PTR(-EINVAL);
+
+	fence = amdgpu_ctx_get_fence(ctx, ring, user->seq_no);
+	amdgpu_ctx_put(ctx);
+
+	return fence;
+}
+
+/**
+ * amdgpu_cs_wait_all_fences - wait on all fences to signal
+ *
+ * @adev: amdgpu device
+ * @filp: file private
+ * @wait: wait parameters
+ * @fences: array of drm_amdgpu_fence
+ *
+ * Collects the still pending fences into a fence_array so the caller
+ * sleeps once and is woken up only when the last of them signals.
+ */
+static int amdgpu_cs_wait_all_fences(struct amdgpu_device *adev,
+				     struct drm_file *filp,
+				     union drm_amdgpu_wait_fences *wait,
+				     struct drm_amdgpu_fence *fences)
+{
+	uint32_t fence_count = wait->in.fence_count;
+	unsigned long timeout = amdgpu_gem_timeout(wait->in.timeout_ns);
+	struct fence_array *array;
+	struct fence **array_fences;
+	unsigned int i, count = 0;
+	long r = 1;
+
+	array_fences = kcalloc(fence_count, sizeof(struct fence *), GFP_KERNEL);
+	if (array_fences == NULL)
+		return -ENOMEM;
+
+	for (i = 0; i < fence_count; i++) {
+		struct fence *fence;
+
+		fence = amdgpu_cs_get_fence(adev, filp, &fences[i]);
+		if (IS_ERR(fence)) {
+			r = PTR_ERR(fence);
+			goto err_put_fences;
+		}
+		if (fence == NULL)
+			continue;
+		if (fence_is_signaled(fence)) {
+			fence_put(fence);
+			continue;
+		}
+		array_fences[count++] = fence;
+	}
+
+	if (count == 1) {
+		r = fence_wait_timeout(array_fences[0], true, timeout);
+		fence_put(array_fences[0]);
+		kfree(array_fences);
+	} else if (count) {
+		/* the array takes over the fence references */
+		array = fence_array_create(count, array_fences,
+					   fence_context_alloc(1), 1, false);
+		if (array == NULL) {
+			r = -ENOMEM;
+			goto err_put_fences;
+		}
+		r = fence_wait_timeout(&array->base, true, timeout);
+		fence_put(&array->base);
+	} else {
+		kfree(array_fences);
+	}
+	if (r < 0)
+		return r;
+
+	memset(wait, 0, sizeof(*wait));
+	wait->out.status = (r > 0);
+
+	return 0;
+
+err_put_fences:
+	for (i = 0; i < count; i++)
+		fence_put(array_fences[i]);
+	kfree(array_fences);
+	return r;
+}
+
+/**
+ * amdgpu_cs_wait_any_fence - wait on any fence to signal
+ *
+ * @adev: amdgpu device
+ * @filp: file private
+ * @wait: wait parameters
+ * @fences: array of drm_amdgpu_fence
+ *
+ * Returns the index of the first signaled fence in first_signaled.
+ */
+static int amdgpu_cs_wait_any_fence(struct amdgpu_device *adev,
+				    struct drm_file *filp,
+				    union drm_amdgpu_wait_fences *wait,
+				    struct drm_amdgpu_fence *fences)
+{
+	unsigned long timeout = amdgpu_gem_timeout(wait->in.timeout_ns);
+	uint32_t fence_count = wait->in.fence_count;
+	uint32_t first = ~0;
+	struct fence **array;
+	unsigned int i;
+	long r;
+
+	/* Prepare the fence array */
+	array = kcalloc(fence_count, sizeof(struct fence *), GFP_KERNEL);
+	if (array == NULL)
+		return -ENOMEM;
+
+	for (i = 0; i < fence_count; i++) {
+		struct fence *fence;
+
+		fence = amdgpu_cs_get_fence(adev, filp, &fences[i]);
+		if (IS_ERR(fence)) {
+			r = PTR_ERR(fence);
+			goto err_free_fence_array;
+		} else if (fence) {
+			array[i] = fence;
+		} else { /* NULL, the fence has been already signaled */
+			r = 1;
+			first = i;
+			goto out;
+		}
+	}
+
+	r = fence_wait_any_timeout(array, fence_count, true, timeout, &first);
+	if (r < 0)
+		goto err_free_fence_array;
+
+out:
+	memset(wait, 0, sizeof(*wait));
+	wait->out.status = (r > 0);
+	wait->out.first_signaled = first;
+	r = 0;
+
+err_free_fence_array:
+	for (i = 0; i < fence_count; i++)
+		fence_put(array[i]);
+	kfree(array);
+
+	return r;
+}
+
+/**
+ * amdgpu_cs_wait_fences_ioctl - wait for multiple command submissions to finish
+ *
+ * @dev: drm device
+ * @data: data from userspace
+ * @filp: file private
+ *
+ * Wait for all or any of the command submissions identified by the
+ * handles in the fences array, which may span contexts and rings.
+ */
+int amdgpu_cs_wait_fences_ioctl(struct drm_device *dev, void *data,
+				struct drm_file *filp)
+{
+	struct amdgpu_device *adev = dev->dev_private;
+	union drm_amdgpu_wait_fences *wait = data;
+	uint32_t fence_count = wait->in.fence_count;
+	struct drm_amdgpu_fence __user *fences_user;
+	struct drm_amdgpu_fence *fences;
+	int r;
+
+	if (fence_count == 0)
+		return -EINVAL;
+
+	/* Get the fences from userspace */
+	fences = kmalloc_array(fence_count, sizeof(struct drm_amdgpu_fence),
+			       GFP_KERNEL);
+	if (fences == NULL)
+		return -ENOMEM;
+
+	fences_user = (void __user *)(unsigned long)(wait->in.fences);
+	if (copy_from_user(fences, fences_user,
+			   sizeof(struct drm_amdgpu_fence) * fence_count)) {
+		r = -EFAULT;
+		goto err_free_fences;
+	}
+
+	if (wait->in.wait_all)
+		r = amdgpu_cs_wait_all_fences(adev, filp, wait, fences);
+	else
+		r = amdgpu_cs_wait_any_fence(adev, filp, wait, fences);
+
+err_free_fences:
+	kfree(fences);
+
+	return r;
+}
+
 /**
  * amdgpu_cs_find_bo_va - find bo_va for VM address
  *
@@ -1200,3 +1750,51 @@ int amdgpu_cs_sysvm_access_required(struct amdgpu_cs_parser *parser)
 
 	return 0;
 }
+
+#if defined(CONFIG_DEBUG_FS)
+static int amdgpu_debugfs_mm_stats(struct seq_file *m, void *data)
+{
+	struct drm_info_node *node = (struct drm_info_node *)m->private;
+	struct drm_device *dev = node->minor->dev;
+	struct amdgpu_device *adev = dev->dev_private;
+	struct amdgpu_mm_client *client;
+
+	seq_printf(m, "enabled: %s\n",
+		   adev->mm_stats.enabled ? "yes" : "no");
+	seq_printf(m, "bandwidth: %llu bytes/us (%llu samples)\n",
+		   (unsigned long long)atomic64_read(&adev->mm_stats.bytes_per_us),
+		   (unsigned long long)atomic64_read(&adev->mm_stats.num_samples));
+
+	spin_lock(&adev->mm_stats.lock);
+	seq_printf(m, "bytes moved: %llu\n",
+		   (unsigned long long)adev->mm_stats.bytes_moved);
+	seq_printf(m, "bytes deferred: %llu\n",
+		   (unsigned long long)adev->mm_stats.bytes_deferred);
+	seq_printf(m, "time in debt: %llu us\n",
+		   (unsigned long long)adev->mm_stats.debt_us);
+	seq_printf(m, "throttled submissions: %llu\n",
+		   (unsigned long long)adev->mm_stats.throttled_cs);
+	seq_printf(m, "active clients: %u\n", adev->mm_stats.num_clients);
+	list_for_each_entry(client, &adev->mm_stats.clients, node)
+		seq_printf(m, "  pid %8d: %lld us, %llu bytes moved, "
+			   "%llu bytes deferred\n", client->pid,
+			   (long long)client->accum_us,
+			   (unsigned long long)client->bytes_moved,
+			   (unsigned long long)client->bytes_deferred);
+	spin_unlock(&adev->mm_stats.lock);
+
+	return 0;
+}
+
+static const struct drm_info_list amdgpu_debugfs_cs_list[] = {
+	{"amdgpu_mm_stats", &amdgpu_debugfs_mm_stats, 0, NULL},
+};
+#endif
+
+int amdgpu_cs_debugfs_init(struct amdgpu_device *adev)
+{
+#if defined(CONFIG_DEBUG_FS)
+	return amdgpu_debugfs_add_files(adev, amdgpu_debugfs_cs_list, 1);
+#endif
+	return 0;
+}
@@ -25,7 +25,17 @@
 #include <drm/drmP.h>
 #include "amdgpu.h"
 
-static int amdgpu_ctx_init(struct amdgpu_device *adev, struct amdgpu_ctx *ctx)
+static void amdgpu_ctx_set_weight(struct amdgpu_ctx *ctx, unsigned weight)
+{
+	struct amdgpu_device *adev = ctx->adev;
+	unsigned i;
+
+	for (i = 0; i < adev->num_rings; i++)
+		amd_sched_entity_set_weight(&ctx->rings[i].entity, weight);
+}
+
+static int amdgpu_ctx_init(struct amdgpu_device *adev, struct amdgpu_ctx *ctx,
+			   unsigned weight)
 {
 	unsigned i, j;
 	int r;
@@ -66,6 +76,9 @@ static int amdgpu_ctx_init(struct amdgpu_device *adev, struct amdgpu_ctx *ctx)
 		ctx->fences = NULL;
 		return r;
 	}
+
+	if (weight != AMD_SCHED_WEIGHT_DEFAULT)
+		amdgpu_ctx_set_weight(ctx, weight);
 	return 0;
 }
 
@@ -88,9 +101,24 @@ static void amdgpu_ctx_fini(struct amdgpu_ctx *ctx)
 				      &ctx->rings[i].entity);
 }
 
+static int amdgpu_ctx_check_weight(uint32_t *weight)
+{
+	if (*weight == 0)
+		*weight = AMD_SCHED_WEIGHT_DEFAULT;
+
+	if (*weight > AMD_SCHED_WEIGHT_MAX)
+		return -EINVAL;
+
+	/* Getting more than the default share is a privileged operation */
+	if (*weight > AMD_SCHED_WEIGHT_DEFAULT && !capable(CAP_SYS_ADMIN))
+		return -EACCES;
+
+	return 0;
+}
+
 static int amdgpu_ctx_alloc(struct amdgpu_device *adev,
 			    struct amdgpu_fpriv *fpriv,
-			    uint32_t *id)
+			    uint32_t weight, uint32_t *id)
 {
 	struct amdgpu_ctx_mgr *mgr = &fpriv->ctx_mgr;
 	struct amdgpu_ctx *ctx;
@@ -108,7 +136,7 @@ static int amdgpu_ctx_alloc(struct amdgpu_device *adev,
 		return r;
 	}
 	*id = (uint32_t)r;
-	r = amdgpu_ctx_init(adev, ctx);
+	r = amdgpu_ctx_init(adev, ctx, weight);
 	if (r) {
 		idr_remove(&mgr->ctx_handles, *id);
 		*id = 0;
@@ -182,11 +210,29 @@ static int amdgpu_ctx_query(struct amdgpu_device *adev,
 	return 0;
 }
 
+static int amdgpu_ctx_weight(struct amdgpu_fpriv *fpriv, uint32_t id,
+			     uint32_t weight)
+{
+	struct amdgpu_ctx_mgr *mgr = &fpriv->ctx_mgr;
+	struct amdgpu_ctx *ctx;
+
+	mutex_lock(&mgr->lock);
+	ctx = idr_find(&mgr->ctx_handles, id);
+	if (!ctx) {
+		mutex_unlock(&mgr->lock);
+		return -EINVAL;
+	}
+
+	amdgpu_ctx_set_weight(ctx, weight);
+	mutex_unlock(&mgr->lock);
+	return 0;
+}
+
 int amdgpu_ctx_ioctl(struct drm_device *dev, void *data,
 		     struct drm_file *filp)
 {
 	int r;
-	uint32_t id;
+	uint32_t id, weight;
 
 	union drm_amdgpu_ctx *args = data;
 	struct amdgpu_device *adev = dev->dev_private;
@@ -197,7 +243,11 @@ int amdgpu_ctx_ioctl(struct drm_device *dev, void *data,
 
 	switch (args->in.op) {
 	case AMDGPU_CTX_OP_ALLOC_CTX:
-		r = amdgpu_ctx_alloc(adev, fpriv, &id);
+		weight = args->in.weight;
+		r = amdgpu_ctx_check_weight(&weight);
+		if (r)
+			return r;
+		r = amdgpu_ctx_alloc(adev, fpriv, weight, &id);
 		args->out.alloc.ctx_id = id;
 		break;
 	case AMDGPU_CTX_OP_FREE_CTX:
@@ -206,6 +256,13 @@ int amdgpu_ctx_ioctl(struct drm_device *dev, void *data,
 	case AMDGPU_CTX_OP_QUERY_STATE:
 		r = amdgpu_ctx_query(adev, fpriv, id, &args->out);
 		break;
+	case AMDGPU_CTX_OP_SET_WEIGHT:
+		weight = args->in.weight;
+		r = amdgpu_ctx_check_weight(&weight);
+		if (r)
+			return r;
+		r = amdgpu_ctx_weight(fpriv, id, weight);
+		break;
 	default:
 		return -EINVAL;
 	}
@@ -984,6 +984,13 @@ static void amdgpu_check_arguments(struct amdgpu_device *adev)
 		amdgpu_sched_jobs = roundup_pow_of_two(amdgpu_sched_jobs);
 	}
 
+	if (amdgpu_sched_policy < 0 ||
+	    amdgpu_sched_policy >= AMD_SCHED_MAX_POLICY) {
+		dev_warn(adev->dev, "invalid sched policy (%d)\n",
+			 amdgpu_sched_policy);
+		amdgpu_sched_policy = AMD_SCHED_POLICY_RR;
+	}
+
 	if (amdgpu_gart_size != -1) {
 		/* gtt size must be greater or equal to 32M */
 		if (amdgpu_gart_size < 32) {
@@ -1431,6 +1438,8 @@ static int amdgpu_fini(struct amdgpu_device *adev)
 {
 	int i, r;
 
+	amdgpu_ih_deferred_flush(adev);
+
 	/* need to disable SMC first */
 	for (i = 0; i < adev->num_ip_blocks; i++) {
 		if (!adev->ip_block_status[i].hw)
@@ -1504,6 +1513,8 @@ int amdgpu_suspend(struct amdgpu_device *adev)
 {
 	int i, r;
 
+	amdgpu_ih_deferred_flush(adev);
+
 	/* ungate SMC block first */
 	r = amdgpu_set_clockgating_state(adev, AMD_IP_BLOCK_TYPE_SMC,
 					 AMD_CG_STATE_UNGATE);
@@ -1575,7 +1586,6 @@ int amdgpu_device_init(struct amdgpu_device *adev,
 {
 	int r, i;
 	bool runtime = false;
-	u32 max_MBps;
 
 	adev->shutdown = false;
 	adev->dev = &pdev->dev;
@@ -1777,13 +1787,8 @@ int amdgpu_device_init(struct amdgpu_device *adev,
 
 	adev->accel_working = true;
 
-	/* Initialize the buffer migration limit. */
-	if (amdgpu_moverate >= 0)
-		max_MBps = amdgpu_moverate;
-	else
-		max_MBps = 8; /* Allow 8 MB/s. */
-	/* Get a log2 for easy divisions. */
-	adev->mm_stats.log2_max_MBps = ilog2(max(1u, max_MBps));
+	/* Initialize the buffer migration throttling. */
+	amdgpu_cs_mm_stats_init(adev);
 
 	amdgpu_fbdev_init(adev);
 
@@ -1819,6 +1824,16 @@ int amdgpu_device_init(struct amdgpu_device *adev,
 		DRM_ERROR("registering gem debugfs failed (%d).\n", r);
 	}
 
+	r = amdgpu_cs_debugfs_init(adev);
+	if (r) {
+		DRM_ERROR("registering cs debugfs failed (%d).\n", r);
+	}
+
+	r = amdgpu_irq_debugfs_init(adev);
+	if (r) {
+		DRM_ERROR("registering irq debugfs failed (%d).\n", r);
+	}
+
 	r = amdgpu_debugfs_regs_init(adev);
 	if (r) {
 		DRM_ERROR("registering register debugfs failed (%d).\n", r);
@@ -1842,6 +1857,12 @@ int amdgpu_device_init(struct amdgpu_device *adev,
 		else
 			DRM_INFO("amdgpu: acceleration disabled, skipping sync tests\n");
 	}
+	if ((amdgpu_testing & 4)) {
+		if (adev->accel_working)
+			amdgpu_test_bo_list(adev);
+		else
+			DRM_INFO("amdgpu: acceleration disabled, skipping BO list tests\n");
+	}
 	if (amdgpu_benchmarking) {
 		if (adev->accel_working)
 			amdgpu_benchmark(adev, amdgpu_benchmarking);
@@ -2306,6 +2327,7 @@ int amdgpu_gpu_reset(struct amdgpu_device *adev)
 	need_full_reset = amdgpu_need_full_reset(adev);
 
 	if (!need_full_reset) {
+		amdgpu_ih_deferred_flush(adev);
 		amdgpu_pre_soft_reset(adev);
 		r = amdgpu_soft_reset(adev);
 		amdgpu_post_soft_reset(adev);
@@ -394,8 +394,8 @@ int amdgpu_fence_driver_init_ring(struct amdgpu_ring *ring,
 		timeout = MAX_SCHEDULE_TIMEOUT;
 	}
 	r = amd_sched_init(&ring->sched, &amdgpu_sched_ops,
-			   num_hw_submission,
-			   timeout, ring->name);
+			   num_hw_submission, timeout,
+			   amdgpu_sched_policy, ring->name);
 	if (r) {
 		DRM_ERROR("Failed to create scheduler on ring %s.\n",
 			  ring->name);
@@ -138,17 +138,94 @@ void amdgpu_ih_ring_fini(struct amdgpu_device *adev)
 	}
 }
 
+/**
+ * amdgpu_ih_deferred_init - set up deferred IH processing
+ *
+ * @adev: amdgpu_device pointer
+ *
+ * Allocates the buffer the interrupt handler copies IV entries
+ * into when the IH ring is processed from a work item.
+ * Returns 0 for success, errors for failure.
+ */
+int amdgpu_ih_deferred_init(struct amdgpu_device *adev)
+{
+	struct amdgpu_ih_ring *ih = &adev->irq.ih;
+
+	if (ih->deferred)
+		return 0;
+
+	/* the hw ring can't hold more than this anyway */
+	ih->num_deferred = ih->ring_size / (AMDGPU_IH_ENTRY_DW * 4);
+	ih->deferred = kcalloc(ih->num_deferred, sizeof(*ih->deferred),
+			       GFP_KERNEL);
+	if (!ih->deferred)
+		return -ENOMEM;
+
+	ih->deferred_rptr = 0;
+	ih->deferred_wptr = 0;
+	ih->deferred_overflow = false;
+	return 0;
+}
+
+/**
+ * amdgpu_ih_deferred_fini - tear down deferred IH processing
+ *
+ * @adev: amdgpu_device pointer
+ */
+void amdgpu_ih_deferred_fini(struct amdgpu_device *adev)
+{
+	kfree(adev->irq.ih.deferred);
+	adev->irq.ih.deferred = NULL;
+}
+
+static bool amdgpu_ih_deferred_full(struct amdgpu_ih_ring *ih)
+{
+	return ih->deferred_wptr - READ_ONCE(ih->deferred_rptr) >=
+		ih->num_deferred;
+}
+
+/**
+ * amdgpu_ih_defer - copy an IV entry for the IH work
+ *
+ * @adev: amdgpu_device pointer
+ * @ring_index: dword index of the entry in the IH ring
+ *
+ * Decodes the entry at the current rptr into the deferred buffer,
+ * so the hw ring slot can be released right away.  The caller
+ * makes sure there is room left.
+ */
+static void amdgpu_ih_defer(struct amdgpu_device *adev, u32 ring_index)
+{
+	struct amdgpu_ih_ring *ih = &adev->irq.ih;
+	struct amdgpu_ih_deferred *d;
+	unsigned i;
+
+	d = &ih->deferred[ih->deferred_wptr & (ih->num_deferred - 1)];
+	for (i = 0; i < AMDGPU_IH_ENTRY_DW; i++)
+		d->dw[i] = ih->ring[ring_index + i];
+	d->entry.iv_entry = d->dw;
+	amdgpu_ih_decode_iv(adev, &d->entry);
+
+	/* Make the entry visible before the new wptr */
+	smp_wmb();
+	WRITE_ONCE(ih->deferred_wptr, ih->deferred_wptr + 1);
+}
+
 /**
  * amdgpu_ih_process - interrupt handler
  *
  * @adev: amdgpu_device pointer
  *
  * Interrupt hander (VI), walk the IH ring.
+ * With deferred processing enabled entries are only copied out of
+ * the ring here and dispatched later by amdgpu_ih_process_deferred().
  * Returns irq process return code.
  */
 int amdgpu_ih_process(struct amdgpu_device *adev)
 {
 	struct amdgpu_iv_entry entry;
+	bool deferred = adev->irq.ih.deferred != NULL;
+	bool full = false;
 	u32 wptr;
 
 	if (!adev->irq.ih.enabled || adev->shutdown)
@@ -169,10 +246,25 @@ restart_ih:
 	while (adev->irq.ih.rptr != wptr) {
 		u32 ring_index = adev->irq.ih.rptr >> 2;
 
+		if (deferred && amdgpu_ih_deferred_full(&adev->irq.ih)) {
+			/* leave the rest in the ring until the work has
+			 * caught up, with the interrupt masked so a level
+			 * triggered line doesn't keep firing meanwhile */
+			amdgpu_ih_set_intr(adev, false);
+			full = true;
+			break;
+		}
+
 		/* Before dispatching irq to IP blocks, send it to amdkfd */
 		amdgpu_amdkfd_interrupt(adev,
 				(const void *) &adev->irq.ih.ring[ring_index]);
 
+		if (deferred) {
+			amdgpu_ih_defer(adev, ring_index);
+			adev->irq.ih.rptr &= adev->irq.ih.ptr_mask;
+			continue;
+		}
+
 		entry.iv_entry = (const uint32_t *)
 			&adev->irq.ih.ring[ring_index];
 		amdgpu_ih_decode_iv(adev, &entry);
@@ -183,6 +275,14 @@ restart_ih:
 	amdgpu_ih_set_rptr(adev);
 	atomic_set(&adev->irq.ih.lock, 0);
 
+	if (deferred) {
+		if (full)
+			WRITE_ONCE(adev->irq.ih.deferred_overflow, true);
+		schedule_work(&adev->irq.ih_work);
+		if (full)
+			return IRQ_HANDLED;
+	}
+
 	/* make sure wptr hasn't changed while processing */
 	wptr = amdgpu_ih_get_wptr(adev);
 	if (wptr != adev->irq.ih.rptr)
@@ -190,3 +290,102 @@ restart_ih:
 
 	return IRQ_HANDLED;
 }
+
+/**
+ * amdgpu_ih_process_deferred - dispatch deferred IV entries
+ *
+ * @adev: amdgpu_device pointer
+ *
+ * Called from the IH work item.  Hands the entries copied by
+ * amdgpu_ih_process() to the IP blocks in batches of up to
+ * AMDGPU_IH_BATCH_SIZE, see amdgpu_irq_dispatch_batch().
+ */
+void amdgpu_ih_process_deferred(struct amdgpu_device *adev)
+{
+	struct amdgpu_ih_ring *ih = &adev->irq.ih;
+	struct amdgpu_iv_entry *batch[AMDGPU_IH_BATCH_SIZE];
+	unsigned rptr, wptr, n;
+
+	rptr = ih->deferred_rptr;
+	for (;;) {
+		wptr = READ_ONCE(ih->deferred_wptr);
+		if (rptr == wptr)
+			break;
+
+		/* Order reading of wptr vs. reading of the entries */
+		smp_rmb();
+
+		if (!ih->enabled || adev->shutdown) {
+			/* IH got disabled, nobody is interested anymore */
+			rptr = wptr;
+			WRITE_ONCE(ih->deferred_rptr, rptr);
+			break;
+		}
+
+		for (n = 0; rptr != wptr && n < AMDGPU_IH_BATCH_SIZE; ++n)
+			batch[n] = &ih->deferred[rptr++ &
+						 (ih->num_deferred - 1)].entry;
+
+		amdgpu_irq_dispatch_batch(adev, batch, n);
+
+		/* Done with the entries before handing the slots back */
+		smp_mb();
+		WRITE_ONCE(ih->deferred_rptr, rptr);
+	}
+
+	/* the irq handler left entries in the hw ring and masked the
+	 * interrupt.  Fetch them while it is still masked, a level
+	 * triggered line would otherwise keep firing and find the ring
+	 * busy until we are done, and only then let the IH fire again */
+	if (READ_ONCE(ih->deferred_overflow)) {
+		WRITE_ONCE(ih->deferred_overflow, false);
+		amdgpu_ih_process(adev);
+
+		/* filled up again, still masked and the work is requeued */
+		if (READ_ONCE(ih->deferred_overflow) || !ih->enabled)
+			return;
+
+		amdgpu_ih_set_intr(adev, true);
+
+		/* entries written before the unmask don't raise an interrupt
+		 * with MSI, pick them up here */
+		if (amdgpu_ih_get_wptr(adev) != ih->rptr)
+			amdgpu_ih_process(adev);
+	}
+}
+
+/**
+ * amdgpu_ih_deferred_flush - dispatch pending deferred IV entries
+ *
+ * @adev: amdgpu_device pointer
+ *
+ * Waits for the IH work, so entries fetched before the IP blocks
+ * are suspended, reset or torn down don't reach them afterwards.
+ */
+void amdgpu_ih_deferred_flush(struct amdgpu_device *adev)
+{
+	if (adev->irq.ih.deferred)
+		flush_work(&adev->irq.ih_work);
+}
+
+/**
+ * amdgpu_ih_deferred_reset - drop deferred IV entries
+ *
+ * @adev: amdgpu_device pointer
+ *
+ * Called by the IH blocks from hw_fini, after the IH got disabled.
+ * Stops the IH work and forgets whatever it hasn't dispatched yet,
+ * the hw ring starts over from zero on the next hw_init.
+ */
+void amdgpu_ih_deferred_reset(struct amdgpu_device *adev)
+{
+	struct amdgpu_ih_ring *ih = &adev->irq.ih;
+
+	if (!ih->deferred)
+		return;
+
+	cancel_work_sync(&adev->irq.ih_work);
+	ih->deferred_rptr = 0;
+	ih->deferred_wptr = 0;
+	ih->deferred_overflow = false;
+}
@@ -26,6 +26,11 @@
 
 struct amdgpu_device;
 
+/* IV entries are 16 bytes on all supported asics */
+#define AMDGPU_IH_ENTRY_DW	4
+/* max number of deferred entries dispatched as one batch */
+#define AMDGPU_IH_BATCH_SIZE	32
+
 /*
  * R6xx+ IH ring
  */
@@ -44,6 +49,17 @@ struct amdgpu_ih_ring {
 	bool			use_doorbell;
 	bool			use_bus_addr;
 	dma_addr_t		rb_dma_addr; /* only used when use_bus_addr = true */
+
+	/* entries copied out of the ring by the irq handler when the IH is
+	 * processed from a work item (amdgpu_ih_threaded), see
+	 * amdgpu_ih_process_deferred().  deferred_rptr/wptr are free
+	 * running, num_deferred is a power of two.
+	 */
+	struct amdgpu_ih_deferred *deferred;
+	unsigned		num_deferred;
+	unsigned		deferred_rptr;
+	unsigned		deferred_wptr;
+	bool			deferred_overflow;
 };
 
 struct amdgpu_iv_entry {
@@ -55,9 +71,20 @@ struct amdgpu_iv_entry {
 	const uint32_t *iv_entry;
 };
 
+struct amdgpu_ih_deferred {
+	struct amdgpu_iv_entry	entry;
+	/* copy of the raw entry, entry.iv_entry points here */
+	uint32_t		dw[AMDGPU_IH_ENTRY_DW];
+};
+
 int amdgpu_ih_ring_init(struct amdgpu_device *adev, unsigned ring_size,
 			bool use_bus_addr);
 void amdgpu_ih_ring_fini(struct amdgpu_device *adev);
 int amdgpu_ih_process(struct amdgpu_device *adev);
+int amdgpu_ih_deferred_init(struct amdgpu_device *adev);
+void amdgpu_ih_deferred_fini(struct amdgpu_device *adev);
+void amdgpu_ih_process_deferred(struct amdgpu_device *adev);
+void amdgpu_ih_deferred_flush(struct amdgpu_device *adev);
+void amdgpu_ih_deferred_reset(struct amdgpu_device *adev);
 
 #endif
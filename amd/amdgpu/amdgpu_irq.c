@@ -164,6 +164,22 @@ void amdgpu_irq_uninstall(struct drm_device *dev)
 	amdgpu_irq_disable_all(adev);
 }
 
+/**
+ * amdgpu_irq_ih_work_func - deferred IH work handler
+ *
+ * @work: work struct
+ *
+ * Dispatches the IV entries the irq handler copied out of the
+ * IH ring when amdgpu_ih_threaded is set.
+ */
+static void amdgpu_irq_ih_work_func(struct work_struct *work)
+{
+	struct amdgpu_device *adev = container_of(work, struct amdgpu_device,
+						  irq.ih_work);
+
+	amdgpu_ih_process_deferred(adev);
+}
+
 /**
  * amdgpu_irq_handler - irq handler
  *
@@ -217,8 +233,22 @@ int amdgpu_irq_init(struct amdgpu_device *adev)
 	int r = 0;
 
 	spin_lock_init(&adev->irq.lock);
+	mutex_init(&adev->irq.stats_lock);
+	adev->irq.stats_last = ktime_get();
+
+	if (amdgpu_ih_threaded) {
+		r = amdgpu_ih_deferred_init(adev);
+		if (r) {
+			mutex_destroy(&adev->irq.stats_lock);
+			return r;
+		}
+		DRM_INFO("amdgpu: using deferred IH processing.\n");
+	}
+
 	r = drm_vblank_init(adev->ddev, adev->mode_info.num_crtc);
 	if (r) {
+		amdgpu_ih_deferred_fini(adev);
+		mutex_destroy(&adev->irq.stats_lock);
 		return r;
 	}
 
@@ -237,6 +267,7 @@ int amdgpu_irq_init(struct amdgpu_device *adev)
 
 	INIT_WORK(&adev->hotplug_work, amdgpu_hotplug_work_func);
 	INIT_WORK(&adev->reset_work, amdgpu_irq_reset_work_func);
+	INIT_WORK(&adev->irq.ih_work, amdgpu_irq_ih_work_func);
 
 	adev->irq.installed = true;
 	r = drm_irq_install(adev->ddev, adev->ddev->pdev->irq);
@@ -244,6 +275,8 @@ int amdgpu_irq_init(struct amdgpu_device *adev)
 		adev->irq.installed = false;
 		flush_work(&adev->hotplug_work);
 		cancel_work_sync(&adev->reset_work);
+		cancel_work_sync(&adev->irq.ih_work);
+		amdgpu_ih_deferred_fini(adev);
 		return r;
 	}
 
@@ -270,9 +303,11 @@ void amdgpu_irq_fini(struct amdgpu_device *adev)
 		if (adev->irq.msi_enabled)
 			pci_disable_msi(adev->pdev);
 #endif
+		cancel_work_sync(&adev->irq.ih_work);
 		flush_work(&adev->hotplug_work);
 		cancel_work_sync(&adev->reset_work);
 	}
+	amdgpu_ih_deferred_fini(adev);
 
 	for (i = 0; i < AMDGPU_MAX_IRQ_SRC_ID; ++i) {
 		struct amdgpu_irq_src *src = adev->irq.sources[i];
@@ -288,6 +323,7 @@ void amdgpu_irq_fini(struct amdgpu_device *adev)
 			adev->irq.sources[i] = NULL;
 		}
 	}
+	mutex_destroy(&adev->irq.stats_lock);
 }
 
 /**
@@ -346,6 +382,8 @@ void amdgpu_irq_dispatch(struct amdgpu_device *adev,
 		return;
 	}
 
+	adev->irq.src_count[src_id]++;
+
 	if (adev->irq.virq[src_id]) {
 		generic_handle_irq(irq_find_mapping(adev->irq.domain, src_id));
 	} else {
@@ -361,6 +399,93 @@ void amdgpu_irq_dispatch(struct amdgpu_device *adev,
 	}
 }
 
+/**
+ * amdgpu_irq_coalescable - check if an irq source only signals fences
+ *
+ * @adev: amdgpu device pointer
+ * @src_id: source id to check
+ *
+ * The end of pipe/trap interrupts of the engines just make the driver
+ * look at the fence memory of the ring, so several identical entries
+ * in one batch can be handled by a single call.
+ */
+static bool amdgpu_irq_coalescable(struct amdgpu_device *adev,
+				   unsigned src_id)
+{
+	struct amdgpu_irq_src *src = adev->irq.sources[src_id];
+
+	if (!src || adev->irq.virq[src_id])
+		return false;
+
+	return src == &adev->gfx.eop_irq ||
+#ifdef CONFIG_DRM_AMDGPU_SI
+		src == &adev->sdma.trap_irq_1 ||
+#endif
+		src == &adev->sdma.trap_irq ||
+		src == &adev->uvd.irq ||
+		src == &adev->vce.irq;
+}
+
+static bool amdgpu_irq_same_iv(struct amdgpu_iv_entry *a,
+			       struct amdgpu_iv_entry *b)
+{
+	return a->src_id == b->src_id && a->src_data == b->src_data &&
+		a->ring_id == b->ring_id && a->vm_id == b->vm_id;
+}
+
+/**
+ * amdgpu_irq_dispatch_batch - dispatch a batch of irqs to IP blocks
+ *
+ * @adev: amdgpu device pointer
+ * @entries: interrupt vectors, in the order they were received
+ * @num_entries: number of interrupt vectors
+ *
+ * Dispatches the entries grouped by source, in the order each source
+ * first shows up in the batch; the order of the entries of one source
+ * is kept.  Repeated fence interrupts for the same ring are only
+ * dispatched once, see amdgpu_irq_coalescable().
+ */
+void amdgpu_irq_dispatch_batch(struct amdgpu_device *adev,
+			       struct amdgpu_iv_entry **entries,
+			       unsigned num_entries)
+{
+	uint32_t done = 0;
+	unsigned i, j, k, src_id;
+	bool coalesce;
+
+	BUILD_BUG_ON(AMDGPU_IH_BATCH_SIZE > 32);
+	adev->irq.num_batches++;
+
+	for (i = 0; i < num_entries; ++i) {
+		if (done & (1u << i))
+			continue;
+
+		src_id = entries[i]->src_id;
+		coalesce = src_id < AMDGPU_MAX_IRQ_SRC_ID &&
+			amdgpu_irq_coalescable(adev, src_id);
+
+		for (j = i; j < num_entries; ++j) {
+			if ((done & (1u << j)) || entries[j]->src_id != src_id)
+				continue;
+			done |= 1u << j;
+
+			if (coalesce) {
+				for (k = i; k < j; ++k)
+					if (amdgpu_irq_same_iv(entries[k],
+							       entries[j]))
+						break;
+				if (k < j) {
+					adev->irq.src_count[src_id]++;
+					adev->irq.src_coalesced[src_id]++;
+					continue;
+				}
+			}
+
+			amdgpu_irq_dispatch(adev, entries[j]);
+		}
+	}
+}
+
 /**
  * amdgpu_irq_update - update hw interrupt state
  *
@@ -575,3 +700,62 @@ unsigned amdgpu_irq_create_mapping(struct amdgpu_device *adev, unsigned src_id)
 
 	return adev->irq.virq[src_id];
 }
+
+/*
+ * Debugfs info
+ */
+#if defined(CONFIG_DEBUG_FS)
+
+static int amdgpu_debugfs_ih_stats(struct seq_file *m, void *data)
+{
+	struct drm_info_node *node = (struct drm_info_node *)m->private;
+	struct drm_device *dev = node->minor->dev;
+	struct amdgpu_device *adev = dev->dev_private;
+	ktime_t now;
+	s64 elapsed_us;
+	unsigned i;
+
+	/* readers share the snapshot of the last read */
+	mutex_lock(&adev->irq.stats_lock);
+	now = ktime_get();
+	elapsed_us = ktime_to_us(ktime_sub(now, adev->irq.stats_last));
+	elapsed_us = max_t(s64, elapsed_us, 1);
+	adev->irq.stats_last = now;
+
+	seq_printf(m, "mode: %s\n",
+		   adev->irq.ih.deferred ? "deferred" : "inline");
+	seq_printf(m, "batches: %llu\n",
+		   (unsigned long long)adev->irq.num_batches);
+	seq_printf(m, "src_id      count  coalesced     rate/s\n");
+	for (i = 0; i < AMDGPU_MAX_IRQ_SRC_ID; ++i) {
+		u64 count = READ_ONCE(adev->irq.src_count[i]);
+		u64 delta = count - adev->irq.src_last_count[i];
+
+		adev->irq.src_last_count[i] = count;
+		if (!count)
+			continue;
+
+		seq_printf(m, "%6u %10llu %10llu %10llu\n", i,
+			   (unsigned long long)count,
+			   (unsigned long long)
+			   READ_ONCE(adev->irq.src_coalesced[i]),
+			   (unsigned long long)
+			   div64_u64(delta * USEC_PER_SEC, elapsed_us));
+	}
+	mutex_unlock(&adev->irq.stats_lock);
+
+	return 0;
+}
+
+static const struct drm_info_list amdgpu_debugfs_irq_list[] = {
+	{"amdgpu_ih_stats", &amdgpu_debugfs_ih_stats, 0, NULL},
+};
+#endif
+
+int amdgpu_irq_debugfs_init(struct amdgpu_device *adev)
+{
+#if defined(CONFIG_DEBUG_FS)
+	return amdgpu_debugfs_add_files(adev, amdgpu_debugfs_irq_list, 1);
+#endif
+	return 0;
+}
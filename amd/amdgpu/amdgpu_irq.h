@@ -71,6 +71,18 @@ struct amdgpu_irq {
 	struct irq_domain		*domain; /* GPU irq controller domain */
 	unsigned			virq[AMDGPU_MAX_IRQ_SRC_ID];
 	uint32_t                        srbm_soft_reset;
+
+	/* deferred IH processing */
+	struct work_struct		ih_work;
+
+	/* per source statistics, only updated by whoever walks the IH */
+	uint64_t			src_count[AMDGPU_MAX_IRQ_SRC_ID];
+	uint64_t			src_coalesced[AMDGPU_MAX_IRQ_SRC_ID];
+	uint64_t			num_batches;
+	/* snapshot of the last debugfs read, for the rates */
+	struct mutex			stats_lock;
+	uint64_t			src_last_count[AMDGPU_MAX_IRQ_SRC_ID];
+	ktime_t				stats_last;
 };
 
 void amdgpu_irq_preinstall(struct drm_device *dev);
@@ -84,6 +96,9 @@ int amdgpu_irq_add_id(struct amdgpu_device *adev, unsigned src_id,
 		      struct amdgpu_irq_src *source);
 void amdgpu_irq_dispatch(struct amdgpu_device *adev,
 			 struct amdgpu_iv_entry *entry);
+void amdgpu_irq_dispatch_batch(struct amdgpu_device *adev,
+			       struct amdgpu_iv_entry **entries,
+			       unsigned num_entries);
 int amdgpu_irq_update(struct amdgpu_device *adev, struct amdgpu_irq_src *src,
 		      unsigned type);
 int amdgpu_irq_get(struct amdgpu_device *adev, struct amdgpu_irq_src *src,
@@ -101,4 +116,6 @@ int amdgpu_irq_add_domain(struct amdgpu_device *adev);
 void amdgpu_irq_remove_domain(struct amdgpu_device *adev);
 unsigned amdgpu_irq_create_mapping(struct amdgpu_device *adev, unsigned src_id);
 
+int amdgpu_irq_debugfs_init(struct amdgpu_device *adev);
+
 #endif
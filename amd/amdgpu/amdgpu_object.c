@@ -866,6 +866,7 @@ void amdgpu_bo_move_notify(struct ttm_buffer_object *bo,
 
 	abo = container_of(bo, struct amdgpu_bo, tbo);
 	amdgpu_vm_bo_invalidate(abo->adev, abo);
+	abo->move_gen++;
 
 	/* update statistics */
 	if (!new_mem)
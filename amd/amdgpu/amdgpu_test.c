@@ -316,3 +316,287 @@ void amdgpu_test_syncing(struct amdgpu_device *adev)
 		}
 	}
 }
+
+#define AMDGPU_TEST_BO_LIST_SIZE 4
+
+/* Check that the BO list entries are intact and can be reserved and
+ * validated the way a command submission does it.
+ */
+static int amdgpu_test_bo_list_submit(struct amdgpu_device *adev,
+				      struct drm_file *file,
+				      struct amdgpu_bo_list *list)
+{
+	struct amdgpu_bo_list_entry *e;
+	struct amdgpu_cs_parser p;
+	unsigned i;
+	int r;
+
+	for (i = 0; i < list->num_entries; ++i) {
+		e = &list->array[i];
+		if (!e->robj || e->tv.bo != &e->robj->tbo) {
+			DRM_ERROR("BO list entry %u is stale\n", i);
+			return -EINVAL;
+		}
+	}
+
+	memset(&p, 0, sizeof(p));
+	p.adev = adev;
+	p.filp = file;
+	p.bytes_moved_threshold = ~0ull;
+	INIT_LIST_HEAD(&p.validated);
+	amdgpu_bo_list_get_list(list, &p.validated);
+	r = ttm_eu_reserve_buffers(&p.ticket, &p.validated, true, NULL);
+	if (r) {
+		DRM_ERROR("Failed to reserve BO list (%d)\n", r);
+		return r;
+	}
+
+	r = amdgpu_cs_list_validate(&p, &p.validated);
+	if (r)
+		DRM_ERROR("Failed to validate BO list (%d)\n", r);
+
+	ttm_eu_backoff_reservation(&p.ticket, &p.validated);
+	fence_put(p.move_fence);
+	return r;
+}
+
+/* Adding a handle which is already on the list must only change its
+ * priority, the entries and their validation state stay as they are.
+ */
+static int amdgpu_test_bo_list_add_dup(struct amdgpu_device *adev,
+				       struct drm_file *file,
+				       struct amdgpu_bo_list *list,
+				       struct drm_amdgpu_bo_list_entry *info)
+{
+	struct amdgpu_bo_list_entry old[AMDGPU_TEST_BO_LIST_SIZE];
+	struct drm_amdgpu_bo_list_entry dup;
+	unsigned i, num_entries = list->num_entries;
+	struct drm_gem_object *gobj;
+	struct amdgpu_bo *bo;
+	int r;
+
+	gobj = drm_gem_object_lookup(file, info->bo_handle);
+	if (!gobj)
+		return -ENOENT;
+	bo = gem_to_amdgpu_bo(gobj);
+
+	memcpy(old, list->array, num_entries * sizeof(*old));
+	dup.bo_handle = info->bo_handle;
+	dup.bo_priority = info->bo_priority + 1;
+	r = amdgpu_bo_list_change(adev, file, list, AMDGPU_BO_LIST_OP_ADD,
+				  &dup, 1);
+	if (r) {
+		DRM_ERROR("Adding a listed BO failed (%d)\n", r);
+		goto out;
+	}
+
+	r = -EINVAL;
+	if (list->num_entries != num_entries) {
+		DRM_ERROR("Adding a listed BO changed the list size\n");
+		goto out;
+	}
+	for (i = 0; i < num_entries; ++i) {
+		struct amdgpu_bo_list_entry *e = &list->array[i];
+		uint32_t priority = old[i].priority;
+
+		if (e->robj == bo)
+			priority = dup.bo_priority;
+
+		if (e->robj != old[i].robj || e->priority != priority ||
+		    e->validated_domain != old[i].validated_domain ||
+		    e->validated_gen != old[i].validated_gen) {
+			DRM_ERROR("Adding a listed BO changed entry %u\n", i);
+			goto out;
+		}
+	}
+	r = 0;
+
+out:
+	drm_gem_object_unreference_unlocked(gobj);
+	return r;
+}
+
+/* Evict a listed BO behind the list's back. The next submission must notice
+ * the move and validate it again instead of trusting its cached state.
+ */
+static int amdgpu_test_bo_list_evict(struct amdgpu_device *adev,
+				     struct drm_file *file,
+				     struct amdgpu_bo_list *list)
+{
+	struct amdgpu_bo_list_entry *e = &list->array[0];
+	struct amdgpu_bo *bo = e->robj;
+	u64 gen = bo->move_gen;
+	int r;
+
+	if (e->validated_gen != gen ||
+	    e->validated_domain != AMDGPU_GEM_DOMAIN_GTT) {
+		DRM_ERROR("BO list entry wasn't validated into GTT\n");
+		return -EINVAL;
+	}
+
+	r = amdgpu_bo_reserve(bo, false);
+	if (r)
+		return r;
+	amdgpu_ttm_placement_from_domain(bo, AMDGPU_GEM_DOMAIN_CPU);
+	r = ttm_bo_validate(&bo->tbo, &bo->placement, true, false);
+	amdgpu_bo_unreserve(bo);
+	if (r) {
+		DRM_ERROR("Failed to evict listed BO (%d)\n", r);
+		return r;
+	}
+	if (bo->move_gen == gen) {
+		DRM_ERROR("Evicting a BO didn't bump its move generation\n");
+		return -EINVAL;
+	}
+
+	r = amdgpu_test_bo_list_submit(adev, file, list);
+	if (r)
+		return r;
+
+	/* Skipping the validation would have left it in system memory */
+	if (bo->tbo.mem.mem_type != TTM_PL_TT ||
+	    e->validated_gen != bo->move_gen ||
+	    e->validated_domain != AMDGPU_GEM_DOMAIN_GTT) {
+		DRM_ERROR("Evicted BO wasn't validated again\n");
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+static void amdgpu_do_test_bo_list(struct amdgpu_device *adev,
+				   struct drm_file *file)
+{
+	struct drm_amdgpu_bo_list_entry info[AMDGPU_TEST_BO_LIST_SIZE];
+	struct drm_amdgpu_bo_list_entry remove[2];
+	struct amdgpu_bo *gds_obj, *gws_obj, *oa_obj;
+	struct drm_gem_object *gobj;
+	struct amdgpu_bo_list *list;
+	unsigned i, n;
+	int r;
+
+	list = kzalloc(sizeof(*list), GFP_KERNEL);
+	if (!list) {
+		r = -ENOMEM;
+		goto out;
+	}
+	mutex_init(&list->lock);
+
+	for (n = 0; n < AMDGPU_TEST_BO_LIST_SIZE; ++n) {
+		r = amdgpu_gem_object_create(adev, PAGE_SIZE, 0,
+					     AMDGPU_GEM_DOMAIN_GTT, 0, false,
+					     &gobj);
+		if (r) {
+			DRM_ERROR("Failed to create BO\n");
+			goto out_cleanup;
+		}
+
+		r = drm_gem_handle_create(file, gobj, &info[n].bo_handle);
+		drm_gem_object_unreference_unlocked(gobj);
+		if (r) {
+			DRM_ERROR("Failed to create BO handle\n");
+			goto out_cleanup;
+		}
+		info[n].bo_priority = n;
+	}
+
+	r = amdgpu_bo_list_change(adev, file, list, AMDGPU_BO_LIST_OP_UPDATE,
+				  info, n);
+	if (r) {
+		DRM_ERROR("Failed to set BO list\n");
+		goto out_cleanup;
+	}
+
+	r = amdgpu_test_bo_list_submit(adev, file, list);
+	if (r)
+		goto out_cleanup;
+
+	r = amdgpu_test_bo_list_add_dup(adev, file, list, &info[1]);
+	if (r)
+		goto out_cleanup;
+
+	r = amdgpu_test_bo_list_evict(adev, file, list);
+	if (r)
+		goto out_cleanup;
+
+	/* A valid handle followed by one which was never allocated, handle
+	 * 0 is never used. The list must not change.
+	 */
+	gds_obj = list->gds_obj;
+	gws_obj = list->gws_obj;
+	oa_obj = list->oa_obj;
+	remove[0] = info[0];
+	remove[1].bo_handle = 0;
+	remove[1].bo_priority = 0;
+	r = amdgpu_bo_list_change(adev, file, list, AMDGPU_BO_LIST_OP_REMOVE,
+				  remove, 2);
+	if (r != -ENOENT) {
+		DRM_ERROR("Removing a bad handle returned %d\n", r);
+		r = -EINVAL;
+		goto out_cleanup;
+	}
+	if (list->num_entries != n || list->gds_obj != gds_obj ||
+	    list->gws_obj != gws_obj || list->oa_obj != oa_obj) {
+		DRM_ERROR("Removing a bad handle changed the BO list\n");
+		r = -EINVAL;
+		goto out_cleanup;
+	}
+
+	r = amdgpu_test_bo_list_submit(adev, file, list);
+	if (r)
+		goto out_cleanup;
+
+	r = amdgpu_bo_list_change(adev, file, list, AMDGPU_BO_LIST_OP_REMOVE,
+				  remove, 1);
+	if (r || list->num_entries != n - 1) {
+		DRM_ERROR("Failed to remove a BO from the list\n");
+		r = r ? r : -EINVAL;
+		goto out_cleanup;
+	}
+
+	r = amdgpu_test_bo_list_submit(adev, file, list);
+
+out_cleanup:
+	amdgpu_bo_list_free(list);
+	for (i = 0; i < n; ++i)
+		drm_gem_handle_delete(file, info[i].bo_handle);
+out:
+	if (r)
+		printk(KERN_WARNING "Error while testing BO lists.\n");
+	else
+		DRM_INFO("Tested BO list updates\n");
+}
+
+/* Run the BO list tests on a private file, set up like drm_open() does for
+ * the parts the GEM handle and amdgpu code use.
+ */
+void amdgpu_test_bo_list(struct amdgpu_device *adev)
+{
+	struct drm_device *dev = adev->ddev;
+	struct drm_file *file;
+	int r;
+
+	file = kzalloc(sizeof(*file), GFP_KERNEL);
+	if (!file)
+		return;
+
+	file->pid = get_pid(task_pid(current));
+	idr_init(&file->object_idr);
+	spin_lock_init(&file->table_lock);
+	drm_vma_offset_cache_init(&file->vma_cache);
+	mutex_init(&file->prime.lock);
+
+	r = amdgpu_driver_open_kms(dev, file);
+	if (r) {
+		DRM_ERROR("Failed to open file for BO list tests (%d)\n", r);
+	} else {
+		amdgpu_do_test_bo_list(adev, file);
+		amdgpu_driver_preclose_kms(dev, file);
+		amdgpu_driver_postclose_kms(dev, file);
+	}
+
+	mutex_destroy(&file->prime.lock);
+	idr_destroy(&file->object_idr);
+	put_pid(file->pid);
+	kfree(file);
+}
@@ -326,6 +326,7 @@ static int cik_ih_hw_fini(void *handle)
 	struct amdgpu_device *adev = (struct amdgpu_device *)handle;
 
 	cik_ih_irq_disable(adev);
+	amdgpu_ih_deferred_reset(adev);
 
 	return 0;
 }
@@ -430,10 +431,30 @@ const struct amd_ip_funcs cik_ih_ip_funcs = {
 	.set_powergating_state = cik_ih_set_powergating_state,
 };
 
+/**
+ * cik_ih_set_intr - gate the IH interrupt
+ *
+ * @adev: amdgpu_device pointer
+ * @enable: true to let the IH raise interrupts again
+ *
+ * Masks or unmasks the interrupt without touching the ring (CIK).
+ */
+static void cik_ih_set_intr(struct amdgpu_device *adev, bool enable)
+{
+	u32 ih_cntl = RREG32(mmIH_CNTL);
+
+	if (enable)
+		ih_cntl |= IH_CNTL__ENABLE_INTR_MASK;
+	else
+		ih_cntl &= ~IH_CNTL__ENABLE_INTR_MASK;
+	WREG32(mmIH_CNTL, ih_cntl);
+}
+
 static const struct amdgpu_ih_funcs cik_ih_funcs = {
 	.get_wptr = cik_ih_get_wptr,
 	.decode_iv = cik_ih_decode_iv,
-	.set_rptr = cik_ih_set_rptr
+	.set_rptr = cik_ih_set_rptr,
+	.set_intr = cik_ih_set_intr
 };
 
 static void cik_ih_set_interrupt_funcs(struct amdgpu_device *adev)
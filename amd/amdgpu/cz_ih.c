@@ -305,6 +305,7 @@ static int cz_ih_hw_fini(void *handle)
 	struct amdgpu_device *adev = (struct amdgpu_device *)handle;
 
 	cz_ih_irq_disable(adev);
+	amdgpu_ih_deferred_reset(adev);
 
 	return 0;
 }
@@ -411,10 +412,27 @@ const struct amd_ip_funcs cz_ih_ip_funcs = {
 	.set_powergating_state = cz_ih_set_powergating_state,
 };
 
+/**
+ * cz_ih_set_intr - gate the IH interrupt
+ *
+ * @adev: amdgpu_device pointer
+ * @enable: true to let the IH raise interrupts again
+ *
+ * Masks or unmasks the interrupt without touching the ring (VI).
+ */
+static void cz_ih_set_intr(struct amdgpu_device *adev, bool enable)
+{
+	u32 ih_cntl = RREG32(mmIH_CNTL);
+
+	ih_cntl = REG_SET_FIELD(ih_cntl, IH_CNTL, ENABLE_INTR, enable ? 1 : 0);
+	WREG32(mmIH_CNTL, ih_cntl);
+}
+
 static const struct amdgpu_ih_funcs cz_ih_funcs = {
 	.get_wptr = cz_ih_get_wptr,
 	.decode_iv = cz_ih_decode_iv,
-	.set_rptr = cz_ih_set_rptr
+	.set_rptr = cz_ih_set_rptr,
+	.set_intr = cz_ih_set_intr
 };
 
 static void cz_ih_set_interrupt_funcs(struct amdgpu_device *adev)
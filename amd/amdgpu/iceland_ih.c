@@ -305,6 +305,7 @@ static int iceland_ih_hw_fini(void *handle)
 	struct amdgpu_device *adev = (struct amdgpu_device *)handle;
 
 	iceland_ih_irq_disable(adev);
+	amdgpu_ih_deferred_reset(adev);
 
 	return 0;
 }
@@ -409,10 +410,27 @@ const struct amd_ip_funcs iceland_ih_ip_funcs = {
 	.set_powergating_state = iceland_ih_set_powergating_state,
 };
 
+/**
+ * iceland_ih_set_intr - gate the IH interrupt
+ *
+ * @adev: amdgpu_device pointer
+ * @enable: true to let the IH raise interrupts again
+ *
+ * Masks or unmasks the interrupt without touching the ring (VI).
+ */
+static void iceland_ih_set_intr(struct amdgpu_device *adev, bool enable)
+{
+	u32 ih_cntl = RREG32(mmIH_CNTL);
+
+	ih_cntl = REG_SET_FIELD(ih_cntl, IH_CNTL, ENABLE_INTR, enable ? 1 : 0);
+	WREG32(mmIH_CNTL, ih_cntl);
+}
+
 static const struct amdgpu_ih_funcs iceland_ih_funcs = {
 	.get_wptr = iceland_ih_get_wptr,
 	.decode_iv = iceland_ih_decode_iv,
-	.set_rptr = iceland_ih_set_rptr
+	.set_rptr = iceland_ih_set_rptr,
+	.set_intr = iceland_ih_set_intr
 };
 
 static void iceland_ih_set_interrupt_funcs(struct amdgpu_device *adev)
@@ -185,6 +185,7 @@ static int si_ih_hw_fini(void *handle)
 	struct amdgpu_device *adev = (struct amdgpu_device *)handle;
 
 	si_ih_irq_disable(adev);
+	amdgpu_ih_deferred_reset(adev);
 
 	return 0;
 }
@@ -285,10 +286,22 @@ const struct amd_ip_funcs si_ih_ip_funcs = {
 	.set_powergating_state = si_ih_set_powergating_state,
 };
 
+static void si_ih_set_intr(struct amdgpu_device *adev, bool enable)
+{
+	u32 ih_cntl = RREG32(IH_CNTL);
+
+	if (enable)
+		ih_cntl |= ENABLE_INTR;
+	else
+		ih_cntl &= ~ENABLE_INTR;
+	WREG32(IH_CNTL, ih_cntl);
+}
+
 static const struct amdgpu_ih_funcs si_ih_funcs = {
 	.get_wptr = si_ih_get_wptr,
 	.decode_iv = si_ih_decode_iv,
-	.set_rptr = si_ih_set_rptr
+	.set_rptr = si_ih_set_rptr,
+	.set_intr = si_ih_set_intr
 };
 
 static void si_ih_set_interrupt_funcs(struct amdgpu_device *adev)
@@ -328,6 +328,7 @@ static int tonga_ih_hw_fini(void *handle)
 	struct amdgpu_device *adev = (struct amdgpu_device *)handle;
 
 	tonga_ih_irq_disable(adev);
+	amdgpu_ih_deferred_reset(adev);
 
 	return 0;
 }
@@ -475,10 +476,28 @@ const struct amd_ip_funcs tonga_ih_ip_funcs = {
 	.set_powergating_state = tonga_ih_set_powergating_state,
 };
 
+/**
+ * tonga_ih_set_intr - gate the IH interrupt
+ *
+ * @adev: amdgpu_device pointer
+ * @enable: true to let the IH raise interrupts again
+ *
+ * Masks or unmasks the interrupt without touching the ring (VI).
+ */
+static void tonga_ih_set_intr(struct amdgpu_device *adev, bool enable)
+{
+	u32 ih_rb_cntl = RREG32(mmIH_RB_CNTL);
+
+	ih_rb_cntl = REG_SET_FIELD(ih_rb_cntl, IH_RB_CNTL, ENABLE_INTR,
+				   enable ? 1 : 0);
+	WREG32(mmIH_RB_CNTL, ih_rb_cntl);
+}
+
 static const struct amdgpu_ih_funcs tonga_ih_funcs = {
 	.get_wptr = tonga_ih_get_wptr,
 	.decode_iv = tonga_ih_decode_iv,
-	.set_rptr = tonga_ih_set_rptr
+	.set_rptr = tonga_ih_set_rptr,
+	.set_intr = tonga_ih_set_intr
 };
 
 static void tonga_ih_set_interrupt_funcs(struct amdgpu_device *adev)
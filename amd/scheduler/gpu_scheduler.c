@@ -35,33 +35,122 @@ static void amd_sched_wakeup(struct amd_gpu_scheduler *sched);
 static void amd_sched_process_job(struct fence *f, struct fence_cb *cb);
 
 /* Initialize a given run queue struct */
-static void amd_sched_rq_init(struct amd_sched_rq *rq)
+static void amd_sched_rq_init(struct amd_sched_rq *rq,
+			      enum amd_sched_policy policy)
 {
 	spin_lock_init(&rq->lock);
-	INIT_LIST_HEAD(&rq->entities);
-	rq->current_entity = NULL;
+	rq->policy = policy;
+	INIT_LIST_HEAD(&rq->ready);
+	rq->ready_tree = RB_ROOT;
+	rq->min_vruntime = 0;
 }
 
-static void amd_sched_rq_add_entity(struct amd_sched_rq *rq,
-				    struct amd_sched_entity *entity)
+/**
+ * Charge the GPU time completed since the last update to the entity's
+ * virtual runtime, scaled by its weight. Must be called with rq->lock held.
+ */
+static void amd_sched_entity_update_vruntime(struct amd_sched_rq *rq,
+					     struct amd_sched_entity *entity)
 {
-	if (!list_empty(&entity->list))
-		return;
-	spin_lock(&rq->lock);
-	list_add_tail(&entity->list, &rq->entities);
-	spin_unlock(&rq->lock);
+	uint64_t runtime = atomic64_read(&entity->runtime->gpu_ns);
+	uint64_t delta = runtime - entity->charged_ns;
+
+	entity->charged_ns = runtime;
+	entity->vruntime += div_u64(delta * AMD_SCHED_WEIGHT_DEFAULT,
+				    entity->weight);
+
+	/* Don't let entities bank credit while they are idle */
+	if (entity->vruntime < rq->min_vruntime)
+		entity->vruntime = rq->min_vruntime;
+}
+
+static void amd_sched_rq_insert_tree(struct amd_sched_rq *rq,
+				     struct amd_sched_entity *entity)
+{
+	struct rb_node **p = &rq->ready_tree.rb_node;
+	struct rb_node *parent = NULL;
+
+	amd_sched_entity_update_vruntime(rq, entity);
+
+	while (*p) {
+		struct amd_sched_entity *e;
+
+		parent = *p;
+		e = rb_entry(parent, struct amd_sched_entity, rb);
+		if (entity->vruntime < e->vruntime)
+			p = &parent->rb_left;
+		else
+			p = &parent->rb_right;
+	}
+
+	rb_link_node(&entity->rb, parent, p);
+	rb_insert_color(&entity->rb, &rq->ready_tree);
+}
+
+/**
+ * Put an entity on the run queue if it can provide a job
+ *
+ * @entity	The entity to queue
+ *
+ * Called whenever the entity might have become ready: a job was pushed into
+ * its empty queue, a dependency signaled or a job was consumed while others
+ * are still queued. Queueing an entity twice is a no-op.
+ */
+static void amd_sched_rq_enqueue_locked(struct amd_sched_rq *rq,
+					struct amd_sched_entity *entity)
+{
+	if (!entity->queued && amd_sched_entity_is_ready(entity)) {
+		entity->queued = true;
+		if (rq->policy == AMD_SCHED_POLICY_WFQ)
+			amd_sched_rq_insert_tree(rq, entity);
+		else
+			list_add_tail(&entity->list, &rq->ready);
+	}
+}
+
+static void amd_sched_rq_enqueue(struct amd_sched_entity *entity)
+{
+	struct amd_sched_rq *rq = entity->rq;
+	unsigned long flags;
+
+	spin_lock_irqsave(&rq->lock, flags);
+	amd_sched_rq_enqueue_locked(rq, entity);
+	spin_unlock_irqrestore(&rq->lock, flags);
+}
+
+/* Must be called with rq->lock held */
+static void amd_sched_rq_unlink(struct amd_sched_rq *rq,
+				struct amd_sched_entity *entity)
+{
+	if (rq->policy == AMD_SCHED_POLICY_WFQ)
+		rb_erase(&entity->rb, &rq->ready_tree);
+	else
+		list_del_init(&entity->list);
+	entity->queued = false;
 }
 
 static void amd_sched_rq_remove_entity(struct amd_sched_rq *rq,
 				       struct amd_sched_entity *entity)
 {
-	if (list_empty(&entity->list))
-		return;
-	spin_lock(&rq->lock);
-	list_del_init(&entity->list);
-	if (rq->current_entity == entity)
-		rq->current_entity = NULL;
-	spin_unlock(&rq->lock);
+	unsigned long flags;
+
+	spin_lock_irqsave(&rq->lock, flags);
+	if (entity->queued)
+		amd_sched_rq_unlink(rq, entity);
+	spin_unlock_irqrestore(&rq->lock, flags);
+}
+
+static struct amd_sched_entity *
+amd_sched_rq_first(struct amd_sched_rq *rq)
+{
+	struct rb_node *rb;
+
+	if (rq->policy != AMD_SCHED_POLICY_WFQ)
+		return list_first_entry_or_null(&rq->ready,
+						struct amd_sched_entity, list);
+
+	rb = rb_first(&rq->ready_tree);
+	return rb ? rb_entry(rb, struct amd_sched_entity, rb) : NULL;
 }
 
 /**
@@ -69,41 +158,37 @@ static void amd_sched_rq_remove_entity(struct amd_sched_rq *rq,
  *
  * @rq		The run queue to check.
  *
- * Try to find a ready entity, returns NULL if none found.
+ * Take the next ready entity off the run queue according to the run queue
+ * policy, returns NULL if none found. The scheduler thread puts the entity
+ * back once it consumed the job and more are queued.
  */
 static struct amd_sched_entity *
 amd_sched_rq_select_entity(struct amd_sched_rq *rq)
 {
 	struct amd_sched_entity *entity;
+	unsigned long flags;
 
-	spin_lock(&rq->lock);
+	spin_lock_irqsave(&rq->lock, flags);
 
-	entity = rq->current_entity;
-	if (entity) {
-		list_for_each_entry_continue(entity, &rq->entities, list) {
-			if (amd_sched_entity_is_ready(entity)) {
-				rq->current_entity = entity;
-				spin_unlock(&rq->lock);
-				return entity;
-			}
-		}
-	}
-
-	list_for_each_entry(entity, &rq->entities, list) {
-
-		if (amd_sched_entity_is_ready(entity)) {
-			rq->current_entity = entity;
-			spin_unlock(&rq->lock);
-			return entity;
-		}
+	while ((entity = amd_sched_rq_first(rq))) {
+		amd_sched_rq_unlink(rq, entity);
 
-		if (entity == rq->current_entity)
+		/*
+		 * Entities can race onto the queue while the scheduler thread
+		 * is installing a dependency callback for them, the callback
+		 * queues them again once the dependency signals.
+		 */
+		if (amd_sched_entity_is_ready(entity))
 			break;
 	}
 
-	spin_unlock(&rq->lock);
+	if (entity && rq->policy == AMD_SCHED_POLICY_WFQ &&
+	    entity->vruntime > rq->min_vruntime)
+		rq->min_vruntime = entity->vruntime;
 
-	return NULL;
+	spin_unlock_irqrestore(&rq->lock, flags);
+
+	return entity;
 }
 
 /**
@@ -129,13 +214,24 @@ int amd_sched_entity_init(struct amd_gpu_scheduler *sched,
 
 	memset(entity, 0, sizeof(struct amd_sched_entity));
 	INIT_LIST_HEAD(&entity->list);
+	RB_CLEAR_NODE(&entity->rb);
 	entity->rq = rq;
 	entity->sched = sched;
+	entity->weight = AMD_SCHED_WEIGHT_DEFAULT;
+
+	entity->runtime = kzalloc(sizeof(*entity->runtime), GFP_KERNEL);
+	if (!entity->runtime)
+		return -ENOMEM;
+	kref_init(&entity->runtime->refcount);
+	atomic64_set(&entity->runtime->gpu_ns, 0);
 
 	spin_lock_init(&entity->queue_lock);
 	r = kfifo_alloc(&entity->job_queue, jobs * sizeof(void *), GFP_KERNEL);
-	if (r)
+	if (r) {
+		amd_sched_runtime_put(entity->runtime);
+		entity->runtime = NULL;
 		return r;
+	}
 
 	atomic_set(&entity->fence_seq, 0);
 	entity->fence_context = fence_context_alloc(2);
@@ -216,6 +312,49 @@ void amd_sched_entity_fini(struct amd_gpu_scheduler *sched,
 
 	amd_sched_rq_remove_entity(rq, entity);
 	kfifo_free(&entity->job_queue);
+	amd_sched_runtime_put(entity->runtime);
+	entity->runtime = NULL;
+}
+
+/**
+ * Set the weight of an entity
+ *
+ * @entity	The pointer to a valid scheduler entity
+ * @weight	Relative share of GPU time, AMD_SCHED_WEIGHT_DEFAULT is 1.0
+ *
+ * Only used by run queues with the weighted fair policy. The new weight
+ * applies to GPU time charged from now on.
+ */
+void amd_sched_entity_set_weight(struct amd_sched_entity *entity,
+				 unsigned weight)
+{
+	struct amd_sched_rq *rq = entity->rq;
+	unsigned long flags;
+
+	bool requeue;
+
+	spin_lock_irqsave(&rq->lock, flags);
+	/* The vruntime is the tree key, take the entity out while updating it */
+	requeue = entity->queued && rq->policy == AMD_SCHED_POLICY_WFQ;
+	if (requeue)
+		rb_erase(&entity->rb, &rq->ready_tree);
+
+	/* Charge the time consumed so far at the old weight */
+	amd_sched_entity_update_vruntime(rq, entity);
+	entity->weight = clamp_t(unsigned, weight, AMD_SCHED_WEIGHT_MIN,
+				 AMD_SCHED_WEIGHT_MAX);
+
+	if (requeue)
+		amd_sched_rq_insert_tree(rq, entity);
+	spin_unlock_irqrestore(&rq->lock, flags);
+}
+
+void amd_sched_runtime_release(struct kref *ref)
+{
+	struct amd_sched_runtime *runtime =
+		container_of(ref, struct amd_sched_runtime, refcount);
+
+	kfree(runtime);
 }
 
 static void amd_sched_entity_wakeup(struct fence *f, struct fence_cb *cb)
@@ -224,6 +363,7 @@ static void amd_sched_entity_wakeup(struct fence *f, struct fence_cb *cb)
 		container_of(cb, struct amd_sched_entity, cb);
 	entity->dependency = NULL;
 	fence_put(f);
+	amd_sched_rq_enqueue(entity);
 	amd_sched_wakeup(entity->sched);
 }
 
@@ -233,6 +373,7 @@ static void amd_sched_entity_clear_dep(struct fence *f, struct fence_cb *cb)
 		container_of(cb, struct amd_sched_entity, cb);
 	entity->dependency = NULL;
 	fence_put(f);
+	amd_sched_rq_enqueue(entity);
 }
 
 static bool amd_sched_entity_add_dependency_cb(struct amd_sched_entity *entity)
@@ -315,7 +456,7 @@ static bool amd_sched_entity_in(struct amd_sched_job *sched_job)
 	/* first job wakes up scheduler */
 	if (first) {
 		/* Add the entity to the run queue */
-		amd_sched_rq_add_entity(entity->rq, entity);
+		amd_sched_rq_enqueue(entity);
 		amd_sched_wakeup(sched);
 	}
 	return added;
@@ -514,6 +655,20 @@ static void amd_sched_process_job(struct fence *f, struct fence_cb *cb)
 		container_of(cb, struct amd_sched_fence, cb);
 	struct amd_gpu_scheduler *sched = s_fence->sched;
 
+	if (f) {
+		uint64_t now = ktime_get_raw_ns();
+		uint64_t start = max(s_fence->dispatch_ns, sched->last_done_ns);
+
+		/*
+		 * The ring executes jobs in order, so the job was running
+		 * from the later of its submission and the completion of the
+		 * previous job.
+		 */
+		if (now > start)
+			atomic64_add(now - start, &s_fence->runtime->gpu_ns);
+		sched->last_done_ns = now;
+	}
+
 	atomic_dec(&sched->hw_rq_count);
 	amd_sched_fence_finished(s_fence);
 
@@ -544,6 +699,8 @@ static int amd_sched_main(void *param)
 		struct amd_sched_entity *entity = NULL;
 		struct amd_sched_fence *s_fence;
 		struct amd_sched_job *sched_job;
+		struct amd_sched_rq *rq;
+		unsigned long flags;
 		struct fence *fence;
 
 		wait_event_interruptible(sched->wake_up_worker,
@@ -563,6 +720,7 @@ static int amd_sched_main(void *param)
 		atomic_inc(&sched->hw_rq_count);
 		amd_sched_job_begin(sched_job);
 
+		s_fence->dispatch_ns = ktime_get_raw_ns();
 		fence = sched->ops->run_job(sched_job);
 		amd_sched_fence_scheduled(s_fence);
 		if (fence) {
@@ -580,9 +738,19 @@ static int amd_sched_main(void *param)
 			amd_sched_process_job(NULL, &s_fence->cb);
 		}
 
+		/*
+		 * Consume the job and put the entity back under the run queue
+		 * lock: once the queue is empty amd_sched_entity_fini() may
+		 * proceed, and it takes the same lock before freeing anything,
+		 * so the entity must not be touched after it is dropped.
+		 */
+		rq = entity->rq;
+		spin_lock_irqsave(&rq->lock, flags);
 		count = kfifo_out(&entity->job_queue, &sched_job,
 				sizeof(sched_job));
 		WARN_ON(count != sizeof(sched_job));
+		amd_sched_rq_enqueue_locked(rq, entity);
+		spin_unlock_irqrestore(&rq->lock, flags);
 		wake_up(&sched->job_scheduled);
 	}
 	return 0;
@@ -594,21 +762,25 @@ static int amd_sched_main(void *param)
  * @sched		The pointer to the scheduler
  * @ops			The backend operations for this scheduler.
  * @hw_submissions	Number of hw submissions to do.
+ * @timeout		Job timeout in jiffies.
+ * @policy		Entity selection policy of the run queues.
  * @name		Name used for debugging
  *
  * Return 0 on success, otherwise error code.
 */
 int amd_sched_init(struct amd_gpu_scheduler *sched,
 		   const struct amd_sched_backend_ops *ops,
-		   unsigned hw_submission, long timeout, const char *name)
+		   unsigned hw_submission, long timeout,
+		   enum amd_sched_policy policy, const char *name)
 {
 	int i;
 	sched->ops = ops;
 	sched->hw_submission_limit = hw_submission;
 	sched->name = name;
 	sched->timeout = timeout;
+	sched->last_done_ns = 0;
 	for (i = 0; i < AMD_SCHED_MAX_PRIORITY; i++)
-		amd_sched_rq_init(&sched->sched_rq[i]);
+		amd_sched_rq_init(&sched->sched_rq[i], policy);
 
 	init_waitqueue_head(&sched->wake_up_worker);
 	init_waitqueue_head(&sched->job_scheduled);
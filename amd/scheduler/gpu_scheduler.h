@@ -26,10 +26,37 @@
 
 #include <linux/kfifo.h>
 #include <linux/fence.h>
+#include <linux/kref.h>
+#include <linux/rbtree.h>
 
 struct amd_gpu_scheduler;
 struct amd_sched_rq;
 
+/**
+ * Policy used by a run queue to pick the next ready entity.
+ *
+ * AMD_SCHED_POLICY_RR serves ready entities in FIFO order, AMD_SCHED_POLICY_WFQ
+ * serves the ready entity with the least weighted GPU time consumed so far.
+ */
+enum amd_sched_policy {
+	AMD_SCHED_POLICY_RR = 0,
+	AMD_SCHED_POLICY_WFQ,
+	AMD_SCHED_MAX_POLICY
+};
+
+#define AMD_SCHED_WEIGHT_MIN		1
+#define AMD_SCHED_WEIGHT_DEFAULT	1024
+#define AMD_SCHED_WEIGHT_MAX		(AMD_SCHED_WEIGHT_DEFAULT * 64)
+
+/**
+ * GPU time consumed by an entity. Jobs keep a reference through their
+ * scheduler fence, so completion can be charged after the entity is gone.
+ */
+struct amd_sched_runtime {
+	struct kref			refcount;
+	atomic64_t			gpu_ns;
+};
+
 /**
  * A scheduler entity is a wrapper around a job queue or a group
  * of other entities. Entities take turns emitting jobs from their
@@ -37,7 +64,10 @@ struct amd_sched_rq;
  * policy.
 */
 struct amd_sched_entity {
+	/* ready queue linkage, protected by rq->lock */
 	struct list_head		list;
+	struct rb_node			rb;
+	bool				queued;
 	struct amd_sched_rq		*rq;
 	struct amd_gpu_scheduler	*sched;
 
@@ -49,17 +79,29 @@ struct amd_sched_entity {
 
 	struct fence			*dependency;
 	struct fence_cb			cb;
+
+	/* weighted fair queueing state, protected by rq->lock */
+	unsigned			weight;
+	uint64_t			vruntime;
+	uint64_t			charged_ns;
+	struct amd_sched_runtime	*runtime;
 };
 
 /**
  * Run queue is a set of entities scheduling command submissions for
  * one specific ring. It implements the scheduling policy that selects
  * the next entity to emit commands from.
+ *
+ * Only entities that have a job queued and no unsignaled dependency are
+ * kept in the run queue, either on the ready list (round robin) or in the
+ * ready tree sorted by virtual runtime (weighted fair).
 */
 struct amd_sched_rq {
 	spinlock_t		lock;
-	struct list_head	entities;
-	struct amd_sched_entity	*current_entity;
+	enum amd_sched_policy	policy;
+	struct list_head	ready;
+	struct rb_root		ready_tree;
+	uint64_t		min_vruntime;
 };
 
 struct amd_sched_fence {
@@ -70,6 +112,8 @@ struct amd_sched_fence {
 	struct amd_gpu_scheduler	*sched;
 	spinlock_t			lock;
 	void                            *owner;
+	struct amd_sched_runtime	*runtime;
+	uint64_t			dispatch_ns;
 };
 
 struct amd_sched_job {
@@ -127,11 +171,13 @@ struct amd_gpu_scheduler {
 	struct task_struct		*thread;
 	struct list_head	ring_mirror_list;
 	spinlock_t			job_list_lock;
+	uint64_t			last_done_ns;
 };
 
 int amd_sched_init(struct amd_gpu_scheduler *sched,
 		   const struct amd_sched_backend_ops *ops,
-		   uint32_t hw_submission, long timeout, const char *name);
+		   uint32_t hw_submission, long timeout,
+		   enum amd_sched_policy policy, const char *name);
 void amd_sched_fini(struct amd_gpu_scheduler *sched);
 
 int amd_sched_entity_init(struct amd_gpu_scheduler *sched,
@@ -141,6 +187,23 @@ int amd_sched_entity_init(struct amd_gpu_scheduler *sched,
 void amd_sched_entity_fini(struct amd_gpu_scheduler *sched,
 			   struct amd_sched_entity *entity);
 void amd_sched_entity_push_job(struct amd_sched_job *sched_job);
+void amd_sched_entity_set_weight(struct amd_sched_entity *entity,
+				 unsigned weight);
+
+void amd_sched_runtime_release(struct kref *ref);
+
+static inline struct amd_sched_runtime *
+amd_sched_runtime_get(struct amd_sched_runtime *runtime)
+{
+	kref_get(&runtime->refcount);
+	return runtime;
+}
+
+static inline void amd_sched_runtime_put(struct amd_sched_runtime *runtime)
+{
+	if (runtime)
+		kref_put(&runtime->refcount, amd_sched_runtime_release);
+}
 
 int amd_sched_fence_slab_init(void);
 void amd_sched_fence_slab_fini(void);
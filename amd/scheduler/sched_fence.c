@@ -58,6 +58,7 @@ struct amd_sched_fence *amd_sched_fence_create(struct amd_sched_entity *entity,
 
 	fence->owner = owner;
 	fence->sched = entity->sched;
+	fence->runtime = amd_sched_runtime_get(entity->runtime);
 	spin_lock_init(&fence->lock);
 
 	seq = atomic_inc_return(&entity->fence_seq);
@@ -118,6 +119,7 @@ static void amd_sched_fence_free(struct rcu_head *rcu)
 	struct amd_sched_fence *fence = to_amd_sched_fence(f);
 
 	fence_put(fence->parent);
+	amd_sched_runtime_put(fence->runtime);
 	kmem_cache_free(sched_fence_slab, fence);
 }
 
@@ -867,6 +867,8 @@ static void drm_core_exit(void)
 	idr_destroy(&drm_minors_idr);
 	drm_connector_ida_destroy();
 	drm_global_release();
+	/* drm_hashtab frees tables retired by a resize with call_rcu() */
+	rcu_barrier();
 }
 
 static int __init drm_core_init(void)
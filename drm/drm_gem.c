@@ -746,6 +746,7 @@ drm_gem_open(struct drm_device *dev, struct drm_file *file_private)
 {
 	idr_init(&file_private->object_idr);
 	spin_lock_init(&file_private->table_lock);
+	drm_vma_offset_cache_init(&file_private->vma_cache);
 }
 
 /**
@@ -969,6 +970,25 @@ int drm_gem_mmap(struct file *filp, struct vm_area_struct *vma)
 	if (drm_device_is_unplugged(dev))
 		return -ENODEV;
 
+	/*
+	 * Objects this file mapped recently can be found without the shared
+	 * manager and node locks. Cached nodes are still allowed for this file
+	 * and can't be freed while the cache lock is held.
+	 */
+	drm_vma_offset_cache_lock(&priv->vma_cache);
+	node = drm_vma_offset_cache_lookup_locked(&priv->vma_cache,
+						  vma->vm_pgoff,
+						  vma_pages(vma));
+	if (likely(node)) {
+		obj = container_of(node, struct drm_gem_object, vma_node);
+		if (!kref_get_unless_zero(&obj->refcount))
+			obj = NULL;
+	}
+	drm_vma_offset_cache_unlock(&priv->vma_cache);
+
+	if (likely(obj))
+		goto map;
+
 	drm_vma_offset_lock_lookup(dev->vma_offset_manager);
 	node = drm_vma_offset_exact_lookup_locked(dev->vma_offset_manager,
 						  vma->vm_pgoff,
@@ -993,11 +1013,12 @@ int drm_gem_mmap(struct file *filp, struct vm_area_struct *vma)
 	if (!obj)
 		return -EINVAL;
 
-	if (!drm_vma_node_is_allowed(node, priv)) {
+	if (!drm_vma_node_authorize(node, priv)) {
 		drm_gem_object_unreference_unlocked(obj);
 		return -EACCES;
 	}
 
+map:
 	ret = drm_gem_mmap_obj(obj, drm_vma_node_size(node) << PAGE_SHIFT,
 			       vma);
 
@@ -41,99 +41,228 @@
 #include <linux/rculist.h>
 #endif
 
-int drm_ht_create(struct drm_open_hash *ht, unsigned int order)
+/*
+ * Largest table a resize may allocate, and items moved and buckets looked at
+ * per manipulation. A shrink starts out with mostly empty buckets, it has to
+ * skip them quickly enough to finish before the removals stop.
+ */
+#define DRM_HT_MAX_ORDER	20
+#define DRM_HT_RESIZE_STEP	4
+#define DRM_HT_RESIZE_SCAN	64
+
+static struct drm_ht_table *drm_ht_table_alloc(unsigned int order, gfp_t gfp)
 {
-	unsigned int size = 1 << order;
+	size_t size = sizeof(struct drm_ht_table) +
+		(sizeof(struct hlist_head) << order);
+	struct drm_ht_table *tbl;
 
-	ht->order = order;
-	ht->table = NULL;
-	if (size <= PAGE_SIZE / sizeof(*ht->table))
-		ht->table = kcalloc(size, sizeof(*ht->table), GFP_KERNEL);
+	if (size <= PAGE_SIZE || gfp != GFP_KERNEL)
+		tbl = kzalloc(size, gfp);
 	else
-		ht->table = vzalloc(size*sizeof(*ht->table));
-	if (!ht->table) {
-		DRM_ERROR("Out of memory for hash table\n");
-		return -ENOMEM;
-	}
-	return 0;
+		tbl = vzalloc(size);
+	if (tbl)
+		tbl->order = order;
+	return tbl;
 }
-EXPORT_SYMBOL(drm_ht_create);
 
-void drm_ht_verbose_list(struct drm_open_hash *ht, unsigned long key)
+static void drm_ht_table_free_rcu(struct rcu_head *rcu)
 {
-	struct drm_hash_item *entry;
-	struct hlist_head *h_list;
-	unsigned int hashed_key;
-	int count = 0;
+	kvfree(container_of(rcu, struct drm_ht_table, rcu));
+}
+
+static inline struct hlist_head *drm_ht_bucket(struct drm_ht_table *tbl,
+					       unsigned long key)
+{
+	return &tbl->buckets[hash_long(key, tbl->order)];
+}
 
-	hashed_key = hash_long(key, ht->order);
-	DRM_DEBUG("Key is 0x%08lx, Hashed key is 0x%08x\n", key, hashed_key);
-	h_list = &ht->table[hashed_key];
-	hlist_for_each_entry(entry, h_list, head)
-		DRM_DEBUG("count %d, key: 0x%08lx\n", count++, entry->key);
+/* Map the list node of a table back to its item */
+static inline struct drm_hash_item *drm_ht_entry(struct hlist_node *node,
+						 unsigned int slot)
+{
+	return container_of(node - slot, struct drm_hash_item, head[0]);
 }
 
-static struct hlist_node *drm_ht_find_key(struct drm_open_hash *ht,
-					  unsigned long key)
+/*
+ * Chains are sorted by key, so both lookups and insertions can stop at the
+ * first larger key.
+ */
+static struct drm_hash_item *drm_ht_table_find(struct drm_ht_table *tbl,
+					       unsigned long key)
 {
 	struct drm_hash_item *entry;
-	struct hlist_head *h_list;
-	unsigned int hashed_key;
+	struct hlist_node *node;
 
-	hashed_key = hash_long(key, ht->order);
-	h_list = &ht->table[hashed_key];
-	hlist_for_each_entry(entry, h_list, head) {
+	for (node = rcu_dereference(drm_ht_bucket(tbl, key)->first); node;
+	     node = rcu_dereference(node->next)) {
+		entry = drm_ht_entry(node, tbl->slot);
 		if (entry->key == key)
-			return &entry->head;
+			return entry;
 		if (entry->key > key)
 			break;
 	}
 	return NULL;
 }
 
-static struct hlist_node *drm_ht_find_key_rcu(struct drm_open_hash *ht,
-					      unsigned long key)
+static int drm_ht_table_link(struct drm_ht_table *tbl,
+			     struct drm_hash_item *item)
 {
+	struct hlist_head *h_list = drm_ht_bucket(tbl, item->key);
+	struct hlist_node *node, *parent = NULL;
 	struct drm_hash_item *entry;
-	struct hlist_head *h_list;
-	unsigned int hashed_key;
 
-	hashed_key = hash_long(key, ht->order);
-	h_list = &ht->table[hashed_key];
-	hlist_for_each_entry_rcu(entry, h_list, head) {
-		if (entry->key == key)
-			return &entry->head;
-		if (entry->key > key)
+	for (node = h_list->first; node; node = node->next) {
+		entry = drm_ht_entry(node, tbl->slot);
+		if (entry->key == item->key)
+			return -EINVAL;
+		if (entry->key > item->key)
 			break;
+		parent = node;
 	}
-	return NULL;
+	if (parent)
+		hlist_add_behind_rcu(&item->head[tbl->slot], parent);
+	else
+		hlist_add_head_rcu(&item->head[tbl->slot], h_list);
+	return 0;
 }
 
-int drm_ht_insert_item(struct drm_open_hash *ht, struct drm_hash_item *item)
+/* Whether the item with this key has been copied into the new table yet */
+static inline bool drm_ht_moved(struct drm_open_hash *ht, unsigned long key)
 {
-	struct drm_hash_item *entry;
-	struct hlist_head *h_list;
-	struct hlist_node *parent;
-	unsigned int hashed_key;
-	unsigned long key = item->key;
-
-	hashed_key = hash_long(key, ht->order);
-	h_list = &ht->table[hashed_key];
-	parent = NULL;
-	hlist_for_each_entry(entry, h_list, head) {
-		if (entry->key == key)
-			return -EINVAL;
-		if (entry->key > key)
-			break;
-		parent = &entry->head;
+	return ht->new_table &&
+		hash_long(key, ht->table->order) < ht->cursor;
+}
+
+/*
+ * Start a resize if the load factor is off, and move a few more buckets into
+ * the new table if one is in progress. Manipulations may be done under a
+ * spinlock, so a resize that can't get its table without sleeping is
+ * retried later, once the item count has moved another step past the
+ * threshold.
+ */
+static void drm_ht_resize_step(struct drm_open_hash *ht)
+{
+	struct drm_ht_table *tbl = ht->table;
+	struct drm_ht_table *new_tbl = ht->new_table;
+	unsigned int size = 1U << tbl->order;
+	struct hlist_node *node;
+	unsigned int i, moved, order;
+
+	if (!new_tbl) {
+		if (ht->count > size && ht->count >= ht->grow_retry &&
+		    tbl->order < DRM_HT_MAX_ORDER)
+			order = tbl->order + 1;
+		else if (ht->count < size / 8 && ht->count <= ht->shrink_retry &&
+			 tbl->order > ht->min_order)
+			order = tbl->order - 1;
+		else
+			return;
+
+		new_tbl = drm_ht_table_alloc(order, GFP_ATOMIC | __GFP_NOWARN);
+		if (!new_tbl) {
+			if (order > tbl->order)
+				ht->grow_retry = ht->count + size / 4;
+			else
+				ht->shrink_retry = ht->count / 2;
+			return;
+		}
+		new_tbl->slot = !tbl->slot;
+		ht->grow_retry = 0;
+		ht->shrink_retry = ULONG_MAX;
+
+		/*
+		 * The new table reuses the list nodes of the table retired by
+		 * the previous resize, which RCU lookups may still be walking.
+		 * Make them retry if they come back empty-handed.
+		 */
+		write_seqcount_begin(&ht->seq);
+		ht->new_table = new_tbl;
+		ht->cursor = 0;
+		write_seqcount_end(&ht->seq);
+	}
+
+	for (i = 0, moved = 0; i < DRM_HT_RESIZE_SCAN &&
+	     moved < DRM_HT_RESIZE_STEP && ht->cursor < size;
+	     ++i, ++ht->cursor) {
+		for (node = tbl->buckets[ht->cursor].first; node;
+		     node = node->next, ++moved)
+			drm_ht_table_link(new_tbl,
+					  drm_ht_entry(node, tbl->slot));
 	}
-	if (parent) {
-		hlist_add_behind_rcu(&item->head, parent);
-	} else {
-		hlist_add_head_rcu(&item->head, h_list);
+
+	if (ht->cursor == size) {
+		rcu_assign_pointer(ht->table, new_tbl);
+		ht->new_table = NULL;
+		call_rcu(&tbl->rcu, drm_ht_table_free_rcu);
+	}
+}
+
+int drm_ht_create(struct drm_open_hash *ht, unsigned int order)
+{
+	ht->new_table = NULL;
+	ht->cursor = 0;
+	ht->count = 0;
+	ht->grow_retry = 0;
+	ht->shrink_retry = ULONG_MAX;
+	ht->min_order = order;
+	seqcount_init(&ht->seq);
+	ht->table = drm_ht_table_alloc(order, GFP_KERNEL);
+	if (!ht->table) {
+		DRM_ERROR("Out of memory for hash table\n");
+		return -ENOMEM;
 	}
 	return 0;
 }
+EXPORT_SYMBOL(drm_ht_create);
+
+void drm_ht_verbose_list(struct drm_open_hash *ht, unsigned long key)
+{
+	struct drm_ht_table *tbl = ht->table;
+	struct hlist_node *node;
+	int count = 0;
+
+	DRM_DEBUG("Key is 0x%08lx, Hashed key is 0x%08x\n", key,
+		  (unsigned int)hash_long(key, tbl->order));
+	for (node = drm_ht_bucket(tbl, key)->first; node; node = node->next)
+		DRM_DEBUG("count %d, key: 0x%08lx\n", count++,
+			  drm_ht_entry(node, tbl->slot)->key);
+}
+
+/*
+ * Lookups only ever use the complete table. A lookup that raced with a
+ * resize reusing the nodes of the table it walks may be led astray, in which
+ * case it is retried.
+ */
+static struct drm_hash_item *drm_ht_find_key_rcu(struct drm_open_hash *ht,
+						 unsigned long key)
+{
+	struct drm_hash_item *entry;
+	unsigned int seq;
+
+	do {
+		seq = read_seqcount_begin(&ht->seq);
+		entry = drm_ht_table_find(rcu_dereference(ht->table), key);
+		if (entry)
+			return entry;
+	} while (read_seqcount_retry(&ht->seq, seq));
+
+	return NULL;
+}
+
+int drm_ht_insert_item(struct drm_open_hash *ht, struct drm_hash_item *item)
+{
+	int ret;
+
+	ret = drm_ht_table_link(ht->table, item);
+	if (ret)
+		return ret;
+
+	if (drm_ht_moved(ht, item->key))
+		drm_ht_table_link(ht->new_table, item);
+	ht->count++;
+	drm_ht_resize_step(ht);
+	return 0;
+}
 EXPORT_SYMBOL(drm_ht_insert_item);
 
 /*
@@ -168,38 +297,45 @@ EXPORT_SYMBOL(drm_ht_just_insert_please);
 int drm_ht_find_item(struct drm_open_hash *ht, unsigned long key,
 		     struct drm_hash_item **item)
 {
-	struct hlist_node *list;
+	struct drm_hash_item *entry;
 
-	list = drm_ht_find_key_rcu(ht, key);
-	if (!list)
+	entry = drm_ht_find_key_rcu(ht, key);
+	if (!entry)
 		return -EINVAL;
 
-	*item = hlist_entry(list, struct drm_hash_item, head);
+	*item = entry;
 	return 0;
 }
 EXPORT_SYMBOL(drm_ht_find_item);
 
 int drm_ht_remove_key(struct drm_open_hash *ht, unsigned long key)
 {
-	struct hlist_node *list;
+	struct drm_hash_item *entry;
 
-	list = drm_ht_find_key(ht, key);
-	if (list) {
-		hlist_del_init_rcu(list);
-		return 0;
-	}
+	entry = drm_ht_table_find(ht->table, key);
+	if (entry)
+		return drm_ht_remove_item(ht, entry);
 	return -EINVAL;
 }
 
 int drm_ht_remove_item(struct drm_open_hash *ht, struct drm_hash_item *item)
 {
-	hlist_del_init_rcu(&item->head);
+	if (hlist_unhashed(&item->head[ht->table->slot]))
+		return 0;
+
+	if (drm_ht_moved(ht, item->key))
+		hlist_del_init_rcu(&item->head[ht->new_table->slot]);
+	hlist_del_init_rcu(&item->head[ht->table->slot]);
+	ht->count--;
+	drm_ht_resize_step(ht);
 	return 0;
 }
 EXPORT_SYMBOL(drm_ht_remove_item);
 
 void drm_ht_remove(struct drm_open_hash *ht)
 {
+	kvfree(ht->new_table);
+	ht->new_table = NULL;
 	if (ht->table) {
 		kvfree(ht->table);
 		ht->table = NULL;
@@ -30,12 +30,11 @@
  * Generic simple memory manager implementation. Intended to be used as a base
  * class implementation for more advanced memory managers.
  *
- * Note that the algorithm used is quite simple and there might be substantial
- * performance gains if a smarter free list is implemented. Currently it is just an
- * unordered stack of free regions. This could easily be improved if an RB-tree
- * is used instead. At least if we expect heavy fragmentation.
+ * Free regions are kept on an unordered stack of recently freed holes and are
+ * additionally indexed by two RB-trees, one sorted by hole size and one sorted
+ * by hole address, so that searches stay cheap under heavy fragmentation.
  *
- * Aligned allocations can also see improvement.
+ * Aligned allocations can still see improvement.
  *
  * Authors:
  * Thomas Hellström <thomas-at-tungstengraphics-dot-com>
@@ -47,6 +46,7 @@
 #include <linux/seq_file.h>
 #include <linux/export.h>
 #include <linux/interval_tree_generic.h>
+#include <linux/rbtree_augmented.h>
 
 /**
  * DOC: Overview
@@ -71,10 +71,15 @@
  *
  * drm_mm maintains a stack of most recently freed holes, which of all
  * simplistic datastructures seems to be a fairly decent approach to clustering
- * allocations and avoiding too much fragmentation. This means free space
- * searches are O(num_holes). Given that all the fancy features drm_mm supports
- * something better would be fairly complex and since gfx thrashing is a fairly
- * steep cliff not a real concern. Removing a node again is O(1).
+ * allocations and avoiding too much fragmentation. The default search first
+ * tries the hole on top of that stack and then falls back to the lowest
+ * suitable hole by address. Holes are also indexed in an RB-tree sorted by
+ * size, used for best-fit searches, and in an RB-tree sorted by address and
+ * augmented with the largest hole of each subtree, used for first-fit,
+ * top-down and range restricted searches. Subtrees without a large enough
+ * hole are skipped, so free space searches are O(log(num_holes)) plus the
+ * number of large enough holes rejected because of alignment, color or range
+ * constraints. Inserting and removing a node is O(log(num_holes)).
  *
  * drm_mm supports a few features: Alignment and range restrictions can be
  * supplied. Further more every &drm_mm_node has a color value (which is just an
@@ -85,7 +90,9 @@
  *
  * Two behaviors are supported for searching and allocating: bottom-up and top-down.
  * The default is bottom-up. Top-down allocation can be used if the memory area
- * has different restrictions, or just to reduce fragmentation.
+ * has different restrictions, or just to reduce fragmentation. A top-down
+ * search (DRM_MM_SEARCH_BELOW) picks the highest suitable hole, a best-fit
+ * search (DRM_MM_SEARCH_BEST) the smallest one.
  *
  * Finally iteration helpers to walk all nodes and all holes are provided as are
  * some basic allocator dumpers for debugging.
@@ -170,6 +177,109 @@ static void drm_mm_interval_tree_add_node(struct drm_mm_node *hole_node,
 			    &drm_mm_interval_tree_augment);
 }
 
+#define HOLE_START(node) __drm_mm_hole_node_start(node)
+#define HOLE_END(node)   (HOLE_START(node) + (node)->hole_size)
+
+static inline struct drm_mm_node *rb_hole_addr_to_node(struct rb_node *rb)
+{
+	return rb_entry_safe(rb, struct drm_mm_node, rb_hole_addr);
+}
+
+static inline struct drm_mm_node *rb_hole_size_to_node(struct rb_node *rb)
+{
+	return rb_entry_safe(rb, struct drm_mm_node, rb_hole_size);
+}
+
+static inline u64 rb_hole_max(struct rb_node *rb)
+{
+	return rb ? rb_hole_addr_to_node(rb)->subtree_max_hole : 0;
+}
+
+static inline u64 drm_mm_hole_subtree_max(struct drm_mm_node *node)
+{
+	u64 max = node->hole_size;
+
+	if (rb_hole_max(node->rb_hole_addr.rb_left) > max)
+		max = rb_hole_max(node->rb_hole_addr.rb_left);
+	if (rb_hole_max(node->rb_hole_addr.rb_right) > max)
+		max = rb_hole_max(node->rb_hole_addr.rb_right);
+
+	return max;
+}
+
+RB_DECLARE_CALLBACKS(static, drm_mm_hole_augment, struct drm_mm_node,
+		     rb_hole_addr, u64, subtree_max_hole,
+		     drm_mm_hole_subtree_max)
+
+/*
+ * Add the hole following @node to the size and address trees. The hole must
+ * already be linked in, i.e. the next node in the node_list must be the one
+ * terminating the hole.
+ */
+static void drm_mm_hole_index(struct drm_mm_node *node)
+{
+	struct drm_mm *mm = node->mm;
+	struct rb_node **link, *rb;
+	struct drm_mm_node *parent;
+	u64 hole_start = __drm_mm_hole_node_start(node);
+
+	node->hole_size = __drm_mm_hole_node_end(node) - hole_start;
+	node->subtree_max_hole = node->hole_size;
+
+	rb = NULL;
+	link = &mm->holes_size.rb_node;
+	while (*link) {
+		rb = *link;
+		parent = rb_hole_size_to_node(rb);
+		if (node->hole_size < parent->hole_size)
+			link = &rb->rb_left;
+		else
+			link = &rb->rb_right;
+	}
+	rb_link_node(&node->rb_hole_size, rb, link);
+	rb_insert_color(&node->rb_hole_size, &mm->holes_size);
+
+	rb = NULL;
+	link = &mm->holes_addr.rb_node;
+	while (*link) {
+		rb = *link;
+		parent = rb_hole_addr_to_node(rb);
+		if (parent->subtree_max_hole < node->hole_size)
+			parent->subtree_max_hole = node->hole_size;
+		if (hole_start < HOLE_START(parent))
+			link = &rb->rb_left;
+		else
+			link = &rb->rb_right;
+	}
+	rb_link_node(&node->rb_hole_addr, rb, link);
+	rb_insert_augmented(&node->rb_hole_addr, &mm->holes_addr,
+			    &drm_mm_hole_augment);
+}
+
+static void drm_mm_hole_unindex(struct drm_mm_node *node)
+{
+	struct drm_mm *mm = node->mm;
+
+	rb_erase(&node->rb_hole_size, &mm->holes_size);
+	rb_erase_augmented(&node->rb_hole_addr, &mm->holes_addr,
+			   &drm_mm_hole_augment);
+	node->hole_size = 0;
+}
+
+static void drm_mm_add_hole(struct drm_mm_node *node)
+{
+	node->hole_follows = 1;
+	list_add(&node->hole_stack, &node->mm->hole_stack);
+	drm_mm_hole_index(node);
+}
+
+static void drm_mm_rm_hole(struct drm_mm_node *node)
+{
+	list_del(&node->hole_stack);
+	drm_mm_hole_unindex(node);
+	node->hole_follows = 0;
+}
+
 static void drm_mm_insert_helper(struct drm_mm_node *hole_node,
 				 struct drm_mm_node *node,
 				 u64 size, unsigned alignment,
@@ -206,6 +316,7 @@ static void drm_mm_insert_helper(struct drm_mm_node *hole_node,
 	BUG_ON(adj_start < hole_start);
 	BUG_ON(adj_end > hole_end);
 
+	drm_mm_hole_unindex(hole_node);
 	if (adj_start == hole_start) {
 		hole_node->hole_follows = 0;
 		list_del(&hole_node->hole_stack);
@@ -221,13 +332,14 @@ static void drm_mm_insert_helper(struct drm_mm_node *hole_node,
 
 	drm_mm_interval_tree_add_node(hole_node, node);
 
+	if (hole_node->hole_follows)
+		drm_mm_hole_index(hole_node);
+
 	BUG_ON(node->start + node->size > adj_end);
 
 	node->hole_follows = 0;
-	if (__drm_mm_hole_node_start(node) < hole_end) {
-		list_add(&node->hole_stack, &mm->hole_stack);
-		node->hole_follows = 1;
-	}
+	if (__drm_mm_hole_node_start(node) < hole_end)
+		drm_mm_add_hole(node);
 }
 
 /**
@@ -278,6 +390,8 @@ int drm_mm_reserve_node(struct drm_mm *mm, struct drm_mm_node *node)
 	node->mm = mm;
 	node->allocated = 1;
 
+	drm_mm_hole_unindex(hole);
+
 	list_add(&node->node_list, &hole->node_list);
 
 	drm_mm_interval_tree_add_node(hole, node);
@@ -285,13 +399,12 @@ int drm_mm_reserve_node(struct drm_mm *mm, struct drm_mm_node *node)
 	if (node->start == hole_start) {
 		hole->hole_follows = 0;
 		list_del(&hole->hole_stack);
-	}
+	} else
+		drm_mm_hole_index(hole);
 
 	node->hole_follows = 0;
-	if (end != hole_end) {
-		list_add(&node->hole_stack, &mm->hole_stack);
-		node->hole_follows = 1;
-	}
+	if (end != hole_end)
+		drm_mm_add_hole(node);
 
 	return 0;
 }
@@ -372,6 +485,7 @@ static void drm_mm_insert_helper_range(struct drm_mm_node *hole_node,
 		}
 	}
 
+	drm_mm_hole_unindex(hole_node);
 	if (adj_start == hole_start) {
 		hole_node->hole_follows = 0;
 		list_del(&hole_node->hole_stack);
@@ -387,16 +501,17 @@ static void drm_mm_insert_helper_range(struct drm_mm_node *hole_node,
 
 	drm_mm_interval_tree_add_node(hole_node, node);
 
+	if (hole_node->hole_follows)
+		drm_mm_hole_index(hole_node);
+
 	BUG_ON(node->start < start);
 	BUG_ON(node->start < adj_start);
 	BUG_ON(node->start + node->size > adj_end);
 	BUG_ON(node->start + node->size > end);
 
 	node->hole_follows = 0;
-	if (__drm_mm_hole_node_start(node) < hole_end) {
-		list_add(&node->hole_stack, &mm->hole_stack);
-		node->hole_follows = 1;
-	}
+	if (__drm_mm_hole_node_start(node) < hole_end)
+		drm_mm_add_hole(node);
 }
 
 /**
@@ -466,7 +581,7 @@ void drm_mm_remove_node(struct drm_mm_node *node)
 	if (node->hole_follows) {
 		BUG_ON(__drm_mm_hole_node_start(node) ==
 		       __drm_mm_hole_node_end(node));
-		list_del(&node->hole_stack);
+		drm_mm_rm_hole(node);
 	} else
 		BUG_ON(__drm_mm_hole_node_start(node) !=
 		       __drm_mm_hole_node_end(node));
@@ -475,12 +590,17 @@ void drm_mm_remove_node(struct drm_mm_node *node)
 	if (!prev_node->hole_follows) {
 		prev_node->hole_follows = 1;
 		list_add(&prev_node->hole_stack, &mm->hole_stack);
-	} else
+	} else {
 		list_move(&prev_node->hole_stack, &mm->hole_stack);
+		drm_mm_hole_unindex(prev_node);
+	}
 
 	drm_mm_interval_tree_remove(node, &mm->interval_tree);
 	list_del(&node->node_list);
 	node->allocated = 0;
+
+	/* The hole of prev_node now extends over the removed node. */
+	drm_mm_hole_index(prev_node);
 }
 EXPORT_SYMBOL(drm_mm_remove_node);
 
@@ -501,48 +621,208 @@ static int check_free_hole(u64 start, u64 end, u64 size, unsigned alignment)
 	return end >= start + size;
 }
 
-static struct drm_mm_node *drm_mm_search_free_generic(const struct drm_mm *mm,
-						      u64 size,
-						      unsigned alignment,
-						      unsigned long color,
-						      enum drm_mm_search_flags flags)
+static bool drm_mm_check_hole(const struct drm_mm *mm,
+			      struct drm_mm_node *entry,
+			      u64 size, unsigned alignment,
+			      unsigned long color,
+			      u64 start, u64 end)
 {
-	struct drm_mm_node *entry;
-	struct drm_mm_node *best;
-	u64 adj_start;
-	u64 adj_end;
-	u64 best_size;
+	u64 adj_start = drm_mm_hole_node_start(entry);
+	u64 adj_end = drm_mm_hole_node_end(entry);
 
-	BUG_ON(mm->scanned_blocks);
+	if (adj_start < start)
+		adj_start = start;
+	if (adj_end > end)
+		adj_end = end;
+	if (adj_end <= adj_start)
+		return false;
 
-	best = NULL;
-	best_size = ~0UL;
+	if (mm->color_adjust) {
+		mm->color_adjust(entry, color, &adj_start, &adj_end);
+		if (adj_end <= adj_start)
+			return false;
+	}
 
-	__drm_mm_for_each_hole(entry, mm, adj_start, adj_end,
-			       flags & DRM_MM_SEARCH_BELOW) {
-		u64 hole_size = adj_end - adj_start;
+	return check_free_hole(adj_start, adj_end, size, alignment);
+}
 
-		if (mm->color_adjust) {
-			mm->color_adjust(entry, color, &adj_start, &adj_end);
-			if (adj_end <= adj_start)
-				continue;
+/* Lowest addressed hole of at least @size in the subtree rooted at @rb. */
+static struct drm_mm_node *drm_mm_hole_subtree_first(struct rb_node *rb,
+						     u64 size)
+{
+	struct drm_mm_node *node;
+
+	while (rb_hole_max(rb) >= size) {
+		if (rb_hole_max(rb->rb_left) >= size) {
+			rb = rb->rb_left;
+			continue;
 		}
 
-		if (!check_free_hole(adj_start, adj_end, size, alignment))
+		node = rb_hole_addr_to_node(rb);
+		if (node->hole_size >= size)
+			return node;
+
+		rb = rb->rb_right;
+	}
+
+	return NULL;
+}
+
+/* Highest addressed hole of at least @size in the subtree rooted at @rb. */
+static struct drm_mm_node *drm_mm_hole_subtree_last(struct rb_node *rb,
+						    u64 size)
+{
+	struct drm_mm_node *node;
+
+	while (rb_hole_max(rb) >= size) {
+		if (rb_hole_max(rb->rb_right) >= size) {
+			rb = rb->rb_right;
 			continue;
+		}
 
-		if (!(flags & DRM_MM_SEARCH_BEST))
-			return entry;
+		node = rb_hole_addr_to_node(rb);
+		if (node->hole_size >= size)
+			return node;
 
-		if (hole_size < best_size) {
-			best = entry;
-			best_size = hole_size;
+		rb = rb->rb_left;
+	}
+
+	return NULL;
+}
+
+/* Next hole of at least @size above the one following @node. */
+static struct drm_mm_node *drm_mm_hole_next(struct drm_mm_node *node, u64 size)
+{
+	struct rb_node *rb = &node->rb_hole_addr;
+	struct rb_node *parent;
+	struct drm_mm_node *next;
+
+	next = drm_mm_hole_subtree_first(rb->rb_right, size);
+	if (next)
+		return next;
+
+	while ((parent = rb_parent(rb))) {
+		if (rb == parent->rb_left) {
+			next = rb_hole_addr_to_node(parent);
+			if (next->hole_size >= size)
+				return next;
+
+			next = drm_mm_hole_subtree_first(parent->rb_right, size);
+			if (next)
+				return next;
+		}
+		rb = parent;
+	}
+
+	return NULL;
+}
+
+/* Next hole of at least @size below the one following @node. */
+static struct drm_mm_node *drm_mm_hole_prev(struct drm_mm_node *node, u64 size)
+{
+	struct rb_node *rb = &node->rb_hole_addr;
+	struct rb_node *parent;
+	struct drm_mm_node *prev;
+
+	prev = drm_mm_hole_subtree_last(rb->rb_left, size);
+	if (prev)
+		return prev;
+
+	while ((parent = rb_parent(rb))) {
+		if (rb == parent->rb_right) {
+			prev = rb_hole_addr_to_node(parent);
+			if (prev->hole_size >= size)
+				return prev;
+
+			prev = drm_mm_hole_subtree_last(parent->rb_left, size);
+			if (prev)
+				return prev;
 		}
+		rb = parent;
+	}
+
+	return NULL;
+}
+
+/* Lowest addressed hole of at least @size which ends above @start. */
+static struct drm_mm_node *drm_mm_hole_first(const struct drm_mm *mm,
+					     u64 start, u64 size)
+{
+	struct rb_node *rb = mm->holes_addr.rb_node;
+	struct drm_mm_node *node, *first = NULL;
+
+	while (rb) {
+		node = rb_hole_addr_to_node(rb);
+		if (HOLE_END(node) > start) {
+			first = node;
+			rb = rb->rb_left;
+		} else
+			rb = rb->rb_right;
+	}
+
+	if (first && first->hole_size < size)
+		first = drm_mm_hole_next(first, size);
+
+	return first;
+}
+
+/* Highest addressed hole of at least @size which starts below @end. */
+static struct drm_mm_node *drm_mm_hole_last(const struct drm_mm *mm,
+					    u64 end, u64 size)
+{
+	struct rb_node *rb = mm->holes_addr.rb_node;
+	struct drm_mm_node *node, *last = NULL;
+
+	while (rb) {
+		node = rb_hole_addr_to_node(rb);
+		if (HOLE_START(node) < end) {
+			last = node;
+			rb = rb->rb_right;
+		} else
+			rb = rb->rb_left;
+	}
+
+	if (last && last->hole_size < size)
+		last = drm_mm_hole_prev(last, size);
+
+	return last;
+}
+
+/* Smallest hole of at least @size. */
+static struct drm_mm_node *drm_mm_hole_smallest(const struct drm_mm *mm,
+						u64 size)
+{
+	struct rb_node *rb = mm->holes_size.rb_node;
+	struct drm_mm_node *node, *best = NULL;
+
+	while (rb) {
+		node = rb_hole_size_to_node(rb);
+		if (node->hole_size >= size) {
+			best = node;
+			rb = rb->rb_left;
+		} else
+			rb = rb->rb_right;
 	}
 
 	return best;
 }
 
+static bool drm_mm_covers_range(const struct drm_mm *mm, u64 start, u64 end)
+{
+	return start <= mm->head_node.start + mm->head_node.size &&
+	       end >= mm->head_node.start;
+}
+
+static struct drm_mm_node *drm_mm_search_free_generic(const struct drm_mm *mm,
+						      u64 size,
+						      unsigned alignment,
+						      unsigned long color,
+						      enum drm_mm_search_flags flags)
+{
+	return drm_mm_search_free_in_range_generic(mm, size, alignment, color,
+						   0, ~(u64)0, flags);
+}
+
 static struct drm_mm_node *drm_mm_search_free_in_range_generic(const struct drm_mm *mm,
 							u64 size,
 							unsigned alignment,
@@ -553,43 +833,77 @@ static struct drm_mm_node *drm_mm_search_free_in_range_generic(const struct drm_
 {
 	struct drm_mm_node *entry;
 	struct drm_mm_node *best;
-	u64 adj_start;
-	u64 adj_end;
-	u64 best_size;
 
 	BUG_ON(mm->scanned_blocks);
 
-	best = NULL;
-	best_size = ~0UL;
-
-	__drm_mm_for_each_hole(entry, mm, adj_start, adj_end,
-			       flags & DRM_MM_SEARCH_BELOW) {
-		u64 hole_size = adj_end - adj_start;
+	if (flags & DRM_MM_SEARCH_BEST) {
+		if (drm_mm_covers_range(mm, start, end)) {
+			for (entry = drm_mm_hole_smallest(mm, size);
+			     entry;
+			     entry = rb_hole_size_to_node(rb_next(&entry->rb_hole_size))) {
+				if (drm_mm_check_hole(mm, entry, size, alignment,
+						      color, start, end))
+					return entry;
+			}
+			return NULL;
+		}
 
-		if (adj_start < start)
-			adj_start = start;
-		if (adj_end > end)
-			adj_end = end;
+		/*
+		 * Only a part of the address space is eligible: walk the
+		 * large enough holes inside the range instead of all large
+		 * enough holes.
+		 */
+		best = NULL;
+		for (entry = drm_mm_hole_first(mm, start, size);
+		     entry && HOLE_START(entry) < end;
+		     entry = drm_mm_hole_next(entry, size)) {
+			if (best && entry->hole_size >= best->hole_size)
+				continue;
 
-		if (mm->color_adjust) {
-			mm->color_adjust(entry, color, &adj_start, &adj_end);
-			if (adj_end <= adj_start)
+			if (!drm_mm_check_hole(mm, entry, size, alignment,
+					       color, start, end))
 				continue;
+
+			best = entry;
+			if (best->hole_size == size)
+				break;
 		}
+		return best;
+	}
 
-		if (!check_free_hole(adj_start, adj_end, size, alignment))
-			continue;
+	if (flags & DRM_MM_SEARCH_BELOW) {
+		for (entry = drm_mm_hole_last(mm, end, size);
+		     entry && HOLE_END(entry) > start;
+		     entry = drm_mm_hole_prev(entry, size)) {
+			if (drm_mm_check_hole(mm, entry, size, alignment,
+					      color, start, end))
+				return entry;
+		}
+		return NULL;
+	}
 
-		if (!(flags & DRM_MM_SEARCH_BEST))
+	/*
+	 * Prefer the most recently freed hole, which keeps allocations
+	 * clustered and makes an insertion right after an eviction scan
+	 * pick up the hole that was just created.
+	 */
+	if (!list_empty(&mm->hole_stack)) {
+		entry = list_entry(mm->hole_stack.next,
+				   struct drm_mm_node, hole_stack);
+		if (drm_mm_check_hole(mm, entry, size, alignment,
+				      color, start, end))
 			return entry;
+	}
 
-		if (hole_size < best_size) {
-			best = entry;
-			best_size = hole_size;
-		}
+	for (entry = drm_mm_hole_first(mm, start, size);
+	     entry && HOLE_START(entry) < end;
+	     entry = drm_mm_hole_next(entry, size)) {
+		if (drm_mm_check_hole(mm, entry, size, alignment,
+				      color, start, end))
+			return entry;
 	}
 
-	return best;
+	return NULL;
 }
 
 /**
@@ -604,14 +918,22 @@ static struct drm_mm_node *drm_mm_search_free_in_range_generic(const struct drm_
 void drm_mm_replace_node(struct drm_mm_node *old, struct drm_mm_node *new)
 {
 	list_replace(&old->node_list, &new->node_list);
-	list_replace(&old->hole_stack, &new->hole_stack);
 	rb_replace_node(&old->rb, &new->rb, &old->mm->interval_tree);
+	if (old->hole_follows) {
+		list_replace(&old->hole_stack, &new->hole_stack);
+		rb_replace_node(&old->rb_hole_size, &new->rb_hole_size,
+				&old->mm->holes_size);
+		rb_replace_node(&old->rb_hole_addr, &new->rb_hole_addr,
+				&old->mm->holes_addr);
+	}
 	new->hole_follows = old->hole_follows;
 	new->mm = old->mm;
 	new->start = old->start;
 	new->size = old->size;
 	new->color = old->color;
 	new->__subtree_last = old->__subtree_last;
+	new->hole_size = old->hole_size;
+	new->subtree_max_hole = old->subtree_max_hole;
 
 	old->allocated = 0;
 	new->allocated = 1;
@@ -641,9 +963,8 @@ EXPORT_SYMBOL(drm_mm_replace_node);
  *
  * Finally the driver evicts all objects selected in the scan. Adding and
  * removing an object is O(1), and since freeing a node is also O(1) the overall
- * complexity is O(scanned_objects). So like the free stack which needs to be
- * walked before a scan operation even begins this is linear in the number of
- * objects. It doesn't seem to hurt badly.
+ * complexity is O(scanned_objects). Unlike the free space search this is
+ * linear in the number of objects. It doesn't seem to hurt badly.
  */
 
 /**
@@ -780,7 +1101,7 @@ EXPORT_SYMBOL(drm_mm_scan_add_block);
  * corrupted.
  *
  * When the scan list is empty, the selected memory nodes can be freed. An
- * immediately following drm_mm_search_free with !DRM_MM_SEARCH_BEST will then
+ * immediately following drm_mm_search_free with DRM_MM_SEARCH_DEFAULT will then
  * return the just freed block (because its at the top of the free_stack list).
  *
  * Returns:
@@ -849,6 +1170,9 @@ void drm_mm_init(struct drm_mm * mm, u64 start, u64 size)
 	list_add_tail(&mm->head_node.hole_stack, &mm->hole_stack);
 
 	mm->interval_tree = RB_ROOT;
+	mm->holes_size = RB_ROOT;
+	mm->holes_addr = RB_ROOT;
+	drm_mm_hole_index(&mm->head_node);
 
 	mm->color_adjust = NULL;
 }
@@ -0,0 +1,765 @@
+#include <sys/cdefs.h>
+__FBSDID("$FreeBSD$");
+
+#include <drm/drmP.h>
+#include <drm/drm_mm.h>
+#include <linux/ktime.h>
+#include <linux/sort.h>
+
+#include <sys/priv.h>
+#include <sys/sysctl.h>
+
+/*
+ * drm_mm allocator benchmark.
+ *
+ * Writing a trace number to the dev.drm.mm_benchmark sysctl replays a
+ * synthetic allocation trace against a private drm_mm, so that allocator
+ * changes can be measured on any machine, with or without a GPU.  Writing 0
+ * runs every trace.  Traces are driven by a pseudo random generator seeded
+ * from dev.drm.mm_benchmark_seed, so a given seed always replays the exact
+ * same sequence of operations.
+ *
+ * Each trace randomly inserts and removes nodes out of a fixed node array.
+ * When an insertion does not fit, an eviction scan over the allocated nodes
+ * is run the same way i915_gem_evict_something() does before retrying.  The
+ * cost of every insertion, removal and eviction scan is recorded and reported
+ * as ns/op percentiles together with the final fragmentation of the range.
+ *
+ * The fuzz trace picks random sizes, alignments, colors and search flags and
+ * checks the allocator invariants after every single operation.
+ *
+ * Recorded traces are replayed by writing them as text to the
+ * dev.drm.mm_benchmark_replay sysctl, one operation per line:
+ *
+ *	size <bytes>
+ *	guard
+ *	insert <id> <size> <alignment> <color> <search flags> <create flags>
+ *	remove <id>
+ *
+ * "size" sets the size of the managed range and "guard" enables the
+ * gtt-color guard pages; both must come before the first operation.  <id>
+ * names one of the DRM_MM_BENCH_NODES node slots, so a recording has to map
+ * the node pointers passed to drm_mm_insert_node_generic() and
+ * drm_mm_remove_node() to slots.  Empty lines and lines starting with '#'
+ * are skipped.  Insertions that do not fit go through the same eviction scan
+ * as the synthetic traces, and the invariants are checked once the whole
+ * trace has been replayed.
+ *
+ * This runs inside drm.ko rather than as a userspace program: the tree has
+ * no userspace build, and the linuxkpi shims drm_mm.c is compiled against
+ * are kernel only.  Loading drm.ko needs no GPU.  It is only built when
+ * DRM_MM_BENCHMARK is defined, e.g. "make DRM_MM_BENCHMARK=1" in drm/, and
+ * the sysctls are restricted to root outside of jails.
+ */
+
+SYSCTL_DECL(_dev_drm);
+
+#define DRM_MM_BENCH_NODES	8192
+#define DRM_MM_BENCH_OPS	(16 * DRM_MM_BENCH_NODES)
+#define DRM_MM_BENCH_FUZZ_OPS	(DRM_MM_BENCH_NODES / 2)
+/* Largest recorded trace accepted by dev.drm.mm_benchmark_replay */
+#define DRM_MM_BENCH_REPLAY_MAX	(16 << 20)
+
+struct drm_mm_bench_trace {
+	const char *name;
+	u64 mm_size;
+	u64 min_size;
+	u64 max_size;
+	unsigned alignment;
+	unsigned long colors;
+	enum drm_mm_search_flags sflags;
+	enum drm_mm_allocator_flags aflags;
+	bool fuzz;
+};
+
+static const struct drm_mm_bench_trace drm_mm_bench_traces[] = {
+	/* 4K-aligned objects in a 4GiB GTT */
+	{ "gtt", 1ULL << 32, PAGE_SIZE, 1 << 20, 0, 0,
+	  DRM_MM_SEARCH_DEFAULT, DRM_MM_CREATE_DEFAULT, false },
+	/* Same, with guard pages between differently colored nodes */
+	{ "gtt-color", 1ULL << 32, PAGE_SIZE, 1 << 20, 0, 3,
+	  DRM_MM_SEARCH_DEFAULT, DRM_MM_CREATE_DEFAULT, false },
+	/* Large, large-aligned objects in 2GiB of VRAM */
+	{ "vram", 1ULL << 31, 64 << 10, 64 << 20, 1 << 21, 0,
+	  DRM_MM_SEARCH_BEST, DRM_MM_CREATE_DEFAULT, false },
+	/* VRAM filled from the top */
+	{ "vram-topdown", 1ULL << 31, 64 << 10, 64 << 20, 1 << 21, 0,
+	  DRM_MM_SEARCH_BELOW, DRM_MM_CREATE_TOP, false },
+	{ "fuzz", 1ULL << 30, PAGE_SIZE, 4 << 20, 0, 4,
+	  DRM_MM_SEARCH_DEFAULT, DRM_MM_CREATE_DEFAULT, true },
+};
+
+struct drm_mm_bench_op {
+	u64 size;
+	unsigned id;
+	unsigned alignment;
+	unsigned long color;
+	enum drm_mm_search_flags sflags;
+	enum drm_mm_allocator_flags aflags;
+	bool insert;
+};
+
+struct drm_mm_bench_stats {
+	u64 *ns;
+	unsigned count;
+};
+
+struct drm_mm_bench {
+	const struct drm_mm_bench_trace *trace;
+	struct drm_mm mm;
+	struct drm_mm_node *nodes;
+	unsigned *scanned;
+	u64 rng;
+
+	struct drm_mm_bench_stats insert;
+	struct drm_mm_bench_stats remove;
+	struct drm_mm_bench_stats evict;
+	unsigned evicted;
+	unsigned failed;
+};
+
+static u64 drm_mm_benchmark_seed = 0x2545f4914f6cdd1dULL;
+SYSCTL_UQUAD(_dev_drm, OID_AUTO, mm_benchmark_seed, CTLFLAG_RWTUN,
+	     &drm_mm_benchmark_seed, 0, "drm_mm benchmark random seed");
+
+static u64 drm_mm_bench_rand(struct drm_mm_bench *bench)
+{
+	/* xorshift64 */
+	bench->rng ^= bench->rng << 13;
+	bench->rng ^= bench->rng >> 7;
+	bench->rng ^= bench->rng << 17;
+	return bench->rng;
+}
+
+static void drm_mm_bench_color_adjust(struct drm_mm_node *node,
+				      unsigned long color,
+				      u64 *start, u64 *end)
+{
+	if (node->allocated && node->color != color)
+		*start += PAGE_SIZE;
+
+	node = list_next_entry(node, node_list);
+	if (node->allocated && node->color != color)
+		*end -= PAGE_SIZE;
+}
+
+static u64 drm_mm_bench_size(struct drm_mm_bench *bench)
+{
+	const struct drm_mm_bench_trace *trace = bench->trace;
+	unsigned order = ilog2(trace->max_size / trace->min_size);
+	u64 size;
+
+	/* Log-uniform: as many small objects per size class as large ones. */
+	size = trace->min_size << (drm_mm_bench_rand(bench) % (order + 1));
+	size += (drm_mm_bench_rand(bench) % size) & ~(u64)(PAGE_SIZE - 1);
+
+	return min(size, trace->max_size);
+}
+
+static void drm_mm_bench_record(struct drm_mm_bench_stats *stats, u64 ns)
+{
+	stats->ns[stats->count++] = ns;
+}
+
+static u64 drm_mm_bench_hole_max(struct rb_node *rb)
+{
+	return rb ? rb_entry(rb, struct drm_mm_node,
+			     rb_hole_addr)->subtree_max_hole : 0;
+}
+
+/* The augmented value as it must be: the largest hole of the subtree. */
+static u64 drm_mm_bench_subtree_max(struct drm_mm_node *node)
+{
+	u64 hole_max = node->hole_size;
+
+	hole_max = max(hole_max,
+		       drm_mm_bench_hole_max(node->rb_hole_addr.rb_left));
+	hole_max = max(hole_max,
+		       drm_mm_bench_hole_max(node->rb_hole_addr.rb_right));
+
+	return hole_max;
+}
+
+static int drm_mm_bench_check(struct drm_mm_bench *bench)
+{
+	struct drm_mm *mm = &bench->mm;
+	struct drm_mm_node *node, *prev = &mm->head_node;
+	struct rb_node *rb;
+	u64 hole_start, hole_end;
+	unsigned holes = 0, indexed = 0;
+
+	drm_mm_for_each_node(node, mm) {
+		if (node->start < __drm_mm_hole_node_start(prev) ||
+		    node->size == 0 || !node->allocated) {
+			DRM_ERROR("node %#llx+%#llx out of order\n",
+				  node->start, node->size);
+			return -EINVAL;
+		}
+		prev = node;
+	}
+
+	drm_mm_for_each_hole(node, mm, hole_start, hole_end) {
+		if (hole_end <= hole_start ||
+		    node->hole_size != hole_end - hole_start) {
+			DRM_ERROR("hole %#llx-%#llx has size %#llx\n",
+				  hole_start, hole_end, node->hole_size);
+			return -EINVAL;
+		}
+		holes++;
+	}
+
+	prev = NULL;
+	for (rb = rb_first(&mm->holes_size); rb; rb = rb_next(rb)) {
+		node = rb_entry(rb, struct drm_mm_node, rb_hole_size);
+		if (prev && node->hole_size < prev->hole_size) {
+			DRM_ERROR("hole %#llx+%#llx out of size order\n",
+				  __drm_mm_hole_node_start(node),
+				  node->hole_size);
+			return -EINVAL;
+		}
+		prev = node;
+		indexed++;
+	}
+	if (indexed != holes) {
+		DRM_ERROR("%u holes, %u indexed by size\n", holes, indexed);
+		return -EINVAL;
+	}
+
+	indexed = 0;
+	prev = NULL;
+	for (rb = rb_first(&mm->holes_addr); rb; rb = rb_next(rb)) {
+		node = rb_entry(rb, struct drm_mm_node, rb_hole_addr);
+		if (prev && __drm_mm_hole_node_start(node) <=
+		    __drm_mm_hole_node_start(prev)) {
+			DRM_ERROR("hole %#llx+%#llx out of address order\n",
+				  __drm_mm_hole_node_start(node),
+				  node->hole_size);
+			return -EINVAL;
+		}
+		if (node->subtree_max_hole !=
+		    drm_mm_bench_subtree_max(node)) {
+			DRM_ERROR("hole %#llx+%#llx subtree max %#llx, expected %#llx\n",
+				  __drm_mm_hole_node_start(node),
+				  node->hole_size, node->subtree_max_hole,
+				  drm_mm_bench_subtree_max(node));
+			return -EINVAL;
+		}
+		prev = node;
+		indexed++;
+	}
+	if (indexed != holes) {
+		DRM_ERROR("%u holes, %u indexed by address\n", holes, indexed);
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+/*
+ * Make room for @size by scanning the allocated nodes in array order starting
+ * at a random one, then evict the nodes overlapping the hole that was found.
+ */
+static bool drm_mm_bench_evict(struct drm_mm_bench *bench, u64 size,
+			       unsigned alignment, unsigned long color)
+{
+	struct drm_mm_node *node;
+	unsigned first, i, n = 0;
+	bool found = false;
+	u64 t0;
+
+	t0 = ktime_get_raw_ns();
+	drm_mm_init_scan(&bench->mm, size, alignment, color);
+	first = drm_mm_bench_rand(bench) % DRM_MM_BENCH_NODES;
+	for (i = 0; i < DRM_MM_BENCH_NODES && !found; i++) {
+		node = &bench->nodes[(first + i) % DRM_MM_BENCH_NODES];
+		if (!drm_mm_node_allocated(node))
+			continue;
+
+		bench->scanned[n++] = (first + i) % DRM_MM_BENCH_NODES;
+		found = drm_mm_scan_add_block(node);
+	}
+
+	/* Nodes must leave the scan list in the reverse order they entered. */
+	i = n;
+	while (i--) {
+		node = &bench->nodes[bench->scanned[i]];
+		if (!drm_mm_scan_remove_block(node) || !found)
+			bench->scanned[i] = DRM_MM_BENCH_NODES;
+	}
+	drm_mm_bench_record(&bench->evict, ktime_get_raw_ns() - t0);
+
+	for (i = 0; i < n; i++) {
+		if (bench->scanned[i] == DRM_MM_BENCH_NODES)
+			continue;
+
+		drm_mm_remove_node(&bench->nodes[bench->scanned[i]]);
+		bench->evicted++;
+	}
+
+	return found;
+}
+
+static int drm_mm_bench_insert_node(struct drm_mm_bench *bench,
+				    struct drm_mm_node *node, u64 size,
+				    unsigned alignment, unsigned long color,
+				    enum drm_mm_search_flags sflags,
+				    enum drm_mm_allocator_flags aflags)
+{
+	const struct drm_mm_bench_trace *trace = bench->trace;
+	u64 t0;
+	int ret;
+
+	memset(node, 0, sizeof(*node));
+	t0 = ktime_get_raw_ns();
+	ret = drm_mm_insert_node_generic(&bench->mm, node, size, alignment,
+					 color, sflags, aflags);
+	drm_mm_bench_record(&bench->insert, ktime_get_raw_ns() - t0);
+	if (ret != -ENOSPC)
+		return ret;
+
+	if (!drm_mm_bench_evict(bench, size, alignment, color)) {
+		bench->failed++;
+		return 0;
+	}
+
+	if (trace->fuzz) {
+		ret = drm_mm_bench_check(bench);
+		if (ret)
+			return ret;
+	}
+
+	/* The hole just created is on top of the hole stack. */
+	t0 = ktime_get_raw_ns();
+	ret = drm_mm_insert_node_generic(&bench->mm, node, size, alignment,
+					 color, DRM_MM_SEARCH_DEFAULT, aflags);
+	drm_mm_bench_record(&bench->insert, ktime_get_raw_ns() - t0);
+	if (ret) {
+		DRM_ERROR("%s: insertion failed after eviction: %d\n",
+			  trace->name, ret);
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+static int drm_mm_bench_insert(struct drm_mm_bench *bench,
+			       struct drm_mm_node *node)
+{
+	const struct drm_mm_bench_trace *trace = bench->trace;
+	enum drm_mm_search_flags sflags = trace->sflags;
+	enum drm_mm_allocator_flags aflags = trace->aflags;
+	unsigned alignment = trace->alignment;
+	unsigned long color = 0;
+	u64 size;
+
+	size = drm_mm_bench_size(bench);
+	if (trace->colors)
+		color = drm_mm_bench_rand(bench) % trace->colors;
+	if (trace->fuzz) {
+		alignment = (drm_mm_bench_rand(bench) % 4) ?
+			0 : PAGE_SIZE << (drm_mm_bench_rand(bench) % 9);
+		sflags = drm_mm_bench_rand(bench) &
+			(DRM_MM_SEARCH_BEST | DRM_MM_SEARCH_BELOW);
+		aflags = (sflags & DRM_MM_SEARCH_BELOW) ?
+			DRM_MM_CREATE_TOP : DRM_MM_CREATE_DEFAULT;
+	}
+
+	return drm_mm_bench_insert_node(bench, node, size, alignment, color,
+					sflags, aflags);
+}
+
+static int drm_mm_bench_cmp(const void *a, const void *b)
+{
+	u64 x = *(const u64 *)a, y = *(const u64 *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static void drm_mm_bench_report(const char *trace, const char *op,
+				struct drm_mm_bench_stats *stats)
+{
+	u64 total = 0;
+	unsigned i;
+
+	if (!stats->count)
+		return;
+
+	sort(stats->ns, stats->count, sizeof(*stats->ns),
+	     drm_mm_bench_cmp, NULL);
+	for (i = 0; i < stats->count; i++)
+		total += stats->ns[i];
+
+	DRM_INFO("drm_mm %s: %u %s, ns/op mean %llu p50 %llu p90 %llu p99 %llu max %llu\n",
+		 trace, stats->count, op, div_u64(total, stats->count),
+		 stats->ns[stats->count / 2],
+		 stats->ns[stats->count * 9 / 10],
+		 stats->ns[stats->count * 99 / 100],
+		 stats->ns[stats->count - 1]);
+}
+
+static void drm_mm_bench_report_fragmentation(struct drm_mm_bench *bench)
+{
+	struct drm_mm_node *node;
+	u64 hole_start, hole_end;
+	u64 free = 0, largest = 0;
+	unsigned holes = 0, nodes = 0;
+
+	drm_mm_for_each_node(node, &bench->mm)
+		nodes++;
+
+	drm_mm_for_each_hole(node, &bench->mm, hole_start, hole_end) {
+		free += hole_end - hole_start;
+		largest = max(largest, hole_end - hole_start);
+		holes++;
+	}
+
+	DRM_INFO("drm_mm %s: %u nodes, %u holes, %llu KiB free, largest hole %llu KiB, fragmentation %llu%%, %u evicted, %u failed\n",
+		 bench->trace->name, nodes, holes, free >> 10, largest >> 10,
+		 free ? 100 - div64_u64(largest * 100, free) : 0,
+		 bench->evicted, bench->failed);
+}
+
+static struct drm_mm_bench *
+drm_mm_bench_create(const struct drm_mm_bench_trace *trace, unsigned ops)
+{
+	struct drm_mm_bench *bench;
+
+	bench = kzalloc(sizeof(*bench), GFP_KERNEL);
+	if (!bench)
+		return NULL;
+
+	bench->trace = trace;
+	bench->rng = drm_mm_benchmark_seed | 1;
+	bench->nodes = drm_calloc_large(DRM_MM_BENCH_NODES,
+					sizeof(*bench->nodes));
+	bench->scanned = drm_malloc_ab(DRM_MM_BENCH_NODES,
+				       sizeof(*bench->scanned));
+	/* Every operation may record an eviction scan and a second insert. */
+	bench->insert.ns = drm_malloc_ab(2 * ops, sizeof(u64));
+	bench->remove.ns = drm_malloc_ab(ops, sizeof(u64));
+	bench->evict.ns = drm_malloc_ab(ops, sizeof(u64));
+	if (!bench->nodes || !bench->scanned || !bench->insert.ns ||
+	    !bench->remove.ns || !bench->evict.ns) {
+		drm_free_large(bench->evict.ns);
+		drm_free_large(bench->remove.ns);
+		drm_free_large(bench->insert.ns);
+		drm_free_large(bench->scanned);
+		drm_free_large(bench->nodes);
+		kfree(bench);
+		return NULL;
+	}
+
+	drm_mm_init(&bench->mm, 0, trace->mm_size);
+	if (trace->colors)
+		bench->mm.color_adjust = drm_mm_bench_color_adjust;
+
+	return bench;
+}
+
+static void drm_mm_bench_remove(struct drm_mm_bench *bench,
+				struct drm_mm_node *node)
+{
+	u64 t0;
+
+	t0 = ktime_get_raw_ns();
+	drm_mm_remove_node(node);
+	drm_mm_bench_record(&bench->remove, ktime_get_raw_ns() - t0);
+}
+
+static void drm_mm_bench_destroy(struct drm_mm_bench *bench)
+{
+	const struct drm_mm_bench_trace *trace = bench->trace;
+	unsigned i;
+
+	drm_mm_bench_report(trace->name, "inserts", &bench->insert);
+	drm_mm_bench_report(trace->name, "removals", &bench->remove);
+	drm_mm_bench_report(trace->name, "eviction scans", &bench->evict);
+	drm_mm_bench_report_fragmentation(bench);
+
+	for (i = 0; i < DRM_MM_BENCH_NODES; i++) {
+		if (drm_mm_node_allocated(&bench->nodes[i]))
+			drm_mm_remove_node(&bench->nodes[i]);
+	}
+	drm_mm_takedown(&bench->mm);
+
+	drm_free_large(bench->evict.ns);
+	drm_free_large(bench->remove.ns);
+	drm_free_large(bench->insert.ns);
+	drm_free_large(bench->scanned);
+	drm_free_large(bench->nodes);
+	kfree(bench);
+}
+
+static int drm_mm_bench_run(const struct drm_mm_bench_trace *trace)
+{
+	struct drm_mm_bench *bench;
+	struct drm_mm_node *node;
+	unsigned i, ops;
+	int ret = 0;
+
+	ops = trace->fuzz ? DRM_MM_BENCH_FUZZ_OPS : DRM_MM_BENCH_OPS;
+
+	bench = drm_mm_bench_create(trace, ops);
+	if (!bench)
+		return -ENOMEM;
+
+	for (i = 0; i < ops; i++) {
+		node = &bench->nodes[drm_mm_bench_rand(bench) %
+				     DRM_MM_BENCH_NODES];
+		if (drm_mm_node_allocated(node)) {
+			drm_mm_bench_remove(bench, node);
+			ret = 0;
+		} else
+			ret = drm_mm_bench_insert(bench, node);
+
+		if (!ret && trace->fuzz)
+			ret = drm_mm_bench_check(bench);
+		if (ret) {
+			DRM_ERROR("drm_mm %s: failed at operation %u: %d\n",
+				  trace->name, i, ret);
+			break;
+		}
+	}
+
+	drm_mm_bench_destroy(bench);
+	return ret;
+}
+
+static char *drm_mm_bench_token(char **p)
+{
+	char *tok;
+
+	while (**p == ' ' || **p == '\t')
+		(*p)++;
+	tok = *p;
+	while (**p != '\0' && **p != ' ' && **p != '\t')
+		(*p)++;
+	if (**p != '\0')
+		*(*p)++ = '\0';
+
+	return *tok != '\0' ? tok : NULL;
+}
+
+static int drm_mm_bench_number(char **p, u64 *val)
+{
+	char *tok, *end;
+
+	tok = drm_mm_bench_token(p);
+	if (!tok)
+		return -EINVAL;
+
+	*val = strtouq(tok, &end, 0);
+	return *end == '\0' ? 0 : -EINVAL;
+}
+
+/*
+ * Parse a recorded trace, see the format at the top of this file.  @buf is
+ * modified.  Returns the number of operations or a negative error code.
+ */
+static int drm_mm_bench_parse(char *buf, struct drm_mm_bench_trace *trace,
+			      struct drm_mm_bench_op **opsp)
+{
+	struct drm_mm_bench_op *ops, *op;
+	unsigned line = 0, n = 0, max_ops = 0;
+	char *p, *next, *cmd, *c;
+	u64 val[6];
+	int i, nargs;
+
+	/* Every operation takes a line of its own. */
+	for (c = buf; *c != '\0'; c++)
+		max_ops += *c == '\n';
+	ops = drm_malloc_ab(max_ops + 1, sizeof(*ops));
+	if (!ops)
+		return -ENOMEM;
+
+	for (p = buf; p; p = next) {
+		next = strchr(p, '\n');
+		if (next)
+			*next++ = '\0';
+		line++;
+
+		cmd = drm_mm_bench_token(&p);
+		if (!cmd || *cmd == '#')
+			continue;
+
+		if (!strcmp(cmd, "insert"))
+			nargs = 6;
+		else if (!strcmp(cmd, "remove"))
+			nargs = 1;
+		else if (!strcmp(cmd, "size") && !n)
+			nargs = 1;
+		else if (!strcmp(cmd, "guard") && !n)
+			nargs = 0;
+		else
+			goto err;
+
+		for (i = 0; i < nargs; i++)
+			if (drm_mm_bench_number(&p, &val[i]))
+				goto err;
+		if (drm_mm_bench_token(&p))
+			goto err;
+
+		if (!strcmp(cmd, "size")) {
+			if (!val[0])
+				goto err;
+			trace->mm_size = val[0];
+			continue;
+		}
+		if (!strcmp(cmd, "guard")) {
+			trace->colors = 1;
+			continue;
+		}
+
+		if (val[0] >= DRM_MM_BENCH_NODES)
+			goto err;
+
+		op = &ops[n++];
+		memset(op, 0, sizeof(*op));
+		op->id = val[0];
+		op->insert = nargs == 6;
+		if (op->insert) {
+			if (!val[1] || val[2] > UINT_MAX)
+				goto err;
+			if (val[4] & ~(u64)(DRM_MM_SEARCH_BEST |
+					    DRM_MM_SEARCH_BELOW))
+				goto err;
+			if (val[5] & ~(u64)DRM_MM_CREATE_TOP)
+				goto err;
+			op->size = val[1];
+			op->alignment = val[2];
+			op->color = val[3];
+			op->sflags = val[4];
+			op->aflags = val[5];
+		}
+	}
+
+	*opsp = ops;
+	return n;
+
+err:
+	DRM_ERROR("drm_mm replay: invalid trace at line %u\n", line);
+	drm_free_large(ops);
+	return -EINVAL;
+}
+
+static int drm_mm_bench_replay(char *buf)
+{
+	struct drm_mm_bench_trace trace = {
+		.name = "replay",
+		.mm_size = 1ULL << 32,
+		.sflags = DRM_MM_SEARCH_DEFAULT,
+		.aflags = DRM_MM_CREATE_DEFAULT,
+	};
+	struct drm_mm_bench *bench;
+	struct drm_mm_bench_op *ops, *op;
+	struct drm_mm_node *node;
+	int i, n, ret = 0;
+
+	n = drm_mm_bench_parse(buf, &trace, &ops);
+	if (n < 0)
+		return n;
+
+	bench = drm_mm_bench_create(&trace, max(n, 1));
+	if (!bench) {
+		drm_free_large(ops);
+		return -ENOMEM;
+	}
+
+	for (i = 0; i < n; i++) {
+		op = &ops[i];
+		node = &bench->nodes[op->id];
+		if (!op->insert) {
+			/* It may have been evicted, or never fit at all. */
+			if (drm_mm_node_allocated(node))
+				drm_mm_bench_remove(bench, node);
+			continue;
+		}
+
+		if (drm_mm_node_allocated(node)) {
+			DRM_ERROR("drm_mm replay: node %u is in use at operation %d\n",
+				  op->id, i);
+			ret = -EINVAL;
+			break;
+		}
+
+		ret = drm_mm_bench_insert_node(bench, node, op->size,
+					       op->alignment, op->color,
+					       op->sflags, op->aflags);
+		if (ret) {
+			DRM_ERROR("drm_mm replay: failed at operation %d: %d\n",
+				  i, ret);
+			break;
+		}
+	}
+
+	if (!ret)
+		ret = drm_mm_bench_check(bench);
+
+	drm_mm_bench_destroy(bench);
+	drm_free_large(ops);
+	return ret;
+}
+
+static int
+drm_mm_benchmark_sysctl(SYSCTL_HANDLER_ARGS)
+{
+	int error, i, trace;
+
+	trace = -1;
+	error = sysctl_handle_int(oidp, &trace, 0, req);
+	if (error || req->newptr == NULL)
+		return (error);
+	error = priv_check(req->td, PRIV_DRIVER);
+	if (error)
+		return (error);
+
+	if (trace < 0 || trace > (int)ARRAY_SIZE(drm_mm_bench_traces))
+		return (EINVAL);
+
+	for (i = 0; i < ARRAY_SIZE(drm_mm_bench_traces); i++) {
+		if (trace && trace != i + 1)
+			continue;
+
+		error = drm_mm_bench_run(&drm_mm_bench_traces[i]);
+		if (error)
+			return (-error);
+	}
+
+	return (0);
+}
+SYSCTL_PROC(_dev_drm, OID_AUTO, mm_benchmark,
+	    CTLTYPE_INT | CTLFLAG_RW | CTLFLAG_MPSAFE, NULL, 0,
+	    drm_mm_benchmark_sysctl, "I",
+	    "Run drm_mm allocator trace (1 gtt, 2 gtt-color, 3 vram, "
+	    "4 vram-topdown, 5 fuzz, 0 all)");
+
+static int
+drm_mm_benchmark_replay_sysctl(SYSCTL_HANDLER_ARGS)
+{
+	char *buf;
+	int error;
+
+	if (req->newptr == NULL)
+		return (SYSCTL_OUT(req, "", 1));
+	error = priv_check(req->td, PRIV_DRIVER);
+	if (error)
+		return (error);
+	if (req->newlen == 0 || req->newlen > DRM_MM_BENCH_REPLAY_MAX)
+		return (EINVAL);
+
+	buf = drm_malloc_ab(req->newlen + 1, 1);
+	if (buf == NULL)
+		return (ENOMEM);
+	error = SYSCTL_IN(req, buf, req->newlen);
+	if (error == 0) {
+		buf[req->newlen] = '\0';
+		error = -drm_mm_bench_replay(buf);
+	}
+	drm_free_large(buf);
+
+	return (error);
+}
+SYSCTL_PROC(_dev_drm, OID_AUTO, mm_benchmark_replay,
+	    CTLTYPE_STRING | CTLFLAG_RW | CTLFLAG_MPSAFE, NULL, 0,
+	    drm_mm_benchmark_replay_sysctl, "A",
+	    "Replay a recorded drm_mm allocation trace");
@@ -0,0 +1,632 @@
+/*
+ * Copyright 2017 Red Hat
+ * Parts ported from amdgpu (fence wait code).
+ * Copyright 2016 Advanced Micro Devices, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+/**
+ * DOC: Overview
+ *
+ * DRM synchronisation objects (syncobj) are a persistent objects,
+ * that contain an optional fence. The fence can be updated with a new
+ * fence, or be NULL.
+ *
+ * syncobj's can be waited upon, where it will wait for the underlying
+ * fence.
+ *
+ * syncobj's can be export to fd's and back, these fd's are opaque and
+ * have no other use case, except passing the syncobj between processes.
+ *
+ * Their primary use-case is to implement Vulkan fences and semaphores.
+ *
+ * syncobj have a kref reference count, but also have an optional file.
+ * The file is only created once the syncobj is exported.
+ * The file takes a reference on the kref.
+ */
+
+#include <sys/param.h>
+#include <sys/fcntl.h>
+#include <sys/file.h>
+#include <sys/capsicum.h>
+
+#include <drm/drmP.h>
+#include <linux/file.h>
+#include <linux/fence.h>
+#include <linux/sched.h>
+
+#include <drm/drm_syncobj.h>
+
+#include "drm_internal.h"
+
+#undef file
+#undef fget
+
+/* XXX */
+#define	DTYPE_SYNCOBJ	101
+
+/**
+ * drm_syncobj_find - lookup and reference a sync object.
+ * @file_private: drm file private pointer
+ * @handle: sync object handle to lookup.
+ *
+ * Returns a reference to the syncobj pointed to by handle or NULL.
+ */
+struct drm_syncobj *drm_syncobj_find(struct drm_file *file_private,
+				     u32 handle)
+{
+	struct drm_syncobj *syncobj;
+
+	spin_lock(&file_private->syncobj_table_lock);
+
+	/* Check if we currently have a reference on the object */
+	syncobj = idr_find(&file_private->syncobj_idr, handle);
+	if (syncobj)
+		drm_syncobj_get(syncobj);
+
+	spin_unlock(&file_private->syncobj_table_lock);
+
+	return syncobj;
+}
+EXPORT_SYMBOL(drm_syncobj_find);
+
+/**
+ * drm_syncobj_fence_get - get a reference to the fence in a sync object
+ * @syncobj: sync object.
+ *
+ * Returns a new reference to the fence bound to @syncobj, or NULL.
+ */
+struct fence *drm_syncobj_fence_get(struct drm_syncobj *syncobj)
+{
+	struct fence *fence;
+
+	spin_lock(&syncobj->lock);
+	fence = fence_get(syncobj->fence);
+	spin_unlock(&syncobj->lock);
+
+	return fence;
+}
+EXPORT_SYMBOL(drm_syncobj_fence_get);
+
+/**
+ * drm_syncobj_replace_fence - replace fence in a sync object.
+ * @syncobj: Sync object to replace fence in
+ * @fence: fence to install in sync file.
+ *
+ * This replaces the fence on a sync object. The sync object takes its own
+ * reference on @fence; @fence may be NULL to reset the object.
+ */
+void drm_syncobj_replace_fence(struct drm_syncobj *syncobj,
+			       struct fence *fence)
+{
+	struct fence *old_fence;
+
+	if (fence)
+		fence_get(fence);
+
+	spin_lock(&syncobj->lock);
+	old_fence = syncobj->fence;
+	syncobj->fence = fence;
+	spin_unlock(&syncobj->lock);
+
+	fence_put(old_fence);
+}
+EXPORT_SYMBOL(drm_syncobj_replace_fence);
+
+/**
+ * drm_syncobj_find_fence - lookup and reference the fence in a sync object
+ * @file_private: drm file private pointer
+ * @handle: sync object handle to lookup.
+ * @fence: out parameter for the fence
+ *
+ * Returns 0 on success with a new fence reference in @fence, -ENOENT if the
+ * handle does not exist and -EINVAL if no fence is bound to the object.
+ */
+int drm_syncobj_find_fence(struct drm_file *file_private,
+			   u32 handle,
+			   struct fence **fence)
+{
+	struct drm_syncobj *syncobj = drm_syncobj_find(file_private, handle);
+	int ret = 0;
+
+	if (!syncobj)
+		return -ENOENT;
+
+	*fence = drm_syncobj_fence_get(syncobj);
+	if (!*fence)
+		ret = -EINVAL;
+
+	drm_syncobj_put(syncobj);
+	return ret;
+}
+EXPORT_SYMBOL(drm_syncobj_find_fence);
+
+/**
+ * drm_syncobj_free - free a sync object.
+ * @kref: kref to free.
+ *
+ * Only to be called from kref_put in drm_syncobj_put.
+ */
+void drm_syncobj_free(struct kref *kref)
+{
+	struct drm_syncobj *syncobj = container_of(kref,
+						   struct drm_syncobj,
+						   refcount);
+
+	fence_put(syncobj->fence);
+	kfree(syncobj);
+}
+EXPORT_SYMBOL(drm_syncobj_free);
+
+/*
+ * Objects created with DRM_SYNCOBJ_CREATE_SIGNALED are bound to an already
+ * signaled fence so that waiting on them returns immediately.
+ */
+static const char *drm_syncobj_stub_fence_get_name(struct fence *fence)
+{
+	return "syncobj";
+}
+
+static bool drm_syncobj_stub_fence_enable_signaling(struct fence *fence)
+{
+	return !fence_is_signaled(fence);
+}
+
+static const struct fence_ops drm_syncobj_stub_fence_ops = {
+	.get_driver_name = drm_syncobj_stub_fence_get_name,
+	.get_timeline_name = drm_syncobj_stub_fence_get_name,
+	.enable_signaling = drm_syncobj_stub_fence_enable_signaling,
+	.wait = fence_default_wait,
+};
+
+struct drm_syncobj_stub_fence {
+	struct fence base;
+	spinlock_t lock;
+};
+
+static int drm_syncobj_assign_null_fence(struct drm_syncobj *syncobj)
+{
+	struct drm_syncobj_stub_fence *fence;
+
+	fence = kzalloc(sizeof(*fence), GFP_KERNEL);
+	if (fence == NULL)
+		return -ENOMEM;
+
+	spin_lock_init(&fence->lock);
+	fence_init(&fence->base, &drm_syncobj_stub_fence_ops, &fence->lock,
+		   fence_context_alloc(1), 1);
+	fence_signal(&fence->base);
+
+	drm_syncobj_replace_fence(syncobj, &fence->base);
+	fence_put(&fence->base);
+
+	return 0;
+}
+
+static int drm_syncobj_create(struct drm_file *file_private,
+			      u32 *handle, uint32_t flags)
+{
+	int ret;
+	struct drm_syncobj *syncobj;
+
+	syncobj = kzalloc(sizeof(struct drm_syncobj), GFP_KERNEL);
+	if (!syncobj)
+		return -ENOMEM;
+
+	kref_init(&syncobj->refcount);
+	spin_lock_init(&syncobj->lock);
+
+	if (flags & DRM_SYNCOBJ_CREATE_SIGNALED) {
+		ret = drm_syncobj_assign_null_fence(syncobj);
+		if (ret) {
+			drm_syncobj_put(syncobj);
+			return ret;
+		}
+	}
+
+	idr_preload(GFP_KERNEL);
+	spin_lock(&file_private->syncobj_table_lock);
+	ret = idr_alloc(&file_private->syncobj_idr, syncobj, 1, 0, GFP_NOWAIT);
+	spin_unlock(&file_private->syncobj_table_lock);
+
+	idr_preload_end();
+
+	if (ret < 0) {
+		drm_syncobj_put(syncobj);
+		return ret;
+	}
+
+	*handle = ret;
+	return 0;
+}
+
+static int drm_syncobj_destroy(struct drm_file *file_private,
+			       u32 handle)
+{
+	struct drm_syncobj *syncobj;
+
+	spin_lock(&file_private->syncobj_table_lock);
+	syncobj = idr_find(&file_private->syncobj_idr, handle);
+	if (syncobj)
+		idr_remove(&file_private->syncobj_idr, handle);
+	spin_unlock(&file_private->syncobj_table_lock);
+
+	if (!syncobj)
+		return -EINVAL;
+
+	drm_syncobj_put(syncobj);
+	return 0;
+}
+
+/*
+ * Exported sync objects are backed by a native file descriptor which holds
+ * a reference on the object until the last descriptor is closed.
+ */
+static fo_close_t drm_syncobj_file_close;
+static fo_stat_t drm_syncobj_file_stat;
+static fo_fill_kinfo_t drm_syncobj_file_fill_kinfo;
+
+static struct fileops drm_syncobj_file_fileops = {
+	.fo_read = invfo_rdwr,
+	.fo_write = invfo_rdwr,
+	.fo_truncate = invfo_truncate,
+	.fo_ioctl = invfo_ioctl,
+	.fo_poll = invfo_poll,
+	.fo_kqfilter = invfo_kqfilter,
+	.fo_stat = drm_syncobj_file_stat,
+	.fo_close = drm_syncobj_file_close,
+	.fo_chmod = invfo_chmod,
+	.fo_chown = invfo_chown,
+	.fo_sendfile = invfo_sendfile,
+	.fo_fill_kinfo = drm_syncobj_file_fill_kinfo,
+	.fo_flags = DFLAG_PASSABLE,
+};
+
+static int
+drm_syncobj_file_close(struct file *fp, struct thread *td)
+{
+	struct drm_syncobj *syncobj = fp->f_data;
+
+	fp->f_ops = &badfileops;
+	fp->f_data = NULL;
+	drm_syncobj_put(syncobj);
+	return (0);
+}
+
+static int
+drm_syncobj_file_stat(struct file *fp, struct stat *sb,
+		      struct ucred *active_cred __unused,
+		      struct thread *td __unused)
+{
+
+	bzero(sb, sizeof(*sb));
+	return (0);
+}
+
+static int
+drm_syncobj_file_fill_kinfo(struct file *fp, struct kinfo_file *kif,
+			    struct filedesc *fdp __unused)
+{
+
+	return (0);
+}
+
+static int drm_syncobj_handle_to_fd(struct drm_file *file_private,
+				    u32 handle, int *p_fd)
+{
+	struct drm_syncobj *syncobj = drm_syncobj_find(file_private, handle);
+	struct file *fp;
+	int ret, fd;
+
+	if (!syncobj)
+		return -EINVAL;
+
+	ret = falloc(curthread, &fp, &fd, O_CLOEXEC);
+	if (ret) {
+		drm_syncobj_put(syncobj);
+		return -ret;
+	}
+
+	/* the file now owns the reference taken by drm_syncobj_find */
+	finit(fp, FREAD | FWRITE, DTYPE_SYNCOBJ, syncobj,
+	      &drm_syncobj_file_fileops);
+	fdrop(fp, curthread);
+
+	*p_fd = fd;
+	return 0;
+}
+
+static int drm_syncobj_fd_to_handle(struct drm_file *file_private,
+				    int fd, u32 *handle)
+{
+	struct drm_syncobj *syncobj;
+	struct file *fp;
+	cap_rights_t rights;
+	int ret;
+
+	CAP_ALL(&rights);
+	ret = fget(curthread, fd, &rights, &fp);
+	if (ret)
+		return -ret;
+
+	if (fp->f_ops != &drm_syncobj_file_fileops) {
+		fdrop(fp, curthread);
+		return -EINVAL;
+	}
+
+	/* take a reference to put in the idr */
+	syncobj = fp->f_data;
+	drm_syncobj_get(syncobj);
+	fdrop(fp, curthread);
+
+	idr_preload(GFP_KERNEL);
+	spin_lock(&file_private->syncobj_table_lock);
+	ret = idr_alloc(&file_private->syncobj_idr, syncobj, 1, 0, GFP_NOWAIT);
+	spin_unlock(&file_private->syncobj_table_lock);
+	idr_preload_end();
+
+	if (ret < 0) {
+		drm_syncobj_put(syncobj);
+		return ret;
+	}
+
+	*handle = ret;
+	return 0;
+}
+
+/**
+ * drm_syncobj_open - initalizes syncobj file-private structures at devnode open time
+ * @file_private: drm file-private structure to set up
+ *
+ * Called at device open time, sets up the structure for handling refcounting
+ * of sync objects.
+ */
+void
+drm_syncobj_open(struct drm_file *file_private)
+{
+	idr_init(&file_private->syncobj_idr);
+	spin_lock_init(&file_private->syncobj_table_lock);
+}
+
+static int
+drm_syncobj_release_handle(int id, void *ptr, void *data)
+{
+	struct drm_syncobj *syncobj = ptr;
+
+	drm_syncobj_put(syncobj);
+	return 0;
+}
+
+/**
+ * drm_syncobj_release - release file-private sync object resources
+ * @file_private: drm file-private structure to clean up
+ *
+ * Called at close time when the filp is going away.
+ *
+ * Releases any remaining references on objects by this filp.
+ */
+void
+drm_syncobj_release(struct drm_file *file_private)
+{
+	idr_for_each(&file_private->syncobj_idr,
+		     &drm_syncobj_release_handle, file_private);
+	idr_destroy(&file_private->syncobj_idr);
+}
+
+int
+drm_syncobj_create_ioctl(struct drm_device *dev, void *data,
+			 struct drm_file *file_private)
+{
+	struct drm_syncobj_create *args = data;
+
+	if (!drm_core_check_feature(dev, DRIVER_SYNCOBJ))
+		return -ENODEV;
+
+	/* no valid flags yet */
+	if (args->flags & ~DRM_SYNCOBJ_CREATE_SIGNALED)
+		return -EINVAL;
+
+	return drm_syncobj_create(file_private,
+				  &args->handle, args->flags);
+}
+
+int
+drm_syncobj_destroy_ioctl(struct drm_device *dev, void *data,
+			  struct drm_file *file_private)
+{
+	struct drm_syncobj_destroy *args = data;
+
+	if (!drm_core_check_feature(dev, DRIVER_SYNCOBJ))
+		return -ENODEV;
+
+	/* make sure padding is empty */
+	if (args->pad)
+		return -EINVAL;
+	return drm_syncobj_destroy(file_private, args->handle);
+}
+
+int
+drm_syncobj_handle_to_fd_ioctl(struct drm_device *dev, void *data,
+				   struct drm_file *file_private)
+{
+	struct drm_syncobj_handle *args = data;
+
+	if (!drm_core_check_feature(dev, DRIVER_SYNCOBJ))
+		return -ENODEV;
+
+	if (args->pad || args->flags)
+		return -EINVAL;
+
+	return drm_syncobj_handle_to_fd(file_private, args->handle,
+					&args->fd);
+}
+
+int
+drm_syncobj_fd_to_handle_ioctl(struct drm_device *dev, void *data,
+				   struct drm_file *file_private)
+{
+	struct drm_syncobj_handle *args = data;
+
+	if (!drm_core_check_feature(dev, DRIVER_SYNCOBJ))
+		return -ENODEV;
+
+	if (args->pad || args->flags)
+		return -EINVAL;
+
+	return drm_syncobj_fd_to_handle(file_private, args->fd,
+					&args->handle);
+}
+
+/**
+ * drm_timeout_abs_to_jiffies - calculate jiffies timeout from absolute value
+ *
+ * @timeout_nsec: timeout nsec component in ns, 0 for poll
+ *
+ * Calculate the timeout in jiffies from an absolute time in ns.
+ */
+static signed long drm_timeout_abs_to_jiffies(int64_t timeout_nsec)
+{
+	ktime_t timeout;
+	u64 timeout_jiffies64;
+
+	/* make 0 timeout means poll - absolute 0 doesn't seem valid */
+	if (timeout_nsec <= 0)
+		return 0;
+
+	timeout = ktime_sub(ns_to_ktime(timeout_nsec), ktime_get());
+	if (ktime_to_ns(timeout) <= 0)
+		return 0;
+
+	timeout_jiffies64 = nsecs_to_jiffies64(ktime_to_ns(timeout));
+	/*  clamp timeout to avoid infinite timeout */
+	if (timeout_jiffies64 >= MAX_SCHEDULE_TIMEOUT - 1)
+		return MAX_SCHEDULE_TIMEOUT - 1;
+
+	return timeout_jiffies64 + 1;
+}
+
+static int drm_syncobj_wait_all_fences(struct drm_device *dev,
+				       struct drm_file *file_private,
+				       struct drm_syncobj_wait *wait,
+				       struct fence **fences)
+{
+	signed long timeout = drm_timeout_abs_to_jiffies(wait->timeout_nsec);
+	signed long ret = 0;
+	uint32_t i;
+
+	for (i = 0; i < wait->count_handles; i++) {
+		ret = fence_wait_timeout(fences[i], true, timeout);
+
+		/* Various fence drivers return errors, so we can't just
+		 * check for a positive remaining timeout. */
+		if (ret < 0)
+			return ret;
+		if (ret == 0)
+			break;
+		timeout = ret;
+	}
+
+	wait->first_signaled = 0;
+	return ret == 0 ? -ETIME : 0;
+}
+
+static int drm_syncobj_wait_any_fence(struct drm_device *dev,
+				      struct drm_file *file_private,
+				      struct drm_syncobj_wait *wait,
+				      struct fence **fences)
+{
+	signed long timeout = drm_timeout_abs_to_jiffies(wait->timeout_nsec);
+	signed long ret = 0;
+	uint32_t first = ~0;
+
+	ret = fence_wait_any_timeout(fences, wait->count_handles, true,
+				     timeout, &first);
+	if (ret < 0)
+		return ret;
+	if (ret == 0)
+		return -ETIME;
+
+	wait->first_signaled = first;
+	return 0;
+}
+
+int
+drm_syncobj_wait_ioctl(struct drm_device *dev, void *data,
+		       struct drm_file *file_private)
+{
+	struct drm_syncobj_wait *args = data;
+	uint32_t *handles;
+	struct fence **fences;
+	int ret = 0;
+	uint32_t i;
+
+	if (!drm_core_check_feature(dev, DRIVER_SYNCOBJ))
+		return -ENODEV;
+
+	if (args->flags & ~DRM_SYNCOBJ_WAIT_FLAGS_WAIT_ALL)
+		return -EINVAL;
+
+	if (args->count_handles == 0)
+		return -EINVAL;
+
+	/* Get the handles from userspace */
+	handles = kmalloc_array(args->count_handles, sizeof(uint32_t),
+				GFP_KERNEL);
+	if (handles == NULL)
+		return -ENOMEM;
+
+	if (copy_from_user(handles,
+			   u64_to_user_ptr(args->handles),
+			   sizeof(uint32_t) * args->count_handles)) {
+		ret = -EFAULT;
+		goto err_free_handles;
+	}
+
+	fences = kcalloc(args->count_handles,
+			 sizeof(struct fence *), GFP_KERNEL);
+	if (!fences) {
+		ret = -ENOMEM;
+		goto err_free_handles;
+	}
+
+	for (i = 0; i < args->count_handles; i++) {
+		ret = drm_syncobj_find_fence(file_private, handles[i],
+					     &fences[i]);
+		if (ret)
+			goto err_free_fence_array;
+	}
+
+	if (args->flags & DRM_SYNCOBJ_WAIT_FLAGS_WAIT_ALL)
+		ret = drm_syncobj_wait_all_fences(dev, file_private,
+						  args, fences);
+	else
+		ret = drm_syncobj_wait_any_fence(dev, file_private,
+						 args, fences);
+err_free_fence_array:
+	for (i = 0; i < args->count_handles; i++)
+		fence_put(fences[i]);
+	kfree(fences);
+err_free_handles:
+	kfree(handles);
+
+	return ret;
+}
@@ -25,6 +25,7 @@
 #include <drm/drmP.h>
 #include <drm/drm_mm.h>
 #include <drm/drm_vma_manager.h>
+#include <linux/hash.h>
 #include <linux/mm.h>
 #include <linux/module.h>
 #include <linux/rbtree.h>
@@ -64,6 +65,14 @@
  * open-file with the offset of the node will fail with -EACCES. To revoke
  * access again, use drm_vma_node_revoke(). However, the caller is responsible
  * for destroying already existing mappings, if required.
+ *
+ * Both the offset lookup and the access check take a reader lock that is shared
+ * by every user of the manager or node. Paths that map many objects (mmap() of
+ * GEM objects by software rasterizers, for instance) can instead use the small
+ * per open-file cache: drm_vma_node_authorize() records a node once access is
+ * granted and drm_vma_offset_cache_lookup_locked() returns it again without
+ * touching the manager or node locks. The cache only holds nodes the file is
+ * still allowed to access, as drm_vma_node_revoke() evicts them.
  */
 
 /**
@@ -248,6 +257,67 @@ void drm_vma_offset_remove(struct drm_vma_offset_manager *mgr,
 }
 EXPORT_SYMBOL(drm_vma_offset_remove);
 
+static inline unsigned int drm_vma_offset_cache_slot(unsigned long start)
+{
+	return hash_long(start, ilog2(DRM_VMA_CACHE_SIZE));
+}
+
+static void drm_vma_offset_cache_evict(struct drm_vma_offset_cache *cache,
+				       struct drm_vma_offset_node *node)
+{
+	unsigned int i;
+
+	/* The node may have moved since it was cached, so check every slot. */
+	spin_lock(&cache->vm_lock);
+	for (i = 0; i < DRM_VMA_CACHE_SIZE; i++) {
+		if (cache->vm_nodes[i] == node)
+			cache->vm_nodes[i] = NULL;
+	}
+	spin_unlock(&cache->vm_lock);
+}
+
+/**
+ * drm_vma_offset_cache_lookup_locked() - Find recently authorized node
+ * @cache: Per open-file cache
+ * @start: Start address for object (page-based)
+ * @pages: Size of object (page-based)
+ *
+ * Look up a node previously recorded with drm_vma_node_authorize(). Only nodes
+ * starting exactly at @start and spanning at least @pages are returned, as
+ * with drm_vma_offset_exact_lookup_locked().
+ *
+ * The cache lock must be held with drm_vma_offset_cache_lock(). The returned
+ * node is guaranteed to exist and to be accessible by the file owning @cache
+ * until the lock is dropped, so this can be used to implement weakly
+ * referenced lookups using kref_get_unless_zero() without taking the manager
+ * lock. On a miss, fall back to drm_vma_offset_lookup_locked().
+ *
+ * RETURNS:
+ * The cached node, or NULL if no suitable node is cached.
+ */
+struct drm_vma_offset_node *drm_vma_offset_cache_lookup_locked(struct drm_vma_offset_cache *cache,
+								unsigned long start,
+								unsigned long pages)
+{
+	struct drm_vma_offset_node *node;
+
+	node = cache->vm_nodes[drm_vma_offset_cache_slot(start)];
+	if (!node)
+		return NULL;
+
+	/*
+	 * drm_vma_offset_remove() may race with us and clear the offset, in
+	 * which case the node simply doesn't match anymore. That is no
+	 * different from a remove right after a locked lookup.
+	 */
+	if (READ_ONCE(node->vm_node.start) != start ||
+	    READ_ONCE(node->vm_node.size) < pages)
+		return NULL;
+
+	return node;
+}
+EXPORT_SYMBOL(drm_vma_offset_cache_lookup_locked);
+
 /**
  * drm_vma_node_allow - Add open-file to list of allowed users
  * @node: Node to modify
@@ -345,6 +415,8 @@ void drm_vma_node_revoke(struct drm_vma_offset_node *node,
 			if (!--entry->vm_count) {
 				rb_erase(&entry->vm_rb, &node->vm_files);
 				kfree(entry);
+				drm_vma_offset_cache_evict(&tag->vma_cache,
+							   node);
 			}
 			break;
 		} else if (tag > entry->vm_tag) {
@@ -395,3 +467,58 @@ bool drm_vma_node_is_allowed(struct drm_vma_offset_node *node,
 	return iter;
 }
 EXPORT_SYMBOL(drm_vma_node_is_allowed);
+
+/**
+ * drm_vma_node_authorize - Check access and cache the node for an open-file
+ * @node: Node to check
+ * @tag: Tag of file to check
+ *
+ * Same as drm_vma_node_is_allowed(), but if access is granted @node is also
+ * recorded in the lookup cache of @tag so that later lookups of the same offset
+ * can use drm_vma_offset_cache_lookup_locked(). All nodes authorized for a
+ * given @tag must belong to the same offset manager, the one used by the
+ * file's device for mmap().
+ *
+ * This is locked against concurrent access internally.
+ *
+ * RETURNS:
+ * true iff @tag is on the list
+ */
+bool drm_vma_node_authorize(struct drm_vma_offset_node *node,
+			    struct drm_file *tag)
+{
+	struct drm_vma_offset_cache *cache = &tag->vma_cache;
+	struct drm_vma_offset_file *entry;
+	struct rb_node *iter;
+	unsigned long start;
+
+	read_lock(&node->vm_lock);
+
+	iter = node->vm_files.rb_node;
+	while (likely(iter)) {
+		entry = rb_entry(iter, struct drm_vma_offset_file, vm_rb);
+		if (tag == entry->vm_tag)
+			break;
+		else if (tag > entry->vm_tag)
+			iter = iter->rb_right;
+		else
+			iter = iter->rb_left;
+	}
+
+	/*
+	 * Insert while still holding node->vm_lock: drm_vma_node_revoke()
+	 * evicts under the write lock, so the cache never keeps a node the file
+	 * lost access to.
+	 */
+	start = READ_ONCE(node->vm_node.start);
+	if (iter && start) {
+		spin_lock(&cache->vm_lock);
+		cache->vm_nodes[drm_vma_offset_cache_slot(start)] = node;
+		spin_unlock(&cache->vm_lock);
+	}
+
+	read_unlock(&node->vm_lock);
+
+	return iter;
+}
+EXPORT_SYMBOL(drm_vma_node_authorize);
@@ -54,6 +54,11 @@ static struct attribute ttm_bo_count = {
 	.mode = S_IRUGO
 };
 
+static struct attribute ttm_bo_vm_faults = {
+	.name = "vm_faults",
+	.mode = S_IRUGO
+};
+
 static inline int ttm_mem_type_from_place(const struct ttm_place *place,
 					  uint32_t *mem_type)
 {
@@ -107,6 +112,23 @@ static ssize_t ttm_bo_global_show(struct kobject *kobj,
 {
 	struct ttm_bo_global *glob =
 		container_of(kobj, struct ttm_bo_global, kobj);
+	ssize_t len;
+	int i;
+
+	if (attr == &ttm_bo_vm_faults) {
+		len = snprintf(buffer, PAGE_SIZE, "%4s %12s %12s %12s\n",
+			       "type", "faults", "pages", "huge");
+		for (i = 0; i < TTM_NUM_MEM_TYPES; ++i)
+			len += snprintf(buffer + len, PAGE_SIZE - len,
+					"%4d %12llu %12llu %12llu\n", i,
+					(unsigned long long)
+					atomic64_read(&glob->vm_faults[i]),
+					(unsigned long long)
+					atomic64_read(&glob->vm_fault_pages[i]),
+					(unsigned long long)
+					atomic64_read(&glob->vm_fault_huge[i]));
+		return len;
+	}
 
 	return snprintf(buffer, PAGE_SIZE, "%lu\n",
 			(unsigned long) atomic_read(&glob->bo_count));
@@ -114,6 +136,7 @@ static ssize_t ttm_bo_global_show(struct kobject *kobj,
 
 static struct attribute *ttm_bo_global_attrs[] = {
 	&ttm_bo_count,
+	&ttm_bo_vm_faults,
 	NULL
 };
 
@@ -1192,6 +1215,8 @@ int ttm_bo_init(struct ttm_bo_device *bdev,
 	}
 	atomic_inc(&bo->glob->bo_count);
 	drm_vma_node_reset(&bo->vma_node);
+	bo->fault_next = 0;
+	bo->fault_window = 0;
 
 	/*
 	 * For ttm_bo_type_device buffers, allocate
@@ -1442,7 +1467,7 @@ int ttm_bo_global_init(struct drm_global_reference *ref)
 	struct ttm_bo_global_ref *bo_ref =
 		container_of(ref, struct ttm_bo_global_ref, ref);
 	struct ttm_bo_global *glob = ref->object;
-	int ret;
+	int ret, i;
 
 	mutex_init(&glob->device_list_mutex);
 	spin_lock_init(&glob->lru_lock);
@@ -1465,6 +1490,11 @@ int ttm_bo_global_init(struct drm_global_reference *ref)
 	}
 
 	atomic_set(&glob->bo_count, 0);
+	for (i = 0; i < TTM_NUM_MEM_TYPES; ++i) {
+		atomic64_set(&glob->vm_faults[i], 0);
+		atomic64_set(&glob->vm_fault_pages[i], 0);
+		atomic64_set(&glob->vm_fault_huge[i], 0);
+	}
 
 	ret = kobject_init_and_add(
 		&glob->kobj, &ttm_bo_glob_kobj_type, ttm_get_kobj(), "buffer_objects");
@@ -42,6 +42,76 @@
 
 #define TTM_BO_VM_NUM_PREFAULT 16
 
+#ifdef __FreeBSD__
+#define TTM_BO_VM_MAX_PREFAULT 512
+
+#ifdef __amd64__
+#define TTM_BO_VM_HUGE_SIZE	NBPDR
+#define TTM_BO_VM_HUGE_PAGES	(TTM_BO_VM_HUGE_SIZE >> PAGE_SHIFT)
+#endif
+
+/*
+ * Grow the prefault window while the bo is faulted in sequentially and drop
+ * back to the minimum on random access. Called with the bo reserved.
+ */
+static unsigned long ttm_bo_vm_fault_window(struct ttm_buffer_object *bo,
+					    unsigned long page_offset)
+{
+	if (page_offset == bo->fault_next)
+		bo->fault_window = clamp_t(unsigned int, bo->fault_window * 2,
+					   TTM_BO_VM_NUM_PREFAULT,
+					   TTM_BO_VM_MAX_PREFAULT);
+	else
+		bo->fault_window = TTM_BO_VM_NUM_PREFAULT;
+
+	return bo->fault_window;
+}
+
+#ifdef TTM_BO_VM_HUGE_PAGES
+/*
+ * Whether the superpage starting at @pidx can be populated in one go: the
+ * object index and the aperture address must both be superpage aligned and
+ * the whole run must be inside the mapping and the fictitious page range.
+ */
+static bool ttm_bo_vm_fault_huge(struct ttm_buffer_object *bo,
+				 vm_pindex_t pidx, unsigned long page_offset,
+				 unsigned long page_last)
+{
+	vm_paddr_t paddr;
+
+	if (!bo->mem.bus.is_iomem || pagesizes[1] != TTM_BO_VM_HUGE_SIZE)
+		return false;
+	if ((pidx & (TTM_BO_VM_HUGE_PAGES - 1)) != 0 ||
+	    page_offset + TTM_BO_VM_HUGE_PAGES > min(page_last, bo->num_pages))
+		return false;
+
+	paddr = bo->mem.bus.base + bo->mem.bus.offset + IDX_TO_OFF(page_offset);
+	if ((paddr & (TTM_BO_VM_HUGE_SIZE - 1)) != 0)
+		return false;
+
+	return PHYS_TO_VM_PAGE(paddr) + TTM_BO_VM_HUGE_PAGES - 1 ==
+	    PHYS_TO_VM_PAGE(paddr + TTM_BO_VM_HUGE_SIZE - PAGE_SIZE);
+}
+#endif
+
+/*
+ * Set the caching attribute of a run of ttm pages with a single call, so that
+ * physically contiguous pages share one direct map update.
+ */
+static void ttm_bo_vm_set_memattr(struct page **pages, unsigned long npages,
+				  vm_memattr_t attr)
+{
+#if defined(__i386__) || defined(__amd64__)
+	(void) set_pages_array_memattr(pages, npages, attr);
+#else
+	unsigned long i;
+
+	for (i = 0; i < npages; ++i)
+		pmap_page_set_memattr(pages[i], attr);
+#endif
+}
+#endif
+
 static int ttm_bo_vm_fault_idle(struct ttm_buffer_object *bo,
 				struct vm_area_struct *vma,
 				struct vm_fault *vmf)
@@ -267,13 +337,35 @@ static int ttm_bo_vm_fault(struct vm_area_struct *vma, struct vm_fault *vmf)
 #else
 	vm_object_t obj;
 	vm_pindex_t pidx;
+	vm_page_t head;
+	vm_memattr_t attr;
+	unsigned long window, run;
+	bool huge;
 
 	obj = vma->vm_obj;
 	pidx = OFF_TO_IDX(address);
 	vma->vm_pfn_first = pidx;
+	attr = pgprot2cachemode(cvma.vm_page_prot);
+	window = ttm_bo_vm_fault_window(bo, page_offset);
+	huge = false;
+#ifdef TTM_BO_VM_HUGE_PAGES
+	if (ttm_bo_vm_fault_huge(bo, pidx, page_offset, page_last)) {
+		window = TTM_BO_VM_HUGE_PAGES;
+		huge = true;
+	} else if (bo->mem.bus.is_iomem) {
+		/*
+		 * Stop at the next superpage boundary so that the next
+		 * sequential fault can map a whole superpage.
+		 */
+		window = min_t(unsigned long, window,
+		    roundup2(pidx + 1, TTM_BO_VM_HUGE_PAGES) - pidx);
+	}
+#endif
+	head = NULL;
+	run = 0;
 
 	VM_OBJECT_WLOCK(obj);
-	for (i = 0; i < TTM_BO_VM_NUM_PREFAULT && page_offset < page_last;
+	for (i = 0; i < window && page_offset < page_last;
 	    i++, page_offset++, pidx++) {
 retry:
 		page = vm_page_lookup(obj, pidx);
@@ -296,9 +388,26 @@ retry:
 			if (vm_page_insert(page, obj, pidx))
 				goto fail;
 			page->valid = VM_PAGE_BITS_ALL;
+			if (bo->mem.bus.is_iomem)
+				page->psind = 0;
+		}
+		if (i == 0)
+			head = page;
+
+		/*
+		 * Pool pages normally have the right caching already; pages
+		 * that don't are collected and changed once per run.
+		 */
+		if (bo->mem.bus.is_iomem) {
+			if (pmap_page_get_memattr(page) != attr)
+				pmap_page_set_memattr(page, attr);
+		} else if (pmap_page_get_memattr(page) != attr) {
+			run++;
+		} else if (run != 0) {
+			ttm_bo_vm_set_memattr(&ttm->pages[page_offset - run],
+			    run, attr);
+			run = 0;
 		}
-		pmap_page_set_memattr(page,
-		    pgprot2cachemode(cvma.vm_page_prot));
 		vm_page_xbusy(page);
 		vma->vm_pfn_count++;
 		continue;
@@ -307,6 +416,27 @@ fail:
 			retval = VM_FAULT_OOM;
 		break;
 	}
+	if (run != 0)
+		ttm_bo_vm_set_memattr(&ttm->pages[page_offset - run], run,
+		    attr);
+
+	/*
+	 * A fully populated, aligned run of aperture pages is physically
+	 * contiguous, let the VM map it with a single superpage.
+	 */
+	if (huge && i == TTM_BO_VM_HUGE_PAGES)
+		head->psind = 1;
+	else
+		huge = false;
+	bo->fault_next = page_offset;
+
+	if (vma->vm_pfn_count != 0) {
+		atomic64_inc(&bo->glob->vm_faults[bo->mem.mem_type]);
+		atomic64_add(vma->vm_pfn_count,
+		    &bo->glob->vm_fault_pages[bo->mem.mem_type]);
+		if (huge)
+			atomic64_inc(&bo->glob->vm_fault_huge[bo->mem.mem_type]);
+	}
 	VM_OBJECT_WUNLOCK(obj);
 #endif
 out_io_unlock:
@@ -58,6 +58,50 @@
 /* times are in msecs */
 #define PAGE_FREE_INTERVAL		1000
 
+/*
+ * New pool pages can be carved out of physically contiguous, superpage
+ * aligned runs. The caching attribute of a whole run is changed at once,
+ * which keeps the direct map superpage intact.
+ */
+#if defined(__FreeBSD__) && defined(__amd64__)
+#define TTM_HAS_HUGE_RUNS
+#define HUGE_RUN_SIZE			NBPDR
+#define HUGE_RUN_PAGES			(HUGE_RUN_SIZE >> PAGE_SHIFT)
+#endif
+
+/*
+ * Per-CPU caches in front of each pool. Small requests are served from and
+ * returned to the cache of the CPU the caller happens to run on, which is
+ * refilled from and drained to the shared pool TTM_CACHE_BATCH pages at a
+ * time. The caller is not pinned to that CPU, see ttm_pool_cache().
+ */
+#define TTM_CACHE_PAGES			16
+#define TTM_CACHE_BATCH			(TTM_CACHE_PAGES / 2)
+#ifdef __FreeBSD__
+#define TTM_NR_CPUS			(mp_maxid + 1)
+#else
+#define TTM_NR_CPUS			nr_cpu_ids
+#endif
+
+/**
+ * struct ttm_pool_cache - Per-CPU cache of pages in front of a pool.
+ *
+ * @lock: Protects the cache. Every access takes it: the CPU id only picks
+ * the cache, so threads that migrated after reading it and the shrinker
+ * draining the cache can use it concurrently. Mostly uncontended.
+ * @npages: Number of pages in the cache.
+ * @pages: Cached pages, used as a stack.
+ * @hits: Number of requests served from the cache.
+ * @misses: Number of requests that had to go to the shared pool.
+ */
+struct ttm_pool_cache {
+	spinlock_t		lock;
+	unsigned		npages;
+	struct page		*pages[TTM_CACHE_PAGES];
+	unsigned long		hits;
+	unsigned long		misses;
+} ____cacheline_aligned;
+
 /**
  * struct ttm_page_pool - Pool to reuse recently allocated uc/wc pages.
  *
@@ -68,6 +112,7 @@
  * @list: Pool of free uc/wc pages for fast reuse.
  * @gfp_flags: Flags to pass for alloc_page.
  * @npages: Number of pages in pool.
+ * @caches: Per-CPU caches, NULL if they couldn't be allocated.
  */
 struct ttm_page_pool {
 	spinlock_t		lock;
@@ -78,6 +123,7 @@ struct ttm_page_pool {
 	char			*name;
 	unsigned long		nfrees;
 	unsigned long		nrefills;
+	struct ttm_pool_cache	*caches;
 };
 
 /**
@@ -90,6 +136,7 @@ struct ttm_pool_opts {
 	unsigned	alloc_size;
 	unsigned	max_size;
 	unsigned	small;
+	unsigned	huge;
 };
 
 #define NUM_POOLS 4
@@ -104,6 +151,8 @@ struct ttm_pool_opts {
  * @work: Work that is used to shrink the pool. Work is only run when there is
  * some pages to free.
  * @small_allocation: Limit in number of pages what is small allocation.
+ * @nhuge_runs: Number of contiguous runs new pages were carved from.
+ * @nhuge_fails: Number of times a contiguous run could not be allocated.
  *
  * @pools: All pool objects in use.
  **/
@@ -111,6 +160,8 @@ struct ttm_pool_manager {
 	struct kobject		kobj;
 	struct shrinker		mm_shrink;
 	struct ttm_pool_opts	options;
+	atomic_long_t		nhuge_runs;
+	atomic_long_t		nhuge_fails;
 
 	union {
 		struct ttm_page_pool	pools[NUM_POOLS];
@@ -135,11 +186,16 @@ static struct attribute ttm_page_pool_alloc_size = {
 	.name = "pool_allocation_size",
 	.mode = S_IRUGO | S_IWUSR
 };
+static struct attribute ttm_page_pool_huge = {
+	.name = "pool_huge_runs",
+	.mode = S_IRUGO | S_IWUSR
+};
 
 static struct attribute *ttm_pool_attrs[] = {
 	&ttm_page_pool_max,
 	&ttm_page_pool_small,
 	&ttm_page_pool_alloc_size,
+	&ttm_page_pool_huge,
 	NULL
 };
 
@@ -161,6 +217,12 @@ static ssize_t ttm_pool_store(struct kobject *kobj,
 	if (chars == 0)
 		return size;
 
+	/* Not a size, just an on/off switch */
+	if (attr == &ttm_page_pool_huge) {
+		m->options.huge = !!val;
+		return size;
+	}
+
 	/* Convert kb to number of pages */
 	val = val / (PAGE_SIZE >> 10);
 
@@ -191,6 +253,9 @@ static ssize_t ttm_pool_show(struct kobject *kobj,
 		container_of(kobj, struct ttm_pool_manager, kobj);
 	unsigned val = 0;
 
+	if (attr == &ttm_page_pool_huge)
+		return snprintf(buffer, PAGE_SIZE, "%u\n", m->options.huge);
+
 	if (attr == &ttm_page_pool_max)
 		val = m->options.max_size;
 	else if (attr == &ttm_page_pool_small)
@@ -272,6 +337,165 @@ static struct ttm_page_pool *ttm_get_pool(int flags,
 	return &_manager->pools[pool_index];
 }
 
+static struct ttm_pool_cache *ttm_pool_cache(struct ttm_page_pool *pool)
+{
+	/*
+	 * The CPU id is only a hint to spread the callers over the caches, so
+	 * it is read without disabling preemption: migrating right after
+	 * reading it only means we use another CPU's cache, which is fine
+	 * since every cache has its own lock. Pinning the thread instead
+	 * would not work anyway, the cache lock may sleep on FreeBSD.
+	 */
+#ifdef __FreeBSD__
+	return pool->caches ? &pool->caches[curcpu] : NULL;
+#else
+	return pool->caches ? &pool->caches[raw_smp_processor_id()] : NULL;
+#endif
+}
+
+/**
+ * Take npages pages from the cache of the current CPU.
+ *
+ * @return true if the request was served, false if the shared pool has to be
+ * used.
+ */
+static bool ttm_pool_cache_get(struct ttm_page_pool *pool,
+			       struct page **pages, unsigned npages)
+{
+	struct ttm_pool_cache *cache = ttm_pool_cache(pool);
+	bool hit = false;
+	unsigned i;
+
+	if (!cache || npages > TTM_CACHE_BATCH)
+		return false;
+
+	spin_lock(&cache->lock);
+	if (cache->npages >= npages) {
+		for (i = 0; i < npages; ++i)
+			pages[i] = cache->pages[--cache->npages];
+		cache->hits++;
+		hit = true;
+	} else {
+		cache->misses++;
+	}
+	spin_unlock(&cache->lock);
+
+	return hit;
+}
+
+/**
+ * Stash the pages on the list in the cache of the current CPU.
+ *
+ * @return the number of pages that didn't fit. They are left on the list.
+ */
+static unsigned ttm_pool_cache_fill(struct ttm_page_pool *pool,
+				    struct pglist *plist, unsigned npages)
+{
+	struct ttm_pool_cache *cache = ttm_pool_cache(pool);
+	struct page *p;
+
+	if (!cache)
+		return npages;
+
+	spin_lock(&cache->lock);
+	while (npages && cache->npages < TTM_CACHE_PAGES) {
+		p = TAILQ_FIRST(plist);
+		TAILQ_REMOVE(plist, p, plinks.q);
+		cache->pages[cache->npages++] = p;
+		--npages;
+	}
+	spin_unlock(&cache->lock);
+
+	return npages;
+}
+
+/**
+ * Put npages pages in the cache of the current CPU. If the cache is full, its
+ * oldest TTM_CACHE_BATCH pages are moved to @drain to be returned to the
+ * shared pool.
+ *
+ * @return the number of pages in @drain, or ~0U if the pages were not cached.
+ */
+static unsigned ttm_pool_cache_put(struct ttm_page_pool *pool,
+				   struct page **pages, unsigned npages,
+				   struct page **drain)
+{
+	struct ttm_pool_cache *cache = ttm_pool_cache(pool);
+	unsigned i, ndrain = 0;
+
+	if (!cache || npages > TTM_CACHE_BATCH)
+		return ~0U;
+
+	spin_lock(&cache->lock);
+	if (cache->npages + npages > TTM_CACHE_PAGES) {
+		ndrain = TTM_CACHE_BATCH;
+		memcpy(drain, cache->pages, ndrain * sizeof(struct page *));
+		cache->npages -= ndrain;
+		memmove(cache->pages, cache->pages + ndrain,
+			cache->npages * sizeof(struct page *));
+	}
+	for (i = 0; i < npages; ++i) {
+		if (pages[i]) {
+			cache->pages[cache->npages++] = pages[i];
+			pages[i] = NULL;
+		}
+	}
+	spin_unlock(&cache->lock);
+
+	return ndrain;
+}
+
+/**
+ * Move the pages of all per-CPU caches back to the shared pool so that they
+ * can be freed.
+ *
+ * @return number of pages moved.
+ */
+static unsigned ttm_pool_cache_drain(struct ttm_page_pool *pool)
+{
+	struct ttm_pool_cache *cache;
+	unsigned long irq_flags;
+	struct pglist plist;
+	unsigned cpu, i, count = 0;
+
+	if (!pool->caches)
+		return 0;
+
+	TAILQ_INIT(&plist);
+	for (cpu = 0; cpu < TTM_NR_CPUS; ++cpu) {
+		cache = &pool->caches[cpu];
+
+		spin_lock(&cache->lock);
+		for (i = 0; i < cache->npages; ++i)
+			TAILQ_INSERT_TAIL(&plist, cache->pages[i], plinks.q);
+		count += cache->npages;
+		cache->npages = 0;
+		spin_unlock(&cache->lock);
+	}
+
+	if (count) {
+		spin_lock_irqsave(&pool->lock, irq_flags);
+		TAILQ_CONCAT(&pool->list, &plist, plinks.q);
+		pool->npages += count;
+		spin_unlock_irqrestore(&pool->lock, irq_flags);
+	}
+
+	return count;
+}
+
+static unsigned ttm_pool_cache_count(struct ttm_page_pool *pool)
+{
+	unsigned cpu, count = 0;
+
+	if (!pool->caches)
+		return 0;
+
+	for (cpu = 0; cpu < TTM_NR_CPUS; ++cpu)
+		count += READ_ONCE(pool->caches[cpu].npages);
+
+	return count;
+}
+
 /* set memory back to wb and free the pages. */
 static void ttm_pages_put(struct page *pages[], unsigned npages)
 {
@@ -424,6 +648,9 @@ ttm_pool_shrink_scan(struct shrinker *shrink, struct shrink_control *sc)
 		if (shrink_pages == 0)
 			break;
 		pool = &_manager->pools[(i + pool_offset)%NUM_POOLS];
+		/* Pages cached per CPU are only reclaimable from the pool */
+		if (pool->npages < nr_free)
+			ttm_pool_cache_drain(pool);
 		/* OK to use static buffer since global mutex is held. */
 		shrink_pages = ttm_page_pool_free(pool, nr_free, true);
 		freed += nr_free - shrink_pages;
@@ -440,7 +667,8 @@ ttm_pool_shrink_count(struct shrinker *shrink, struct shrink_control *sc)
 	unsigned long count = 0;
 
 	for (i = 0; i < NUM_POOLS; ++i)
-		count += _manager->pools[i].npages;
+		count += _manager->pools[i].npages +
+			 ttm_pool_cache_count(&_manager->pools[i]);
 
 	return count;
 }
@@ -502,6 +730,70 @@ static void ttm_handle_caching_state_failure(struct pglist *pages,
 	}
 }
 
+#ifdef TTM_HAS_HUGE_RUNS
+static void ttm_free_huge_run(struct page **run, unsigned npages)
+{
+	unsigned i;
+
+	for (i = 0; i < npages; ++i) {
+		vm_page_lock(run[i]);
+		vm_page_unwire(run[i], PQ_NONE);
+		vm_page_unlock(run[i]);
+		__free_page(run[i]);
+	}
+}
+
+/**
+ * Allocate a physically contiguous, superpage aligned run of pages, set its
+ * caching state at once and put the pages on the list.
+ *
+ * The pages are independent once allocated and are freed one by one, exactly
+ * like the pages from alloc_page(). Returns -ENOMEM without touching the list
+ * if no such run is available so the caller can fall back to single pages.
+ */
+static int ttm_alloc_huge_run(struct pglist *pages, gfp_t gfp_flags,
+		enum ttm_caching_state cstate, struct page **run)
+{
+	vm_paddr_t high;
+	struct page *p;
+	int req, r;
+	unsigned i;
+
+	req = VM_ALLOC_NORMAL | VM_ALLOC_NOOBJ | VM_ALLOC_WIRED;
+	if (gfp_flags & __GFP_ZERO)
+		req |= VM_ALLOC_ZERO;
+	high = (gfp_flags & GFP_DMA32) ? BUS_SPACE_MAXADDR_32BIT :
+	    BUS_SPACE_MAXADDR;
+
+	p = vm_page_alloc_contig(NULL, 0, req, HUGE_RUN_PAGES, 0, high,
+	    HUGE_RUN_SIZE, 0, VM_MEMATTR_DEFAULT);
+	if (p == NULL) {
+		atomic_long_inc(&_manager->nhuge_fails);
+		return -ENOMEM;
+	}
+
+	for (i = 0; i < HUGE_RUN_PAGES; ++i) {
+		run[i] = p + i;
+		if ((gfp_flags & __GFP_ZERO) && (run[i]->flags & PG_ZERO) == 0)
+			pmap_zero_page(run[i]);
+	}
+
+	/* The whole run is contiguous, this is a single attribute change */
+	r = ttm_set_pages_caching(run, cstate, HUGE_RUN_PAGES);
+	if (r) {
+		ttm_free_huge_run(run, HUGE_RUN_PAGES);
+		return r;
+	}
+
+	/* Keep the run in ascending order once it's on the list */
+	for (i = HUGE_RUN_PAGES; i > 0; --i)
+		TAILQ_INSERT_HEAD(pages, run[i - 1], plinks.q);
+
+	atomic_long_inc(&_manager->nhuge_runs);
+	return 0;
+}
+#endif
+
 /**
  * Allocate new pages with correct caching.
  *
@@ -526,7 +818,19 @@ static int ttm_alloc_new_pages(struct pglist *pages, gfp_t gfp_flags,
 		return -ENOMEM;
 	}
 
-	for (i = 0, cpages = 0; i < count; ++i) {
+	i = 0;
+#ifdef TTM_HAS_HUGE_RUNS
+	/* Carve as much as possible out of contiguous runs first */
+	while (_manager->options.huge && max_cpages >= HUGE_RUN_PAGES &&
+	       count - i >= HUGE_RUN_PAGES) {
+		if (ttm_alloc_huge_run(pages, gfp_flags, cstate,
+				       caching_array))
+			break;
+		i += HUGE_RUN_PAGES;
+	}
+#endif
+
+	for (cpages = 0; i < count; ++i) {
 		p = alloc_page(gfp_flags);
 
 		if (!p) {
@@ -704,32 +1008,13 @@ out:
 	return count;
 }
 
-/* Put all pages in pages list to correct pool to wait for reuse */
-static void ttm_put_pages(struct page **pages, unsigned npages, int flags,
-			  enum ttm_caching_state cstate)
+/* Put pages in the shared pool, shrinking it if it goes over the limit */
+static void ttm_page_pool_put_pages(struct ttm_page_pool *pool,
+				    struct page **pages, unsigned npages)
 {
 	unsigned long irq_flags;
-	struct ttm_page_pool *pool = ttm_get_pool(flags, cstate);
 	unsigned i;
 
-	if (pool == NULL) {
-		/* No pool for this memory type so free the pages */
-		for (i = 0; i < npages; i++) {
-			if (pages[i]) {	
-				if (page_count(pages[i]) != 1)
-					pr_err("Erroneous page count. Leaking pages.\n");
-#ifdef __FreeBSD__
-				vm_page_lock(pages[i]);
-				vm_page_unwire(pages[i], PQ_NONE);
-				vm_page_unlock(pages[i]);
-#endif
-				__free_page(pages[i]);
-				pages[i] = NULL;
-			}
-		}
-		return;
-	}
-
 	spin_lock_irqsave(&pool->lock, irq_flags);
 	for (i = 0; i < npages; i++) {
 		if (pages[i]) {
@@ -754,6 +1039,39 @@ static void ttm_put_pages(struct page **pages, unsigned npages, int flags,
 		ttm_page_pool_free(pool, npages, false);
 }
 
+/* Put all pages in pages list to correct pool to wait for reuse */
+static void ttm_put_pages(struct page **pages, unsigned npages, int flags,
+			  enum ttm_caching_state cstate)
+{
+	struct ttm_page_pool *pool = ttm_get_pool(flags, cstate);
+	struct page *drain[TTM_CACHE_BATCH];
+	unsigned i, ndrain;
+
+	if (pool == NULL) {
+		/* No pool for this memory type so free the pages */
+		for (i = 0; i < npages; i++) {
+			if (pages[i]) {	
+				if (page_count(pages[i]) != 1)
+					pr_err("Erroneous page count. Leaking pages.\n");
+#ifdef __FreeBSD__
+				vm_page_lock(pages[i]);
+				vm_page_unwire(pages[i], PQ_NONE);
+				vm_page_unlock(pages[i]);
+#endif
+				__free_page(pages[i]);
+				pages[i] = NULL;
+			}
+		}
+		return;
+	}
+
+	ndrain = ttm_pool_cache_put(pool, pages, npages, drain);
+	if (ndrain == ~0U)
+		ttm_page_pool_put_pages(pool, pages, npages);
+	else if (ndrain)
+		ttm_page_pool_put_pages(pool, drain, ndrain);
+}
+
 /*
  * On success pages list will hold count number of correctly
  * cached pages.
@@ -765,7 +1083,7 @@ static int ttm_get_pages(struct page **pages, unsigned npages, int flags,
 	struct pglist plist;
 	struct page *p = NULL;
 	gfp_t gfp_flags = GFP_USER;
-	unsigned count;
+	unsigned count, refill = 0, want;
 	int r;
 
 	/* set zero flag for page allocation if required */
@@ -801,17 +1119,45 @@ static int ttm_get_pages(struct page **pages, unsigned npages, int flags,
 	/* combine zero flag to pool flags */
 	gfp_flags |= pool->gfp_flags;
 
-	/* First we take pages from the pool */
-	TAILQ_INIT(&plist);
-	npages = ttm_page_pool_get_pages(pool, &plist, flags, cstate, npages);
+	/* First try the cache of this CPU, refill it from the pool on a miss */
 	count = 0;
-	TAILQ_FOREACH(p, &plist, plinks.q) {
-		pages[count++] = p;
+	if (ttm_pool_cache_get(pool, pages, npages)) {
+		count = npages;
+		npages = 0;
+	} else if (pool->caches && npages <= TTM_CACHE_BATCH) {
+		refill = TTM_CACHE_BATCH;
+	}
+
+	/* Then we take pages from the pool */
+	if (npages) {
+		TAILQ_INIT(&plist);
+		want = npages + refill;
+		want -= ttm_page_pool_get_pages(pool, &plist, flags, cstate,
+						want);
+		while (count < npages && (p = TAILQ_FIRST(&plist))) {
+			TAILQ_REMOVE(&plist, p, plinks.q);
+			pages[count++] = p;
+		}
+		npages = want < npages ? npages - want : 0;
+
+		/* Whatever is left goes to the cache, or back to the pool */
+		if (!TAILQ_EMPTY(&plist)) {
+			want = ttm_pool_cache_fill(pool, &plist, want - count);
+			if (want) {
+				unsigned long irq_flags;
+
+				spin_lock_irqsave(&pool->lock, irq_flags);
+				TAILQ_CONCAT(&pool->list, &plist, plinks.q);
+				pool->npages += want;
+				spin_unlock_irqrestore(&pool->lock, irq_flags);
+			}
+		}
 	}
 
 	/* clear the pages coming from the pool if requested */
 	if (flags & TTM_PAGE_FLAG_ZERO_ALLOC) {
-		TAILQ_FOREACH(p, &plist, plinks.q) {
+		for (r = 0; r < count; ++r) {
+			p = pages[r];
 #ifdef __FreeBSD__
 			pmap_zero_page(p);
 #else
@@ -849,12 +1195,23 @@ static int ttm_get_pages(struct page **pages, unsigned npages, int flags,
 static void ttm_page_pool_init_locked(struct ttm_page_pool *pool, gfp_t flags,
 		char *name)
 {
+	unsigned cpu;
+
 	spin_lock_init(&pool->lock);
 	pool->fill_lock = false;
 	TAILQ_INIT(&pool->list);
 	pool->npages = pool->nfrees = 0;
 	pool->gfp_flags = flags;
 	pool->name = name;
+
+	/* The pool works without per-CPU caches, just slower */
+	pool->caches = kcalloc(TTM_NR_CPUS, sizeof(*pool->caches), GFP_KERNEL);
+	if (!pool->caches) {
+		pr_warn("Unable to allocate per-CPU caches for pool %s\n", name);
+		return;
+	}
+	for (cpu = 0; cpu < TTM_NR_CPUS; ++cpu)
+		spin_lock_init(&pool->caches[cpu].lock);
 }
 
 int ttm_page_alloc_init(struct ttm_mem_global *glob, unsigned max_pages)
@@ -880,6 +1237,9 @@ int ttm_page_alloc_init(struct ttm_mem_global *glob, unsigned max_pages)
 	_manager->options.max_size = max_pages;
 	_manager->options.small = SMALL_ALLOCATION;
 	_manager->options.alloc_size = NUM_PAGES_TO_ALLOC;
+#ifdef TTM_HAS_HUGE_RUNS
+	_manager->options.huge = 1;
+#endif
 
 	ret = kobject_init_and_add(&_manager->kobj, &ttm_pool_kobj_type,
 				   &glob->kobj, "pool");
@@ -902,8 +1262,11 @@ void ttm_page_alloc_fini(void)
 	ttm_pool_mm_shrink_fini(_manager);
 
 	/* OK to use static buffer since global mutex is no longer used. */
-	for (i = 0; i < NUM_POOLS; ++i)
+	for (i = 0; i < NUM_POOLS; ++i) {
+		ttm_pool_cache_drain(&_manager->pools[i]);
 		ttm_page_pool_free(&_manager->pools[i], FREE_ALL_PAGES, true);
+		kfree(_manager->pools[i].caches);
+	}
 
 	kobject_put(&_manager->kobj);
 	_manager = NULL;
@@ -967,8 +1330,9 @@ EXPORT_SYMBOL(ttm_pool_unpopulate);
 
 int ttm_page_alloc_debugfs(struct seq_file *m, void *data)
 {
+	struct ttm_pool_cache *c;
 	struct ttm_page_pool *p;
-	unsigned i;
+	unsigned i, cpu;
 	char *h[] = {"pool", "refills", "pages freed", "size"};
 	if (!_manager) {
 		seq_printf(m, "No pool allocator running.\n");
@@ -983,6 +1347,29 @@ int ttm_page_alloc_debugfs(struct seq_file *m, void *data)
 				p->name, p->nrefills,
 				p->nfrees, p->npages);
 	}
+	seq_printf(m, "\n%6s %4s %6s %12s %12s\n",
+			"pool", "cpu", "cached", "hits", "misses");
+	for (i = 0; i < NUM_POOLS; ++i) {
+		p = &_manager->pools[i];
+		if (!p->caches)
+			continue;
+
+		for (cpu = 0; cpu < TTM_NR_CPUS; ++cpu) {
+			c = &p->caches[cpu];
+			/* Skip CPUs that never touched this pool */
+			if (!c->hits && !c->misses)
+				continue;
+			seq_printf(m, "%6s %4u %6u %12lu %12lu\n",
+					p->name, cpu, c->npages,
+					c->hits, c->misses);
+		}
+	}
+#ifdef TTM_HAS_HUGE_RUNS
+	seq_printf(m, "huge runs %s: %ld allocated, %ld failed\n",
+		   _manager->options.huge ? "enabled" : "disabled",
+		   atomic_long_read(&_manager->nhuge_runs),
+		   atomic_long_read(&_manager->nhuge_fails));
+#endif
 	return 0;
 }
 EXPORT_SYMBOL(ttm_page_alloc_debugfs);
@@ -688,7 +688,40 @@ static bool validate_regs_sorted(struct intel_engine_cs *engine)
 
 struct cmd_node {
 	const struct drm_i915_cmd_descriptor *desc;
-	struct hlist_node node;
+	struct cmd_node *next;
+};
+
+#define CMD_KEY_BITS	16
+#define CMD_L2_BITS	6
+#define CMD_L1_SIZE	(1 << (CMD_KEY_BITS - CMD_L2_BITS))
+#define CMD_L2_SIZE	(1 << CMD_L2_BITS)
+
+/*
+ * Descriptors indexed by cmd_header_key(). The first level is indexed by the
+ * top bits of the key and only the second level tables covering opcodes that
+ * have descriptors are allocated. Keys shared by several descriptors are
+ * chained, which is rare enough to keep lookups constant time.
+ */
+struct i915_cmd_index {
+	struct cmd_node *nodes;
+	struct cmd_node **l1[CMD_L1_SIZE];
+};
+
+#define REG_FILTER_BITS	1024
+
+/*
+ * All register tables of an engine merged into one array sorted by offset,
+ * table order preserved for equal offsets. The bitmap rejects most registers
+ * that are not whitelisted without searching the array.
+ */
+struct i915_reg_index {
+	DECLARE_BITMAP(filter, REG_FILTER_BITS);
+	int count;
+	struct i915_reg_entry {
+		u32 addr;
+		bool master;
+		const struct drm_i915_reg_descriptor *desc;
+	} regs[];
 };
 
 /*
@@ -700,6 +733,9 @@ struct cmd_node {
  * non-opcode bits being set. But if we don't include those bits, some 3D
  * commands may hash to the same bucket due to not including opcode bits that
  * make the command unique. For now, we will risk hashing to the same bucket.
+ *
+ * The key is at most 16 bits wide (3D commands), so it directly indexes the
+ * two-level cmd_index table below.
  */
 static inline u32 cmd_header_key(u32 x)
 {
@@ -721,45 +757,119 @@ static inline u32 cmd_header_key(u32 x)
 	return x >> shift;
 }
 
-static int init_hash_table(struct intel_engine_cs *engine,
-			   const struct drm_i915_cmd_table *cmd_tables,
-			   int cmd_table_count)
+static inline unsigned int reg_filter_hash(u32 addr)
 {
-	int i, j;
+	return hash_32(addr, ilog2(REG_FILTER_BITS));
+}
+
+static void fini_cmd_index(struct intel_engine_cs *engine)
+{
+	struct i915_cmd_index *index = engine->cmd_index;
+	int i;
+
+	if (index) {
+		for (i = 0; i < CMD_L1_SIZE; i++)
+			kfree(index->l1[i]);
+		kfree(index->nodes);
+		kfree(index);
+		engine->cmd_index = NULL;
+	}
+
+	kfree(engine->reg_index);
+	engine->reg_index = NULL;
+}
 
-	hash_init(engine->cmd_hash);
+static int init_cmd_index(struct intel_engine_cs *engine,
+			  const struct drm_i915_cmd_table *cmd_tables,
+			  int cmd_table_count)
+{
+	struct i915_cmd_index *index;
+	struct cmd_node *desc_node;
+	int i, j, count;
 
+	index = kzalloc(sizeof(*index), GFP_KERNEL);
+	if (!index)
+		return -ENOMEM;
+	engine->cmd_index = index;
+
+	count = 0;
+	for (i = 0; i < cmd_table_count; i++)
+		count += cmd_tables[i].count;
+
+	index->nodes = kcalloc(count, sizeof(*index->nodes), GFP_KERNEL);
+	if (!index->nodes)
+		return -ENOMEM;
+
+	desc_node = index->nodes;
 	for (i = 0; i < cmd_table_count; i++) {
 		const struct drm_i915_cmd_table *table = &cmd_tables[i];
 
 		for (j = 0; j < table->count; j++) {
-			const struct drm_i915_cmd_descriptor *desc =
-				&table->table[j];
-			struct cmd_node *desc_node =
-				kmalloc(sizeof(*desc_node), GFP_KERNEL);
-
-			if (!desc_node)
-				return -ENOMEM;
+			u32 key = cmd_header_key(table->table[j].cmd.value);
+			struct cmd_node ***l1 = &index->l1[key >> CMD_L2_BITS];
+			struct cmd_node **slot;
+
+			if (!*l1) {
+				*l1 = kcalloc(CMD_L2_SIZE, sizeof(**l1),
+					      GFP_KERNEL);
+				if (!*l1)
+					return -ENOMEM;
+			}
 
-			desc_node->desc = desc;
-			hash_add(engine->cmd_hash, &desc_node->node,
-				 cmd_header_key(desc->cmd.value));
+			/*
+			 * Push at the head of the chain, so that descriptors
+			 * from later tables take precedence.
+			 */
+			slot = &(*l1)[key & (CMD_L2_SIZE - 1)];
+			desc_node->desc = &table->table[j];
+			desc_node->next = *slot;
+			*slot = desc_node++;
 		}
 	}
 
 	return 0;
 }
 
-static void fini_hash_table(struct intel_engine_cs *engine)
+static int init_reg_index(struct intel_engine_cs *engine)
 {
-	struct hlist_node *tmp;
-	struct cmd_node *desc_node;
-	int i;
+	struct i915_reg_index *index;
+	int i, j, count;
+
+	count = 0;
+	for (i = 0; i < engine->reg_table_count; i++)
+		count += engine->reg_tables[i].num_regs;
+	if (!count)
+		return 0;
 
-	hash_for_each_safe(engine->cmd_hash, i, tmp, desc_node, node) {
-		hash_del(&desc_node->node);
-		kfree(desc_node);
+	index = kzalloc(sizeof(*index) + count * sizeof(index->regs[0]),
+			GFP_KERNEL);
+	if (!index)
+		return -ENOMEM;
+
+	for (i = 0; i < engine->reg_table_count; i++) {
+		const struct drm_i915_reg_table *table = &engine->reg_tables[i];
+
+		for (j = 0; j < table->num_regs; j++) {
+			struct i915_reg_entry entry = {
+				.addr = i915_mmio_reg_offset(table->regs[j].addr),
+				.master = table->master,
+				.desc = &table->regs[j],
+			};
+			int k;
+
+			/* Stable insertion sort, the tables are tiny */
+			for (k = index->count;
+			     k > 0 && index->regs[k - 1].addr > entry.addr; k--)
+				index->regs[k] = index->regs[k - 1];
+			index->regs[k] = entry;
+			index->count++;
+
+			__set_bit(reg_filter_hash(entry.addr), index->filter);
+		}
 	}
+
+	engine->reg_index = index;
+	return 0;
 }
 
 /**
@@ -845,10 +955,12 @@ void intel_engine_init_cmd_parser(struct intel_engine_cs *engine)
 		return;
 	}
 
-	ret = init_hash_table(engine, cmd_tables, cmd_table_count);
+	ret = init_cmd_index(engine, cmd_tables, cmd_table_count);
+	if (ret == 0)
+		ret = init_reg_index(engine);
 	if (ret) {
 		DRM_ERROR("%s: initialised failed!\n", engine->name);
-		fini_hash_table(engine);
+		fini_cmd_index(engine);
 		return;
 	}
 
@@ -867,17 +979,22 @@ void intel_engine_cleanup_cmd_parser(struct intel_engine_cs *engine)
 	if (!engine->needs_cmd_parser)
 		return;
 
-	fini_hash_table(engine);
+	fini_cmd_index(engine);
 }
 
 static const struct drm_i915_cmd_descriptor*
 find_cmd_in_table(struct intel_engine_cs *engine,
 		  u32 cmd_header)
 {
-	struct cmd_node *desc_node;
+	u32 key = cmd_header_key(cmd_header);
+	struct cmd_node **l2 = engine->cmd_index->l1[key >> CMD_L2_BITS];
+	const struct cmd_node *desc_node;
+
+	if (!l2)
+		return NULL;
 
-	hash_for_each_possible(engine->cmd_hash, desc_node, node,
-			       cmd_header_key(cmd_header)) {
+	for (desc_node = l2[key & (CMD_L2_SIZE - 1)]; desc_node;
+	     desc_node = desc_node->next) {
 		const struct drm_i915_cmd_descriptor *desc = desc_node->desc;
 		if (((cmd_header ^ desc->cmd.value) & desc->cmd.mask) == 0)
 			return desc;
@@ -920,120 +1037,31 @@ find_cmd(struct intel_engine_cs *engine,
 	return default_desc;
 }
 
-static const struct drm_i915_reg_descriptor *
-__find_reg(const struct drm_i915_reg_descriptor *table, int count, u32 addr)
-{
-	int start = 0, end = count;
-	while (start < end) {
-		int mid = start + (end - start) / 2;
-		int ret = addr - i915_mmio_reg_offset(table[mid].addr);
-		if (ret < 0)
-			end = mid;
-		else if (ret > 0)
-			start = mid + 1;
-		else
-			return &table[mid];
-	}
-	return NULL;
-}
-
 static const struct drm_i915_reg_descriptor *
 find_reg(const struct intel_engine_cs *engine, bool is_master, u32 addr)
 {
-	const struct drm_i915_reg_table *table = engine->reg_tables;
-	int count = engine->reg_table_count;
-
-	do {
-		if (!table->master || is_master) {
-			const struct drm_i915_reg_descriptor *reg;
-
-			reg = __find_reg(table->regs, table->num_regs, addr);
-			if (reg != NULL)
-				return reg;
-		}
-	} while (table++, --count);
-
-	return NULL;
-}
+	const struct i915_reg_index *index = engine->reg_index;
+	int start = 0, end;
 
-/* Returns a vmap'd pointer to dst_obj, which the caller must unmap */
-static u32 *copy_batch(struct drm_i915_gem_object *dst_obj,
-		       struct drm_i915_gem_object *src_obj,
-		       u32 batch_start_offset,
-		       u32 batch_len,
-		       bool *needs_clflush_after)
-{
-	unsigned int src_needs_clflush;
-	unsigned int dst_needs_clflush;
-	void *dst, *src;
-	int ret;
-
-	ret = i915_gem_obj_prepare_shmem_read(src_obj, &src_needs_clflush);
-	if (ret)
-		return ERR_PTR(ret);
-
-	ret = i915_gem_obj_prepare_shmem_write(dst_obj, &dst_needs_clflush);
-	if (ret) {
-		dst = ERR_PTR(ret);
-		goto unpin_src;
-	}
+	if (!index || !test_bit(reg_filter_hash(addr), index->filter))
+		return NULL;
 
-	dst = i915_gem_object_pin_map(dst_obj, I915_MAP_WB);
-	if (IS_ERR(dst))
-		goto unpin_dst;
+	end = index->count;
+	while (start < end) {
+		int mid = start + (end - start) / 2;
 
-	src = ERR_PTR(-ENODEV);
-	if (src_needs_clflush &&
-	    i915_memcpy_from_wc((void *)(uintptr_t)batch_start_offset, NULL, 0)) {
-		src = i915_gem_object_pin_map(src_obj, I915_MAP_WC);
-		if (!IS_ERR(src)) {
-			i915_memcpy_from_wc(dst,
-					    src + batch_start_offset,
-					    ALIGN(batch_len, 16));
-			i915_gem_object_unpin_map(src_obj);
-		}
+		if (index->regs[mid].addr < addr)
+			start = mid + 1;
+		else
+			end = mid;
 	}
-	if (IS_ERR(src)) {
-		void *ptr;
-		int offset, n;
 
-		offset = offset_in_page(batch_start_offset);
-
-		/* We can avoid clflushing partial cachelines before the write
-		 * if we only every write full cache-lines. Since we know that
-		 * both the source and destination are in multiples of
-		 * PAGE_SIZE, we can simply round up to the next cacheline.
-		 * We don't care about copying too much here as we only
-		 * validate up to the end of the batch.
-		 */
-		if (dst_needs_clflush & CLFLUSH_BEFORE)
-			batch_len = roundup(batch_len,
-					    boot_cpu_data.x86_clflush_size);
-
-		ptr = dst;
-		for (n = batch_start_offset >> PAGE_SHIFT; batch_len; n++) {
-			int len = min_t(int, batch_len, PAGE_SIZE - offset);
-
-			src = kmap_atomic(i915_gem_object_get_page(src_obj, n));
-			if (src_needs_clflush)
-				drm_clflush_virt_range(src + offset, len);
-			memcpy(ptr, src + offset, len);
-			kunmap_atomic(src);
-
-			ptr += len;
-			batch_len -= len;
-			offset = 0;
-		}
+	for (; start < index->count && index->regs[start].addr == addr; start++) {
+		if (!index->regs[start].master || is_master)
+			return index->regs[start].desc;
 	}
 
-	/* dst_obj is returned with vmap pinned */
-	*needs_clflush_after = dst_needs_clflush & CLFLUSH_AFTER;
-
-unpin_dst:
-	i915_gem_obj_finish_shmem_access(dst_obj);
-unpin_src:
-	i915_gem_obj_finish_shmem_access(src_obj);
-	return dst;
+	return NULL;
 }
 
 /**
@@ -1189,6 +1217,306 @@ static bool check_cmd(const struct intel_engine_cs *engine,
 
 #define LENGTH_BIAS 2
 
+/* Bytes copied into the shadow batch between two parsing passes */
+#define CMD_PARSER_CHUNK PAGE_SIZE
+
+struct cmd_parser {
+	struct intel_engine_cs *engine;
+	struct drm_i915_cmd_descriptor default_desc;
+	const struct drm_i915_cmd_descriptor *desc;
+	u32 *cmd;
+	u32 *batch_end;
+	bool is_master;
+	bool oacontrol_set; /* OACONTROL tracking. See check_cmd() */
+	bool done;
+	int ret;
+	/* Running batch hash of the validated commands, see batch_hash() */
+	bool want_hash;
+	u32 *hashed;
+	u64 hash;
+};
+
+#define BATCH_HASH_PRIME1 0x9E3779B185EBCA87ULL
+#define BATCH_HASH_PRIME2 0xC2B2AE3D27D4EB4FULL
+
+/*
+ * The batch hash covers the dwords from the start of the batch up to and
+ * including its MI_BATCH_BUFFER_END, i.e. exactly what the parser validated.
+ */
+static inline u64 batch_hash(u64 acc, const u32 *src, const u32 *end)
+{
+	for (; src < end; src++) {
+		acc ^= *src * BATCH_HASH_PRIME2;
+		acc = ((acc << 31) | (acc >> 33)) * BATCH_HASH_PRIME1;
+	}
+	return acc;
+}
+
+static inline u64 batch_hash_final(u64 acc, u32 len)
+{
+	acc ^= len;
+	acc ^= acc >> 33;
+	acc *= BATCH_HASH_PRIME2;
+	acc ^= acc >> 29;
+	return acc;
+}
+
+/*
+ * Validate the commands of the shadow batch that were completely copied, i.e.
+ * that end at or before @end. A command straddling @end is left for the next
+ * pass. Sets parser->done on MI_BATCH_BUFFER_END and parser->ret on error.
+ */
+static void parse_cmds(struct cmd_parser *parser, u32 *end)
+{
+	while (parser->cmd < end) {
+		u32 *cmd = parser->cmd;
+		u32 length;
+
+		if (*cmd == MI_BATCH_BUFFER_END) {
+			parser->done = true;
+			return;
+		}
+
+		parser->desc = find_cmd(parser->engine, *cmd, parser->desc,
+					&parser->default_desc);
+		if (!parser->desc) {
+			DRM_DEBUG_DRIVER("CMD: Unrecognized command: 0x%08X\n",
+					 *cmd);
+			parser->ret = -EINVAL;
+			return;
+		}
+
+		/*
+		 * If the batch buffer contains a chained batch, return an
+		 * error that tells the caller to abort and dispatch the
+		 * workload as a non-secure batch.
+		 */
+		if (parser->desc->cmd.value == MI_BATCH_BUFFER_START) {
+			parser->ret = -EACCES;
+			return;
+		}
+
+		if (parser->desc->flags & CMD_DESC_FIXED)
+			length = parser->desc->length.fixed;
+		else
+			length = ((*cmd & parser->desc->length.mask) +
+				  LENGTH_BIAS);
+
+		if ((parser->batch_end - cmd) < length) {
+			DRM_DEBUG_DRIVER("CMD: Command length exceeds batch length: 0x%08X length=%u batchlen=%td\n",
+					 *cmd,
+					 length,
+					 parser->batch_end - cmd);
+			parser->ret = -EINVAL;
+			return;
+		}
+
+		if ((end - cmd) < length)
+			return;
+
+		if (!check_cmd(parser->engine, parser->desc, cmd, length,
+			       parser->is_master, &parser->oacontrol_set)) {
+			parser->ret = -EINVAL;
+			return;
+		}
+
+		parser->cmd += length;
+	}
+}
+
+static void parse_copied(struct cmd_parser *parser, void *dst, u32 copied)
+{
+	u32 *end;
+
+	parse_cmds(parser, min(parser->batch_end,
+			       (u32 *)(dst + rounddown(copied, sizeof(u32)))));
+
+	/* Hash what was just validated while it is still in the cache */
+	if (parser->want_hash && !parser->ret) {
+		end = parser->done ? parser->cmd + 1 : parser->cmd;
+		parser->hash = batch_hash(parser->hash, parser->hashed, end);
+		parser->hashed = end;
+	}
+}
+
+/*
+ * Copies the batch into dst_obj and validates it as it goes, so that every
+ * command is checked while it is still in the cache. Copying stops as soon as
+ * the parser hits the end of the batch or an error.
+ *
+ * Returns a vmap'd pointer to dst_obj, which the caller must unmap.
+ */
+static u32 *copy_batch(struct drm_i915_gem_object *dst_obj,
+		       struct drm_i915_gem_object *src_obj,
+		       u32 batch_start_offset,
+		       u32 batch_len,
+		       struct cmd_parser *parser,
+		       bool *needs_clflush_after)
+{
+	unsigned int src_needs_clflush;
+	unsigned int dst_needs_clflush;
+	void *dst, *src;
+	u32 copied;
+	int ret;
+
+	ret = i915_gem_obj_prepare_shmem_read(src_obj, &src_needs_clflush);
+	if (ret)
+		return ERR_PTR(ret);
+
+	ret = i915_gem_obj_prepare_shmem_write(dst_obj, &dst_needs_clflush);
+	if (ret) {
+		dst = ERR_PTR(ret);
+		goto unpin_src;
+	}
+
+	dst = i915_gem_object_pin_map(dst_obj, I915_MAP_WB);
+	if (IS_ERR(dst))
+		goto unpin_dst;
+
+	parser->cmd = dst;
+	parser->batch_end = parser->cmd + (batch_len / sizeof(u32));
+	parser->hashed = parser->cmd;
+	parser->hash = BATCH_HASH_PRIME1;
+
+	src = ERR_PTR(-ENODEV);
+	if (src_needs_clflush &&
+	    i915_memcpy_from_wc((void *)(uintptr_t)batch_start_offset, NULL, 0)) {
+		src = i915_gem_object_pin_map(src_obj, I915_MAP_WC);
+		if (!IS_ERR(src)) {
+			for (copied = 0; copied < batch_len; ) {
+				u32 len = min_t(u32, batch_len - copied,
+						CMD_PARSER_CHUNK);
+
+				i915_memcpy_from_wc(dst + copied,
+						    src + batch_start_offset +
+						    copied,
+						    ALIGN(len, 16));
+				copied += len;
+
+				parse_copied(parser, dst, copied);
+				if (parser->done || parser->ret)
+					break;
+			}
+			i915_gem_object_unpin_map(src_obj);
+		}
+	}
+	if (IS_ERR(src)) {
+		void *ptr;
+		int offset, n;
+
+		offset = offset_in_page(batch_start_offset);
+
+		/* We can avoid clflushing partial cachelines before the write
+		 * if we only every write full cache-lines. Since we know that
+		 * both the source and destination are in multiples of
+		 * PAGE_SIZE, we can simply round up to the next cacheline.
+		 * We don't care about copying too much here as we only
+		 * validate up to the end of the batch.
+		 */
+		if (dst_needs_clflush & CLFLUSH_BEFORE)
+			batch_len = roundup(batch_len,
+					    boot_cpu_data.x86_clflush_size);
+
+		ptr = dst;
+		for (n = batch_start_offset >> PAGE_SHIFT; batch_len; n++) {
+			int len = min_t(int, batch_len, PAGE_SIZE - offset);
+
+			src = kmap_atomic(i915_gem_object_get_page(src_obj, n));
+			if (src_needs_clflush)
+				drm_clflush_virt_range(src + offset, len);
+			memcpy(ptr, src + offset, len);
+			kunmap_atomic(src);
+
+			ptr += len;
+			batch_len -= len;
+			offset = 0;
+
+			parse_copied(parser, dst, ptr - dst);
+			if (parser->done || parser->ret)
+				break;
+		}
+	}
+
+	/* dst_obj is returned with vmap pinned */
+	*needs_clflush_after = dst_needs_clflush & CLFLUSH_AFTER;
+
+unpin_dst:
+	i915_gem_obj_finish_shmem_access(dst_obj);
+unpin_src:
+	i915_gem_obj_finish_shmem_access(src_obj);
+	return dst;
+}
+
+/**
+ * intel_engine_cmd_parser_hash() - hash the contents of a batch
+ * @batch_obj: the batch buffer in question
+ * @batch_start_offset: byte offset in the batch at which execution starts
+ * @hash_len: length of the commands to hash, as returned by
+ *	      intel_engine_cmd_parser() for the batch it validated
+ * @hash: returns the 64-bit hash of the batch dwords
+ *
+ * Used to recognize batches that are resubmitted unchanged so that their
+ * validated shadow copy can be reused. The hash is not cryptographic. A
+ * collision only makes the submitter run its own previously validated batch,
+ * never unvalidated commands.
+ *
+ * Return: 0 on success, -EINVAL if the batch is not dword aligned, or the error
+ * from preparing the object for CPU reads.
+ */
+int intel_engine_cmd_parser_hash(struct drm_i915_gem_object *batch_obj,
+				 u32 batch_start_offset,
+				 u32 hash_len,
+				 u64 *hash)
+{
+	unsigned int needs_clflush;
+	u64 acc = BATCH_HASH_PRIME1;
+	u32 len = hash_len;
+	int offset, n, ret;
+
+	if (!IS_ALIGNED(batch_start_offset | hash_len, sizeof(u32)))
+		return -EINVAL;
+
+	ret = i915_gem_obj_prepare_shmem_read(batch_obj, &needs_clflush);
+	if (ret)
+		return ret;
+
+	offset = offset_in_page(batch_start_offset);
+	for (n = batch_start_offset >> PAGE_SHIFT; len; n++) {
+		int chunk = min_t(int, len, PAGE_SIZE - offset);
+		void *vaddr;
+
+		vaddr = kmap_atomic(i915_gem_object_get_page(batch_obj, n));
+		if (needs_clflush)
+			drm_clflush_virt_range(vaddr + offset, chunk);
+		acc = batch_hash(acc, vaddr + offset,
+				 vaddr + offset + chunk);
+		kunmap_atomic(vaddr);
+
+		len -= chunk;
+		offset = 0;
+	}
+
+	i915_gem_obj_finish_shmem_access(batch_obj);
+
+	*hash = batch_hash_final(acc, hash_len);
+	return 0;
+}
+
+static void cmd_parser_account(struct intel_engine_cs *engine,
+			       u32 batch_len, u64 ns)
+{
+	struct intel_cmd_parser_stats *stats = &engine->cmd_parser_stats;
+	int bucket;
+
+	bucket = min_t(int, fls64(div_u64(ns, NSEC_PER_USEC)),
+		       I915_CMD_PARSER_HIST_BUCKETS - 1);
+
+	stats->batches++;
+	stats->bytes += batch_len;
+	stats->time_ns += ns;
+	stats->hist[bucket]++;
+}
+
 /**
  * i915_parse_cmds() - parse a submitted batch buffer for privilege violations
  * @engine: the engine on which the batch is to execute
@@ -1197,9 +1525,14 @@ static bool check_cmd(const struct intel_engine_cs *engine,
  * @batch_start_offset: byte offset in the batch at which execution starts
  * @batch_len: length of the commands in batch_obj
  * @is_master: is the submitting process the drm master?
+ * @hash: if not NULL, returns the hash of the validated commands, see
+ *	  intel_engine_cmd_parser_hash()
+ * @hash_len: returns the length covered by @hash, only used with @hash
  *
  * Parses the specified batch buffer looking for privilege violations as
- * described in the overview.
+ * described in the overview. The commands are validated while the batch is
+ * copied into @shadow_batch_obj, one chunk at a time. The hash is computed
+ * in the same pass.
  *
  * Return: non-zero if the parser finds violations or otherwise fails; -EACCES
  * if the batch appears legal but should use hardware parsing
@@ -1209,90 +1542,55 @@ int intel_engine_cmd_parser(struct intel_engine_cs *engine,
 			    struct drm_i915_gem_object *shadow_batch_obj,
 			    u32 batch_start_offset,
 			    u32 batch_len,
-			    bool is_master)
+			    bool is_master,
+			    u64 *hash,
+			    u32 *hash_len)
 {
-	u32 *cmd, *batch_end;
-	struct drm_i915_cmd_descriptor default_desc = noop_desc;
-	const struct drm_i915_cmd_descriptor *desc = &default_desc;
-	bool oacontrol_set = false; /* OACONTROL tracking. See check_cmd() */
+	struct cmd_parser parser = {
+		.engine = engine,
+		.default_desc = noop_desc,
+		.is_master = is_master,
+		.want_hash = hash != NULL,
+	};
 	bool needs_clflush_after = false;
-	int ret = 0;
+	u32 *cmd;
+	u64 start;
+	int ret;
 
+	start = ktime_get_raw_ns();
+
+	parser.desc = &parser.default_desc;
 	cmd = copy_batch(shadow_batch_obj, batch_obj,
 			 batch_start_offset, batch_len,
-			 &needs_clflush_after);
+			 &parser, &needs_clflush_after);
 	if (IS_ERR(cmd)) {
 		DRM_DEBUG_DRIVER("CMD: Failed to copy batch\n");
 		return PTR_ERR(cmd);
 	}
 
-	/*
-	 * We use the batch length as size because the shadow object is as
-	 * large or larger and copy_batch() will write MI_NOPs to the extra
-	 * space. Parsing should be faster in some cases this way.
-	 */
-	batch_end = cmd + (batch_len / sizeof(*batch_end));
-	while (cmd < batch_end) {
-		u32 length;
-
-		if (*cmd == MI_BATCH_BUFFER_END)
-			break;
-
-		desc = find_cmd(engine, *cmd, desc, &default_desc);
-		if (!desc) {
-			DRM_DEBUG_DRIVER("CMD: Unrecognized command: 0x%08X\n",
-					 *cmd);
-			ret = -EINVAL;
-			break;
-		}
-
-		/*
-		 * If the batch buffer contains a chained batch, return an
-		 * error that tells the caller to abort and dispatch the
-		 * workload as a non-secure batch.
-		 */
-		if (desc->cmd.value == MI_BATCH_BUFFER_START) {
-			ret = -EACCES;
-			break;
-		}
-
-		if (desc->flags & CMD_DESC_FIXED)
-			length = desc->length.fixed;
-		else
-			length = ((*cmd & desc->length.mask) + LENGTH_BIAS);
-
-		if ((batch_end - cmd) < length) {
-			DRM_DEBUG_DRIVER("CMD: Command length exceeds batch length: 0x%08X length=%u batchlen=%td\n",
-					 *cmd,
-					 length,
-					 batch_end - cmd);
-			ret = -EINVAL;
-			break;
-		}
-
-		if (!check_cmd(engine, desc, cmd, length, is_master,
-			       &oacontrol_set)) {
-			ret = -EINVAL;
-			break;
-		}
-
-		cmd += length;
-	}
+	ret = parser.ret;
 
-	if (oacontrol_set) {
+	if (parser.oacontrol_set) {
 		DRM_DEBUG_DRIVER("CMD: batch set OACONTROL but did not clear it\n");
 		ret = -EINVAL;
 	}
 
-	if (cmd >= batch_end) {
+	if (ret == 0 && !parser.done) {
 		DRM_DEBUG_DRIVER("CMD: Got to the end of the buffer w/o a BBE cmd!\n");
 		ret = -EINVAL;
 	}
 
+	if (ret == 0 && hash) {
+		*hash_len = (parser.hashed - cmd) * sizeof(u32);
+		*hash = batch_hash_final(parser.hash, *hash_len);
+	}
+
 	if (ret == 0 && needs_clflush_after)
 		drm_clflush_virt_range(shadow_batch_obj->mapping, batch_len);
 	i915_gem_object_unpin_map(shadow_batch_obj);
 
+	cmd_parser_account(engine, batch_len, ktime_get_raw_ns() - start);
+
 	return ret;
 }
 
@@ -340,10 +340,13 @@ static void print_batch_pool_stats(struct seq_file *m,
 	memset(&stats, 0, sizeof(stats));
 
 	for_each_engine(engine, dev_priv) {
-		for (j = 0; j < ARRAY_SIZE(engine->batch_pool.cache_list); j++) {
-			list_for_each_entry(obj,
-					    &engine->batch_pool.cache_list[j],
-					    batch_pool_link)
+		for (j = 0; j < ARRAY_SIZE(engine->batch_pool.classes); j++) {
+			struct i915_gem_batch_pool_class *class =
+				&engine->batch_pool.classes[j];
+
+			list_for_each_entry(obj, &class->busy, batch_pool_link)
+				per_file_stats(0, obj, &stats);
+			list_for_each_entry(obj, &class->idle, batch_pool_link)
 				per_file_stats(0, obj, &stats);
 		}
 	}
@@ -616,27 +619,43 @@ static int i915_gem_batch_pool_info(struct seq_file *m, void *data)
 		return ret;
 
 	for_each_engine(engine, dev_priv) {
-		for (j = 0; j < ARRAY_SIZE(engine->batch_pool.cache_list); j++) {
-			int count;
-
-			count = 0;
-			list_for_each_entry(obj,
-					    &engine->batch_pool.cache_list[j],
-					    batch_pool_link)
-				count++;
-			seq_printf(m, "%s cache[%d]: %d objects\n",
-				   engine->name, j, count);
-
-			list_for_each_entry(obj,
-					    &engine->batch_pool.cache_list[j],
-					    batch_pool_link) {
+		struct i915_gem_batch_pool *pool = &engine->batch_pool;
+
+		for (j = 0; j < ARRAY_SIZE(pool->classes); j++) {
+			struct i915_gem_batch_pool_class *class =
+				&pool->classes[j];
+			int busy, idle;
+
+			busy = 0;
+			list_for_each_entry(obj, &class->busy, batch_pool_link)
+				busy++;
+			idle = 0;
+			list_for_each_entry(obj, &class->idle, batch_pool_link)
+				idle++;
+			if (!busy && !idle)
+				continue;
+
+			seq_printf(m, "%s class[%d]: %d busy, %d idle objects\n",
+				   engine->name, j, busy, idle);
+
+			list_for_each_entry(obj, &class->busy, batch_pool_link) {
+				seq_puts(m, "   ");
+				describe_obj(m, obj);
+				seq_putc(m, '\n');
+			}
+			list_for_each_entry(obj, &class->idle, batch_pool_link) {
 				seq_puts(m, "   ");
 				describe_obj(m, obj);
 				seq_putc(m, '\n');
 			}
 
-			total += count;
+			total += busy + idle;
 		}
+
+		seq_printf(m, "%s: %zu idle bytes (high water %zu), %lu reused, %lu created, %lu purged, %lu trimmed\n",
+			   engine->name, pool->idle_size, pool->high_water,
+			   pool->stats.reused, pool->stats.created,
+			   pool->stats.purged, pool->stats.trimmed);
 	}
 
 	seq_printf(m, "total: %d\n", total);
@@ -646,6 +665,112 @@ static int i915_gem_batch_pool_info(struct seq_file *m, void *data)
 	return 0;
 }
 
+static int i915_cmd_parser_info(struct seq_file *m, void *data)
+{
+	struct drm_i915_private *dev_priv = node_to_i915(m->private);
+	struct drm_device *dev = &dev_priv->drm;
+	struct intel_engine_cs *engine;
+	int ret, i;
+
+	ret = mutex_lock_interruptible(&dev->struct_mutex);
+	if (ret)
+		return ret;
+
+	for_each_engine(engine, dev_priv) {
+		const struct intel_cmd_parser_stats *stats =
+			&engine->cmd_parser_stats;
+
+		if (!intel_engine_needs_cmd_parser(engine))
+			continue;
+
+		seq_printf(m, "%s: %llu batches, %llu bytes, %llu us",
+			   engine->name, stats->batches, stats->bytes,
+			   div_u64(stats->time_ns, NSEC_PER_USEC));
+		if (stats->bytes)
+			seq_printf(m, ", %llu us/MB",
+				   div64_u64(stats->time_ns,
+					     (stats->bytes + 1023) >> 10) *
+				   1024 / NSEC_PER_USEC);
+		seq_putc(m, '\n');
+		seq_printf(m, "  batch cache: %llu hits, %llu misses\n",
+			   stats->cache_hits, stats->cache_misses);
+
+		for (i = 0; i < I915_CMD_PARSER_HIST_BUCKETS; i++) {
+			if (!stats->hist[i])
+				continue;
+			if (i == I915_CMD_PARSER_HIST_BUCKETS - 1)
+				seq_printf(m, "   >=%6u us: %llu\n",
+					   1u << (i - 1), stats->hist[i]);
+			else
+				seq_printf(m, "    <%6u us: %llu\n",
+					   1u << i, stats->hist[i]);
+		}
+	}
+
+	mutex_unlock(&dev->struct_mutex);
+
+	return 0;
+}
+
+static int i915_memcpy_from_wc_info(struct seq_file *m, void *data)
+{
+	struct drm_i915_private *dev_priv = node_to_i915(m->private);
+	struct drm_device *dev = &dev_priv->drm;
+	struct drm_i915_gem_object *obj;
+	const unsigned long len = 1 << 20;
+	void *src, *dst;
+	int ret;
+
+	dst = drm_malloc_gfp(len >> PAGE_SHIFT, PAGE_SIZE, GFP_KERNEL);
+	if (!dst)
+		return -ENOMEM;
+
+	ret = mutex_lock_interruptible(&dev->struct_mutex);
+	if (ret)
+		goto out_free;
+
+	obj = i915_gem_object_create(dev, len);
+	if (IS_ERR(obj)) {
+		ret = PTR_ERR(obj);
+		goto out_unlock;
+	}
+
+	src = i915_gem_object_pin_map(obj, I915_MAP_WC);
+	if (IS_ERR(src)) {
+		ret = PTR_ERR(src);
+		goto out_put;
+	}
+
+	memset(src, 0, len);
+	i915_memcpy_from_wc_benchmark(m, dst, src, len);
+
+	i915_gem_object_unpin_map(obj);
+out_put:
+	i915_gem_object_put(obj);
+out_unlock:
+	mutex_unlock(&dev->struct_mutex);
+out_free:
+	drm_free_large(dst);
+	return ret;
+}
+
+static int i915_gem_reloc_benchmark_info(struct seq_file *m, void *data)
+{
+	struct drm_i915_private *dev_priv = node_to_i915(m->private);
+	struct drm_device *dev = &dev_priv->drm;
+	int ret;
+
+	ret = mutex_lock_interruptible(&dev->struct_mutex);
+	if (ret)
+		return ret;
+
+	ret = i915_gem_execbuffer_reloc_benchmark(m, dev_priv);
+
+	mutex_unlock(&dev->struct_mutex);
+
+	return ret;
+}
+
 static int i915_gem_request_info(struct seq_file *m, void *data)
 {
 	struct drm_i915_private *dev_priv = node_to_i915(m->private);
@@ -5285,6 +5410,9 @@ static const struct drm_info_list i915_debugfs_list[] = {
 	{"i915_gem_hws_bsd", i915_hws_info, 0, (void *)VCS},
 	{"i915_gem_hws_vebox", i915_hws_info, 0, (void *)VECS},
 	{"i915_gem_batch_pool", i915_gem_batch_pool_info, 0},
+	{"i915_memcpy_from_wc", i915_memcpy_from_wc_info, 0},
+	{"i915_gem_reloc_benchmark", i915_gem_reloc_benchmark_info, 0},
+	{"i915_cmd_parser", i915_cmd_parser_info, 0},
 	{"i915_guc_info", i915_guc_info, 0},
 	{"i915_guc_load_status", i915_guc_load_status_info, 0},
 	{"i915_guc_log_dump", i915_guc_log_dump, 0},
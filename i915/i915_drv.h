@@ -42,6 +42,7 @@
 #include <linux/intel-iommu.h>
 #include <linux/kref.h>
 #include <linux/pm_qos.h>
+#include <linux/radix-tree.h>
 #include <linux/shmem_fs.h>
 
 #include <drm/drmP.h>
@@ -890,6 +891,22 @@ struct i915_ctx_hang_stats {
 /* This must match up with the value previously used for execbuf2.rsvd1. */
 #define DEFAULT_CONTEXT_HANDLE 0
 
+/*
+ * An entry in a context's handles_vma table, also linked to the object so
+ * that closing the handle removes it again. Protected by struct_mutex.
+ */
+struct i915_lut_handle {
+	struct list_head obj_link;
+	struct list_head ctx_link;
+	struct i915_gem_context *ctx;
+	u32 handle;
+};
+
+/* Number of validated shadow batches a context keeps for reuse */
+#define I915_BATCH_CACHE_SIZE 8
+/* Pinned shadow batch bytes all contexts together keep for reuse */
+#define I915_BATCH_CACHE_BYTES (16 << 20)
+
 /**
  * struct i915_gem_context - as the name implies, represents a context.
  * @ref: reference count.
@@ -897,6 +914,7 @@ struct i915_ctx_hang_stats {
  * @remap_slice: l3 row remapping information.
  * @flags: context specific flags:
  *         CONTEXT_NO_ZEROMAP: do not allow mapping things to page 0.
+ *         CONTEXT_BATCH_CACHE: reuse shadow batches of identical batches.
  * @file_priv: filp associated with this context (NULL for global default
  *	       context).
  * @hang_stats: information about the role of this context in possible GPU
@@ -905,6 +923,8 @@ struct i915_ctx_hang_stats {
  * @legacy_hw_ctx: render context backing object and whether it is correctly
  *                initialized (legacy ring submission mechanism only).
  * @link: link in the global list of contexts.
+ * @handles_vma: execbuffer lookup table from object handle to vma.
+ * @handles_list: the i915_lut_handle entries of @handles_vma.
  *
  * Contexts are memory images used by the hardware to store copies of their
  * internal state.
@@ -925,6 +945,7 @@ struct i915_gem_context {
 	unsigned long flags;
 #define CONTEXT_NO_ZEROMAP		BIT(0)
 #define CONTEXT_NO_ERROR_CAPTURE	BIT(1)
+#define CONTEXT_BATCH_CACHE		BIT(2)
 
 	/* Unique identifier for this context, used by the hw for tracking */
 	unsigned int hw_id;
@@ -947,8 +968,35 @@ struct i915_gem_context {
 
 	struct list_head link;
 
+	struct radix_tree_root handles_vma;
+	struct list_head handles_list;
+
 	u8 remap_slice;
 	bool closed:1;
+
+	/**
+	 * @batch_cache: Shadow batches the command parser accepted, reused
+	 * when the same batch is submitted again unchanged. Only used with
+	 * CONTEXT_BATCH_CACHE, protected by struct_mutex.
+	 */
+	struct i915_batch_cache_entry {
+		struct drm_i915_gem_object *shadow;
+		/*
+		 * Only compared against, never dereferenced: no reference is
+		 * held, so the object may be gone and its address reused.
+		 * The hash check makes that harmless.
+		 */
+		const struct drm_i915_gem_object *batch;
+		u64 hash;
+		u32 hash_len;
+		u32 batch_start_offset;
+		u32 batch_len;
+		enum intel_engine_id engine;
+		bool is_master;
+		unsigned long last_use;
+		struct list_head lru_link;
+	} batch_cache[I915_BATCH_CACHE_SIZE];
+	unsigned long batch_cache_clock;
 };
 
 enum fb_op_origin {
@@ -1357,6 +1405,14 @@ struct i915_gem_mm {
 	/** LRU list of objects with fence regs on them. */
 	struct list_head fence_list;
 
+	/**
+	 * LRU list of the shadow batches cached by all contexts, see
+	 * i915_gem_batch_cache_trim(). Their size adds up to
+	 * batch_cache_bytes, at most I915_BATCH_CACHE_BYTES.
+	 */
+	struct list_head batch_cache_lru;
+	u64 batch_cache_bytes;
+
 	/**
 	 * Are we in a non-interruptible section of code like
 	 * modesetting?
@@ -2212,6 +2268,9 @@ struct drm_i915_gem_object {
 	/** Used in execbuf to temporarily hold a ref */
 	struct list_head obj_exec_link;
 
+	/** Entries for this object in the contexts' handles_vma tables */
+	struct list_head lut_list;
+
 	struct list_head batch_pool_link;
 
 	unsigned long flags;
@@ -3070,6 +3129,10 @@ int i915_gem_execbuffer(struct drm_device *dev, void *data,
 			struct drm_file *file_priv);
 int i915_gem_execbuffer2(struct drm_device *dev, void *data,
 			 struct drm_file *file_priv);
+#ifdef CONFIG_DEBUG_FS
+int i915_gem_execbuffer_reloc_benchmark(struct seq_file *m,
+					struct drm_i915_private *dev_priv);
+#endif
 int i915_gem_busy_ioctl(struct drm_device *dev, void *data,
 			struct drm_file *file_priv);
 int i915_gem_get_caching_ioctl(struct drm_device *dev, void *data,
@@ -3431,6 +3494,10 @@ void i915_gem_context_close(struct drm_device *dev, struct drm_file *file);
 int i915_switch_context(struct drm_i915_gem_request *req);
 int i915_gem_switch_to_kernel_context(struct drm_i915_private *dev_priv);
 void i915_gem_context_free(struct kref *ctx_ref);
+void i915_gem_context_flush_batch_cache(struct i915_gem_context *ctx);
+void i915_gem_batch_cache_release(struct drm_i915_private *dev_priv,
+				  struct i915_batch_cache_entry *entry);
+void i915_gem_batch_cache_trim(struct drm_i915_private *dev_priv, u64 target);
 struct drm_i915_gem_object *
 i915_gem_alloc_context_obj(struct drm_device *dev, size_t size);
 struct i915_gem_context *
@@ -3579,6 +3646,10 @@ const char *i915_cache_level_str(struct drm_i915_private *i915, int type);
 
 /* i915_cmd_parser.c */
 int i915_cmd_parser_get_version(struct drm_i915_private *dev_priv);
+int intel_engine_cmd_parser_hash(struct drm_i915_gem_object *batch_obj,
+				 u32 batch_start_offset,
+				 u32 hash_len,
+				 u64 *hash);
 void intel_engine_init_cmd_parser(struct intel_engine_cs *engine);
 void intel_engine_cleanup_cmd_parser(struct intel_engine_cs *engine);
 bool intel_engine_needs_cmd_parser(struct intel_engine_cs *engine);
@@ -3587,7 +3658,9 @@ int intel_engine_cmd_parser(struct intel_engine_cs *engine,
 			    struct drm_i915_gem_object *shadow_batch_obj,
 			    u32 batch_start_offset,
 			    u32 batch_len,
-			    bool is_master);
+			    bool is_master,
+			    u64 *hash,
+			    u32 *hash_len);
 
 /* i915_suspend.c */
 extern int i915_save_state(struct drm_device *dev);
@@ -3970,6 +4043,11 @@ void i915_locks_destroy(struct drm_i915_private *dev_priv);
 
 void i915_memcpy_init_early(struct drm_i915_private *dev_priv);
 bool i915_memcpy_from_wc(void *dst, const void *src, unsigned long len);
+void i915_unaligned_memcpy_from_wc(void *dst, const void *src, unsigned long len);
+#ifdef CONFIG_DEBUG_FS
+void i915_memcpy_from_wc_benchmark(struct seq_file *m, void *dst,
+				   const void *src, unsigned long len);
+#endif
 
 /* i915_mm.c */
 int remap_io_mapping(struct vm_area_struct *vma,
@@ -2865,9 +2865,22 @@ void i915_gem_close_object(struct drm_gem_object *gem, struct drm_file *file)
 {
 	struct drm_i915_gem_object *obj = to_intel_bo(gem);
 	struct drm_i915_file_private *fpriv = file->driver_priv;
+	struct i915_lut_handle *lut, *ln;
 	struct i915_vma *vma, *vn;
 
 	mutex_lock(&obj->base.dev->struct_mutex);
+
+	/* Drop the handle from the execbuffer lookup tables of the file */
+	list_for_each_entry_safe(lut, ln, &obj->lut_list, obj_link) {
+		if (lut->ctx->file_priv != fpriv)
+			continue;
+
+		radix_tree_delete(&lut->ctx->handles_vma, lut->handle);
+		list_del(&lut->ctx_link);
+		list_del(&lut->obj_link);
+		kfree(lut);
+	}
+
 	list_for_each_entry_safe(vma, vn, &obj->vma_list, obj_link)
 		if (vma->vm->file == fpriv)
 			i915_vma_close(vma);
@@ -4186,6 +4199,7 @@ void i915_gem_object_init(struct drm_i915_gem_object *obj,
 	init_request_active(&obj->last_write,
 			    i915_gem_object_retire__write);
 	INIT_LIST_HEAD(&obj->obj_exec_link);
+	INIT_LIST_HEAD(&obj->lut_list);
 	INIT_LIST_HEAD(&obj->vma_list);
 	INIT_LIST_HEAD(&obj->batch_pool_link);
 
@@ -4688,6 +4702,7 @@ i915_gem_load_init(struct drm_device *dev)
 	INIT_LIST_HEAD(&dev_priv->mm.unbound_list);
 	INIT_LIST_HEAD(&dev_priv->mm.bound_list);
 	INIT_LIST_HEAD(&dev_priv->mm.fence_list);
+	INIT_LIST_HEAD(&dev_priv->mm.batch_cache_lru);
 	for (i = 0; i < I915_NUM_ENGINES; i++)
 		init_engine_lists(&dev_priv->engine[i]);
 	INIT_DELAYED_WORK(&dev_priv->gt.retire_work,
@@ -37,8 +37,99 @@
  * The batch pool framework provides a mechanism for the driver to manage a
  * set of scratch buffers to use for this purpose. The framework can be
  * extended to support other uses cases should they arise.
+ *
+ * Buffers are kept in power-of-two size classes. Each class has a busy list of
+ * buffers that were handed out and an idle list of buffers the GPU is done
+ * with, so finding a buffer to reuse never has to look past buffers that are
+ * still in flight. Buffers purged by the shrinker and idle buffers above the
+ * engine's high-water mark are released from a background worker instead of
+ * on the allocation path.
  */
 
+static inline int batch_pool_class(size_t size)
+{
+	int n = fls(DIV_ROUND_UP(size, PAGE_SIZE) - 1);
+
+	return min(n, I915_BATCH_POOL_CLASSES - 1);
+}
+
+static void batch_pool_free_idle(struct i915_gem_batch_pool *pool,
+				 struct drm_i915_gem_object *obj)
+{
+	pool->idle_size -= obj->base.size;
+	list_del(&obj->batch_pool_link);
+	i915_gem_object_put(obj);
+}
+
+/* Move buffers the GPU has finished with from the busy to the idle list */
+static void batch_pool_retire(struct i915_gem_batch_pool *pool,
+			      struct i915_gem_batch_pool_class *class)
+{
+	struct drm_i915_gem_object *obj, *next;
+
+	list_for_each_entry_safe(obj, next, &class->busy, batch_pool_link) {
+		/* The batches are strictly LRU ordered */
+		if (!i915_gem_active_is_idle(&obj->last_read[pool->engine->id],
+					     &obj->base.dev->struct_mutex))
+			break;
+
+		list_move_tail(&obj->batch_pool_link, &class->idle);
+		pool->idle_size += obj->base.size;
+	}
+}
+
+static void batch_pool_reap(struct i915_gem_batch_pool *pool)
+{
+	struct drm_i915_gem_object *obj, *next;
+	int n;
+
+	for (n = 0; n < I915_BATCH_POOL_CLASSES; n++) {
+		struct i915_gem_batch_pool_class *class = &pool->classes[n];
+
+		batch_pool_retire(pool, class);
+
+		list_for_each_entry_safe(obj, next, &class->idle,
+					 batch_pool_link) {
+			if (obj->madv == __I915_MADV_PURGED) {
+				batch_pool_free_idle(pool, obj);
+				pool->stats.purged++;
+			}
+		}
+	}
+
+	/* Trim the largest, least recently used buffers first */
+	for (n = I915_BATCH_POOL_CLASSES - 1;
+	     n >= 0 && pool->idle_size > pool->high_water; n--) {
+		struct i915_gem_batch_pool_class *class = &pool->classes[n];
+
+		while (!list_empty(&class->idle) &&
+		       pool->idle_size > pool->high_water) {
+			obj = list_first_entry(&class->idle, typeof(*obj),
+					       batch_pool_link);
+			batch_pool_free_idle(pool, obj);
+			pool->stats.trimmed++;
+		}
+	}
+}
+
+static void batch_pool_reap_worker(struct work_struct *work)
+{
+	struct i915_gem_batch_pool *pool =
+		container_of(work, typeof(*pool), reap_work.work);
+	struct drm_device *dev = &pool->engine->i915->drm;
+
+	/*
+	 * Never wait for struct_mutex here, fini cancels us while holding it.
+	 * If it is contended the next allocation reschedules us anyway.
+	 */
+	if (!mutex_trylock(&dev->struct_mutex))
+		return;
+
+	batch_pool_reap(pool);
+
+	mutex_unlock(&dev->struct_mutex);
+}
+
 /**
  * i915_gem_batch_pool_init() - initialize a batch buffer pool
  * @engine: the associated request submission engine
@@ -51,8 +142,15 @@ void i915_gem_batch_pool_init(struct intel_engine_cs *engine,
 
 	pool->engine = engine;
 
-	for (n = 0; n < ARRAY_SIZE(pool->cache_list); n++)
-		INIT_LIST_HEAD(&pool->cache_list[n]);
+	for (n = 0; n < ARRAY_SIZE(pool->classes); n++) {
+		INIT_LIST_HEAD(&pool->classes[n].busy);
+		INIT_LIST_HEAD(&pool->classes[n].idle);
+	}
+
+	INIT_DELAYED_WORK(&pool->reap_work, batch_pool_reap_worker);
+	pool->idle_size = 0;
+	pool->high_water = I915_BATCH_POOL_HIGH_WATER;
+	memset(&pool->stats, 0, sizeof(pool->stats));
 }
 
 /**
@@ -67,16 +165,24 @@ void i915_gem_batch_pool_fini(struct i915_gem_batch_pool *pool)
 
 	lockdep_assert_held(&pool->engine->i915->drm.struct_mutex);
 
-	for (n = 0; n < ARRAY_SIZE(pool->cache_list); n++) {
+	cancel_delayed_work_sync(&pool->reap_work);
+
+	for (n = 0; n < ARRAY_SIZE(pool->classes); n++) {
+		struct i915_gem_batch_pool_class *class = &pool->classes[n];
 		struct drm_i915_gem_object *obj, *next;
 
-		list_for_each_entry_safe(obj, next,
-					 &pool->cache_list[n],
+		list_for_each_entry_safe(obj, next, &class->busy,
+					 batch_pool_link)
+			i915_gem_object_put(obj);
+		list_for_each_entry_safe(obj, next, &class->idle,
 					 batch_pool_link)
 			i915_gem_object_put(obj);
 
-		INIT_LIST_HEAD(&pool->cache_list[n]);
+		INIT_LIST_HEAD(&class->busy);
+		INIT_LIST_HEAD(&class->idle);
 	}
+
+	pool->idle_size = 0;
 }
 
 /**
@@ -96,34 +202,24 @@ struct drm_i915_gem_object *
 i915_gem_batch_pool_get(struct i915_gem_batch_pool *pool,
 			size_t size)
 {
+	struct i915_gem_batch_pool_class *class;
 	struct drm_i915_gem_object *obj = NULL;
-	struct drm_i915_gem_object *tmp, *next;
-	struct list_head *list;
+	struct drm_i915_gem_object *tmp;
 	int n;
 
 	lockdep_assert_held(&pool->engine->i915->drm.struct_mutex);
 
-	/* Compute a power-of-two bucket, but throw everything greater than
-	 * 16KiB into the same bucket: i.e. the the buckets hold objects of
-	 * (1 page, 2 pages, 4 pages, 8+ pages).
-	 */
-	n = fls(size >> PAGE_SHIFT) - 1;
-	if (n >= ARRAY_SIZE(pool->cache_list))
-		n = ARRAY_SIZE(pool->cache_list) - 1;
-	list = &pool->cache_list[n];
-
-	list_for_each_entry_safe(tmp, next, list, batch_pool_link) {
-		/* The batches are strictly LRU ordered */
-		if (!i915_gem_active_is_idle(&tmp->last_read[pool->engine->id],
-					     &tmp->base.dev->struct_mutex))
-			break;
+	n = batch_pool_class(size);
+	class = &pool->classes[n];
+	batch_pool_retire(pool, class);
 
-		/* While we're looping, do some clean up */
-		if (tmp->madv == __I915_MADV_PURGED) {
-			list_del(&tmp->batch_pool_link);
-			i915_gem_object_put(tmp);
+	/*
+	 * Every idle buffer of a regular class is large enough, only the last
+	 * class needs a size check. Purged buffers are left to the reaper.
+	 */
+	list_for_each_entry(tmp, &class->idle, batch_pool_link) {
+		if (tmp->madv == __I915_MADV_PURGED)
 			continue;
-		}
 
 		if (tmp->base.size >= size) {
 			obj = tmp;
@@ -131,9 +227,15 @@ i915_gem_batch_pool_get(struct i915_gem_batch_pool *pool,
 		}
 	}
 
-	if (obj == NULL) {
+	if (obj) {
+		pool->idle_size -= obj->base.size;
+		pool->stats.reused++;
+	} else {
 		int ret;
 
+		if (n < I915_BATCH_POOL_CLASSES - 1)
+			size = PAGE_SIZE << n;
+
 		obj = i915_gem_object_create(&pool->engine->i915->drm, size);
 		if (IS_ERR(obj))
 			return obj;
@@ -143,9 +245,12 @@ i915_gem_batch_pool_get(struct i915_gem_batch_pool *pool,
 			return ERR_PTR(ret);
 
 		obj->madv = I915_MADV_DONTNEED;
+		pool->stats.created++;
 	}
 
-	list_move_tail(&obj->batch_pool_link, list);
+	list_move_tail(&obj->batch_pool_link, &class->busy);
 	i915_gem_object_pin_pages(obj);
+
+	schedule_delayed_work(&pool->reap_work, HZ);
 	return obj;
 }
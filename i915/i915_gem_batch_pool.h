@@ -29,9 +29,34 @@
 
 struct intel_engine_cs;
 
+/*
+ * Size classes of 1, 2, 4, ... pages. Objects in all but the last class are
+ * allocated with the full class size, so any idle object of a class can serve
+ * a request for it. The last class holds everything larger, at its exact size.
+ */
+#define I915_BATCH_POOL_CLASSES	12
+
+/* Idle bytes an engine keeps cached before the reaper trims them */
+#define I915_BATCH_POOL_HIGH_WATER	(8 << 20)
+
 struct i915_gem_batch_pool {
 	struct intel_engine_cs *engine;
-	struct list_head cache_list[4];
+	struct i915_gem_batch_pool_class {
+		/* Handed out, possibly still in use by the GPU, LRU ordered */
+		struct list_head busy;
+		/* Known idle, ready for reuse, LRU ordered */
+		struct list_head idle;
+	} classes[I915_BATCH_POOL_CLASSES];
+	struct delayed_work reap_work;
+	size_t idle_size;
+	size_t high_water;
+
+	struct {
+		unsigned long reused;
+		unsigned long created;
+		unsigned long purged;
+		unsigned long trimmed;
+	} stats;
 };
 
 /* i915_gem_batch_pool.c */
@@ -134,6 +134,65 @@ static int get_context_size(struct drm_i915_private *dev_priv)
 	return ret;
 }
 
+/**
+ * i915_gem_batch_cache_release() - drop a cached shadow batch
+ * @dev_priv: i915 device
+ * @entry: the batch cache entry, may be empty
+ *
+ * Unpins the shadow batch and removes it from the global LRU. Callers must
+ * hold the struct_mutex.
+ */
+void i915_gem_batch_cache_release(struct drm_i915_private *dev_priv,
+				  struct i915_batch_cache_entry *entry)
+{
+	lockdep_assert_held(&dev_priv->drm.struct_mutex);
+
+	if (!entry->shadow)
+		return;
+
+	list_del(&entry->lru_link);
+	dev_priv->mm.batch_cache_bytes -= entry->shadow->base.size;
+
+	i915_gem_object_unpin_pages(entry->shadow);
+	i915_gem_object_put(entry->shadow);
+	entry->shadow = NULL;
+}
+
+/**
+ * i915_gem_batch_cache_trim() - limit the memory held by cached batches
+ * @dev_priv: i915 device
+ * @target: number of bytes to keep at most
+ *
+ * Releases the least recently used shadow batches of all contexts until
+ * the cached ones take up no more than @target bytes. Callers must hold
+ * the struct_mutex.
+ */
+void i915_gem_batch_cache_trim(struct drm_i915_private *dev_priv, u64 target)
+{
+	struct i915_batch_cache_entry *entry;
+
+	while (dev_priv->mm.batch_cache_bytes > target) {
+		entry = list_first_entry(&dev_priv->mm.batch_cache_lru,
+					 typeof(*entry), lru_link);
+		i915_gem_batch_cache_release(dev_priv, entry);
+	}
+}
+
+/**
+ * i915_gem_context_flush_batch_cache() - drop all cached shadow batches
+ * @ctx: the context
+ *
+ * Releases the shadow batches kept for CONTEXT_BATCH_CACHE. Callers must hold
+ * the struct_mutex.
+ */
+void i915_gem_context_flush_batch_cache(struct i915_gem_context *ctx)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(ctx->batch_cache); i++)
+		i915_gem_batch_cache_release(ctx->i915, &ctx->batch_cache[i]);
+}
+
 void i915_gem_context_free(struct kref *ctx_ref)
 {
 	struct i915_gem_context *ctx = container_of(ctx_ref, typeof(*ctx), ref);
@@ -144,6 +203,7 @@ void i915_gem_context_free(struct kref *ctx_ref)
 	GEM_BUG_ON(!ctx->closed);
 
 	i915_ppgtt_put(ctx->ppgtt);
+	i915_gem_context_flush_batch_cache(ctx);
 
 	for (i = 0; i < I915_NUM_ENGINES; i++) {
 		struct intel_context *ce = &ctx->engine[i];
@@ -225,10 +285,23 @@ static void i915_ppgtt_close(struct i915_address_space *vm)
 	}
 }
 
+static void lut_close(struct i915_gem_context *ctx)
+{
+	struct i915_lut_handle *lut, *ln;
+
+	list_for_each_entry_safe(lut, ln, &ctx->handles_list, ctx_link) {
+		radix_tree_delete(&ctx->handles_vma, lut->handle);
+		list_del(&lut->obj_link);
+		kfree(lut);
+	}
+	INIT_LIST_HEAD(&ctx->handles_list);
+}
+
 static void context_close(struct i915_gem_context *ctx)
 {
 	GEM_BUG_ON(ctx->closed);
 	ctx->closed = true;
+	lut_close(ctx);
 	if (ctx->ppgtt)
 		i915_ppgtt_close(&ctx->ppgtt->base);
 	ctx->file_priv = ERR_PTR(-EBADF);
@@ -279,6 +352,9 @@ __create_hw_context(struct drm_device *dev,
 	list_add_tail(&ctx->link, &dev_priv->context_list);
 	ctx->i915 = dev_priv;
 
+	INIT_RADIX_TREE(&ctx->handles_vma, GFP_KERNEL);
+	INIT_LIST_HEAD(&ctx->handles_list);
+
 	ctx->ggtt_alignment = get_context_alignment(dev_priv);
 
 	if (dev_priv->hw_context_size) {
@@ -1061,6 +1137,9 @@ int i915_gem_context_getparam_ioctl(struct drm_device *dev, void *data,
 	case I915_CONTEXT_PARAM_NO_ERROR_CAPTURE:
 		args->value = !!(ctx->flags & CONTEXT_NO_ERROR_CAPTURE);
 		break;
+	case I915_CONTEXT_PARAM_BATCH_CACHE:
+		args->value = !!(ctx->flags & CONTEXT_BATCH_CACHE);
+		break;
 	default:
 		ret = -EINVAL;
 		break;
@@ -1116,6 +1195,16 @@ int i915_gem_context_setparam_ioctl(struct drm_device *dev, void *data,
 				ctx->flags &= ~CONTEXT_NO_ERROR_CAPTURE;
 		}
 		break;
+	case I915_CONTEXT_PARAM_BATCH_CACHE:
+		if (args->size) {
+			ret = -EINVAL;
+		} else if (args->value) {
+			ctx->flags |= CONTEXT_BATCH_CACHE;
+		} else {
+			ctx->flags &= ~CONTEXT_BATCH_CACHE;
+			i915_gem_context_flush_batch_cache(ctx);
+		}
+		break;
 	default:
 		ret = -EINVAL;
 		break;
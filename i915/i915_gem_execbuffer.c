@@ -28,9 +28,11 @@
 
 #include <linux/dma_remapping.h>
 #include <linux/reservation.h>
+#include <linux/sort.h>
 #include <linux/uaccess.h>
 
 #include <drm/drmP.h>
+#include <drm/drm_syncobj.h>
 #include <drm/i915_drm.h>
 
 #include "i915_drv.h"
@@ -68,6 +70,8 @@ struct i915_execbuffer_params {
 struct eb_vmas {
 	struct drm_i915_private *i915;
 	struct list_head vmas;
+	struct reloc_write *reloc_writes;
+	unsigned int reloc_batch;
 	int and;
 	union {
 		struct i915_vma *lut[0];
@@ -106,6 +110,8 @@ eb_create(struct drm_i915_private *i915,
 
 	eb->i915 = i915;
 	INIT_LIST_HEAD(&eb->vmas);
+	eb->reloc_writes = NULL;
+	eb->reloc_batch = 0;
 	return eb;
 }
 
@@ -136,100 +142,119 @@ eb_get_batch(struct eb_vmas *eb)
 	return vma;
 }
 
+static struct i915_vma *
+eb_lookup_vma_slow(struct i915_gem_context *ctx,
+		   struct i915_address_space *vm,
+		   struct drm_file *file,
+		   u32 handle)
+{
+	struct drm_i915_gem_object *obj;
+	struct i915_lut_handle *lut;
+	struct i915_vma *vma;
+
+	obj = i915_gem_object_lookup(file, handle);
+	if (unlikely(!obj))
+		return ERR_PTR(-ENOENT);
+
+	/*
+	 * NOTE: We can leak any vmas created here when something fails
+	 * later on. But that's no issue since vma_unbind can deal with
+	 * vmas which are not actually bound. And since only
+	 * lookup_or_create exists as an interface to get at the vma
+	 * from the (obj, vm) we don't run the risk of creating
+	 * duplicated vmas for the same vm.
+	 */
+	vma = i915_gem_obj_lookup_or_create_vma(obj, vm, NULL);
+	if (unlikely(IS_ERR(vma))) {
+		i915_gem_object_put(obj);
+		return vma;
+	}
+
+	/*
+	 * Remember the vma so the next execbuffer of this context need not
+	 * look the handle up again. Failing to do so only costs us the
+	 * slow lookup next time. The context may have been closed while the
+	 * relocation slow path dropped struct_mutex.
+	 */
+	lut = NULL;
+	if (!ctx->closed)
+		lut = kmalloc(sizeof(*lut), GFP_KERNEL | __GFP_NOWARN);
+	if (lut) {
+		if (radix_tree_insert(&ctx->handles_vma, handle, vma) == 0) {
+			lut->ctx = ctx;
+			lut->handle = handle;
+			list_add(&lut->obj_link, &obj->lut_list);
+			list_add(&lut->ctx_link, &ctx->handles_list);
+		} else {
+			kfree(lut);
+		}
+	}
+
+	/* The lookup reference is handed over to the execbuffer */
+	return vma;
+}
+
 static int
 eb_lookup_vmas(struct eb_vmas *eb,
 	       struct drm_i915_gem_exec_object2 *exec,
 	       const struct drm_i915_gem_execbuffer2 *args,
+	       struct i915_gem_context *ctx,
 	       struct i915_address_space *vm,
 	       struct drm_file *file)
 {
-	struct drm_i915_gem_object *obj;
-	struct list_head objects;
-	int i, ret;
-
-	INIT_LIST_HEAD(&objects);
-	spin_lock(&file->table_lock);
-	/* Grab a reference to the object and release the lock so we can lookup
-	 * or create the VMA without using GFP_ATOMIC */
-	for (i = 0; i < args->buffer_count; i++) {
-		obj = to_intel_bo(idr_find(&file->object_idr, exec[i].handle));
-		if (obj == NULL) {
-			spin_unlock(&file->table_lock);
-			DRM_DEBUG("Invalid object handle %d at index %d\n",
-				   exec[i].handle, i);
-			ret = -ENOENT;
-			goto err;
-		}
-
-		if (!list_empty(&obj->obj_exec_link)) {
-			spin_unlock(&file->table_lock);
-			DRM_DEBUG("Object %p [handle %d, index %d] appears more than once in object list\n",
-				   obj, exec[i].handle, i);
-			ret = -EINVAL;
-			goto err;
-		}
+	int i;
 
-		i915_gem_object_get(obj);
-		list_add_tail(&obj->obj_exec_link, &objects);
-	}
-	spin_unlock(&file->table_lock);
+	lockdep_assert_held(&eb->i915->drm.struct_mutex);
 
-	i = 0;
-	while (!list_empty(&objects)) {
+	for (i = 0; i < args->buffer_count; i++) {
+		u32 handle = exec[i].handle;
 		struct i915_vma *vma;
 
-		obj = list_first_entry(&objects,
-				       struct drm_i915_gem_object,
-				       obj_exec_link);
+		vma = radix_tree_lookup(&ctx->handles_vma, handle);
+		if (likely(vma)) {
+			if (unlikely(!list_empty(&vma->exec_list)))
+				goto err_dup;
 
-		/*
-		 * NOTE: We can leak any vmas created here when something fails
-		 * later on. But that's no issue since vma_unbind can deal with
-		 * vmas which are not actually bound. And since only
-		 * lookup_or_create exists as an interface to get at the vma
-		 * from the (obj, vm) we don't run the risk of creating
-		 * duplicated vmas for the same vm.
-		 */
-		vma = i915_gem_obj_lookup_or_create_vma(obj, vm, NULL);
-		if (unlikely(IS_ERR(vma))) {
-			DRM_DEBUG("Failed to lookup VMA\n");
-			ret = PTR_ERR(vma);
-			goto err;
+			i915_vma_get(vma);
+		} else {
+			vma = eb_lookup_vma_slow(ctx, vm, file, handle);
+			if (unlikely(IS_ERR(vma))) {
+				DRM_DEBUG("Invalid object handle %d at index %d\n",
+					  handle, i);
+				return PTR_ERR(vma);
+			}
+
+			if (unlikely(!list_empty(&vma->exec_list))) {
+				i915_vma_put(vma);
+				goto err_dup;
+			}
 		}
 
-		/* Transfer ownership from the objects list to the vmas list. */
+		/* Ownership of the reference passes to the vmas list. */
 		list_add_tail(&vma->exec_list, &eb->vmas);
-		list_del_init(&obj->obj_exec_link);
 
 		vma->exec_entry = &exec[i];
 		if (eb->and < 0) {
 			eb->lut[i] = vma;
 		} else {
-			uint32_t handle = args->flags & I915_EXEC_HANDLE_LUT ? i : exec[i].handle;
+			if (args->flags & I915_EXEC_HANDLE_LUT)
+				handle = i;
 			vma->exec_handle = handle;
 			hlist_add_head(&vma->exec_node,
 				       &eb->buckets[handle & eb->and]);
 		}
-		++i;
 	}
 
 	return 0;
 
-
-err:
-	while (!list_empty(&objects)) {
-		obj = list_first_entry(&objects,
-				       struct drm_i915_gem_object,
-				       obj_exec_link);
-		list_del_init(&obj->obj_exec_link);
-		i915_gem_object_put(obj);
-	}
+err_dup:
 	/*
-	 * Objects already transfered to the vmas list will be unreferenced by
+	 * Vmas already transferred to the vmas list will be unreferenced by
 	 * eb_destroy.
 	 */
-
-	return ret;
+	DRM_DEBUG("Object [handle %d, index %d] appears more than once in object list\n",
+		  exec[i].handle, i);
+	return -EINVAL;
 }
 
 static struct i915_vma *eb_get_vma(struct eb_vmas *eb, unsigned long handle)
@@ -282,6 +307,7 @@ static void eb_destroy(struct eb_vmas *eb)
 		i915_gem_execbuffer_unreserve_vma(vma);
 		i915_vma_put(vma);
 	}
+	kfree(eb->reloc_writes);
 	kfree(eb);
 }
 
@@ -323,22 +349,54 @@ relocation_target(const struct drm_i915_gem_relocation_entry *reloc,
 	return gen8_canonical_addr((int)reloc->delta + target_offset);
 }
 
+/*
+ * Relocations of an object are not written as they are validated but queued
+ * up to RELOC_BATCH_MAX at a time, then sorted by offset and applied in one
+ * sweep over the object. Userspace emits them in command order, which for
+ * state and surface pointers jumps back and forth across the batch, and
+ * each jump costs a page lookup and a remap in the reloc_cache.
+ *
+ * When the object cannot be pinned in the mappable aperture, pages are bound
+ * into a window of RELOC_WINDOW_PAGES GGTT slots instead of a single one, so
+ * returning to a recently written page does not rewrite its PTE.
+ */
+#define RELOC_BATCH_MIN 64
+#define RELOC_BATCH_MAX 512
+#define RELOC_WINDOW_PAGES 16
+
+struct reloc_write {
+	u64 offset;
+	u64 target_offset;
+	u64 __user *presumed;
+	int delta;
+	unsigned int seq;
+};
+
 struct reloc_cache {
 	struct drm_i915_private *i915;
 	struct drm_mm_node node;
 	unsigned long vaddr;
 	unsigned int page;
+	unsigned int window[RELOC_WINDOW_PAGES];
+	struct reloc_write *writes;
+	unsigned int nwrites;
+	unsigned int max_writes;
 	bool use_64bit_reloc;
 };
 
 static void reloc_cache_init(struct reloc_cache *cache,
-			     struct drm_i915_private *i915)
+			     struct drm_i915_private *i915,
+			     struct reloc_write *writes,
+			     unsigned int max_writes)
 {
 	cache->page = -1;
 	cache->vaddr = 0;
 	cache->i915 = i915;
 	cache->use_64bit_reloc = INTEL_GEN(cache->i915) >= 8;
 	cache->node.allocated = false;
+	cache->writes = writes;
+	cache->nwrites = 0;
+	cache->max_writes = writes ? max_writes : 0;
 }
 
 static inline void *unmask_page(unsigned long p)
@@ -424,15 +482,6 @@ static void *reloc_iomap(struct drm_i915_gem_object *obj,
 	unsigned long offset;
 	void *vaddr;
 
-	if (cache->node.allocated) {
-		wmb();
-		ggtt->base.insert_page(&ggtt->base,
-				       i915_gem_object_get_dma_address(obj, page),
-				       cache->node.start, I915_CACHE_NONE, 0);
-		cache->page = page;
-		return unmask_page(cache->vaddr);
-	}
-
 	if (cache->vaddr) {
 		io_mapping_unmap_atomic(unmask_page(cache->vaddr));
 	} else {
@@ -449,15 +498,23 @@ static void *reloc_iomap(struct drm_i915_gem_object *obj,
 		vma = i915_gem_object_ggtt_pin(obj, NULL, 0, 0,
 					       PIN_MAPPABLE | PIN_NONBLOCK);
 		if (IS_ERR(vma)) {
-			memset(&cache->node, 0, sizeof(cache->node));
-			ret = drm_mm_insert_node_in_range_generic
-				(&ggtt->base.mm, &cache->node,
-				 4096, 0, 0,
-				 0, ggtt->mappable_end,
-				 DRM_MM_SEARCH_DEFAULT,
-				 DRM_MM_CREATE_DEFAULT);
+			u64 size = RELOC_WINDOW_PAGES << PAGE_SHIFT;
+
+			/* Settle for a smaller window if the aperture is tight */
+			do {
+				memset(&cache->node, 0, sizeof(cache->node));
+				ret = drm_mm_insert_node_in_range_generic
+					(&ggtt->base.mm, &cache->node,
+					 size, 0, 0,
+					 0, ggtt->mappable_end,
+					 DRM_MM_SEARCH_DEFAULT,
+					 DRM_MM_CREATE_DEFAULT);
+				size >>= 2;
+			} while (ret && size >= PAGE_SIZE);
 			if (ret) /* no inactive aperture space, use cpu reloc */
 				return NULL;
+
+			memset(cache->window, 0xff, sizeof(cache->window));
 		} else {
 			ret = i915_vma_put_fence(vma);
 			if (ret) {
@@ -472,9 +529,16 @@ static void *reloc_iomap(struct drm_i915_gem_object *obj,
 
 	offset = cache->node.start;
 	if (cache->node.allocated) {
-		ggtt->base.insert_page(&ggtt->base,
-				       i915_gem_object_get_dma_address(obj, page),
-				       offset, I915_CACHE_NONE, 0);
+		unsigned int slot = page % (cache->node.size >> PAGE_SHIFT);
+
+		offset += (unsigned long)slot << PAGE_SHIFT;
+		if (cache->window[slot] != page) {
+			wmb();
+			ggtt->base.insert_page(&ggtt->base,
+					       i915_gem_object_get_dma_address(obj, page),
+					       offset, I915_CACHE_NONE, 0);
+			cache->window[slot] = page;
+		}
 	} else {
 		offset += page << PAGE_SHIFT;
 	}
@@ -528,16 +592,14 @@ static void clflush_write32(u32 *addr, u32 value, unsigned int flushes)
 }
 
 static int
-relocate_entry(struct drm_i915_gem_object *obj,
-	       const struct drm_i915_gem_relocation_entry *reloc,
+relocate_write(struct drm_i915_gem_object *obj,
 	       struct reloc_cache *cache,
+	       u64 offset,
 	       u64 target_offset)
 {
-	u64 offset = reloc->offset;
 	bool wide = cache->use_64bit_reloc;
 	void *vaddr;
 
-	target_offset = relocation_target(reloc, target_offset);
 repeat:
 	vaddr = reloc_vaddr(obj, cache, offset >> PAGE_SHIFT);
 	if (IS_ERR(vaddr))
@@ -557,6 +619,89 @@ repeat:
 	return 0;
 }
 
+static int reloc_write_cmp(const void *A, const void *B)
+{
+	const struct reloc_write *a = A, *b = B;
+
+	if (a->offset != b->offset)
+		return a->offset < b->offset ? -1 : 1;
+
+	/* Keep the submission order of writes to the same location */
+	return (int)a->seq - (int)b->seq;
+}
+
+static int
+reloc_cache_flush(struct drm_i915_gem_object *obj,
+		  struct reloc_cache *cache)
+{
+	struct reloc_write *w, *end;
+	int ret = 0;
+
+	if (!cache->nwrites)
+		return 0;
+
+	end = cache->writes + cache->nwrites;
+	for (w = cache->writes + 1; w < end; w++) {
+		if (w[-1].offset > w->offset) {
+			sort(cache->writes, cache->nwrites, sizeof(*w),
+			     reloc_write_cmp, NULL);
+			break;
+		}
+	}
+
+	for (w = cache->writes; w < end; w++) {
+		ret = relocate_write(obj, cache, w->offset,
+				     gen8_canonical_addr(w->delta +
+							 w->target_offset));
+		if (ret)
+			break;
+
+		/* Only tell userspace about relocations that have landed */
+		if (w->presumed && __put_user(w->target_offset, w->presumed)) {
+			ret = -EFAULT;
+			break;
+		}
+	}
+
+	cache->nwrites = 0;
+	return ret;
+}
+
+static int
+relocate_entry(struct drm_i915_gem_object *obj,
+	       const struct drm_i915_gem_relocation_entry *reloc,
+	       struct reloc_cache *cache,
+	       u64 target_offset,
+	       u64 __user *presumed)
+{
+	int ret;
+
+	if (cache->max_writes) {
+		struct reloc_write *w = &cache->writes[cache->nwrites];
+
+		w->offset = reloc->offset;
+		w->target_offset = target_offset;
+		w->presumed = presumed;
+		w->delta = (int)reloc->delta;
+		w->seq = cache->nwrites;
+
+		if (++cache->nwrites == cache->max_writes)
+			return reloc_cache_flush(obj, cache);
+
+		return 0;
+	}
+
+	ret = relocate_write(obj, cache, reloc->offset,
+			     relocation_target(reloc, target_offset));
+	if (ret)
+		return ret;
+
+	if (presumed && __put_user(target_offset, presumed))
+		return -EFAULT;
+
+	return 0;
+}
+
 static bool object_is_idle(struct drm_i915_gem_object *obj)
 {
 	unsigned long active = i915_gem_object_get_active(obj);
@@ -575,7 +720,8 @@ static int
 i915_gem_execbuffer_relocate_entry(struct drm_i915_gem_object *obj,
 				   struct eb_vmas *eb,
 				   struct drm_i915_gem_relocation_entry *reloc,
-				   struct reloc_cache *cache)
+				   struct reloc_cache *cache,
+				   u64 __user *presumed)
 {
 	struct drm_device *dev = obj->base.dev;
 	struct drm_gem_object *target_obj;
@@ -660,7 +806,7 @@ i915_gem_execbuffer_relocate_entry(struct drm_i915_gem_object *obj,
 	if (pagefault_disabled() && !object_is_idle(obj))
 		return -EFAULT;
 
-	ret = relocate_entry(obj, reloc, cache, target_offset);
+	ret = relocate_entry(obj, reloc, cache, target_offset, presumed);
 	if (ret)
 		return ret;
 
@@ -681,7 +827,7 @@ i915_gem_execbuffer_relocate_vma(struct i915_vma *vma,
 	int remain, ret = 0;
 
 	user_relocs = u64_to_user_ptr(entry->relocs_ptr);
-	reloc_cache_init(&cache, eb->i915);
+	reloc_cache_init(&cache, eb->i915, eb->reloc_writes, eb->reloc_batch);
 
 	remain = entry->relocation_count;
 	while (remain) {
@@ -697,24 +843,17 @@ i915_gem_execbuffer_relocate_vma(struct i915_vma *vma,
 		}
 
 		do {
-			u64 offset = r->presumed_offset;
-
-			ret = i915_gem_execbuffer_relocate_entry(vma->obj, eb, r, &cache);
+			ret = i915_gem_execbuffer_relocate_entry(vma->obj, eb, r, &cache,
+								 &user_relocs->presumed_offset);
 			if (ret)
 				goto out;
 
-			if (r->presumed_offset != offset &&
-			    __put_user(r->presumed_offset,
-				       &user_relocs->presumed_offset)) {
-				ret = -EFAULT;
-				goto out;
-			}
-
 			user_relocs++;
 			r++;
 		} while (--count);
 	}
 
+	ret = reloc_cache_flush(vma->obj, &cache);
 out:
 	reloc_cache_fini(&cache);
 	return ret;
@@ -730,23 +869,52 @@ i915_gem_execbuffer_relocate_vma_slow(struct i915_vma *vma,
 	struct reloc_cache cache;
 	int i, ret = 0;
 
-	reloc_cache_init(&cache, eb->i915);
+	reloc_cache_init(&cache, eb->i915, eb->reloc_writes, eb->reloc_batch);
 	for (i = 0; i < entry->relocation_count; i++) {
-		ret = i915_gem_execbuffer_relocate_entry(vma->obj, eb, &relocs[i], &cache);
+		ret = i915_gem_execbuffer_relocate_entry(vma->obj, eb, &relocs[i], &cache,
+							 NULL);
 		if (ret)
 			break;
 	}
+	if (ret == 0)
+		ret = reloc_cache_flush(vma->obj, &cache);
 	reloc_cache_fini(&cache);
 
 	return ret;
 }
 
+static void
+eb_reloc_batch_init(struct eb_vmas *eb)
+{
+	struct i915_vma *vma;
+	unsigned int count = 0;
+
+	if (eb->reloc_writes)
+		return;
+
+	list_for_each_entry(vma, &eb->vmas, exec_list)
+		count = max_t(unsigned int, count,
+			      vma->exec_entry->relocation_count);
+	if (count < RELOC_BATCH_MIN)
+		return;
+
+	/* Without the buffer relocations are simply written unsorted */
+	count = min_t(unsigned int, count, RELOC_BATCH_MAX);
+	eb->reloc_writes = kmalloc_array(count, sizeof(*eb->reloc_writes),
+					 GFP_TEMPORARY | __GFP_NOWARN |
+					 __GFP_NORETRY);
+	if (eb->reloc_writes)
+		eb->reloc_batch = count;
+}
+
 static int
 i915_gem_execbuffer_relocate(struct eb_vmas *eb)
 {
 	struct i915_vma *vma;
 	int ret = 0;
 
+	eb_reloc_batch_init(eb);
+
 	/* This is the fast path and we cannot handle a pagefault whilst
 	 * holding the struct mutex lest the user pass in the relocations
 	 * contained within a mmaped bo. For in such a case we, the page
@@ -1090,7 +1258,7 @@ i915_gem_execbuffer_relocate_slow(struct drm_device *dev,
 
 	/* reacquire the objects */
 	eb_reset(eb);
-	ret = eb_lookup_vmas(eb, exec, args, vm, file);
+	ret = eb_lookup_vmas(eb, exec, args, ctx, vm, file);
 	if (ret)
 		goto err;
 
@@ -1100,6 +1268,7 @@ i915_gem_execbuffer_relocate_slow(struct drm_device *dev,
 	if (ret)
 		goto err;
 
+	eb_reloc_batch_init(eb);
 	list_for_each_entry(vma, &eb->vmas, exec_list) {
 		int offset = vma->exec_entry - exec;
 		ret = i915_gem_execbuffer_relocate_vma_slow(vma, eb,
@@ -1176,9 +1345,13 @@ i915_gem_check_execbuffer(struct drm_i915_gem_execbuffer2 *exec)
 	if (exec->flags & __I915_EXEC_UNKNOWN_FLAGS)
 		return false;
 
-	/* Kernel clipping was a DRI1 misfeature */
-	if (exec->num_cliprects || exec->cliprects_ptr)
-		return false;
+	/* Kernel clipping was a DRI1 misfeature; the fields are reused to
+	 * pass the fence array.
+	 */
+	if (!(exec->flags & I915_EXEC_FENCE_ARRAY)) {
+		if (exec->num_cliprects || exec->cliprects_ptr)
+			return false;
+	}
 
 	if (exec->DR4 == 0xffffffff) {
 		DRM_DEBUG("UXA submitting garbage DR4, fixing up\n");
@@ -1410,19 +1583,139 @@ i915_reset_gen7_sol_offsets(struct drm_i915_gem_request *req)
 	return 0;
 }
 
+/*
+ * Look up a shadow batch the command parser accepted earlier for the same
+ * batch contents. Returns the matching entry with *hit set, otherwise the
+ * entry to be replaced when the new shadow batch is accepted.
+ *
+ * Only an entry for the same batch object, range, engine and privilege is
+ * a candidate, and only then is the batch read back to compare its hash, so
+ * batches seen for the first time are read just once, by the parser.
+ */
+static struct i915_batch_cache_entry *
+batch_cache_lookup(struct i915_gem_context *ctx,
+		   struct intel_engine_cs *engine,
+		   struct drm_i915_gem_object *batch_obj,
+		   u32 batch_start_offset,
+		   u32 batch_len,
+		   bool is_master,
+		   bool *hit)
+{
+	struct i915_batch_cache_entry *entry, *victim = NULL;
+	u64 hash;
+	int i;
+
+	*hit = false;
+	for (i = 0; i < ARRAY_SIZE(ctx->batch_cache); i++) {
+		entry = &ctx->batch_cache[i];
+
+		if (entry->shadow &&
+		    entry->batch == batch_obj &&
+		    entry->batch_start_offset == batch_start_offset &&
+		    entry->batch_len == batch_len &&
+		    entry->engine == engine->id &&
+		    entry->is_master == is_master) {
+			/* The batch may have been rewritten since */
+			if (intel_engine_cmd_parser_hash(batch_obj,
+							 batch_start_offset,
+							 entry->hash_len,
+							 &hash) == 0 &&
+			    hash == entry->hash) {
+				entry->last_use = ++ctx->batch_cache_clock;
+				list_move_tail(&entry->lru_link,
+					       &ctx->i915->mm.batch_cache_lru);
+				*hit = true;
+			}
+			return entry;
+		}
+
+		if (!victim ||
+		    (victim->shadow && (!entry->shadow ||
+					entry->last_use < victim->last_use)))
+			victim = entry;
+	}
+
+	return victim;
+}
+
+static void
+batch_cache_insert(struct i915_gem_context *ctx,
+		   struct i915_batch_cache_entry *entry,
+		   struct intel_engine_cs *engine,
+		   struct drm_i915_gem_object *shadow_batch_obj,
+		   struct drm_i915_gem_object *batch_obj,
+		   u32 batch_start_offset,
+		   u32 batch_len,
+		   u64 hash,
+		   u32 hash_len,
+		   bool is_master)
+{
+	struct drm_i915_private *dev_priv = ctx->i915;
+	u64 size = shadow_batch_obj->base.size;
+
+	i915_gem_batch_cache_release(dev_priv, entry);
+	if (size > I915_BATCH_CACHE_BYTES)
+		return;
+
+	/* Make room by dropping the oldest batches of any context */
+	i915_gem_batch_cache_trim(dev_priv, I915_BATCH_CACHE_BYTES - size);
+
+	/*
+	 * Take the shadow out of the batch pool, together with the pool's
+	 * reference, so that it is never handed out and overwritten again.
+	 * Keeping its pages pinned stops the shrinker from purging it, the
+	 * shrinker calls i915_gem_batch_cache_trim() to get at them instead.
+	 */
+	list_del_init(&shadow_batch_obj->batch_pool_link);
+	i915_gem_object_pin_pages(shadow_batch_obj);
+	list_add_tail(&entry->lru_link, &dev_priv->mm.batch_cache_lru);
+	dev_priv->mm.batch_cache_bytes += size;
+
+	entry->shadow = shadow_batch_obj;
+	entry->batch = batch_obj;
+	entry->hash = hash;
+	entry->hash_len = hash_len;
+	entry->batch_start_offset = batch_start_offset;
+	entry->batch_len = batch_len;
+	entry->engine = engine->id;
+	entry->is_master = is_master;
+	entry->last_use = ++ctx->batch_cache_clock;
+}
+
 static struct i915_vma *
 i915_gem_execbuffer_parse(struct intel_engine_cs *engine,
 			  struct drm_i915_gem_exec_object2 *shadow_exec_entry,
 			  struct drm_i915_gem_object *batch_obj,
 			  struct eb_vmas *eb,
+			  struct i915_gem_context *ctx,
 			  u32 batch_start_offset,
 			  u32 batch_len,
 			  bool is_master)
 {
 	struct drm_i915_gem_object *shadow_batch_obj;
+	struct i915_batch_cache_entry *cached = NULL;
 	struct i915_vma *vma;
+	u32 hash_len = 0;
+	u64 hash = 0;
+	bool hit;
 	int ret;
 
+	if (ctx->flags & CONTEXT_BATCH_CACHE) {
+		cached = batch_cache_lookup(ctx, engine, batch_obj,
+					    batch_start_offset, batch_len,
+					    is_master, &hit);
+		if (hit) {
+			shadow_batch_obj = cached->shadow;
+			ret = i915_gem_object_pin_pages(shadow_batch_obj);
+			if (ret)
+				return ERR_PTR(ret);
+
+			engine->cmd_parser_stats.cache_hits++;
+			goto pin;
+		}
+		engine->cmd_parser_stats.cache_misses++;
+	}
+
 	shadow_batch_obj = i915_gem_batch_pool_get(&engine->batch_pool,
 						   PAGE_ALIGN(batch_len));
 	if (IS_ERR(shadow_batch_obj))
@@ -1433,7 +1726,9 @@ i915_gem_execbuffer_parse(struct intel_engine_cs *engine,
 				      shadow_batch_obj,
 				      batch_start_offset,
 				      batch_len,
-				      is_master);
+				      is_master,
+				      cached ? &hash : NULL,
+				      &hash_len);
 	if (ret) {
 		if (ret == -EACCES) /* unhandled chained batch */
 			vma = NULL;
@@ -1442,6 +1737,12 @@ i915_gem_execbuffer_parse(struct intel_engine_cs *engine,
 		goto out;
 	}
 
+	if (cached)
+		batch_cache_insert(ctx, cached, engine, shadow_batch_obj,
+				   batch_obj, batch_start_offset, batch_len,
+				   hash, hash_len, is_master);
+
+pin:
 	vma = i915_gem_object_ggtt_pin(shadow_batch_obj, NULL, 0, 0, 0);
 	if (IS_ERR(vma))
 		goto out;
@@ -1629,6 +1930,115 @@ eb_select_engine(struct drm_i915_private *dev_priv,
 	return engine;
 }
 
+struct eb_fence {
+	struct drm_syncobj *syncobj;
+	unsigned int flags;
+};
+
+static void
+eb_put_fence_array(struct eb_fence *fences, unsigned int nfences)
+{
+	unsigned int n;
+
+	for (n = 0; n < nfences; n++)
+		drm_syncobj_put(fences[n].syncobj);
+	drm_free_large(fences);
+}
+
+static struct eb_fence *
+eb_get_fence_array(struct drm_i915_gem_execbuffer2 *args,
+		   struct drm_file *file)
+{
+	const unsigned int nfences = args->num_cliprects;
+	struct drm_i915_gem_exec_fence __user *user;
+	struct eb_fence *fences;
+	unsigned int n;
+	int err;
+
+	if (!(args->flags & I915_EXEC_FENCE_ARRAY))
+		return NULL;
+
+	if (nfences == 0)
+		return NULL;
+
+	fences = drm_malloc_gfp(nfences, sizeof(*fences), GFP_TEMPORARY);
+	if (fences == NULL)
+		return ERR_PTR(-ENOMEM);
+
+	user = u64_to_user_ptr(args->cliprects_ptr);
+	for (n = 0; n < nfences; n++) {
+		struct drm_i915_gem_exec_fence fence;
+		struct drm_syncobj *syncobj;
+
+		if (copy_from_user(&fence, user++, sizeof(fence))) {
+			err = -EFAULT;
+			goto err;
+		}
+
+		if (fence.flags & __I915_EXEC_FENCE_UNKNOWN_FLAGS) {
+			err = -EINVAL;
+			goto err;
+		}
+
+		syncobj = drm_syncobj_find(file, fence.handle);
+		if (!syncobj) {
+			DRM_DEBUG("Invalid syncobj handle provided\n");
+			err = -ENOENT;
+			goto err;
+		}
+
+		fences[n].syncobj = syncobj;
+		fences[n].flags = fence.flags;
+	}
+
+	return fences;
+
+err:
+	eb_put_fence_array(fences, n);
+	return ERR_PTR(err);
+}
+
+static int
+eb_await_fence_array(struct drm_i915_gem_request *req,
+		     struct eb_fence *fences, unsigned int nfences)
+{
+	unsigned int n;
+	int err;
+
+	for (n = 0; n < nfences; n++) {
+		struct fence *fence;
+
+		if (!(fences[n].flags & I915_EXEC_FENCE_WAIT))
+			continue;
+
+		fence = drm_syncobj_fence_get(fences[n].syncobj);
+		if (!fence)
+			return -EINVAL;
+
+		err = i915_sw_fence_await_dma_fence(&req->submit, fence,
+						    10*HZ, GFP_KERNEL);
+		fence_put(fence);
+		if (err < 0)
+			return err;
+	}
+
+	return 0;
+}
+
+static void
+eb_signal_fence_array(struct drm_i915_gem_request *req,
+		      struct eb_fence *fences, unsigned int nfences)
+{
+	unsigned int n;
+
+	for (n = 0; n < nfences; n++) {
+		if (!(fences[n].flags & I915_EXEC_FENCE_SIGNAL))
+			continue;
+
+		drm_syncobj_replace_fence(fences[n].syncobj, &req->fence);
+	}
+}
+
 static int
 i915_gem_do_execbuffer(struct drm_device *dev, void *data,
 		       struct drm_file *file,
@@ -1645,6 +2055,7 @@ i915_gem_do_execbuffer(struct drm_device *dev, void *data,
 	struct i915_execbuffer_params params_master; /* XXX: will be removed later */
 	struct i915_execbuffer_params *params = &params_master;
 	const u32 ctx_id = i915_execbuffer2_get_context_id(*args);
+	struct eb_fence *fences;
 	u32 dispatch_flags;
 	int ret;
 	bool need_relocs;
@@ -1689,6 +2100,10 @@ i915_gem_do_execbuffer(struct drm_device *dev, void *data,
 		dispatch_flags |= I915_DISPATCH_RS;
 	}
 
+	fences = eb_get_fence_array(args, file);
+	if (IS_ERR(fences))
+		return PTR_ERR(fences);
+
 	/* Take a local wakeref for preparing to dispatch the execbuf as
 	 * we expect to access the hardware fairly frequently in the
 	 * process. Upon first dispatch, we acquire another prolonged
@@ -1726,7 +2141,7 @@ i915_gem_do_execbuffer(struct drm_device *dev, void *data,
 	}
 
 	/* Look up object handles */
-	ret = eb_lookup_vmas(eb, exec, args, vm, file);
+	ret = eb_lookup_vmas(eb, exec, args, ctx, vm, file);
 	if (ret)
 		goto err;
 
@@ -1773,7 +2188,7 @@ i915_gem_do_execbuffer(struct drm_device *dev, void *data,
 
 		vma = i915_gem_execbuffer_parse(engine, &shadow_exec_entry,
 						params->batch->obj,
-						eb,
+						eb, ctx,
 						args->batch_start_offset,
 						args->batch_len,
 						drm_is_current_master(file));
@@ -1845,6 +2260,13 @@ i915_gem_do_execbuffer(struct drm_device *dev, void *data,
 	if (ret)
 		goto err_request;
 
+	if (fences) {
+		ret = eb_await_fence_array(params->request, fences,
+					   args->num_cliprects);
+		if (ret)
+			goto err_request;
+	}
+
 	/*
 	 * Save assorted stuff away to pass through to *_submission().
 	 * NB: This data should be 'persistent' and not local as it will
@@ -1861,6 +2283,10 @@ i915_gem_do_execbuffer(struct drm_device *dev, void *data,
 err_request:
 	__i915_add_request(params->request, ret == 0);
 
+	if (fences && ret == 0)
+		eb_signal_fence_array(params->request, fences,
+				      args->num_cliprects);
+
 err_batch_unpin:
 	/*
 	 * FIXME: We crucially rely upon the active tracking for the (ppgtt)
@@ -1881,6 +2307,8 @@ pre_mutex_err:
 	/* intel_gpu_busy should also get a ref, so it will free when the device
 	 * is really idle. */
 	intel_runtime_pm_put(dev_priv);
+	if (fences)
+		eb_put_fence_array(fences, args->num_cliprects);
 	return ret;
 }
 
@@ -2037,3 +2465,167 @@ i915_gem_execbuffer2(struct drm_device *dev, void *data,
 	drm_free_large(exec2_list);
 	return ret;
 }
+
+#ifdef CONFIG_DEBUG_FS
+#define RELOC_BENCH_SIZE (4 << 20)
+#define RELOC_BENCH_COUNT 16384
+#define RELOC_BENCH_PASSES 4
+
+enum reloc_bench_pattern {
+	RELOC_BENCH_LINEAR,
+	RELOC_BENCH_INTERLEAVED,
+	RELOC_BENCH_SCATTERED,
+};
+
+static const char * const reloc_bench_names[] = {
+	[RELOC_BENCH_LINEAR] = "linear",
+	[RELOC_BENCH_INTERLEAVED] = "interleaved",
+	[RELOC_BENCH_SCATTERED] = "scattered",
+};
+
+static void reloc_bench_fill(struct drm_i915_gem_relocation_entry *relocs,
+			     enum reloc_bench_pattern pattern)
+{
+	const u64 stride = RELOC_BENCH_SIZE / RELOC_BENCH_COUNT;
+	u32 rng = 0x9e3779b9;
+	int i;
+
+	for (i = 0; i < RELOC_BENCH_COUNT; i++) {
+		struct drm_i915_gem_relocation_entry *r = &relocs[i];
+
+		switch (pattern) {
+		case RELOC_BENCH_LINEAR:
+			r->offset = i * stride;
+			break;
+		case RELOC_BENCH_INTERLEAVED:
+			/* Commands at the front, the state they point to behind */
+			r->offset = (i / 2) * stride;
+			if (i & 1)
+				r->offset += RELOC_BENCH_SIZE / 2;
+			break;
+		case RELOC_BENCH_SCATTERED:
+			rng ^= rng << 13;
+			rng ^= rng >> 17;
+			rng ^= rng << 5;
+			r->offset = (rng % (RELOC_BENCH_SIZE - 8)) & ~7;
+			break;
+		}
+
+		r->target_handle = 0;
+		r->delta = i & 0xfff;
+		r->presumed_offset = (u64)(i + 1) << PAGE_SHIFT;
+		r->read_domains = I915_GEM_DOMAIN_RENDER;
+		r->write_domain = 0;
+	}
+}
+
+static int reloc_bench_run(struct drm_i915_gem_object *obj,
+			   const struct drm_i915_gem_relocation_entry *relocs,
+			   struct reloc_write *writes,
+			   unsigned int max_writes,
+			   u64 *best)
+{
+	struct reloc_cache cache;
+	int pass, i, ret = 0;
+
+	*best = ~0ULL;
+	for (pass = 0; pass < RELOC_BENCH_PASSES; pass++) {
+		u64 start = ktime_get_raw_ns();
+
+		reloc_cache_init(&cache, to_i915(obj->base.dev),
+				 writes, max_writes);
+		for (i = 0; i < RELOC_BENCH_COUNT && !ret; i++)
+			ret = relocate_entry(obj, &relocs[i], &cache,
+					     relocs[i].presumed_offset, NULL);
+		if (ret == 0)
+			ret = reloc_cache_flush(obj, &cache);
+		reloc_cache_fini(&cache);
+		if (ret)
+			return ret;
+
+		*best = min(*best, ktime_get_raw_ns() - start);
+	}
+
+	return 0;
+}
+
+/**
+ * i915_gem_execbuffer_reloc_benchmark - measure relocation throughput
+ * @m: seq_file to report to
+ * @dev_priv: i915 device
+ *
+ * Applies synthetic relocation lists to a scratch object, once written in
+ * list order and once batched and sorted as execbuffer does, and reports
+ * the best of several passes in relocations per second. Where the platform
+ * does not always relocate through the CPU, the lists are also applied
+ * through the GTT.
+ *
+ * Note: Callers must hold the struct_mutex.
+ */
+int i915_gem_execbuffer_reloc_benchmark(struct seq_file *m,
+					struct drm_i915_private *dev_priv)
+{
+	struct drm_i915_gem_relocation_entry *relocs;
+	struct drm_i915_gem_object *obj;
+	struct reloc_write *writes;
+	int pattern, domain, ret;
+
+	lockdep_assert_held(&dev_priv->drm.struct_mutex);
+
+	relocs = drm_malloc_ab(RELOC_BENCH_COUNT, sizeof(*relocs));
+	writes = kmalloc_array(RELOC_BATCH_MAX, sizeof(*writes), GFP_KERNEL);
+	if (!relocs || !writes) {
+		ret = -ENOMEM;
+		goto out_free;
+	}
+
+	obj = i915_gem_object_create(&dev_priv->drm, RELOC_BENCH_SIZE);
+	if (IS_ERR(obj)) {
+		ret = PTR_ERR(obj);
+		goto out_free;
+	}
+
+	seq_printf(m, "%d relocations into %d KiB, best of %d\n",
+		   RELOC_BENCH_COUNT, RELOC_BENCH_SIZE >> 10,
+		   RELOC_BENCH_PASSES);
+
+	for (domain = 0; domain < (HAS_LLC(dev_priv) ? 1 : 2); domain++) {
+		if (domain) {
+			ret = i915_gem_object_set_to_gtt_domain(obj, true);
+			if (ret)
+				goto out_put;
+		}
+
+		for (pattern = 0; pattern < ARRAY_SIZE(reloc_bench_names);
+		     pattern++) {
+			u64 direct, batched;
+
+			reloc_bench_fill(relocs, pattern);
+
+			ret = reloc_bench_run(obj, relocs, NULL, 0, &direct);
+			if (ret)
+				goto out_put;
+
+			ret = reloc_bench_run(obj, relocs, writes,
+					      RELOC_BATCH_MAX, &batched);
+			if (ret)
+				goto out_put;
+
+			seq_printf(m, "%s %-12s direct %10llu/s, batched %10llu/s\n",
+				   domain ? "gtt" : "cpu",
+				   reloc_bench_names[pattern],
+				   div64_u64((u64)RELOC_BENCH_COUNT * NSEC_PER_SEC,
+					     max_t(u64, direct, 1)),
+				   div64_u64((u64)RELOC_BENCH_COUNT * NSEC_PER_SEC,
+					     max_t(u64, batched, 1)));
+		}
+	}
+
+out_put:
+	i915_gem_object_put(obj);
+out_free:
+	kfree(writes);
+	drm_free_large(relocs);
+	return ret;
+}
+#endif
@@ -229,6 +229,7 @@ unsigned long i915_gem_shrink_all(struct drm_i915_private *dev_priv)
 {
 	unsigned long freed;
 
+	i915_gem_batch_cache_trim(dev_priv, 0);
 	freed = i915_gem_shrink(dev_priv, -1UL,
 				I915_SHRINK_BOUND |
 				I915_SHRINK_UNBOUND |
@@ -299,11 +300,14 @@ i915_gem_shrinker_scan(struct shrinker *shrinker, struct shrink_control *sc)
 				I915_SHRINK_BOUND |
 				I915_SHRINK_UNBOUND |
 				I915_SHRINK_PURGEABLE);
-	if (freed < sc->nr_to_scan)
+	if (freed < sc->nr_to_scan) {
+		/* cached shadow batches are pinned, let them go first */
+		i915_gem_batch_cache_trim(dev_priv, 0);
 		freed += i915_gem_shrink(dev_priv,
 					 sc->nr_to_scan - freed,
 					 I915_SHRINK_BOUND |
 					 I915_SHRINK_UNBOUND);
+	}
 	if (unlock)
 		mutex_unlock(&dev->struct_mutex);
 
@@ -744,7 +744,9 @@ i915_error_object_create(struct drm_i915_private *dev_priv,
 
 			s = io_mapping_map_atomic_wc(&ggtt->mappable,
 						     reloc_offset);
-			memcpy_fromio(d, s, PAGE_SIZE);
+			if (!i915_memcpy_from_wc(d, (void __force *)s,
+						 PAGE_SIZE))
+				memcpy_fromio(d, s, PAGE_SIZE);
 			io_mapping_unmap_atomic(s);
 		} else {
 			struct page *page;
@@ -26,8 +26,36 @@
 
 #include "i915_drv.h"
 
-#ifndef __FreeBSD__
+#ifdef __FreeBSD__
+#if defined(CONFIG_AS_MOVNTDQA) || defined(CONFIG_AS_AVX2)
+#include <machine/fpu.h>
+#include <machine/md_var.h>
+#include <machine/specialreg.h>
+#endif
+
+/* Only the copy routines the assembler can build look at these. */
+#ifdef CONFIG_AS_MOVNTDQA
+static bool has_movntdqa __read_mostly;
+#define i915_has_movntdqa()	likely(has_movntdqa)
+#endif
+#ifdef CONFIG_AS_AVX2
+static bool has_avx2 __read_mostly;
+#define i915_has_avx2()		likely(has_avx2)
+#endif
+
+/*
+ * FPU_KERN_NOCTX saves the current FPU state into the PCB and runs the
+ * section inside a critical section, like kernel_fpu_begin() does by
+ * disabling preemption.
+ */
+#define kernel_fpu_begin()	fpu_kern_enter(curthread, NULL, FPU_KERN_NOCTX)
+#define kernel_fpu_end()	fpu_kern_leave(curthread, NULL)
+#else
 static DEFINE_STATIC_KEY_FALSE(has_movntdqa);
+static DEFINE_STATIC_KEY_FALSE(has_avx2);
+
+#define i915_has_movntdqa()	static_branch_likely(&has_movntdqa)
+#define i915_has_avx2()		static_branch_likely(&has_avx2)
 #endif
 
 #ifdef CONFIG_AS_MOVNTDQA
@@ -60,6 +88,95 @@ static void __memcpy_ntdqa(void *dst, const void *src, unsigned long len)
 
 	kernel_fpu_end();
 }
+
+/* As __memcpy_ntdqa(), but @dst need not be aligned. */
+static void __memcpy_ntdqu(void *dst, const void *src, unsigned long len)
+{
+	kernel_fpu_begin();
+
+	len >>= 4;
+	while (len >= 4) {
+		asm("movntdqa   (%0), %%xmm0\n"
+		    "movntdqa 16(%0), %%xmm1\n"
+		    "movntdqa 32(%0), %%xmm2\n"
+		    "movntdqa 48(%0), %%xmm3\n"
+		    "movups %%xmm0,   (%1)\n"
+		    "movups %%xmm1, 16(%1)\n"
+		    "movups %%xmm2, 32(%1)\n"
+		    "movups %%xmm3, 48(%1)\n"
+		    :: "r" (src), "r" (dst) : "memory");
+		src += 64;
+		dst += 64;
+		len -= 4;
+	}
+	while (len--) {
+		asm("movntdqa (%0), %%xmm0\n"
+		    "movups %%xmm0, (%1)\n"
+		    :: "r" (src), "r" (dst) : "memory");
+		src += 16;
+		dst += 16;
+	}
+
+	kernel_fpu_end();
+}
+#endif
+
+#ifdef CONFIG_AS_AVX2
+/*
+ * 32-byte streaming loads, four ymm registers per iteration. @src must be
+ * aligned to 32 bytes, @dst to 16 bytes; a trailing 16 byte chunk is copied
+ * through xmm0.
+ */
+static void __memcpy_ntdqa_avx2(void *dst, const void *src, unsigned long len)
+{
+	kernel_fpu_begin();
+
+	len >>= 4;
+	while (len >= 8) {
+		asm("vmovntdqa   (%0), %%ymm0\n"
+		    "vmovntdqa 32(%0), %%ymm1\n"
+		    "vmovntdqa 64(%0), %%ymm2\n"
+		    "vmovntdqa 96(%0), %%ymm3\n"
+		    "vmovdqu %%ymm0,   (%1)\n"
+		    "vmovdqu %%ymm1, 32(%1)\n"
+		    "vmovdqu %%ymm2, 64(%1)\n"
+		    "vmovdqu %%ymm3, 96(%1)\n"
+		    :: "r" (src), "r" (dst) : "memory");
+		src += 128;
+		dst += 128;
+		len -= 8;
+	}
+	while (len >= 2) {
+		asm("vmovntdqa (%0), %%ymm0\n"
+		    "vmovdqu %%ymm0, (%1)\n"
+		    :: "r" (src), "r" (dst) : "memory");
+		src += 32;
+		dst += 32;
+		len -= 2;
+	}
+	if (len)
+		asm("vmovntdqa (%0), %%xmm0\n"
+		    "vmovdqa %%xmm0, (%1)\n"
+		    :: "r" (src), "r" (dst) : "memory");
+
+	/* Avoid the SSE/AVX transition penalty in whoever runs next. */
+	asm volatile("vzeroupper" ::: "memory");
+
+	kernel_fpu_end();
+}
+#endif
+
+#ifdef CONFIG_AS_MOVNTDQA
+static void __memcpy_from_wc(void *dst, const void *src, unsigned long len)
+{
+#ifdef CONFIG_AS_AVX2
+	if (i915_has_avx2() && !((unsigned long)src & 31)) {
+		__memcpy_ntdqa_avx2(dst, src, len);
+		return;
+	}
+#endif
+	__memcpy_ntdqa(dst, src, len);
+}
 #endif
 
 /**
@@ -71,7 +188,8 @@ static void __memcpy_ntdqa(void *dst, const void *src, unsigned long len)
  * i915_memcpy_from_wc copies @len bytes from @src to @dst using
  * non-temporal instructions where available. Note that all arguments
  * (@src, @dst) must be aligned to 16 bytes and @len must be a multiple
- * of 16.
+ * of 16. The 32 byte AVX2 loads are used when the CPU supports them and
+ * @src is 32 byte aligned.
  *
  * To test whether accelerated reads from WC are supported, use
  * i915_memcpy_from_wc(NULL, NULL, 0);
@@ -85,9 +203,9 @@ bool i915_memcpy_from_wc(void *dst, const void *src, unsigned long len)
 		return false;
 
 #ifdef CONFIG_AS_MOVNTDQA
-	if (static_branch_likely(&has_movntdqa)) {
+	if (i915_has_movntdqa()) {
 		if (likely(len))
-			__memcpy_ntdqa(dst, src, len);
+			__memcpy_from_wc(dst, src, len);
 		return true;
 	}
 #endif
@@ -95,10 +213,165 @@ bool i915_memcpy_from_wc(void *dst, const void *src, unsigned long len)
 	return false;
 }
 
+/**
+ * i915_unaligned_memcpy_from_wc: perform a mostly accelerated read from WC
+ * @dst: destination pointer
+ * @src: source pointer
+ * @len: how many bytes to copy
+ *
+ * Like i915_memcpy_from_wc(), but without any alignment restrictions. The
+ * unaligned head of @src is copied with plain loads, the bulk with streaming
+ * loads, and the tail by streaming the last 16 byte chunk of @src (which
+ * never crosses a page) into a bounce buffer.
+ *
+ * Must only be called if i915_memcpy_from_wc(NULL, NULL, 0) returned true.
+ */
+void i915_unaligned_memcpy_from_wc(void *dst, const void *src, unsigned long len)
+{
+#ifdef CONFIG_AS_MOVNTDQA
+	unsigned long addr = (unsigned long)src;
+	unsigned long x;
+
+	GEM_BUG_ON(!i915_has_movntdqa());
+
+	if (!IS_ALIGNED(addr, 16)) {
+		x = min(ALIGN(addr, 16) - addr, len);
+
+		memcpy(dst, src, x);
+
+		len -= x;
+		dst += x;
+		src += x;
+	}
+
+	x = len & ~15ul;
+	if (x) {
+		if (IS_ALIGNED((unsigned long)dst, 16))
+			__memcpy_from_wc(dst, src, x);
+		else
+			__memcpy_ntdqu(dst, src, x);
+
+		len -= x;
+		dst += x;
+		src += x;
+	}
+
+	if (len) {
+		u8 tail[16] __aligned(16);
+
+		__memcpy_ntdqa(tail, src, sizeof(tail));
+		memcpy(dst, tail, len);
+	}
+#else
+	memcpy(dst, src, len);
+#endif
+}
+
 void i915_memcpy_init_early(struct drm_i915_private *dev_priv)
 {
-#ifndef __FreeBSD__
+#ifdef __FreeBSD__
+#ifdef CONFIG_AS_MOVNTDQA
+	if (cpu_feature2 & CPUID2_SSE41)
+		has_movntdqa = true;
+#endif
+#ifdef CONFIG_AS_AVX2
+	/* The kernel must also be saving the ymm state on context switch. */
+	if ((cpu_feature2 & CPUID2_SSE41) &&
+	    (cpu_stdext_feature & CPUID_STDEXT_AVX2) &&
+	    use_xsave && (xsave_mask & XFEATURE_ENABLED_AVX))
+		has_avx2 = true;
+#endif
+#else
 	if (static_cpu_has(X86_FEATURE_XMM4_1))
 		static_branch_enable(&has_movntdqa);
+	if (static_cpu_has(X86_FEATURE_XMM4_1) &&
+	    static_cpu_has(X86_FEATURE_AVX2))
+		static_branch_enable(&has_avx2);
+#endif
+}
+
+#ifdef CONFIG_DEBUG_FS
+#define I915_MEMCPY_BENCH_PASSES 16
+
+static u64 i915_memcpy_bench(void (*copy)(void *, const void *, unsigned long),
+			     void *dst, const void *src, unsigned long len)
+{
+	u64 best = ~0ULL;
+	int pass;
+
+	for (pass = 0; pass < I915_MEMCPY_BENCH_PASSES; pass++) {
+		u64 t0 = ktime_get_raw_ns();
+
+		copy(dst, src, len);
+		best = min(best, ktime_get_raw_ns() - t0);
+	}
+
+	return best;
+}
+
+static void i915_memcpy_bench_plain(void *dst, const void *src,
+				    unsigned long len)
+{
+	memcpy(dst, src, len);
+}
+
+#ifdef CONFIG_AS_MOVNTDQA
+static void i915_memcpy_bench_unaligned(void *dst, const void *src,
+					unsigned long len)
+{
+	i915_unaligned_memcpy_from_wc(dst, src + 1, len - 16);
+}
 #endif
+
+static void i915_memcpy_bench_report(struct seq_file *m, const char *name,
+				     unsigned long len, u64 ns)
+{
+	seq_printf(m, "%-16s %8llu ns %6llu MiB/s\n", name, ns,
+		   div64_u64((u64)len * NSEC_PER_SEC, max_t(u64, ns, 1)) >> 20);
 }
+
+/**
+ * i915_memcpy_from_wc_benchmark - compare WC read implementations
+ * @m: seq_file to report to
+ * @dst: 16 byte aligned, cacheable destination buffer
+ * @src: 32 byte aligned, write-combined source buffer
+ * @len: size of both buffers, a multiple of 32
+ *
+ * Reports the best of several passes of a plain memcpy, the SSE4.1 and
+ * AVX2 streaming loads and the unaligned variant reading from @src.
+ */
+void i915_memcpy_from_wc_benchmark(struct seq_file *m, void *dst,
+				   const void *src, unsigned long len)
+{
+	seq_printf(m, "WC read of %lu KiB, best of %d\n",
+		   len >> 10, I915_MEMCPY_BENCH_PASSES);
+
+	i915_memcpy_bench_report(m, "memcpy", len,
+				 i915_memcpy_bench(i915_memcpy_bench_plain,
+						   dst, src, len));
+
+#ifdef CONFIG_AS_MOVNTDQA
+	if (!i915_has_movntdqa()) {
+		seq_puts(m, "movntdqa not supported\n");
+		return;
+	}
+
+	i915_memcpy_bench_report(m, "sse4.1", len,
+				 i915_memcpy_bench(__memcpy_ntdqa,
+						   dst, src, len));
+#ifdef CONFIG_AS_AVX2
+	if (i915_has_avx2())
+		i915_memcpy_bench_report(m, "avx2", len,
+					 i915_memcpy_bench(__memcpy_ntdqa_avx2,
+							   dst, src, len));
+	else
+		seq_puts(m, "avx2 not supported\n");
+#endif
+	i915_memcpy_bench_report(m, "unaligned", len,
+				 i915_memcpy_bench(i915_memcpy_bench_unaligned,
+						   dst, src, len));
+#else
+	seq_puts(m, "movntdqa not supported\n");
+#endif
+}
+#endif
@@ -5,7 +5,7 @@
 #include "i915_gem_batch_pool.h"
 #include "i915_gem_request.h"
 
-#define I915_CMD_HASH_ORDER 9
+#define I915_CMD_PARSER_HIST_BUCKETS 16
 
 /* Early gen2 devices have a cacheline of just 32 bytes, using 64 is overkill,
  * but keeps the logic simple. Indeed, the whole purpose of this macro is just
@@ -345,15 +345,17 @@ struct intel_engine_cs {
 
 	/*
 	 * Table of commands the command parser needs to know about
-	 * for this engine.
+	 * for this engine, indexed by opcode.
 	 */
-	DECLARE_HASHTABLE(cmd_hash, I915_CMD_HASH_ORDER);
+	struct i915_cmd_index *cmd_index;
 
 	/*
-	 * Table of registers allowed in commands that read/write registers.
+	 * Table of registers allowed in commands that read/write registers,
+	 * and all of them merged into a single index used for lookups.
 	 */
 	const struct drm_i915_reg_table *reg_tables;
 	int reg_table_count;
+	struct i915_reg_index *reg_index;
 
 	/*
 	 * Returns the bitmask for the length field of the specified command.
@@ -366,6 +368,20 @@ struct intel_engine_cs {
 	 * certain bits to encode the command length in the header).
 	 */
 	u32 (*get_cmd_length_mask)(u32 cmd_header);
+
+	/*
+	 * Command parser cost, protected by struct_mutex. hist[] buckets
+	 * batches by parse time, bucket n counting those below 2^n us.
+	 * cache_hits and cache_misses count lookups of CONTEXT_BATCH_CACHE.
+	 */
+	struct intel_cmd_parser_stats {
+		u64 batches;
+		u64 bytes;
+		u64 time_ns;
+		u64 hist[I915_CMD_PARSER_HIST_BUCKETS];
+		u64 cache_hits;
+		u64 cache_misses;
+	} cmd_parser_stats;
 };
 
 static inline bool
@@ -248,6 +248,7 @@ void drm_printk(const char *level, unsigned int category,
 #define DRIVER_RENDER			0x8000
 #define DRIVER_ATOMIC			0x10000
 #define DRIVER_KMS_LEGACY_CONTEXT	0x20000
+#define DRIVER_SYNCOBJ			0x40000
 
 /***********************************************************************/
 /** \name Macros to make printk easier */
@@ -477,6 +478,8 @@ struct drm_file {
 	struct idr object_idr;
 	/** Lock for synchronization of access to object_idr. */
 	spinlock_t table_lock;
+	/** Recently mapped objects, see drm_vma_node_authorize(). */
+	struct drm_vma_offset_cache vma_cache;
 
 	struct file *filp;
 	void *driver_priv;
@@ -505,6 +508,11 @@ struct drm_file {
 	struct mutex event_read_lock;
 
 	struct drm_prime_file_private prime;
+
+	/** Mapping of sync object handles to object pointers. */
+	struct idr syncobj_idr;
+	/** Lock for synchronization of access to syncobj_idr. */
+	spinlock_t syncobj_table_lock;
 };
 
 /**
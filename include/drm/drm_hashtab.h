@@ -36,17 +36,54 @@
 #define DRM_HASHTAB_H
 
 #include <linux/list.h>
+#include <linux/rcupdate.h>
+#include <linux/seqlock.h>
 
 #define drm_hash_entry(_ptr, _type, _member) container_of(_ptr, _type, _member)
 
+/*
+ * An item has one list node per table so that it can be linked into the old
+ * and the new table at the same time while the table is being resized.
+ */
 struct drm_hash_item {
-	struct hlist_node head;
+	struct hlist_node head[2];
 	unsigned long key;
 };
 
-struct drm_open_hash {
-	struct hlist_head *table;
+struct drm_ht_table {
+	struct rcu_head rcu;
 	u8 order;
+	u8 slot;
+	struct hlist_head buckets[];
+};
+
+/*
+ * The table grows and shrinks with the number of items. Resizing is
+ * incremental: a new table is allocated and each manipulation moves a few
+ * buckets over until the new table is complete and replaces the old one, so
+ * no single operation pays for a full rehash.
+ *
+ * @table: Table used for lookups, always complete.
+ * @new_table: Table being populated during a resize, NULL otherwise.
+ * @cursor: Next bucket of @table to copy into @new_table.
+ * @count: Number of items.
+ * @grow_retry: After a failed allocation, don't try to grow again before
+ * there are this many items.
+ * @shrink_retry: Same for shrinking, don't try again before there are at
+ * most this many items.
+ * @min_order: Order given to drm_ht_create(), the table never shrinks below.
+ * @seq: Bumped when a resize starts reusing the list nodes of a retired
+ * table, RCU lookups that miss retry if it changed.
+ */
+struct drm_open_hash {
+	struct drm_ht_table *table;
+	struct drm_ht_table *new_table;
+	unsigned int cursor;
+	unsigned long count;
+	unsigned long grow_retry;
+	unsigned long shrink_retry;
+	u8 min_order;
+	seqcount_t seq;
 };
 
 extern int drm_ht_create(struct drm_open_hash *ht, unsigned int order);
@@ -63,6 +63,8 @@ struct drm_mm_node {
 	struct list_head node_list;
 	struct list_head hole_stack;
 	struct rb_node rb;
+	struct rb_node rb_hole_size;
+	struct rb_node rb_hole_addr;
 	unsigned hole_follows : 1;
 	unsigned scanned_block : 1;
 	unsigned scanned_prev_free : 1;
@@ -73,6 +75,8 @@ struct drm_mm_node {
 	u64 start;
 	u64 size;
 	u64 __subtree_last;
+	u64 hole_size;
+	u64 subtree_max_hole;
 	struct drm_mm *mm;
 };
 
@@ -84,6 +88,11 @@ struct drm_mm {
 	struct drm_mm_node head_node;
 	/* Keep an interval_tree for fast lookup of drm_mm_nodes by address. */
 	struct rb_root interval_tree;
+	/* The same holes, indexed by size for best-fit searches and by start
+	 * address (augmented with the largest hole in each subtree) for
+	 * first-fit, top-down and range restricted searches. */
+	struct rb_root holes_size;
+	struct rb_root holes_addr;
 
 	unsigned int scan_check_range : 1;
 	unsigned scan_alignment;
@@ -49,6 +49,18 @@ struct drm_vma_offset_manager {
 	struct drm_mm vm_addr_space_mm;
 };
 
+#define DRM_VMA_CACHE_SIZE	8
+
+/*
+ * Per open-file cache of nodes that were recently found and authorized for
+ * that file. Entries are dropped when the file's access to the node is revoked,
+ * so a cached node stays valid as long as vm_lock is held.
+ */
+struct drm_vma_offset_cache {
+	spinlock_t vm_lock;
+	struct drm_vma_offset_node *vm_nodes[DRM_VMA_CACHE_SIZE];
+};
+
 void drm_vma_offset_manager_init(struct drm_vma_offset_manager *mgr,
 				 unsigned long page_offset, unsigned long size);
 void drm_vma_offset_manager_destroy(struct drm_vma_offset_manager *mgr);
@@ -66,6 +78,12 @@ void drm_vma_node_revoke(struct drm_vma_offset_node *node,
 			 struct drm_file *tag);
 bool drm_vma_node_is_allowed(struct drm_vma_offset_node *node,
 			     struct drm_file *tag);
+bool drm_vma_node_authorize(struct drm_vma_offset_node *node,
+			    struct drm_file *tag);
+
+struct drm_vma_offset_node *drm_vma_offset_cache_lookup_locked(struct drm_vma_offset_cache *cache,
+								unsigned long start,
+								unsigned long pages);
 
 /**
  * drm_vma_offset_exact_lookup_locked() - Look up node by exact address
@@ -122,6 +140,45 @@ static inline void drm_vma_offset_unlock_lookup(struct drm_vma_offset_manager *m
 	read_unlock(&mgr->vm_lock);
 }
 
+/**
+ * drm_vma_offset_cache_init() - Initialize per-file lookup cache
+ * @cache: Cache to initialize
+ *
+ * Initialize an empty lookup cache. This must be called before the owning
+ * open-file is passed to drm_vma_node_allow() or drm_vma_node_authorize().
+ */
+static inline void drm_vma_offset_cache_init(struct drm_vma_offset_cache *cache)
+{
+	memset(cache->vm_nodes, 0, sizeof(cache->vm_nodes));
+	spin_lock_init(&cache->vm_lock);
+}
+
+/**
+ * drm_vma_offset_cache_lock() - Lock per-file cache for lookups
+ * @cache: Cache to lock
+ *
+ * Same as drm_vma_offset_lock_lookup() but for lookups with
+ * drm_vma_offset_cache_lookup_locked(). The lock is private to a single
+ * open-file, so it is only contended by threads sharing that file.
+ *
+ * Note: You're in atomic-context while holding this lock!
+ */
+static inline void drm_vma_offset_cache_lock(struct drm_vma_offset_cache *cache)
+{
+	spin_lock(&cache->vm_lock);
+}
+
+/**
+ * drm_vma_offset_cache_unlock() - Unlock per-file cache
+ * @cache: Cache to unlock
+ *
+ * Release lock taken with drm_vma_offset_cache_lock().
+ */
+static inline void drm_vma_offset_cache_unlock(struct drm_vma_offset_cache *cache)
+{
+	spin_unlock(&cache->vm_lock);
+}
+
 /**
  * drm_vma_node_reset() - Initialize or reset node object
  * @node: Node to initialize or reset
@@ -453,6 +453,8 @@ struct ttm_bo_driver {
 	struct list_head *(*swap_lru_tail)(struct ttm_buffer_object *bo);
 };
 
+#define TTM_NUM_MEM_TYPES 8
+
 /**
  * struct ttm_bo_global_ref - Argument to initialize a struct ttm_bo_global.
  */
@@ -474,6 +476,9 @@ struct ttm_bo_global_ref {
  * @lru_lock: Spinlock protecting the bo subsystem lru lists.
  * @device_list: List of buffer object devices.
  * @swap_lru: Lru list of buffer objects used for swapping.
+ * @vm_faults: CPU faults served, per memory type of the faulting bo.
+ * @vm_fault_pages: Pages made available by those faults, prefault included.
+ * @vm_fault_huge: Superpage sized runs made available by those faults.
  */
 
 struct ttm_bo_global {
@@ -503,11 +508,12 @@ struct ttm_bo_global {
 	 * Internal protection.
 	 */
 	atomic_t bo_count;
+	atomic64_t vm_faults[TTM_NUM_MEM_TYPES];
+	atomic64_t vm_fault_pages[TTM_NUM_MEM_TYPES];
+	atomic64_t vm_fault_huge[TTM_NUM_MEM_TYPES];
 };
 
 
-#define TTM_NUM_MEM_TYPES 8
-
 /**
  * struct ttm_bo_device - Buffer object driver device-specific data.
  *
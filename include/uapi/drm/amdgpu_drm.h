@@ -50,6 +50,7 @@ extern "C" {
 #define DRM_AMDGPU_WAIT_CS		0x09
 #define DRM_AMDGPU_GEM_OP		0x10
 #define DRM_AMDGPU_GEM_USERPTR		0x11
+#define DRM_AMDGPU_WAIT_FENCES		0x12
 
 #define DRM_IOCTL_AMDGPU_GEM_CREATE	DRM_IOWR(DRM_COMMAND_BASE + DRM_AMDGPU_GEM_CREATE, union drm_amdgpu_gem_create)
 #define DRM_IOCTL_AMDGPU_GEM_MMAP	DRM_IOWR(DRM_COMMAND_BASE + DRM_AMDGPU_GEM_MMAP, union drm_amdgpu_gem_mmap)
@@ -63,6 +64,7 @@ extern "C" {
 #define DRM_IOCTL_AMDGPU_WAIT_CS	DRM_IOWR(DRM_COMMAND_BASE + DRM_AMDGPU_WAIT_CS, union drm_amdgpu_wait_cs)
 #define DRM_IOCTL_AMDGPU_GEM_OP		DRM_IOWR(DRM_COMMAND_BASE + DRM_AMDGPU_GEM_OP, struct drm_amdgpu_gem_op)
 #define DRM_IOCTL_AMDGPU_GEM_USERPTR	DRM_IOWR(DRM_COMMAND_BASE + DRM_AMDGPU_GEM_USERPTR, struct drm_amdgpu_gem_userptr)
+#define DRM_IOCTL_AMDGPU_WAIT_FENCES	DRM_IOWR(DRM_COMMAND_BASE + DRM_AMDGPU_WAIT_FENCES, union drm_amdgpu_wait_fences)
 
 #define AMDGPU_GEM_DOMAIN_CPU		0x1
 #define AMDGPU_GEM_DOMAIN_GTT		0x2
@@ -110,6 +112,10 @@ union drm_amdgpu_gem_create {
 #define AMDGPU_BO_LIST_OP_DESTROY	1
 /** Opcode to update resource information in the list */
 #define AMDGPU_BO_LIST_OP_UPDATE	2
+/** Opcode to add BOs to the list, keeping the existing entries */
+#define AMDGPU_BO_LIST_OP_ADD		3
+/** Opcode to remove BOs from the list, keeping the other entries */
+#define AMDGPU_BO_LIST_OP_REMOVE	4
 
 struct drm_amdgpu_bo_list_in {
 	/** Type of operation */
@@ -146,6 +152,7 @@ union drm_amdgpu_bo_list {
 #define AMDGPU_CTX_OP_ALLOC_CTX	1
 #define AMDGPU_CTX_OP_FREE_CTX	2
 #define AMDGPU_CTX_OP_QUERY_STATE	3
+#define AMDGPU_CTX_OP_SET_WEIGHT	4
 
 /* GPU reset status */
 #define AMDGPU_CTX_NO_RESET		0
@@ -162,7 +169,13 @@ struct drm_amdgpu_ctx_in {
 	/** For future use, no flags defined so far */
 	__u32	flags;
 	__u32	ctx_id;
-	__u32	_pad;
+	/**
+	 * Scheduling weight for AMDGPU_CTX_OP_ALLOC_CTX and
+	 * AMDGPU_CTX_OP_SET_WEIGHT, only used by the weighted fair scheduler
+	 * policy. 0 means the default of 1024, at most 64 times the default.
+	 * Weights above the default require CAP_SYS_ADMIN.
+	 */
+	__u32	weight;
 };
 
 union drm_amdgpu_ctx_out {
@@ -305,6 +318,34 @@ union drm_amdgpu_wait_cs {
 	struct drm_amdgpu_wait_cs_out out;
 };
 
+struct drm_amdgpu_fence {
+	__u32 ctx_id;
+	__u32 ip_type;
+	__u32 ip_instance;
+	__u32 ring;
+	__u64 seq_no;
+};
+
+struct drm_amdgpu_wait_fences_in {
+	/** This points to uint64_t * which points to fences */
+	__u64 fences;
+	__u32 fence_count;
+	__u32 wait_all;
+	__u64 timeout_ns;
+};
+
+struct drm_amdgpu_wait_fences_out {
+	/** 0 - fences still busy, 1 - wait condition met */
+	__u32 status;
+	/** Index of the first signaled fence for wait any */
+	__u32 first_signaled;
+};
+
+union drm_amdgpu_wait_fences {
+	struct drm_amdgpu_wait_fences_in in;
+	struct drm_amdgpu_wait_fences_out out;
+};
+
 #define AMDGPU_GEM_OP_GET_GEM_CREATE_INFO	0
 #define AMDGPU_GEM_OP_SET_PLACEMENT		1
 
@@ -360,6 +401,8 @@ struct drm_amdgpu_gem_va {
 #define AMDGPU_CHUNK_ID_IB		0x01
 #define AMDGPU_CHUNK_ID_FENCE		0x02
 #define AMDGPU_CHUNK_ID_DEPENDENCIES	0x03
+#define AMDGPU_CHUNK_ID_SYNCOBJ_IN	0x04
+#define AMDGPU_CHUNK_ID_SYNCOBJ_OUT	0x05
 
 struct drm_amdgpu_cs_chunk {
 	__u32		chunk_id;
@@ -424,6 +467,11 @@ struct drm_amdgpu_cs_chunk_fence {
 	__u32 offset;
 };
 
+/* Sync object handle for AMDGPU_CHUNK_ID_SYNCOBJ_IN/OUT */
+struct drm_amdgpu_cs_chunk_sem {
+	__u32 handle;
+};
+
 struct drm_amdgpu_cs_chunk_data {
 	union {
 		struct drm_amdgpu_cs_chunk_ib		ib_data;
@@ -389,6 +389,13 @@ typedef struct drm_i915_irq_wait {
 #define I915_PARAM_MIN_EU_IN_POOL	 39
 #define I915_PARAM_MMAP_GTT_VERSION	 40
 
+/*
+ * Query whether DRM_I915_GEM_EXECBUFFER2 supports the ability to pass an
+ * array of sync objects through the cliprects fields (I915_EXEC_FENCE_ARRAY).
+ * Numbered to match the upstream interface.
+ */
+#define I915_PARAM_HAS_EXEC_FENCE_ARRAY  49
+
 typedef struct drm_i915_getparam {
 	__s32 param;
 	/*
@@ -740,6 +747,18 @@ struct drm_i915_gem_exec_object2 {
 	__u64 rsvd2;
 };
 
+struct drm_i915_gem_exec_fence {
+	/**
+	 * User's handle for a drm_syncobj to wait on or signal.
+	 */
+	__u32 handle;
+
+#define I915_EXEC_FENCE_WAIT            (1<<0)
+#define I915_EXEC_FENCE_SIGNAL          (1<<1)
+#define __I915_EXEC_FENCE_UNKNOWN_FLAGS (-(I915_EXEC_FENCE_SIGNAL << 1))
+	__u32 flags;
+};
+
 struct drm_i915_gem_execbuffer2 {
 	/**
 	 * List of gem_exec_object2 structs
@@ -753,8 +772,12 @@ struct drm_i915_gem_execbuffer2 {
 	__u32 batch_len;
 	__u32 DR1;
 	__u32 DR4;
+	/**
+	 * This is a struct drm_clip_rect *cliprects, or a
+	 * struct drm_i915_gem_exec_fence *fences if I915_EXEC_FENCE_ARRAY
+	 * is set, with num_cliprects giving the number of fences.
+	 */
 	__u32 num_cliprects;
-	/** This is a struct drm_clip_rect *cliprects */
 	__u64 cliprects_ptr;
 #define I915_EXEC_RING_MASK              (7<<0)
 #define I915_EXEC_DEFAULT                (0<<0)
@@ -820,7 +843,19 @@ struct drm_i915_gem_execbuffer2 {
  */
 #define I915_EXEC_RESOURCE_STREAMER     (1<<15)
 
-#define __I915_EXEC_UNKNOWN_FLAGS -(I915_EXEC_RESOURCE_STREAMER<<1)
+/* Bits 16-18 are reserved for the upstream fence in/out and batch-first
+ * flags, which are not implemented here and are rejected.
+ */
+#define __I915_EXEC_RESERVED_FLAGS	(7<<16)
+
+/* Setting I915_EXEC_FENCE_ARRAY implies that num_cliprects and cliprects_ptr
+ * define an array of drm_i915_gem_exec_fence structures which specify a set
+ * of dependencies (wait) and output (signal) sync objects for the batch.
+ */
+#define I915_EXEC_FENCE_ARRAY		(1<<19)
+
+#define __I915_EXEC_UNKNOWN_FLAGS (-(I915_EXEC_FENCE_ARRAY<<1) | \
+				   __I915_EXEC_RESERVED_FLAGS)
 
 #define I915_EXEC_CONTEXT_ID_MASK	(0xffffffff)
 #define i915_execbuffer2_set_context_id(eb2, context) \
@@ -1219,6 +1254,7 @@ struct drm_i915_gem_context_param {
 #define I915_CONTEXT_PARAM_NO_ZEROMAP	0x2
 #define I915_CONTEXT_PARAM_GTT_SIZE	0x3
 #define I915_CONTEXT_PARAM_NO_ERROR_CAPTURE	0x4
+#define I915_CONTEXT_PARAM_BATCH_CACHE	0x5
 	__u64 value;
 };
 
@@ -950,6 +950,9 @@ struct drm_radeon_gem_va {
 #define RADEON_CHUNK_ID_IB	0x02
 #define RADEON_CHUNK_ID_FLAGS	0x03
 #define RADEON_CHUNK_ID_CONST_IB	0x04
+/* Since KMS 2.49 a CS may carry up to 16 RADEON_CHUNK_ID_IB chunks (and no
+ * RADEON_CHUNK_ID_CONST_IB), they are executed in order behind one fence.
+ */
 
 /* The first dword of RADEON_CHUNK_ID_FLAGS is a uint32 of these flags: */
 #define RADEON_CS_KEEP_TILING_FLAGS 0x01
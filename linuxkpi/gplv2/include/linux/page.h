@@ -23,6 +23,8 @@ page_count(vm_page_t page __unused)
 int set_pages_array_wb(struct page **pages, int addrinarray);
 int set_pages_array_uc(struct page **pages, int addrinarray);
 int set_pages_array_wc(struct page **pages, int addrinarray);
+int set_pages_array_memattr(struct page **pages, int addrinarray,
+    vm_memattr_t ma);
 
 int set_pages_wb(vm_page_t page, int numpages);
 int set_memory_wb(unsigned long addr, int numpages);
@@ -27,6 +27,12 @@
  */
 
 #include <sys/param.h>
+#include <sys/kernel.h>
+#include <sys/malloc.h>
+#include <sys/pcpu.h>
+#include <sys/proc.h>
+#include <sys/sched.h>
+#include <sys/smp.h>
 
 #include <sys/lock.h>
 #include <sys/rwlock.h>
@@ -34,6 +40,7 @@
 #include <machine/atomic.h>
 
 #include <vm/vm.h>
+#include <vm/vm_extern.h>
 #include <vm/vm_param.h>
 #include <vm/vm_page.h>
 #include <vm/vm_map.h>
@@ -52,6 +59,10 @@
 #undef	LINUXKPI_HAVE_DMAP
 #endif
 
+#if defined(__i386__) || defined(__amd64__)
+#define	LINUXKPI_HAVE_KMAP_WINDOW
+#endif
+
 extern u_int	cpu_feature;
 extern u_int	cpu_stdext_feature;
 
@@ -88,17 +99,138 @@ kmap(vm_page_t page)
 #endif
 }
 
+#ifdef LINUXKPI_HAVE_KMAP_WINDOW
+/*
+ * Per-CPU windows for kmap_atomic_prot() with a non-default memory
+ * attribute, akin to the Linux kmap_atomic() fixmap slots.  Entering the
+ * page into a private KVA slot with pmap_kenter_attr() leaves the memory
+ * attribute of the vm_page, and with it the direct map, untouched, so no
+ * cache flush or TLB shootdown is needed.  The mapping thread is pinned and
+ * a slot is only ever used by the CPU owning it, hence a local invlpg when
+ * the slot is released is sufficient.
+ */
+#define	KMAP_WINDOW_SLOTS	8
+
+struct kmap_window {
+	vm_offset_t	kva;
+	u_int		busy;		/* mask of slots in use */
+} __aligned(CACHE_LINE_SIZE);
+
+static struct kmap_window *kmap_windows;
+
+static void
+kmap_window_init(void *arg __unused)
+{
+	vm_offset_t kva;
+	int i;
+
+	kva = kva_alloc(ptoa(KMAP_WINDOW_SLOTS * (mp_maxid + 1)));
+	if (kva == 0)
+		return;
+
+	kmap_windows = malloc(sizeof(*kmap_windows) * (mp_maxid + 1),
+	    M_DEVBUF, M_WAITOK | M_ZERO);
+	for (i = 0; i <= mp_maxid; i++)
+		kmap_windows[i].kva = kva + ptoa(KMAP_WINDOW_SLOTS * i);
+}
+SYSINIT(kmap_window, SI_SUB_DRIVERS, SI_ORDER_ANY, kmap_window_init, NULL);
+
+static void
+kmap_window_uninit(void *arg __unused)
+{
+	if (kmap_windows == NULL)
+		return;
+
+	kva_free(kmap_windows[0].kva,
+	    ptoa(KMAP_WINDOW_SLOTS * (mp_maxid + 1)));
+	free(kmap_windows, M_DEVBUF);
+	kmap_windows = NULL;
+}
+SYSUNINIT(kmap_window, SI_SUB_DRIVERS, SI_ORDER_ANY, kmap_window_uninit, NULL);
+
+static void *
+kmap_window_enter(vm_page_t page, vm_memattr_t attr)
+{
+	struct kmap_window *kw;
+	vm_offset_t va;
+	int slot;
+
+	if (kmap_windows == NULL)
+		return (NULL);
+
+	sched_pin();
+	kw = &kmap_windows[curcpu];
+
+	/* Another thread on this CPU may preempt us and map a slot too. */
+	critical_enter();
+	slot = ffs(~kw->busy) - 1;
+	if (slot >= KMAP_WINDOW_SLOTS)
+		slot = -1;
+	else
+		kw->busy |= 1u << slot;
+	critical_exit();
+
+	if (slot < 0) {
+		sched_unpin();
+		return (NULL);
+	}
+
+	va = kw->kva + ptoa(slot);
+	pmap_kenter_attr(va, VM_PAGE_TO_PHYS(page), attr);
+	return ((void *)va);
+}
+
+static bool
+kmap_window_leave(void *vaddr)
+{
+	struct kmap_window *kw;
+	vm_offset_t va;
+	int slot;
+
+	if (kmap_windows == NULL)
+		return (false);
+
+	/* Only a pinned thread can hold a window address of this CPU. */
+	kw = &kmap_windows[curcpu];
+	va = trunc_page((vm_offset_t)vaddr);
+	if (va < kw->kva || va >= kw->kva + ptoa(KMAP_WINDOW_SLOTS))
+		return (false);
+
+	slot = atop(va - kw->kva);
+	pmap_kremove(va);
+	invlpg(va);
+
+	critical_enter();
+	kw->busy &= ~(1u << slot);
+	critical_exit();
+
+	sched_unpin();
+	return (true);
+}
+#endif
+
 void *
 kmap_atomic_prot(vm_page_t page, pgprot_t prot)
 {
 	vm_memattr_t attr = pgprot2cachemode(prot);
+#ifdef LINUXKPI_HAVE_KMAP_WINDOW
+	void *vaddr;
+#endif
 
-	if (attr != VM_MEMATTR_DEFAULT) {
-		vm_page_lock(page);
-		page->flags |= PG_FICTITIOUS;
-		vm_page_unlock(page);
-		pmap_page_set_memattr(page, attr);
-	}
+	if (attr == VM_MEMATTR_DEFAULT || attr == pmap_page_get_memattr(page))
+		return (kmap(page));
+
+#ifdef LINUXKPI_HAVE_KMAP_WINDOW
+	vaddr = kmap_window_enter(page, attr);
+	if (vaddr != NULL)
+		return (vaddr);
+#endif
+
+	/* All windows of this CPU are in use, change the page itself. */
+	vm_page_lock(page);
+	page->flags |= PG_FICTITIOUS;
+	vm_page_unlock(page);
+	pmap_page_set_memattr(page, attr);
 	return (kmap(page));
 }
 
@@ -130,6 +262,10 @@ kunmap(vm_page_t page)
 void
 kunmap_atomic(void *vaddr)
 {
+#ifdef LINUXKPI_HAVE_KMAP_WINDOW
+	if (kmap_window_leave(vaddr))
+		return;
+#endif
 #ifdef LINUXKPI_HAVE_DMAP
 	/* NOP */
 #else
@@ -259,33 +395,80 @@ retry:
 }
 
 #if defined(__i386__) || defined(__amd64__)
+/*
+ * Change the memory attribute of an array of pages.  On amd64 physically
+ * contiguous runs, in either direction, are changed with a single
+ * pmap_change_attr() call on the direct map instead of one call, and one
+ * TLB shootdown, per page.  A 2MB aligned run keeps its direct map
+ * superpage.
+ */
 int
-set_pages_array_wb(struct page **pages, int addrinarray)
+set_pages_array_memattr(struct page **pages, int addrinarray, vm_memattr_t ma)
 {
-	int i;
+	int i, j;
+#ifdef __amd64__
+	vm_paddr_t pa, start;
+	int error, k, step;
+#endif
 
-	for (i = 0; i < addrinarray; i++)
-		set_pages_wb(pages[i], 1);
+	for (i = 0; i < addrinarray; i = j) {
+		j = i + 1;
+#ifdef __amd64__
+		if (j < addrinarray &&
+		    (pages[i]->flags & PG_FICTITIOUS) == 0) {
+			pa = VM_PAGE_TO_PHYS(pages[i]);
+			if (VM_PAGE_TO_PHYS(pages[j]) == pa + PAGE_SIZE)
+				step = 1;
+			else if (VM_PAGE_TO_PHYS(pages[j]) == pa - PAGE_SIZE)
+				step = -1;
+			else
+				step = 0;
+			if (step != 0) {
+				while (j < addrinarray &&
+				    (pages[j]->flags & PG_FICTITIOUS) == 0 &&
+				    VM_PAGE_TO_PHYS(pages[j]) ==
+				    pa + (vm_paddr_t)(j - i) * step * PAGE_SIZE)
+					j++;
+			}
+		}
+		if (j - i > 1) {
+			start = MIN(VM_PAGE_TO_PHYS(pages[i]),
+			    VM_PAGE_TO_PHYS(pages[j - 1]));
+			for (k = i; k < j; k++)
+				pages[k]->md.pat_mode = ma;
+			error = pmap_change_attr(PHYS_TO_DMAP(start),
+			    (vm_size_t)(j - i) * PAGE_SIZE, ma);
+			if (error != 0)
+				return (-error);
+			continue;
+		}
+#endif
+		pmap_page_set_memattr(pages[i], ma);
+	}
 	return (0);
 }
 
+int
+set_pages_array_wb(struct page **pages, int addrinarray)
+{
+
+	return (set_pages_array_memattr(pages, addrinarray,
+	    VM_MEMATTR_WRITE_BACK));
+}
+
 int
 set_pages_array_wc(struct page **pages, int addrinarray)
 {
-	int i;
 
-	for (i = 0; i < addrinarray; i++)
-		set_pages_wc(pages[i], 1);
-	return (0);
+	return (set_pages_array_memattr(pages, addrinarray,
+	    VM_MEMATTR_WRITE_COMBINING));
 }
 
 int
 set_pages_array_uc(struct page **pages, int addrinarray)
 {
-	int i;
 
-	for (i = 0; i < addrinarray; i++)
-		set_pages_uc(pages[i], 1);
-	return (0);
+	return (set_pages_array_memattr(pages, addrinarray,
+	    VM_MEMATTR_UNCACHEABLE));
 }
 #endif
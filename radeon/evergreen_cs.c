@@ -1768,6 +1768,51 @@ static inline bool evergreen_is_safe_reg(struct radeon_cs_parser *p, u32 reg)
 	return false;
 }
 
+/**
+ * evergreen_cs_check_reg_range() - check the registers of a SET_*_REG packet
+ * @parser: parser structure holding parsing context
+ * @start_reg: first register written
+ * @end_reg: last register written
+ * @idx: index into the cs buffer of the value for @start_reg
+ */
+static int evergreen_cs_check_reg_range(struct radeon_cs_parser *p,
+					u32 start_reg, u32 end_reg, u32 idx)
+{
+	struct evergreen_cs_track *track = p->track;
+	u32 reg = start_reg;
+	int r;
+
+	for (;;) {
+		reg = r600_cs_next_unsafe_reg(track->reg_safe_bm,
+					      REG_SAFE_BM_SIZE,
+					      reg, end_reg);
+		if (reg > end_reg)
+			return 0;
+
+		r = evergreen_cs_handle_reg(p, reg,
+					    idx + ((reg - start_reg) >> 2));
+		if (r)
+			return r;
+		reg += 4;
+	}
+}
+
+/**
+ * evergreen_cs_test_reg_ranges() - check the range walk on the evergreen
+ * and cayman bitmaps
+ */
+int evergreen_cs_test_reg_ranges(void)
+{
+	int r;
+
+	r = r600_cs_test_reg_safe_bm("evergreen", evergreen_reg_safe_bm,
+				     REG_SAFE_BM_SIZE);
+	if (r)
+		return r;
+	return r600_cs_test_reg_safe_bm("cayman", cayman_reg_safe_bm,
+					REG_SAFE_BM_SIZE);
+}
+
 static int evergreen_packet3_check(struct radeon_cs_parser *p,
 				   struct radeon_cs_packet *pkt)
 {
@@ -2305,13 +2350,9 @@ static int evergreen_packet3_check(struct radeon_cs_parser *p,
 			DRM_ERROR("bad PACKET3_SET_CONFIG_REG\n");
 			return -EINVAL;
 		}
-		for (reg = start_reg, idx++; reg <= end_reg; reg += 4, idx++) {
-			if (evergreen_is_safe_reg(p, reg))
-				continue;
-			r = evergreen_cs_handle_reg(p, reg, idx);
-			if (r)
-				return r;
-		}
+		r = evergreen_cs_check_reg_range(p, start_reg, end_reg, idx+1);
+		if (r)
+			return r;
 		break;
 	case PACKET3_SET_CONTEXT_REG:
 		start_reg = (idx_value << 2) + PACKET3_SET_CONTEXT_REG_START;
@@ -2322,13 +2363,9 @@ static int evergreen_packet3_check(struct radeon_cs_parser *p,
 			DRM_ERROR("bad PACKET3_SET_CONTEXT_REG\n");
 			return -EINVAL;
 		}
-		for (reg = start_reg, idx++; reg <= end_reg; reg += 4, idx++) {
-			if (evergreen_is_safe_reg(p, reg))
-				continue;
-			r = evergreen_cs_handle_reg(p, reg, idx);
-			if (r)
-				return r;
-		}
+		r = evergreen_cs_check_reg_range(p, start_reg, end_reg, idx+1);
+		if (r)
+			return r;
 		break;
 	case PACKET3_SET_RESOURCE:
 		if (pkt->count % 8) {
@@ -957,30 +957,139 @@ static int r600_cs_parse_packet0(struct radeon_cs_parser *p,
 }
 
 /**
- * r600_cs_check_reg() - check if register is authorized or not
+ * r600_cs_next_unsafe_reg() - find the next register needing special handling
+ * @reg_safe_bm: register bitmap, a set bit flags a register as not safe
+ * @bm_size: number of words in @reg_safe_bm
+ * @reg: first register of the range
+ * @end_reg: last register of the range
+ *
+ * Registers written by SET_*_REG packets come in contiguous ranges and
+ * almost all of them are safe, so instead of testing the bitmap once per
+ * register test it one word (32 registers) at a time. Registers beyond the
+ * end of the bitmap are not safe.
+ *
+ * Returns the first register in [@reg, @end_reg] that is not flagged as
+ * safe, or a value above @end_reg if the whole range is safe.
+ */
+u32 r600_cs_next_unsafe_reg(const unsigned *reg_safe_bm, unsigned bm_size,
+			    u32 reg, u32 end_reg)
+{
+	u32 bit = reg >> 2, last = end_reg >> 2;
+
+	while (bit <= last) {
+		u32 i = bit >> 5;
+		u32 word;
+
+		if (i >= bm_size)
+			return bit << 2;
+
+		word = reg_safe_bm[i] & (~0u << (bit & 31));
+		if (i == (last >> 5))
+			word &= ~0u >> (31 - (last & 31));
+		if (word)
+			return ((i << 5) + __ffs(word)) << 2;
+
+		bit = (i + 1) << 5;
+	}
+
+	return end_reg + 4;
+}
+
+/*
+ * Per register bitmap test, as done before the range walk of
+ * r600_cs_next_unsafe_reg(), kept to check the two against each other.
+ */
+static bool r600_cs_reg_is_safe(const unsigned *reg_safe_bm, unsigned bm_size,
+				u32 reg)
+{
+	u32 i = reg >> 7;
+
+	if (i >= bm_size)
+		return false;
+	return !(reg_safe_bm[i] & (1 << ((reg >> 2) & 31)));
+}
+
+/**
+ * r600_cs_test_reg_safe_bm() - compare range and per register checks
+ * @name: name of the bitmap for messages
+ * @reg_safe_bm: register bitmap, a set bit flags a register as not safe
+ * @bm_size: number of words in @reg_safe_bm
+ *
+ * Walks every SET_*_REG style range of a few interesting lengths (word
+ * sized and unaligned ones, up to past the end of the bitmap) the way the
+ * CS checkers do and makes sure it stops on exactly the registers the
+ * per register test flags as not safe, in order.
+ *
+ * Returns 0 if both agree, -EINVAL otherwise.
+ */
+int r600_cs_test_reg_safe_bm(const char *name, const unsigned *reg_safe_bm,
+			     unsigned bm_size)
+{
+	static const u32 lengths[] = { 1, 2, 3, 31, 32, 33, 64, 65, 256 };
+	u32 max_reg = (bm_size << 7) + 256;
+	u32 start_reg, end_reg, reg, next;
+	unsigned i;
+
+	for (i = 0; i < ARRAY_SIZE(lengths); i++) {
+		for (start_reg = 0; start_reg < max_reg; start_reg += 4) {
+			end_reg = start_reg + 4 * (lengths[i] - 1);
+			next = r600_cs_next_unsafe_reg(reg_safe_bm, bm_size,
+						       start_reg, end_reg);
+			for (reg = start_reg; reg <= end_reg; reg += 4) {
+				if (r600_cs_reg_is_safe(reg_safe_bm, bm_size,
+							reg)) {
+					if (next == reg)
+						goto fail;
+					continue;
+				}
+				if (next != reg)
+					goto fail;
+				next = r600_cs_next_unsafe_reg(reg_safe_bm,
+							       bm_size,
+							       reg + 4,
+							       end_reg);
+			}
+			if (next <= end_reg)
+				goto fail;
+		}
+	}
+	return 0;
+
+fail:
+	DRM_ERROR("%s: range check of 0x%04X-0x%04X disagrees at 0x%04X "
+		  "(0x%04X)\n", name, start_reg, end_reg, reg, next);
+	return -EINVAL;
+}
+
+/**
+ * r600_cs_test_reg_ranges() - check the range walk on the r600 bitmap
+ */
+int r600_cs_test_reg_ranges(void)
+{
+	return r600_cs_test_reg_safe_bm("r600", r600_reg_safe_bm,
+					ARRAY_SIZE(r600_reg_safe_bm));
+}
+
+/**
+ * r600_cs_handle_reg() - process registers that need special handling.
  * @parser: parser structure holding parsing context
  * @reg: register we are testing
  * @idx: index into the cs buffer
  *
- * This function will test against r600_reg_safe_bm and return 0
- * if register is safe. If register is not flag as safe this function
- * will test it against a list of register needind special handling.
+ * Called for registers that are not flagged as safe in r600_reg_safe_bm,
+ * tests them against a list of registers needing special handling.
  */
-static int r600_cs_check_reg(struct radeon_cs_parser *p, u32 reg, u32 idx)
+static int r600_cs_handle_reg(struct radeon_cs_parser *p, u32 reg, u32 idx)
 {
 	struct r600_cs_track *track = (struct r600_cs_track *)p->track;
 	struct radeon_bo_list *reloc;
-	u32 m, i, tmp, *ib;
+	u32 tmp, *ib;
 	int r;
 
-	i = (reg >> 7);
-	if (i >= ARRAY_SIZE(r600_reg_safe_bm)) {
+	if ((reg >> 7) >= ARRAY_SIZE(r600_reg_safe_bm)) {
 		dev_warn(p->dev, "forbidden register 0x%08x at %d\n", reg, idx);
 		return -EINVAL;
 	}
-	m = 1 << ((reg >> 2) & 31);
-	if (!(r600_reg_safe_bm[i] & m))
-		return 0;
 	ib = p->ib.ptr;
 	switch (reg) {
 	/* force following reg to 0 in an attempt to disable out buffer
@@ -1607,6 +1716,33 @@ static int r600_check_texture_resource(struct radeon_cs_parser *p,  u32 idx,
 	return 0;
 }
 
+/**
+ * r600_cs_check_reg_range() - check the registers of a SET_*_REG packet
+ * @parser: parser structure holding parsing context
+ * @start_reg: first register written
+ * @end_reg: last register written
+ * @idx: index into the cs buffer of the value for @start_reg
+ */
+static int r600_cs_check_reg_range(struct radeon_cs_parser *p,
+				   u32 start_reg, u32 end_reg, u32 idx)
+{
+	u32 reg = start_reg;
+	int r;
+
+	for (;;) {
+		reg = r600_cs_next_unsafe_reg(r600_reg_safe_bm,
+					      ARRAY_SIZE(r600_reg_safe_bm),
+					      reg, end_reg);
+		if (reg > end_reg)
+			return 0;
+
+		r = r600_cs_handle_reg(p, reg, idx + ((reg - start_reg) >> 2));
+		if (r)
+			return r;
+		reg += 4;
+	}
+}
+
 static bool r600_is_safe_reg(struct radeon_cs_parser *p, u32 reg, u32 idx)
 {
 	u32 m, i;
@@ -1914,12 +2050,9 @@ static int r600_packet3_check(struct radeon_cs_parser *p,
 			DRM_ERROR("bad PACKET3_SET_CONFIG_REG\n");
 			return -EINVAL;
 		}
-		for (i = 0; i < pkt->count; i++) {
-			reg = start_reg + (4 * i);
-			r = r600_cs_check_reg(p, reg, idx+1+i);
-			if (r)
-				return r;
-		}
+		r = r600_cs_check_reg_range(p, start_reg, end_reg, idx+1);
+		if (r)
+			return r;
 		break;
 	case PACKET3_SET_CONTEXT_REG:
 		start_reg = (idx_value << 2) + PACKET3_SET_CONTEXT_REG_OFFSET;
@@ -1930,12 +2063,9 @@ static int r600_packet3_check(struct radeon_cs_parser *p,
 			DRM_ERROR("bad PACKET3_SET_CONTEXT_REG\n");
 			return -EINVAL;
 		}
-		for (i = 0; i < pkt->count; i++) {
-			reg = start_reg + (4 * i);
-			r = r600_cs_check_reg(p, reg, idx+1+i);
-			if (r)
-				return r;
-		}
+		r = r600_cs_check_reg_range(p, start_reg, end_reg, idx+1);
+		if (r)
+			return r;
 		break;
 	case PACKET3_SET_RESOURCE:
 		if (pkt->count % 7) {
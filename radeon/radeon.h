@@ -127,6 +127,10 @@ extern int radeon_vce;
 #define RADEON_USEC_IB_TEST_TIMEOUT		1000000 /* 1s */
 /* RADEON_IB_POOL_SIZE must be a power of 2 */
 #define RADEON_IB_POOL_SIZE			16
+/* ring space reserved for each additional IB of a multi IB submission */
+#define RADEON_IB_EXECUTE_DW			32
+/* maximum number of IB chunks in a single CS */
+#define RADEON_CS_MAX_IBS			16
 #define RADEON_DEBUGFS_MAX_COMPONENTS		32
 #define RADEONFB_CONN_LIMIT			4
 #define RADEON_BIOS_NUM_SCRATCH			8
@@ -524,9 +528,12 @@ int radeon_gem_debugfs_init(struct radeon_device *rdev);
  * like the indirect buffer or semaphore, which both have their
  * locking.
  *
+ * The buffer is split into one region per active ring, each region
+ * being managed on its own so rings only ever wait on their own fences.
+ *
  * Principe is simple, we keep a list of sub allocation in offset
- * order (first entry has offset == 0, last entry has the highest
- * offset).
+ * order (first entry has the region start offset, last entry has the
+ * highest offset).
  *
  * When allocating new object we first check if there is room at
  * the end total_size - (last_object_offset + last_object_size) >=
@@ -542,12 +549,23 @@ int radeon_gem_debugfs_init(struct radeon_device *rdev);
  * Assumption is that there won't be hole (all object on same
  * alignment).
  */
-struct radeon_sa_manager {
+struct radeon_sa_region {
 	wait_queue_head_t	wq;
-	struct radeon_bo	*bo;
 	struct list_head	*hole;
-	struct list_head	flist[RADEON_NUM_RINGS];
+	struct list_head	flist;
 	struct list_head	olist;
+	unsigned		soffset;
+	unsigned		eoffset;
+	/* statistics, protected by wq.lock */
+	u64			allocs;
+	u64			waits;
+	u64			wait_ns;
+};
+
+struct radeon_sa_manager {
+	struct radeon_bo	*bo;
+	struct radeon_sa_region	regions[RADEON_NUM_RINGS];
+	int			fallback;
 	unsigned		size;
 	uint64_t		gpu_addr;
 	void			*cpu_ptr;
@@ -562,6 +580,7 @@ struct radeon_sa_bo {
 	struct list_head		olist;
 	struct list_head		flist;
 	struct radeon_sa_manager	*manager;
+	struct radeon_sa_region		*region;
 	unsigned			soffset;
 	unsigned			eoffset;
 	struct radeon_fence		*fence;
@@ -598,7 +617,7 @@ struct radeon_semaphore {
 	uint64_t		gpu_addr;
 };
 
-int radeon_semaphore_create(struct radeon_device *rdev,
+int radeon_semaphore_create(struct radeon_device *rdev, int ring,
 			    struct radeon_semaphore **semaphore);
 bool radeon_semaphore_emit_signal(struct radeon_device *rdev, int ring,
 				  struct radeon_semaphore *semaphore);
@@ -1027,9 +1046,14 @@ struct radeon_rlc {
 int radeon_ib_get(struct radeon_device *rdev, int ring,
 		  struct radeon_ib *ib, struct radeon_vm *vm,
 		  unsigned size);
+void radeon_ib_get_sub(struct radeon_ib *parent, struct radeon_ib *ib,
+		       unsigned offset);
 void radeon_ib_free(struct radeon_device *rdev, struct radeon_ib *ib);
 int radeon_ib_schedule(struct radeon_device *rdev, struct radeon_ib *ib,
 		       struct radeon_ib *const_ib, bool hdp_flush);
+int radeon_ib_schedule_multi(struct radeon_device *rdev, struct radeon_ib *ib,
+			     struct radeon_ib *ibs, unsigned nibs,
+			     bool hdp_flush);
 int radeon_ib_pool_init(struct radeon_device *rdev);
 void radeon_ib_pool_fini(struct radeon_device *rdev);
 int radeon_ib_ring_tests(struct radeon_device *rdev);
@@ -1099,6 +1123,11 @@ struct radeon_cs_parser {
 	struct radeon_cs_chunk  *chunk_const_ib;
 	struct radeon_ib	ib;
 	struct radeon_ib	const_ib;
+	/* IB chunks of the CS, chunk_ib points to the one being parsed */
+	unsigned		nibs;
+	struct radeon_cs_chunk	**chunks_ib;
+	/* IBs scheduled after ib when the CS has more than one IB chunk */
+	struct radeon_ib	*ibs;
 	void			*track;
 	unsigned		family;
 	int			parser_error;
@@ -1784,6 +1813,7 @@ struct r600_audio {
  * Benchmarking
  */
 void radeon_benchmark(struct radeon_device *rdev, int test_number);
+int radeon_benchmark_debugfs_init(struct radeon_device *rdev);
 
 
 /*
@@ -1794,6 +1824,7 @@ void radeon_test_ring_sync(struct radeon_device *rdev,
 			   struct radeon_ring *cpA,
 			   struct radeon_ring *cpB);
 void radeon_test_syncing(struct radeon_device *rdev);
+void radeon_test_cs_reg_ranges(struct radeon_device *rdev);
 
 /*
  * MMU Notifier
@@ -2978,6 +3009,12 @@ int radeon_cs_packet_next_reloc(struct radeon_cs_parser *p,
 int r600_cs_common_vline_parse(struct radeon_cs_parser *p,
 			       uint32_t *vline_start_end,
 			       uint32_t *vline_status);
+u32 r600_cs_next_unsafe_reg(const unsigned *reg_safe_bm, unsigned bm_size,
+			    u32 reg, u32 end_reg);
+int r600_cs_test_reg_safe_bm(const char *name, const unsigned *reg_safe_bm,
+			     unsigned bm_size);
+int r600_cs_test_reg_ranges(void);
+int evergreen_cs_test_reg_ranges(void);
 
 #include "radeon_object.h"
 
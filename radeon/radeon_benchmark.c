@@ -23,27 +23,75 @@
  */
 #include <drm/drmP.h>
 #include <drm/radeon_drm.h>
+#include <linux/ktime.h>
 #include "radeon_reg.h"
 #include "radeon.h"
 
+/*
+ * Copy benchmark.
+ *
+ * Every measurement copies between two pinned buffers with the DMA engine,
+ * the blit engine or the CPU and reports wall time in nanoseconds.  GPU
+ * copies are pipelined: up to RADEON_BENCHMARK_INFLIGHT copies are queued
+ * before the oldest fence is waited on, so the numbers reflect engine
+ * throughput rather than submission latency.  The number of copies scales
+ * with the buffer size so that every measurement moves a similar amount
+ * of data.
+ *
+ * The radeon.benchmark parameter runs a test at load time and logs to the
+ * console; the radeon_benchmark debugfs file runs the full sweep over sizes,
+ * domain pairs and methods and prints one result per line.
+ */
+
 #define RADEON_BENCHMARK_COPY_BLIT 1
 #define RADEON_BENCHMARK_COPY_DMA  0
+#define RADEON_BENCHMARK_COPY_CPU  2
 
 #define RADEON_BENCHMARK_ITERATIONS 1024
+#define RADEON_BENCHMARK_INFLIGHT 8
+#define RADEON_BENCHMARK_BYTES (256 << 20)
+#define RADEON_BENCHMARK_CPU_BYTES (32 << 20)
 #define RADEON_BENCHMARK_COMMON_MODES_N 17
+#define RADEON_BENCHMARK_SWEEP_ORDER 12
+
+static const char * const radeon_benchmark_kind[] = {
+	[RADEON_BENCHMARK_COPY_DMA] = "dma",
+	[RADEON_BENCHMARK_COPY_BLIT] = "blit",
+	[RADEON_BENCHMARK_COPY_CPU] = "cpu",
+};
+
+static unsigned radeon_benchmark_iterations(unsigned size, int flag)
+{
+	unsigned bytes = flag == RADEON_BENCHMARK_COPY_CPU ?
+		RADEON_BENCHMARK_CPU_BYTES : RADEON_BENCHMARK_BYTES;
+
+	return clamp_t(unsigned, bytes / size, RADEON_BENCHMARK_INFLIGHT,
+		       RADEON_BENCHMARK_ITERATIONS);
+}
 
 static int radeon_benchmark_do_move(struct radeon_device *rdev, unsigned size,
 				    uint64_t saddr, uint64_t daddr,
 				    int flag, int n,
-				    struct reservation_object *resv)
+				    struct reservation_object *resv,
+				    u64 *ns)
 {
-	unsigned long start_jiffies;
-	unsigned long end_jiffies;
-	struct radeon_fence *fence = NULL;
-	int i, r;
+	struct radeon_fence *fences[RADEON_BENCHMARK_INFLIGHT] = {};
+	u64 start;
+	int i, r = 0;
 
-	start_jiffies = jiffies;
+	start = ktime_get_raw_ns();
 	for (i = 0; i < n; i++) {
+		struct radeon_fence **slot = &fences[i % RADEON_BENCHMARK_INFLIGHT];
+		struct radeon_fence *fence;
+
+		/* Wait for the copy queued RADEON_BENCHMARK_INFLIGHT ago */
+		if (*slot) {
+			r = radeon_fence_wait(*slot, false);
+			radeon_fence_unref(slot);
+			if (r)
+				goto out;
+		}
+
 		switch (flag) {
 		case RADEON_BENCHMARK_COPY_DMA:
 			fence = radeon_copy_dma(rdev, saddr, daddr,
@@ -57,43 +105,119 @@ static int radeon_benchmark_do_move(struct radeon_device *rdev, unsigned size,
 			break;
 		default:
 			DRM_ERROR("Unknown copy method\n");
-			return -EINVAL;
+			r = -EINVAL;
+			goto out;
+		}
+		if (IS_ERR(fence)) {
+			r = PTR_ERR(fence);
+			goto out;
 		}
-		if (IS_ERR(fence))
-			return PTR_ERR(fence);
+		*slot = fence;
+	}
 
-		r = radeon_fence_wait(fence, false);
-		radeon_fence_unref(&fence);
-		if (r)
-			return r;
+out:
+	for (i = 0; i < RADEON_BENCHMARK_INFLIGHT; i++) {
+		if (!fences[i])
+			continue;
+		if (!r)
+			r = radeon_fence_wait(fences[i], false);
+		radeon_fence_unref(&fences[i]);
+	}
+	*ns = ktime_get_raw_ns() - start;
+	return r;
+}
+
+static int radeon_benchmark_do_memcpy(struct radeon_bo *sobj,
+				      struct radeon_bo *dobj,
+				      unsigned size, int n, u64 *ns)
+{
+	void *sptr, *dptr;
+	u64 start;
+	int i, r;
+
+	r = radeon_bo_reserve(sobj, false);
+	if (unlikely(r != 0))
+		return r;
+	r = radeon_bo_kmap(sobj, &sptr);
+	radeon_bo_unreserve(sobj);
+	if (r)
+		return r;
+
+	r = radeon_bo_reserve(dobj, false);
+	if (unlikely(r != 0))
+		goto out_sobj;
+	r = radeon_bo_kmap(dobj, &dptr);
+	radeon_bo_unreserve(dobj);
+	if (r)
+		goto out_sobj;
+
+	start = ktime_get_raw_ns();
+	for (i = 0; i < n; i++)
+		memcpy(dptr, sptr, size);
+	mb();
+	*ns = ktime_get_raw_ns() - start;
+
+	if (radeon_bo_reserve(dobj, false) == 0) {
+		radeon_bo_kunmap(dobj);
+		radeon_bo_unreserve(dobj);
 	}
-	end_jiffies = jiffies;
-	return jiffies_to_msecs(end_jiffies - start_jiffies);
+out_sobj:
+	if (radeon_bo_reserve(sobj, false) == 0) {
+		radeon_bo_kunmap(sobj);
+		radeon_bo_unreserve(sobj);
+	}
+	return r;
 }
 
+static const char *radeon_benchmark_domain(unsigned domain)
+{
+	switch (domain) {
+	case RADEON_GEM_DOMAIN_VRAM:
+		return "vram";
+	case RADEON_GEM_DOMAIN_GTT:
+		return "gtt";
+	default:
+		return "cpu";
+	}
+}
 
-static void radeon_benchmark_log_results(int n, unsigned size,
-					 unsigned int time,
+static void radeon_benchmark_log_results(struct seq_file *m,
+					 int n, unsigned size, u64 ns,
 					 unsigned sdomain, unsigned ddomain,
-					 char *kind)
+					 int flag)
 {
-	unsigned int throughput = (n * (size >> 10)) / time;
-	DRM_INFO("radeon: %s %u bo moves of %u kB from"
-		 " %d to %d in %u ms, throughput: %u Mb/s or %u MB/s\n",
-		 kind, n, size >> 10, sdomain, ddomain, time,
-		 throughput * 8, throughput);
+	/* MB/s without overflowing for n * size up to 2^37 bytes */
+	u64 bytes = (u64)n * size;
+	u64 throughput = div64_u64(bytes * (NSEC_PER_SEC >> 9),
+				   max_t(u64, ns, 1)) >> 11;
+
+	if (m) {
+		seq_printf(m, "%-4s %-4s %-4s %9u %5d %12llu %6llu\n",
+			   radeon_benchmark_kind[flag],
+			   radeon_benchmark_domain(sdomain),
+			   radeon_benchmark_domain(ddomain),
+			   size, n, ns, throughput);
+		return;
+	}
+
+	DRM_INFO("radeon: %s %d bo moves of %u kB from"
+		 " %s to %s in %llu us, throughput: %llu Mb/s or %llu MB/s\n",
+		 radeon_benchmark_kind[flag], n, size >> 10,
+		 radeon_benchmark_domain(sdomain),
+		 radeon_benchmark_domain(ddomain),
+		 div_u64(ns, NSEC_PER_USEC), throughput * 8, throughput);
 }
 
 static void radeon_benchmark_move(struct radeon_device *rdev, unsigned size,
-				  unsigned sdomain, unsigned ddomain)
+				  unsigned sdomain, unsigned ddomain,
+				  struct seq_file *m)
 {
 	struct radeon_bo *dobj = NULL;
 	struct radeon_bo *sobj = NULL;
 	uint64_t saddr, daddr;
 	int r, n;
-	int time;
+	u64 ns;
 
-	n = RADEON_BENCHMARK_ITERATIONS;
 	r = radeon_bo_create(rdev, size, PAGE_SIZE, true, sdomain, 0, NULL, NULL, &sobj);
 	if (r) {
 		goto out_cleanup;
@@ -120,27 +244,33 @@ static void radeon_benchmark_move(struct radeon_device *rdev, unsigned size,
 	}
 
 	if (rdev->asic->copy.dma) {
-		time = radeon_benchmark_do_move(rdev, size, saddr, daddr,
-						RADEON_BENCHMARK_COPY_DMA, n,
-						dobj->tbo.resv);
-		if (time < 0)
+		n = radeon_benchmark_iterations(size, RADEON_BENCHMARK_COPY_DMA);
+		r = radeon_benchmark_do_move(rdev, size, saddr, daddr,
+					     RADEON_BENCHMARK_COPY_DMA, n,
+					     dobj->tbo.resv, &ns);
+		if (r)
 			goto out_cleanup;
-		if (time > 0)
-			radeon_benchmark_log_results(n, size, time,
-						     sdomain, ddomain, "dma");
+		radeon_benchmark_log_results(m, n, size, ns, sdomain, ddomain,
+					     RADEON_BENCHMARK_COPY_DMA);
 	}
 
 	if (rdev->asic->copy.blit) {
-		time = radeon_benchmark_do_move(rdev, size, saddr, daddr,
-						RADEON_BENCHMARK_COPY_BLIT, n,
-						dobj->tbo.resv);
-		if (time < 0)
+		n = radeon_benchmark_iterations(size, RADEON_BENCHMARK_COPY_BLIT);
+		r = radeon_benchmark_do_move(rdev, size, saddr, daddr,
+					     RADEON_BENCHMARK_COPY_BLIT, n,
+					     dobj->tbo.resv, &ns);
+		if (r)
 			goto out_cleanup;
-		if (time > 0)
-			radeon_benchmark_log_results(n, size, time,
-						     sdomain, ddomain, "blit");
+		radeon_benchmark_log_results(m, n, size, ns, sdomain, ddomain,
+					     RADEON_BENCHMARK_COPY_BLIT);
 	}
 
+	/* VRAM outside of the CPU visible aperture cannot be mapped, skip */
+	n = radeon_benchmark_iterations(size, RADEON_BENCHMARK_COPY_CPU);
+	if (radeon_benchmark_do_memcpy(sobj, dobj, size, n, &ns) == 0)
+		radeon_benchmark_log_results(m, n, size, ns, sdomain, ddomain,
+					     RADEON_BENCHMARK_COPY_CPU);
+
 out_cleanup:
 	if (sobj) {
 		r = radeon_bo_reserve(sobj, false);
@@ -164,6 +294,25 @@ out_cleanup:
 	}
 }
 
+/* Powers of 4 from one GPU page to 16MB across all domain pairs */
+static void radeon_benchmark_sweep(struct radeon_device *rdev,
+				   struct seq_file *m)
+{
+	static const unsigned domains[][2] = {
+		{ RADEON_GEM_DOMAIN_GTT, RADEON_GEM_DOMAIN_VRAM },
+		{ RADEON_GEM_DOMAIN_VRAM, RADEON_GEM_DOMAIN_GTT },
+		{ RADEON_GEM_DOMAIN_VRAM, RADEON_GEM_DOMAIN_VRAM },
+		{ RADEON_GEM_DOMAIN_GTT, RADEON_GEM_DOMAIN_GTT },
+	};
+	int i, order;
+
+	for (i = 0; i < ARRAY_SIZE(domains); i++)
+		for (order = 0; order <= RADEON_BENCHMARK_SWEEP_ORDER; order += 2)
+			radeon_benchmark_move(rdev,
+					      RADEON_GPU_PAGE_SIZE << order,
+					      domains[i][0], domains[i][1], m);
+}
+
 void radeon_benchmark(struct radeon_device *rdev, int test_number)
 {
 	int i;
@@ -191,59 +340,97 @@ void radeon_benchmark(struct radeon_device *rdev, int test_number)
 	case 1:
 		/* simple test, VRAM to GTT and GTT to VRAM */
 		radeon_benchmark_move(rdev, 1024*1024, RADEON_GEM_DOMAIN_GTT,
-				      RADEON_GEM_DOMAIN_VRAM);
+				      RADEON_GEM_DOMAIN_VRAM, NULL);
 		radeon_benchmark_move(rdev, 1024*1024, RADEON_GEM_DOMAIN_VRAM,
-				      RADEON_GEM_DOMAIN_GTT);
+				      RADEON_GEM_DOMAIN_GTT, NULL);
 		break;
 	case 2:
 		/* simple test, VRAM to VRAM */
 		radeon_benchmark_move(rdev, 1024*1024, RADEON_GEM_DOMAIN_VRAM,
-				      RADEON_GEM_DOMAIN_VRAM);
+				      RADEON_GEM_DOMAIN_VRAM, NULL);
 		break;
 	case 3:
 		/* GTT to VRAM, buffer size sweep, powers of 2 */
 		for (i = 1; i <= 16384; i <<= 1)
 			radeon_benchmark_move(rdev, i * RADEON_GPU_PAGE_SIZE,
 					      RADEON_GEM_DOMAIN_GTT,
-					      RADEON_GEM_DOMAIN_VRAM);
+					      RADEON_GEM_DOMAIN_VRAM, NULL);
 		break;
 	case 4:
 		/* VRAM to GTT, buffer size sweep, powers of 2 */
 		for (i = 1; i <= 16384; i <<= 1)
 			radeon_benchmark_move(rdev, i * RADEON_GPU_PAGE_SIZE,
 					      RADEON_GEM_DOMAIN_VRAM,
-					      RADEON_GEM_DOMAIN_GTT);
+					      RADEON_GEM_DOMAIN_GTT, NULL);
 		break;
 	case 5:
 		/* VRAM to VRAM, buffer size sweep, powers of 2 */
 		for (i = 1; i <= 16384; i <<= 1)
 			radeon_benchmark_move(rdev, i * RADEON_GPU_PAGE_SIZE,
 					      RADEON_GEM_DOMAIN_VRAM,
-					      RADEON_GEM_DOMAIN_VRAM);
+					      RADEON_GEM_DOMAIN_VRAM, NULL);
 		break;
 	case 6:
 		/* GTT to VRAM, buffer size sweep, common modes */
 		for (i = 0; i < RADEON_BENCHMARK_COMMON_MODES_N; i++)
 			radeon_benchmark_move(rdev, common_modes[i],
 					      RADEON_GEM_DOMAIN_GTT,
-					      RADEON_GEM_DOMAIN_VRAM);
+					      RADEON_GEM_DOMAIN_VRAM, NULL);
 		break;
 	case 7:
 		/* VRAM to GTT, buffer size sweep, common modes */
 		for (i = 0; i < RADEON_BENCHMARK_COMMON_MODES_N; i++)
 			radeon_benchmark_move(rdev, common_modes[i],
 					      RADEON_GEM_DOMAIN_VRAM,
-					      RADEON_GEM_DOMAIN_GTT);
+					      RADEON_GEM_DOMAIN_GTT, NULL);
 		break;
 	case 8:
 		/* VRAM to VRAM, buffer size sweep, common modes */
 		for (i = 0; i < RADEON_BENCHMARK_COMMON_MODES_N; i++)
 			radeon_benchmark_move(rdev, common_modes[i],
 					      RADEON_GEM_DOMAIN_VRAM,
-					      RADEON_GEM_DOMAIN_VRAM);
+					      RADEON_GEM_DOMAIN_VRAM, NULL);
+		break;
+	case 9:
+		/* all methods, buffer size sweep, all domain pairs */
+		radeon_benchmark_sweep(rdev, NULL);
 		break;
 
 	default:
 		DRM_ERROR("Unknown benchmark\n");
 	}
 }
+
+#if defined(CONFIG_DEBUG_FS)
+static int radeon_debugfs_benchmark(struct seq_file *m, void *data)
+{
+	struct drm_info_node *node = (struct drm_info_node *) m->private;
+	struct drm_device *dev = node->minor->dev;
+	struct radeon_device *rdev = dev->dev_private;
+
+	if (!rdev->accel_working)
+		return -ENODEV;
+
+	seq_puts(m, "kind src  dst       size     n           ns   MB/s\n");
+
+	/* Keep GPU resets out while copies are in flight */
+	down_read(&rdev->exclusive_lock);
+	radeon_benchmark_sweep(rdev, m);
+	up_read(&rdev->exclusive_lock);
+
+	return 0;
+}
+
+static struct drm_info_list radeon_debugfs_benchmark_list[] = {
+	{"radeon_benchmark", &radeon_debugfs_benchmark, 0, NULL},
+};
+#endif
+
+int radeon_benchmark_debugfs_init(struct radeon_device *rdev)
+{
+#if defined(CONFIG_DEBUG_FS)
+	return radeon_debugfs_add_files(rdev, radeon_debugfs_benchmark_list, 1);
+#else
+	return 0;
+#endif
+}
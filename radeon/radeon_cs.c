@@ -269,6 +269,9 @@ int radeon_cs_parser_init(struct radeon_cs_parser *p, void *data)
 	p->chunk_relocs = NULL;
 	p->chunk_flags = NULL;
 	p->chunk_const_ib = NULL;
+	p->nibs = 0;
+	p->chunks_ib = NULL;
+	p->ibs = NULL;
 	p->chunks_array = kcalloc(cs->num_chunks, sizeof(uint64_t), GFP_KERNEL);
 	if (p->chunks_array == NULL) {
 		return -ENOMEM;
@@ -284,6 +287,10 @@ int radeon_cs_parser_init(struct radeon_cs_parser *p, void *data)
 	if (p->chunks == NULL) {
 		return -ENOMEM;
 	}
+	p->chunks_ib = kcalloc(p->nchunks, sizeof(*p->chunks_ib), GFP_KERNEL);
+	if (p->chunks_ib == NULL) {
+		return -ENOMEM;
+	}
 	for (i = 0; i < p->nchunks; i++) {
 		struct drm_radeon_cs_chunk __user **chunk_ptr = NULL;
 		struct drm_radeon_cs_chunk user_chunk;
@@ -299,7 +306,7 @@ int radeon_cs_parser_init(struct radeon_cs_parser *p, void *data)
 			p->chunk_relocs = &p->chunks[i];
 		}
 		if (user_chunk.chunk_id == RADEON_CHUNK_ID_IB) {
-			p->chunk_ib = &p->chunks[i];
+			p->chunks_ib[p->nibs++] = &p->chunks[i];
 			/* zero length IB isn't useful */
 			if (p->chunks[i].length_dw == 0)
 				return -EINVAL;
@@ -345,6 +352,14 @@ int radeon_cs_parser_init(struct radeon_cs_parser *p, void *data)
 		}
 	}
 
+	if (p->nibs) {
+		p->chunk_ib = p->chunks_ib[0];
+		/* several IBs are scheduled back to back without a const IB */
+		if (p->nibs > 1 && (p->chunk_const_ib != NULL ||
+				    p->nibs > RADEON_CS_MAX_IBS))
+			return -EINVAL;
+	}
+
 	/* these are KMS only */
 	if (p->rdev) {
 		if ((p->cs_flags & RADEON_CS_USE_VM) &&
@@ -435,6 +450,41 @@ static void radeon_cs_parser_fini(struct radeon_cs_parser *parser, int error, bo
 	kfree(parser->chunks_array);
 	radeon_ib_free(parser->rdev, &parser->ib);
 	radeon_ib_free(parser->rdev, &parser->const_ib);
+	if (parser->ibs != NULL) {
+		for (i = 0; i < parser->nibs - 1; i++)
+			radeon_ib_free(parser->rdev, &parser->ibs[i]);
+		kfree(parser->ibs);
+	}
+	kfree(parser->chunks_ib);
+}
+
+/**
+ * radeon_cs_parse_ibs() - run the command stream checker over all IBs
+ * @rdev:	radeon_device pointer
+ * @p:		parser structure holding parsing context.
+ *
+ * The checkers only know about p->ib and p->chunk_ib, so every further
+ * IB is temporarily swapped in while it is being checked. Each IB is
+ * checked with a fresh tracker, as if it had been submitted on its own.
+ **/
+static int radeon_cs_parse_ibs(struct radeon_device *rdev,
+			       struct radeon_cs_parser *p)
+{
+	unsigned i;
+	int r;
+
+	r = radeon_cs_parse(rdev, p->ring, p);
+	for (i = 1; !r && !p->parser_error && i < p->nibs; i++) {
+		kfree(p->track);
+		p->track = NULL;
+		p->idx = 0;
+		p->chunk_ib = p->chunks_ib[i];
+		swap(p->ib, p->ibs[i - 1]);
+		r = radeon_cs_parse(rdev, p->ring, p);
+		swap(p->ib, p->ibs[i - 1]);
+	}
+	p->chunk_ib = p->chunks_ib[0];
+	return r;
 }
 
 static int radeon_cs_ib_chunk(struct radeon_device *rdev,
@@ -448,7 +498,7 @@ static int radeon_cs_ib_chunk(struct radeon_device *rdev,
 	if (parser->cs_flags & RADEON_CS_USE_VM)
 		return 0;
 
-	r = radeon_cs_parse(rdev, parser->ring, parser);
+	r = radeon_cs_parse_ibs(rdev, parser);
 	if (r || parser->parser_error) {
 		DRM_ERROR("Invalid command stream !\n");
 		return r;
@@ -467,7 +517,11 @@ static int radeon_cs_ib_chunk(struct radeon_device *rdev,
 		 (parser->ring == TN_RING_TYPE_VCE2_INDEX))
 		radeon_vce_note_usage(rdev);
 
-	r = radeon_ib_schedule(rdev, &parser->ib, NULL, true);
+	if (parser->nibs > 1)
+		r = radeon_ib_schedule_multi(rdev, &parser->ib, parser->ibs,
+					     parser->nibs - 1, true);
+	else
+		r = radeon_ib_schedule(rdev, &parser->ib, NULL, true);
 	if (r) {
 		DRM_ERROR("Failed to schedule IB !\n");
 	}
@@ -524,6 +578,7 @@ static int radeon_cs_ib_vm_chunk(struct radeon_device *rdev,
 {
 	struct radeon_fpriv *fpriv = parser->filp->driver_priv;
 	struct radeon_vm *vm = &fpriv->vm;
+	unsigned i;
 	int r;
 
 	if (parser->chunk_ib == NULL)
@@ -543,6 +598,13 @@ static int radeon_cs_ib_vm_chunk(struct radeon_device *rdev,
 		return r;
 	}
 
+	for (i = 0; i < parser->nibs - 1; i++) {
+		r = radeon_ring_ib_parse(rdev, parser->ring, &parser->ibs[i]);
+		if (r) {
+			return r;
+		}
+	}
+
 	if (parser->ring == R600_RING_TYPE_UVD_INDEX)
 		radeon_uvd_note_usage(rdev);
 
@@ -562,6 +624,9 @@ static int radeon_cs_ib_vm_chunk(struct radeon_device *rdev,
 	if ((rdev->family >= CHIP_TAHITI) &&
 	    (parser->chunk_const_ib != NULL)) {
 		r = radeon_ib_schedule(rdev, &parser->ib, &parser->const_ib, true);
+	} else if (parser->nibs > 1) {
+		r = radeon_ib_schedule_multi(rdev, &parser->ib, parser->ibs,
+					     parser->nibs - 1, true);
 	} else {
 		r = radeon_ib_schedule(rdev, &parser->ib, NULL, true);
 	}
@@ -581,10 +646,24 @@ static int radeon_cs_handle_lockup(struct radeon_device *rdev, int r)
 	return r;
 }
 
+static int radeon_cs_ib_copy(struct radeon_cs_chunk *ib_chunk,
+			     struct radeon_ib *ib)
+{
+	ib->length_dw = ib_chunk->length_dw;
+	if (ib_chunk->kdata)
+		memcpy(ib->ptr, ib_chunk->kdata, ib_chunk->length_dw * 4);
+	else if (copy_from_user(ib->ptr, ib_chunk->user_ptr, ib_chunk->length_dw * 4))
+		return -EFAULT;
+	return 0;
+}
+
 static int radeon_cs_ib_fill(struct radeon_device *rdev, struct radeon_cs_parser *parser)
 {
+	struct radeon_cs_chunk *const_chunk = NULL;
 	struct radeon_cs_chunk *ib_chunk;
 	struct radeon_vm *vm = NULL;
+	unsigned i, offset;
+	u64 size;
 	int r;
 
 	if (parser->chunk_ib == NULL)
@@ -596,44 +675,65 @@ static int radeon_cs_ib_fill(struct radeon_device *rdev, struct radeon_cs_parser
 
 		if ((rdev->family >= CHIP_TAHITI) &&
 		    (parser->chunk_const_ib != NULL)) {
-			ib_chunk = parser->chunk_const_ib;
-			if (ib_chunk->length_dw > RADEON_IB_VM_MAX_SIZE) {
-				DRM_ERROR("cs IB CONST too big: %d\n", ib_chunk->length_dw);
+			const_chunk = parser->chunk_const_ib;
+			if (const_chunk->length_dw > RADEON_IB_VM_MAX_SIZE) {
+				DRM_ERROR("cs IB CONST too big: %d\n", const_chunk->length_dw);
 				return -EINVAL;
 			}
-			r =  radeon_ib_get(rdev, parser->ring, &parser->const_ib,
-					   vm, ib_chunk->length_dw * 4);
-			if (r) {
-				DRM_ERROR("Failed to get const ib !\n");
-				return r;
-			}
-			parser->const_ib.is_const_ib = true;
-			parser->const_ib.length_dw = ib_chunk->length_dw;
-			if (copy_from_user(parser->const_ib.ptr,
-					       ib_chunk->user_ptr,
-					       ib_chunk->length_dw * 4))
-				return -EFAULT;
 		}
+	}
 
-		ib_chunk = parser->chunk_ib;
-		if (ib_chunk->length_dw > RADEON_IB_VM_MAX_SIZE) {
+	/* All IBs, the const IB included, come out of a single
+	 * sub-allocation: holding some of them unfenced while waiting for
+	 * room for the next could wait forever once they fill up the
+	 * ring's region.
+	 */
+	for (i = 0, size = 0; i < parser->nibs; i++) {
+		ib_chunk = parser->chunks_ib[i];
+		if (vm && ib_chunk->length_dw > RADEON_IB_VM_MAX_SIZE) {
 			DRM_ERROR("cs IB too big: %d\n", ib_chunk->length_dw);
 			return -EINVAL;
 		}
+		size += ALIGN((u64)ib_chunk->length_dw * 4, 256);
+	}
+	if (const_chunk)
+		size += const_chunk->length_dw * 4;
+	if (size > UINT_MAX) {
+		DRM_ERROR("cs IBs too big: %llu\n", (unsigned long long)size);
+		return -EINVAL;
 	}
-	ib_chunk = parser->chunk_ib;
 
-	r =  radeon_ib_get(rdev, parser->ring, &parser->ib,
-			   vm, ib_chunk->length_dw * 4);
+	r =  radeon_ib_get(rdev, parser->ring, &parser->ib, vm, size);
 	if (r) {
 		DRM_ERROR("Failed to get ib !\n");
 		return r;
 	}
-	parser->ib.length_dw = ib_chunk->length_dw;
-	if (ib_chunk->kdata)
-		memcpy(parser->ib.ptr, ib_chunk->kdata, ib_chunk->length_dw * 4);
-	else if (copy_from_user(parser->ib.ptr, ib_chunk->user_ptr, ib_chunk->length_dw * 4))
-		return -EFAULT;
+	r = radeon_cs_ib_copy(parser->chunk_ib, &parser->ib);
+	if (r)
+		return r;
+	offset = ALIGN(parser->chunk_ib->length_dw * 4, 256);
+
+	if (const_chunk) {
+		radeon_ib_get_sub(&parser->ib, &parser->const_ib, offset);
+		parser->const_ib.is_const_ib = true;
+		return radeon_cs_ib_copy(const_chunk, &parser->const_ib);
+	}
+
+	if (parser->nibs < 2)
+		return 0;
+
+	parser->ibs = kcalloc(parser->nibs - 1, sizeof(struct radeon_ib),
+			      GFP_KERNEL);
+	if (parser->ibs == NULL)
+		return -ENOMEM;
+	for (i = 1; i < parser->nibs; i++) {
+		ib_chunk = parser->chunks_ib[i];
+		radeon_ib_get_sub(&parser->ib, &parser->ibs[i - 1], offset);
+		r = radeon_cs_ib_copy(ib_chunk, &parser->ibs[i - 1]);
+		if (r)
+			return r;
+		offset += ALIGN(ib_chunk->length_dw * 4, 256);
+	}
 	return 0;
 }
 
@@ -1519,6 +1519,11 @@ int radeon_device_init(struct radeon_device *rdev,
 		DRM_ERROR("registering mst debugfs failed (%d).\n", r);
 	}
 
+	r = radeon_benchmark_debugfs_init(rdev);
+	if (r) {
+		DRM_ERROR("registering benchmark debugfs failed (%d).\n", r);
+	}
+
 	if (rdev->flags & RADEON_IS_AGP && !rdev->accel_working) {
 		/* Acceleration not working on AGP card try again
 		 * with fallback to PCI or PCIE GART
@@ -1562,6 +1567,8 @@ int radeon_device_init(struct radeon_device *rdev,
 		else
 			DRM_INFO("radeon: acceleration disabled, skipping sync tests\n");
 	}
+	if ((radeon_testing & 4))
+		radeon_test_cs_reg_ranges(rdev);
 	if (radeon_benchmarking) {
 		if (rdev->accel_working)
 			radeon_benchmark(rdev, radeon_benchmarking);
@@ -58,7 +58,8 @@ int radeon_ib_get(struct radeon_device *rdev, int ring,
 {
 	int r;
 
-	r = radeon_sa_bo_new(rdev, &rdev->ring_tmp_bo, &ib->sa_bo, size, 256);
+	r = radeon_sa_bo_new(rdev, &rdev->ring_tmp_bo, &ib->sa_bo, ring,
+			     size, 256);
 	if (r) {
 		dev_err(rdev->dev, "failed to get a new IB (%d)\n", r);
 		return r;
@@ -83,6 +84,32 @@ int radeon_ib_get(struct radeon_device *rdev, int ring,
 	return 0;
 }
 
+/**
+ * radeon_ib_get_sub - carve an IB out of another IB's allocation
+ *
+ * @parent: IB from radeon_ib_get() big enough to hold @ib at @offset
+ * @ib: IB object returned
+ * @offset: byte offset of @ib in @parent, 256 byte aligned
+ *
+ * Used to put several IBs into a single sub-allocation (all asics).
+ * @ib has no allocation of its own, it must be scheduled and fenced
+ * together with @parent, as the const IB of radeon_ib_schedule() or
+ * by radeon_ib_schedule_multi().
+ */
+void radeon_ib_get_sub(struct radeon_ib *parent, struct radeon_ib *ib,
+		       unsigned offset)
+{
+	radeon_sync_create(&ib->sync);
+
+	ib->sa_bo = NULL;
+	ib->ring = parent->ring;
+	ib->fence = NULL;
+	ib->ptr = parent->ptr + offset / 4;
+	ib->vm = parent->vm;
+	ib->gpu_addr = parent->gpu_addr + offset;
+	ib->is_const_ib = false;
+}
+
 /**
  * radeon_ib_free - free an IB (Indirect Buffer)
  *
@@ -98,31 +125,12 @@ void radeon_ib_free(struct radeon_device *rdev, struct radeon_ib *ib)
 	radeon_fence_unref(&ib->fence);
 }
 
-/**
- * radeon_ib_schedule - schedule an IB (Indirect Buffer) on the ring
- *
- * @rdev: radeon_device pointer
- * @ib: IB object to schedule
- * @const_ib: Const IB to schedule (SI only)
- * @hdp_flush: Whether or not to perform an HDP cache flush
- *
- * Schedule an IB on the associated ring (all asics).
- * Returns 0 on success, error on failure.
- *
- * On SI, there are two parallel engines fed from the primary ring,
- * the CE (Constant Engine) and the DE (Drawing Engine).  Since
- * resource descriptors have moved to memory, the CE allows you to
- * prime the caches while the DE is updating register state so that
- * the resource descriptors will be already in cache when the draw is
- * processed.  To accomplish this, the userspace driver submits two
- * IBs, one for the CE and one for the DE.  If there is a CE IB (called
- * a CONST_IB), it will be put on the ring prior to the DE IB.  Prior
- * to SI there was just a DE IB.
- */
-int radeon_ib_schedule(struct radeon_device *rdev, struct radeon_ib *ib,
-		       struct radeon_ib *const_ib, bool hdp_flush)
+static int __radeon_ib_schedule(struct radeon_device *rdev, struct radeon_ib *ib,
+				struct radeon_ib *ibs, unsigned nibs,
+				struct radeon_ib *const_ib, bool hdp_flush)
 {
 	struct radeon_ring *ring = &rdev->ring[ib->ring];
+	unsigned i;
 	int r = 0;
 
 	if (!ib->length_dw || !ring->ready) {
@@ -132,7 +140,8 @@ int radeon_ib_schedule(struct radeon_device *rdev, struct radeon_ib *ib,
 	}
 
 	/* 64 dwords should be enough for fence too */
-	r = radeon_ring_lock(rdev, ring, 64 + RADEON_NUM_SYNCS * 8);
+	r = radeon_ring_lock(rdev, ring, 64 + RADEON_NUM_SYNCS * 8 +
+			     nibs * RADEON_IB_EXECUTE_DW);
 	if (r) {
 		dev_err(rdev->dev, "scheduling IB failed (%d).\n", r);
 		return r;
@@ -162,6 +171,8 @@ int radeon_ib_schedule(struct radeon_device *rdev, struct radeon_ib *ib,
 		radeon_sync_free(rdev, &const_ib->sync, NULL);
 	}
 	radeon_ring_ib_execute(rdev, ib->ring, ib);
+	for (i = 0; i < nibs; i++)
+		radeon_ring_ib_execute(rdev, ibs[i].ring, &ibs[i]);
 	r = radeon_fence_emit(rdev, &ib->fence, ib->ring);
 	if (r) {
 		dev_err(rdev->dev, "failed to emit fence for new IB (%d)\n", r);
@@ -171,6 +182,8 @@ int radeon_ib_schedule(struct radeon_device *rdev, struct radeon_ib *ib,
 	if (const_ib) {
 		const_ib->fence = radeon_fence_ref(ib->fence);
 	}
+	for (i = 0; i < nibs; i++)
+		ibs[i].fence = radeon_fence_ref(ib->fence);
 
 	if (ib->vm)
 		radeon_vm_fence(rdev, ib->vm, ib->fence);
@@ -179,13 +192,66 @@ int radeon_ib_schedule(struct radeon_device *rdev, struct radeon_ib *ib,
 	return 0;
 }
 
+/**
+ * radeon_ib_schedule - schedule an IB (Indirect Buffer) on the ring
+ *
+ * @rdev: radeon_device pointer
+ * @ib: IB object to schedule
+ * @const_ib: Const IB to schedule (SI only)
+ * @hdp_flush: Whether or not to perform an HDP cache flush
+ *
+ * Schedule an IB on the associated ring (all asics).
+ * Returns 0 on success, error on failure.
+ *
+ * On SI, there are two parallel engines fed from the primary ring,
+ * the CE (Constant Engine) and the DE (Drawing Engine).  Since
+ * resource descriptors have moved to memory, the CE allows you to
+ * prime the caches while the DE is updating register state so that
+ * the resource descriptors will be already in cache when the draw is
+ * processed.  To accomplish this, the userspace driver submits two
+ * IBs, one for the CE and one for the DE.  If there is a CE IB (called
+ * a CONST_IB), it will be put on the ring prior to the DE IB.  Prior
+ * to SI there was just a DE IB.
+ */
+int radeon_ib_schedule(struct radeon_device *rdev, struct radeon_ib *ib,
+		       struct radeon_ib *const_ib, bool hdp_flush)
+{
+	return __radeon_ib_schedule(rdev, ib, NULL, 0, const_ib, hdp_flush);
+}
+
+/**
+ * radeon_ib_schedule_multi - schedule several IBs (Indirect Buffers)
+ *
+ * @rdev: radeon_device pointer
+ * @ib: first IB to schedule, carries the sync and VM state
+ * @ibs: IBs to schedule right after @ib
+ * @nibs: number of IBs in @ibs
+ * @hdp_flush: Whether or not to perform an HDP cache flush
+ *
+ * Schedule @ib followed by all of @ibs back to back on the ring of
+ * @ib, syncing once before the first one and protecting all of them
+ * with a single fence (all asics).  All IBs must target the same ring
+ * and VM.
+ * Returns 0 on success, error on failure.
+ */
+int radeon_ib_schedule_multi(struct radeon_device *rdev, struct radeon_ib *ib,
+			     struct radeon_ib *ibs, unsigned nibs,
+			     bool hdp_flush)
+{
+	return __radeon_ib_schedule(rdev, ib, ibs, nibs, NULL, hdp_flush);
+}
+
 /**
  * radeon_ib_pool_init - Init the IB (Indirect Buffer) pool
  *
  * @rdev: radeon_device pointer
  *
  * Initialize the suballocator to manage a pool of memory
- * for use as IBs (all asics).
+ * for use as IBs (all asics).  Every active ring gets its own
+ * region of the pool, so the rings must be set up before this.
+ * Each region is as big as the single pool used to be, so the
+ * pool takes up to RADEON_SA_MAX_SIZE of GTT, see
+ * radeon_sa_bo_manager_init().
  * Returns 0 on success, error on failure.
  */
 int radeon_ib_pool_init(struct radeon_device *rdev)
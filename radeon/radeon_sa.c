@@ -29,42 +29,117 @@
  */
 /* Algorithm:
  *
- * We store the last allocated bo in "hole", we always try to allocate
- * after the last allocated bo. Principle is that in a linear GPU ring
- * progression was is after last is the oldest bo we allocated and thus
- * the first one that should no longer be in use by the GPU.
+ * The buffer is split into one region per active ring and every region
+ * is managed as an independent ring buffer with its own lock, so rings
+ * never contend with each other nor look at each other's fences.
  *
- * If it's not the case we skip over the bo after last to the closest
+ * We store the last allocated bo of a region in "hole", we always try
+ * to allocate after the last allocated bo. Principle is that in a linear
+ * GPU ring progression was is after last is the oldest bo we allocated
+ * and thus the first one that should no longer be in use by the GPU.
+ *
+ * If it's not the case we skip over the bo after last to the oldest
  * done bo if such one exist. If none exist and we are not asked to
  * block we report failure to allocate.
  *
- * If we are asked to block we wait on all the oldest fence of all
- * rings. We just wait for any of those fence to complete.
+ * If we are asked to block we wait on the oldest fence of the region.
  */
 #include <drm/drmP.h>
 #include "radeon.h"
 
+/* the pool is mapped at RADEON_VA_IB_OFFSET in every VM */
+#define RADEON_SA_MAX_SIZE	(RADEON_VA_RESERVED_SIZE - RADEON_VA_IB_OFFSET)
+
 static void radeon_sa_bo_remove_locked(struct radeon_sa_bo *sa_bo);
-static void radeon_sa_bo_try_free(struct radeon_sa_manager *sa_manager);
+static void radeon_sa_bo_try_free(struct radeon_sa_region *region);
+
+static inline unsigned radeon_sa_region_size(struct radeon_sa_region *region)
+{
+	return region->eoffset - region->soffset;
+}
+
+/**
+ * radeon_sa_region - Get the region to allocate from for a ring
+ *
+ * @sa_manager: pointer to the sa_manager
+ * @ring: ring index the allocation will be used on
+ *
+ * Rings which were not active when the manager was created share
+ * the region of the first active ring.
+ */
+static struct radeon_sa_region *radeon_sa_region(struct radeon_sa_manager *sa_manager,
+						 int ring)
+{
+	struct radeon_sa_region *region = &sa_manager->regions[ring];
 
+	if (!radeon_sa_region_size(region))
+		region = &sa_manager->regions[sa_manager->fallback];
+	return region;
+}
+
+/**
+ * radeon_sa_bo_manager_init - Create the sub allocator
+ *
+ * @rdev: radeon_device pointer
+ * @sa_manager: pointer to the sa_manager
+ * @size: size of the region given to each active ring
+ * @align: alignment of the regions and upper bound of allocation alignment
+ * @domain: memory domain of the backing bo
+ * @flags: creation flags of the backing bo
+ *
+ * Every active ring gets a region of @size bytes rather than a share
+ * of it: a ring can only wait for its own fences, so a region has to
+ * hold several of the largest IBs (RADEON_IB_VM_MAX_SIZE dwords) by
+ * itself, and splitting the old 1MB pool between the eight rings of
+ * SI would leave less than one.  The backing bo thus grows with the
+ * number of rings, up to RADEON_SA_MAX_SIZE (7MB of GTT) where the
+ * regions are clamped so the whole pool still fits into the range
+ * reserved for it in the VM address space.
+ * Returns 0 on success, error on failure.
+ */
 int radeon_sa_bo_manager_init(struct radeon_device *rdev,
 			      struct radeon_sa_manager *sa_manager,
 			      unsigned size, u32 align, u32 domain, u32 flags)
 {
+	unsigned offset = 0, nrings = 0;
 	int i, r;
 
-	init_waitqueue_head(&sa_manager->wq);
+	for (i = 0; i < RADEON_NUM_RINGS; ++i) {
+		if (rdev->ring[i].ring_size)
+			nrings++;
+	}
+	if (!nrings)
+		nrings = 1;
+	size = min(size, (unsigned)RADEON_SA_MAX_SIZE / nrings);
+	size = round_down(size, align);
+
 	sa_manager->bo = NULL;
-	sa_manager->size = size;
-	sa_manager->domain = domain;
-	sa_manager->align = align;
-	sa_manager->hole = &sa_manager->olist;
-	INIT_LIST_HEAD(&sa_manager->olist);
+	sa_manager->fallback = -1;
 	for (i = 0; i < RADEON_NUM_RINGS; ++i) {
-		INIT_LIST_HEAD(&sa_manager->flist[i]);
+		struct radeon_sa_region *region = &sa_manager->regions[i];
+
+		init_waitqueue_head(&region->wq);
+		region->hole = &region->olist;
+		INIT_LIST_HEAD(&region->olist);
+		INIT_LIST_HEAD(&region->flist);
+		region->allocs = 0;
+		region->waits = 0;
+		region->wait_ns = 0;
+
+		region->soffset = offset;
+		if (rdev->ring[i].ring_size ||
+		    (sa_manager->fallback < 0 && i == RADEON_NUM_RINGS - 1))
+			offset += size;
+		region->eoffset = offset;
+
+		if (sa_manager->fallback < 0 && region->eoffset != region->soffset)
+			sa_manager->fallback = i;
 	}
+	sa_manager->size = offset;
+	sa_manager->domain = domain;
+	sa_manager->align = align;
 
-	r = radeon_bo_create(rdev, size, align, true,
+	r = radeon_bo_create(rdev, sa_manager->size, align, true,
 			     domain, flags, NULL, NULL, &sa_manager->bo);
 	if (r) {
 		dev_err(rdev->dev, "(%d) failed to allocate bo for manager\n", r);
@@ -78,16 +153,21 @@ void radeon_sa_bo_manager_fini(struct radeon_device *rdev,
 			       struct radeon_sa_manager *sa_manager)
 {
 	struct radeon_sa_bo *sa_bo, *tmp;
+	int i;
 
-	if (!list_empty(&sa_manager->olist)) {
-		sa_manager->hole = &sa_manager->olist,
-		radeon_sa_bo_try_free(sa_manager);
-		if (!list_empty(&sa_manager->olist)) {
-			dev_err(rdev->dev, "sa_manager is not empty, clearing anyway\n");
+	for (i = 0; i < RADEON_NUM_RINGS; ++i) {
+		struct radeon_sa_region *region = &sa_manager->regions[i];
+
+		if (!list_empty(&region->olist)) {
+			region->hole = &region->olist,
+			radeon_sa_bo_try_free(region);
+			if (!list_empty(&region->olist)) {
+				dev_err(rdev->dev, "sa_manager is not empty, clearing anyway\n");
+			}
+		}
+		list_for_each_entry_safe(sa_bo, tmp, &region->olist, olist) {
+			radeon_sa_bo_remove_locked(sa_bo);
 		}
-	}
-	list_for_each_entry_safe(sa_bo, tmp, &sa_manager->olist, olist) {
-		radeon_sa_bo_remove_locked(sa_bo);
 	}
 	radeon_bo_unref(&sa_manager->bo);
 	sa_manager->size = 0;
@@ -141,9 +221,9 @@ int radeon_sa_bo_manager_suspend(struct radeon_device *rdev,
 
 static void radeon_sa_bo_remove_locked(struct radeon_sa_bo *sa_bo)
 {
-	struct radeon_sa_manager *sa_manager = sa_bo->manager;
-	if (sa_manager->hole == &sa_bo->olist) {
-		sa_manager->hole = sa_bo->olist.prev;
+	struct radeon_sa_region *region = sa_bo->region;
+	if (region->hole == &sa_bo->olist) {
+		region->hole = sa_bo->olist.prev;
 	}
 	list_del_init(&sa_bo->olist);
 	list_del_init(&sa_bo->flist);
@@ -151,15 +231,15 @@ static void radeon_sa_bo_remove_locked(struct radeon_sa_bo *sa_bo)
 	kfree(sa_bo);
 }
 
-static void radeon_sa_bo_try_free(struct radeon_sa_manager *sa_manager)
+static void radeon_sa_bo_try_free(struct radeon_sa_region *region)
 {
 	struct radeon_sa_bo *sa_bo, *tmp;
 
-	if (sa_manager->hole->next == &sa_manager->olist)
+	if (region->hole->next == &region->olist)
 		return;
 
-	sa_bo = list_entry(sa_manager->hole->next, struct radeon_sa_bo, olist);
-	list_for_each_entry_safe_from(sa_bo, tmp, &sa_manager->olist, olist) {
+	sa_bo = list_entry(region->hole->next, struct radeon_sa_bo, olist);
+	list_for_each_entry_safe_from(sa_bo, tmp, &region->olist, olist) {
 		if (sa_bo->fence == NULL || !radeon_fence_signaled(sa_bo->fence)) {
 			return;
 		}
@@ -167,45 +247,45 @@ static void radeon_sa_bo_try_free(struct radeon_sa_manager *sa_manager)
 	}
 }
 
-static inline unsigned radeon_sa_bo_hole_soffset(struct radeon_sa_manager *sa_manager)
+static inline unsigned radeon_sa_bo_hole_soffset(struct radeon_sa_region *region)
 {
-	struct list_head *hole = sa_manager->hole;
+	struct list_head *hole = region->hole;
 
-	if (hole != &sa_manager->olist) {
+	if (hole != &region->olist) {
 		return list_entry(hole, struct radeon_sa_bo, olist)->eoffset;
 	}
-	return 0;
+	return region->soffset;
 }
 
-static inline unsigned radeon_sa_bo_hole_eoffset(struct radeon_sa_manager *sa_manager)
+static inline unsigned radeon_sa_bo_hole_eoffset(struct radeon_sa_region *region)
 {
-	struct list_head *hole = sa_manager->hole;
+	struct list_head *hole = region->hole;
 
-	if (hole->next != &sa_manager->olist) {
+	if (hole->next != &region->olist) {
 		return list_entry(hole->next, struct radeon_sa_bo, olist)->soffset;
 	}
-	return sa_manager->size;
+	return region->eoffset;
 }
 
-static bool radeon_sa_bo_try_alloc(struct radeon_sa_manager *sa_manager,
+static bool radeon_sa_bo_try_alloc(struct radeon_sa_region *region,
 				   struct radeon_sa_bo *sa_bo,
 				   unsigned size, unsigned align)
 {
 	unsigned soffset, eoffset, wasted;
 
-	soffset = radeon_sa_bo_hole_soffset(sa_manager);
-	eoffset = radeon_sa_bo_hole_eoffset(sa_manager);
+	soffset = radeon_sa_bo_hole_soffset(region);
+	eoffset = radeon_sa_bo_hole_eoffset(region);
 	wasted = (align - (soffset % align)) % align;
 
 	if ((eoffset - soffset) >= (size + wasted)) {
 		soffset += wasted;
 
-		sa_bo->manager = sa_manager;
+		sa_bo->region = region;
 		sa_bo->soffset = soffset;
 		sa_bo->eoffset = soffset + size;
-		list_add(&sa_bo->olist, sa_manager->hole);
+		list_add(&sa_bo->olist, region->hole);
 		INIT_LIST_HEAD(&sa_bo->flist);
-		sa_manager->hole = &sa_bo->olist;
+		region->hole = &sa_bo->olist;
 		return true;
 	}
 	return false;
@@ -214,27 +294,24 @@ static bool radeon_sa_bo_try_alloc(struct radeon_sa_manager *sa_manager,
 /**
  * radeon_sa_event - Check if we can stop waiting
  *
- * @sa_manager: pointer to the sa_manager
+ * @region: pointer to the region we allocate from
  * @size: number of bytes we want to allocate
  * @align: alignment we need to match
  *
  * Check if either there is a fence we can wait for or
  * enough free memory to satisfy the allocation directly
  */
-static bool radeon_sa_event(struct radeon_sa_manager *sa_manager,
+static bool radeon_sa_event(struct radeon_sa_region *region,
 			    unsigned size, unsigned align)
 {
 	unsigned soffset, eoffset, wasted;
-	int i;
 
-	for (i = 0; i < RADEON_NUM_RINGS; ++i) {
-		if (!list_empty(&sa_manager->flist[i])) {
-			return true;
-		}
+	if (!list_empty(&region->flist)) {
+		return true;
 	}
 
-	soffset = radeon_sa_bo_hole_soffset(sa_manager);
-	eoffset = radeon_sa_bo_hole_eoffset(sa_manager);
+	soffset = radeon_sa_bo_hole_soffset(region);
+	eoffset = radeon_sa_bo_hole_eoffset(region);
 	wasted = (align - (soffset % align)) % align;
 
 	if ((eoffset - soffset) >= (size + wasted)) {
@@ -244,130 +321,130 @@ static bool radeon_sa_event(struct radeon_sa_manager *sa_manager,
 	return false;
 }
 
-static bool radeon_sa_bo_next_hole(struct radeon_sa_manager *sa_manager,
-				   struct radeon_fence **fences,
+static bool radeon_sa_bo_next_hole(struct radeon_sa_region *region,
+				   struct radeon_fence **fence,
 				   unsigned *tries)
 {
-	struct radeon_sa_bo *best_bo = NULL;
-	unsigned i, soffset, best, tmp;
+	struct radeon_sa_bo *sa_bo;
 
-	/* if hole points to the end of the buffer */
-	if (sa_manager->hole->next == &sa_manager->olist) {
+	/* if hole points to the end of the region */
+	if (region->hole->next == &region->olist) {
 		/* try again with its beginning */
-		sa_manager->hole = &sa_manager->olist;
+		region->hole = &region->olist;
 		return true;
 	}
 
-	soffset = radeon_sa_bo_hole_soffset(sa_manager);
-	/* to handle wrap around we add sa_manager->size */
-	best = sa_manager->size * 2;
-	/* go over all fence list and try to find the closest sa_bo
-	 * of the current last
-	 */
-	for (i = 0; i < RADEON_NUM_RINGS; ++i) {
-		struct radeon_sa_bo *sa_bo;
-
-		if (list_empty(&sa_manager->flist[i])) {
-			continue;
-		}
-
-		sa_bo = list_first_entry(&sa_manager->flist[i],
-					 struct radeon_sa_bo, flist);
-
-		if (!radeon_fence_signaled(sa_bo->fence)) {
-			fences[i] = sa_bo->fence;
-			continue;
-		}
+	if (list_empty(&region->flist)) {
+		return false;
+	}
 
-		/* limit the number of tries each ring gets */
-		if (tries[i] > 2) {
-			continue;
-		}
+	/* frees are queued in submission order, so the head of the
+	 * fence list is the oldest allocation still pending
+	 */
+	sa_bo = list_first_entry(&region->flist, struct radeon_sa_bo, flist);
+	if (!radeon_fence_signaled(sa_bo->fence)) {
+		*fence = sa_bo->fence;
+		return false;
+	}
 
-		tmp = sa_bo->soffset;
-		if (tmp < soffset) {
-			/* wrap around, pretend it's after */
-			tmp += sa_manager->size;
-		}
-		tmp -= soffset;
-		if (tmp < best) {
-			/* this sa bo is the closest one */
-			best = tmp;
-			best_bo = sa_bo;
-		}
+	/* limit the number of tries */
+	if ((*tries)++ > 2) {
+		return false;
 	}
 
-	if (best_bo) {
-		++tries[best_bo->fence->ring];
-		sa_manager->hole = best_bo->olist.prev;
+	region->hole = sa_bo->olist.prev;
 
-		/* we knew that this one is signaled,
-		   so it's save to remote it */
-		radeon_sa_bo_remove_locked(best_bo);
-		return true;
-	}
-	return false;
+	/* we knew that this one is signaled,
+	   so it's save to remote it */
+	radeon_sa_bo_remove_locked(sa_bo);
+	return true;
 }
 
+/**
+ * radeon_sa_bo_new - Sub allocate from the region of a ring
+ *
+ * @rdev: radeon_device pointer
+ * @sa_manager: pointer to the sa_manager
+ * @sa_bo: resulting sub allocation
+ * @ring: ring index the allocation will be used on
+ * @size: number of bytes to allocate
+ * @align: alignment of the allocation
+ *
+ * Blocks until the oldest pending allocation of the ring's region is
+ * retired if there is no room left.
+ * Returns 0 on success, error on failure.
+ */
 int radeon_sa_bo_new(struct radeon_device *rdev,
 		     struct radeon_sa_manager *sa_manager,
 		     struct radeon_sa_bo **sa_bo,
-		     unsigned size, unsigned align)
+		     int ring, unsigned size, unsigned align)
 {
-	struct radeon_fence *fences[RADEON_NUM_RINGS];
-	unsigned tries[RADEON_NUM_RINGS];
-	int i, r;
+	struct radeon_sa_region *region;
+	struct radeon_fence *fence;
+	unsigned tries;
+	u64 start;
+	int r;
 
 	BUG_ON(align > sa_manager->align);
-	BUG_ON(size > sa_manager->size);
+
+	region = radeon_sa_region(sa_manager, ring);
+	if (size > radeon_sa_region_size(region)) {
+		return -ENOMEM;
+	}
 
 	*sa_bo = kmalloc(sizeof(struct radeon_sa_bo), GFP_KERNEL);
 	if ((*sa_bo) == NULL) {
 		return -ENOMEM;
 	}
 	(*sa_bo)->manager = sa_manager;
+	(*sa_bo)->region = region;
 	(*sa_bo)->fence = NULL;
 	INIT_LIST_HEAD(&(*sa_bo)->olist);
 	INIT_LIST_HEAD(&(*sa_bo)->flist);
 
-	spin_lock(&sa_manager->wq.lock);
+	spin_lock(&region->wq.lock);
+	region->allocs++;
 	do {
-		for (i = 0; i < RADEON_NUM_RINGS; ++i) {
-			fences[i] = NULL;
-			tries[i] = 0;
-		}
+		fence = NULL;
+		tries = 0;
 
 		do {
-			radeon_sa_bo_try_free(sa_manager);
+			radeon_sa_bo_try_free(region);
 
-			if (radeon_sa_bo_try_alloc(sa_manager, *sa_bo,
+			if (radeon_sa_bo_try_alloc(region, *sa_bo,
 						   size, align)) {
-				spin_unlock(&sa_manager->wq.lock);
+				spin_unlock(&region->wq.lock);
 				return 0;
 			}
 
 			/* see if we can skip over some allocations */
-		} while (radeon_sa_bo_next_hole(sa_manager, fences, tries));
+		} while (radeon_sa_bo_next_hole(region, &fence, &tries));
 
-		for (i = 0; i < RADEON_NUM_RINGS; ++i)
-			radeon_fence_ref(fences[i]);
+		radeon_fence_ref(fence);
+		spin_unlock(&region->wq.lock);
 
-		spin_unlock(&sa_manager->wq.lock);
-		r = radeon_fence_wait_any(rdev, fences, false);
-		for (i = 0; i < RADEON_NUM_RINGS; ++i)
-			radeon_fence_unref(&fences[i]);
-		spin_lock(&sa_manager->wq.lock);
+		start = ktime_get_raw_ns();
+		if (fence) {
+			r = radeon_fence_wait(fence, false);
+			radeon_fence_unref(&fence);
+		} else {
+			r = -ENOENT;
+		}
+
+		spin_lock(&region->wq.lock);
 		/* if we have nothing to wait for block */
 		if (r == -ENOENT) {
 			r = wait_event_interruptible_locked(
-				sa_manager->wq, 
-				radeon_sa_event(sa_manager, size, align)
+				region->wq,
+				radeon_sa_event(region, size, align)
 			);
 		}
+		region->waits++;
+		region->wait_ns += ktime_get_raw_ns() - start;
 
 	} while (!r);
 
-	spin_unlock(&sa_manager->wq.lock);
+	spin_unlock(&region->wq.lock);
 	kfree(*sa_bo);
 	*sa_bo = NULL;
 	return r;
@@ -376,23 +453,22 @@ int radeon_sa_bo_new(struct radeon_device *rdev,
 void radeon_sa_bo_free(struct radeon_device *rdev, struct radeon_sa_bo **sa_bo,
 		       struct radeon_fence *fence)
 {
-	struct radeon_sa_manager *sa_manager;
+	struct radeon_sa_region *region;
 
 	if (sa_bo == NULL || *sa_bo == NULL) {
 		return;
 	}
 
-	sa_manager = (*sa_bo)->manager;
-	spin_lock(&sa_manager->wq.lock);
+	region = (*sa_bo)->region;
+	spin_lock(&region->wq.lock);
 	if (fence && !radeon_fence_signaled(fence)) {
 		(*sa_bo)->fence = radeon_fence_ref(fence);
-		list_add_tail(&(*sa_bo)->flist,
-			      &sa_manager->flist[fence->ring]);
+		list_add_tail(&(*sa_bo)->flist, &region->flist);
 	} else {
 		radeon_sa_bo_remove_locked(*sa_bo);
 	}
-	wake_up_all_locked(&sa_manager->wq);
-	spin_unlock(&sa_manager->wq.lock);
+	wake_up_all_locked(&region->wq);
+	spin_unlock(&region->wq.lock);
 	*sa_bo = NULL;
 }
 
@@ -401,24 +477,37 @@ void radeon_sa_bo_dump_debug_info(struct radeon_sa_manager *sa_manager,
 				  struct seq_file *m)
 {
 	struct radeon_sa_bo *i;
+	int r;
 
-	spin_lock(&sa_manager->wq.lock);
-	list_for_each_entry(i, &sa_manager->olist, olist) {
-		uint64_t soffset = i->soffset + sa_manager->gpu_addr;
-		uint64_t eoffset = i->eoffset + sa_manager->gpu_addr;
-		if (&i->olist == sa_manager->hole) {
-			seq_printf(m, ">");
-		} else {
-			seq_printf(m, " ");
-		}
-		seq_printf(m, "[0x%010llx 0x%010llx] size %8lld",
-			   soffset, eoffset, eoffset - soffset);
-		if (i->fence) {
-			seq_printf(m, " protected by 0x%016llx on ring %d",
-				   i->fence->seq, i->fence->ring);
+	for (r = 0; r < RADEON_NUM_RINGS; ++r) {
+		struct radeon_sa_region *region = &sa_manager->regions[r];
+
+		if (!radeon_sa_region_size(region))
+			continue;
+
+		spin_lock(&region->wq.lock);
+		seq_printf(m, "ring %d: [0x%010llx 0x%010llx] allocs %llu waits %llu wait %llu us\n",
+			   r, region->soffset + sa_manager->gpu_addr,
+			   region->eoffset + sa_manager->gpu_addr,
+			   region->allocs, region->waits,
+			   div_u64(region->wait_ns, NSEC_PER_USEC));
+		list_for_each_entry(i, &region->olist, olist) {
+			uint64_t soffset = i->soffset + sa_manager->gpu_addr;
+			uint64_t eoffset = i->eoffset + sa_manager->gpu_addr;
+			if (&i->olist == region->hole) {
+				seq_printf(m, ">");
+			} else {
+				seq_printf(m, " ");
+			}
+			seq_printf(m, "[0x%010llx 0x%010llx] size %8lld",
+				   soffset, eoffset, eoffset - soffset);
+			if (i->fence) {
+				seq_printf(m, " protected by 0x%016llx on ring %d",
+					   i->fence->seq, i->fence->ring);
+			}
+			seq_printf(m, "\n");
 		}
-		seq_printf(m, "\n");
+		spin_unlock(&region->wq.lock);
 	}
-	spin_unlock(&sa_manager->wq.lock);
 }
 #endif
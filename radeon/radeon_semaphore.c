@@ -31,7 +31,7 @@
 #include "radeon.h"
 #include "radeon_trace.h"
 
-int radeon_semaphore_create(struct radeon_device *rdev,
+int radeon_semaphore_create(struct radeon_device *rdev, int ring,
 			    struct radeon_semaphore **semaphore)
 {
 	int r;
@@ -41,7 +41,7 @@ int radeon_semaphore_create(struct radeon_device *rdev,
 		return -ENOMEM;
 	}
 	r = radeon_sa_bo_new(rdev, &rdev->ring_tmp_bo,
-			     &(*semaphore)->sa_bo, 8, 8);
+			     &(*semaphore)->sa_bo, ring, 8, 8);
 	if (r) {
 		kfree(*semaphore);
 		*semaphore = NULL;
@@ -162,7 +162,7 @@ int radeon_sync_rings(struct radeon_device *rdev,
 				return r;
 			continue;
 		}
-		r = radeon_semaphore_create(rdev, &semaphore);
+		r = radeon_semaphore_create(rdev, ring, &semaphore);
 		if (r)
 			return r;
 
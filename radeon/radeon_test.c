@@ -312,7 +312,7 @@ void radeon_test_ring_sync(struct radeon_device *rdev,
 	struct radeon_semaphore *semaphore = NULL;
 	int r;
 
-	r = radeon_semaphore_create(rdev, &semaphore);
+	r = radeon_semaphore_create(rdev, ringA->idx, &semaphore);
 	if (r) {
 		DRM_ERROR("Failed to create semaphore\n");
 		goto out_cleanup;
@@ -407,7 +407,7 @@ static void radeon_test_ring_sync2(struct radeon_device *rdev,
 	bool sigA, sigB;
 	int i, r;
 
-	r = radeon_semaphore_create(rdev, &semaphore);
+	r = radeon_semaphore_create(rdev, ringA->idx, &semaphore);
 	if (r) {
 		DRM_ERROR("Failed to create semaphore\n");
 		goto out_cleanup;
@@ -572,3 +572,20 @@ void radeon_test_syncing(struct radeon_device *rdev)
 		}
 	}
 }
+
+/* Check the CS checkers' register range walk against the per register test */
+void radeon_test_cs_reg_ranges(struct radeon_device *rdev)
+{
+	int r;
+
+	if (rdev->family < CHIP_R600)
+		return;
+
+	DRM_INFO("Testing CS register range checks...\n");
+	if (rdev->family < CHIP_CEDAR)
+		r = r600_cs_test_reg_ranges();
+	else
+		r = evergreen_cs_test_reg_ranges();
+	if (r)
+		printk(KERN_WARNING "Error while testing CS register ranges.\n");
+}